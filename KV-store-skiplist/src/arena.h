@@ -0,0 +1,235 @@
+/**
+ * arena.h
+ * This is a simple bump-pointer memory allocator, modeled after leveldb's
+ * Arena. Memory is carved out of big blocks and is never returned one piece at
+ * a time: everything is released together when the Arena is destroyed.
+ *
+ * ConcurrentArena lets many threads allocate at once, in the spirit of
+ * RocksDB's: each thread is assigned one of a few shards, and carves small
+ * allocations out of the shard's current chunk under the shard's own lock.
+ * Only refilling a chunk, or a big allocation, goes to the shared Arena
+ */
+#ifndef KVSTORE_ARENA_H
+#define KVSTORE_ARENA_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "port.h"
+
+namespace kvstore {
+
+/**
+ * @brief Arena hands out memory from a list of blocks
+ *        Allocate is not thread-safe, the owner is responsible for serializing
+ *        the callers. MemoryUsage could be read from any thread
+ */
+class Arena {
+ public:
+  /** the size of a regular block allocated from the heap */
+  static const std::size_t kBlockSize = 4096;
+
+  /**
+   * @brief create an empty Arena, no block is allocated until first use
+   */
+  Arena() = default;
+
+  /**
+   * @brief release all the blocks in O(blocks)
+   */
+  ~Arena() {
+    for (auto block : blocks_) {
+      delete[] block;
+    }
+  }
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  /**
+   * @brief hand out a piece of memory
+   * @param bytes how many bytes requested, must be positive
+   * @return pointer to a newly allocated memory of the requested size
+   */
+  char *Allocate(std::size_t bytes) {
+    assert(bytes > 0);
+    if (bytes <= alloc_bytes_remaining_) {
+      char *result = alloc_ptr_;
+      alloc_ptr_ += bytes;
+      alloc_bytes_remaining_ -= bytes;
+      return result;
+    }
+    return AllocateFallback(bytes);
+  }
+
+  /**
+   * @brief hand out a piece of memory aligned for any pointer-sized object
+   * @param bytes how many bytes requested, must be positive
+   * @return pointer to a newly allocated and aligned memory
+   */
+  char *AllocateAligned(std::size_t bytes) {
+    const std::size_t align = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+    static_assert((align & (align - 1)) == 0, "alignment must be a power of 2");
+    std::size_t current_mod =
+        reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
+    std::size_t slop = (current_mod == 0 ? 0 : align - current_mod);
+    std::size_t needed = bytes + slop;
+    char *result;
+    if (needed <= alloc_bytes_remaining_) {
+      result = alloc_ptr_ + slop;
+      alloc_ptr_ += needed;
+      alloc_bytes_remaining_ -= needed;
+    } else {
+      // AllocateFallback always returns aligned memory
+      result = AllocateFallback(bytes);
+    }
+    assert((reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+    return result;
+  }
+
+  /**
+   * @brief an estimate of the total memory held by the Arena
+   * @return the number of bytes allocated from the heap, including bookkeeping
+   */
+  std::size_t MemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /**
+   * @brief the current block cannot fit the request, start a new one
+   * @param bytes how many bytes requested
+   * @return pointer to the allocated memory
+   */
+  char *AllocateFallback(std::size_t bytes) {
+    if (bytes > kBlockSize / 4) {
+      // big object gets its own block so we don't waste the current one
+      return AllocateNewBlock(bytes);
+    }
+    alloc_ptr_ = AllocateNewBlock(kBlockSize);
+    alloc_bytes_remaining_ = kBlockSize;
+
+    char *result = alloc_ptr_;
+    alloc_ptr_ += bytes;
+    alloc_bytes_remaining_ -= bytes;
+    return result;
+  }
+
+  /**
+   * @brief grab a new block from the heap and remember it for release
+   * @param block_bytes the size of the new block
+   * @return pointer to the new block
+   */
+  char *AllocateNewBlock(std::size_t block_bytes) {
+    char *result = new char[block_bytes];
+    blocks_.push_back(result);
+    memory_usage_.fetch_add(block_bytes + sizeof(char *),
+                            std::memory_order_relaxed);
+    return result;
+  }
+
+  /** the next free byte in the current block */
+  char *alloc_ptr_ = nullptr;
+
+  /** how many bytes are left in the current block */
+  std::size_t alloc_bytes_remaining_ = 0;
+
+  /** all the blocks allocated so far */
+  std::vector<char *> blocks_;
+
+  /** total memory usage of the Arena */
+  std::atomic<std::size_t> memory_usage_{0};
+};
+
+/**
+ * @brief ConcurrentArena is an Arena whose allocations are thread-safe
+ */
+class ConcurrentArena {
+ public:
+  /** the number of shards, threads are spread over them round robin */
+  static const int kNumShards = 8;
+  /** the size of the chunks a shard takes from the shared Arena */
+  static const std::size_t kShardChunkSize = Arena::kBlockSize / 4;
+
+  ConcurrentArena() = default;
+
+  ConcurrentArena(const ConcurrentArena &) = delete;
+  ConcurrentArena &operator=(const ConcurrentArena &) = delete;
+
+  /**
+   * @brief hand out a piece of memory aligned for any pointer-sized object
+   * @param bytes how many bytes requested, must be positive
+   * @return pointer to a newly allocated and aligned memory
+   */
+  char *AllocateAligned(std::size_t bytes) {
+    if (bytes > kShardChunkSize / 4) {
+      // a big object is rare, not worth wasting the rest of a chunk on it
+      std::lock_guard<SpinLock> guard(arena_lock_);
+      return arena_.AllocateAligned(bytes);
+    }
+    const std::size_t align = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+    Shard &shard = shards_[ShardIndex()];
+    std::lock_guard<SpinLock> guard(shard.lock);
+    std::size_t current_mod =
+        reinterpret_cast<uintptr_t>(shard.alloc_ptr) & (align - 1);
+    std::size_t slop = (current_mod == 0 ? 0 : align - current_mod);
+    if (bytes + slop > shard.alloc_bytes_remaining) {
+      std::lock_guard<SpinLock> arena_guard(arena_lock_);
+      shard.alloc_ptr = arena_.AllocateAligned(kShardChunkSize);
+      shard.alloc_bytes_remaining = kShardChunkSize;
+      slop = 0;
+    }
+    char *result = shard.alloc_ptr + slop;
+    shard.alloc_ptr += bytes + slop;
+    shard.alloc_bytes_remaining -= bytes + slop;
+    return result;
+  }
+
+  /**
+   * @brief an estimate of the total memory held, including the unused part
+   *        of the chunks held by the shards
+   * @return the number of bytes allocated from the heap
+   */
+  std::size_t MemoryUsage() const { return arena_.MemoryUsage(); }
+
+ private:
+  /**
+   * @brief Shard is the chunk a group of threads allocates from, padded to
+   *        its own cache line so shards don't contend
+   */
+  struct Shard {
+    /** serializes the threads sharing the shard */
+    SpinLock lock;
+    /** the next free byte in the chunk */
+    char *alloc_ptr = nullptr;
+    /** how many bytes are left in the chunk */
+    std::size_t alloc_bytes_remaining = 0;
+    /** keeps the next shard off this cache line */
+    char padding[64 - sizeof(char *) - sizeof(std::size_t) - sizeof(SpinLock)];
+  };
+
+  /**
+   * @brief the shard of the calling thread, assigned on its first call
+   * @return the shard index
+   */
+  static int ShardIndex() {
+    static std::atomic<int> next_index{0};
+    static thread_local int index =
+        next_index.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+    return index;
+  }
+
+  /** the shards */
+  Shard shards_[kNumShards];
+  /** protects arena_ */
+  SpinLock arena_lock_;
+  /** the Arena the chunks are carved from */
+  Arena arena_;
+};
+}  // namespace kvstore
+
+#endif
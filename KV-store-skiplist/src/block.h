@@ -0,0 +1,239 @@
+/**
+ * block.h
+ * This is the reader of a block built by BlockBuilder. A block is immutable
+ * once read, so any number of Iterators may walk it concurrently
+ */
+#ifndef KVSTORE_BLOCK_H
+#define KVSTORE_BLOCK_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "coding.h"
+#include "status.h"
+
+namespace kvstore {
+
+/**
+ * @brief Block gives typed access to the entries of a block
+ * @tparam K key type, must have a Coder
+ * @tparam T value type, must have a Coder
+ */
+template <typename K, typename T>
+class Block {
+ public:
+  /**
+   * @brief Iterator walks the entries of a Block in key order
+   */
+  class Iterator {
+   public:
+    /**
+     * @brief create an Iterator over a Block, initially not Valid
+     * @param block the Block, must outlive the Iterator
+     */
+    explicit Iterator(const Block *block) : block_(block) {
+      if (block_->restarts_ == nullptr) {
+        status_ = Status::Corruption("bad block contents");
+      }
+    }
+
+    /**
+     * @brief if the Iterator is positioned at an entry
+     * @return true if positioned, false otherwise
+     */
+    bool Valid() const { return valid_; }
+
+    /**
+     * @brief the key at the current position, requires Valid()
+     * @return key
+     */
+    const K &GetKey() const { return key_; }
+
+    /**
+     * @brief decode the value at the current position, requires Valid()
+     * @param value where to store the value
+     * @return true on success, false if the value is malformed
+     */
+    bool GetValue(T *value) const {
+      return Coder<T>::Decode(value_, value_ + value_size_, value) ==
+             value_ + value_size_;
+    }
+
+    /**
+     * @brief OK, unless a malformed entry stopped the Iterator
+     * @return the status
+     */
+    Status GetStatus() const { return status_; }
+
+    /**
+     * @brief position at the first entry
+     */
+    void SeekToFirst() {
+      if (!status_.ok()) {
+        return;
+      }
+      SeekToRestartPoint(0);
+      ParseNextEntry();
+    }
+
+    /**
+     * @brief position at the first entry with key >= target
+     *        a binary search over the restart points, then a linear walk
+     * @param target the key to seek
+     */
+    void Seek(const K &target) {
+      valid_ = false;
+      if (!status_.ok()) {
+        return;
+      }
+      // find the last restart point with a key < target
+      uint32_t left = 0;
+      uint32_t right = block_->num_restarts_ - 1;
+      while (left < right) {
+        uint32_t mid = (left + right + 1) / 2;
+        SeekToRestartPoint(mid);
+        if (!ParseNextEntry()) {
+          return;
+        }
+        if (key_ < target) {
+          left = mid;
+        } else {
+          right = mid - 1;
+        }
+      }
+      SeekToRestartPoint(left);
+      while (ParseNextEntry() && key_ < target) {
+      }
+    }
+
+    /**
+     * @brief advance to the next entry, requires Valid()
+     */
+    void Next() { ParseNextEntry(); }
+
+   private:
+    /**
+     * @brief make the next ParseNextEntry read the entry at a restart point
+     * @param index the restart point
+     */
+    void SeekToRestartPoint(uint32_t index) {
+      key_bytes_.clear();
+      next_ = block_->data_ + block_->GetRestartPoint(index);
+    }
+
+    /**
+     * @brief decode the entry at next_ into the current position
+     * @return true if positioned at an entry, false at the end or on a
+     *         malformed entry
+     */
+    bool ParseNextEntry() {
+      valid_ = false;
+      const char *p = next_;
+      const char *limit = block_->restarts_;
+      if (p >= limit) {
+        return false;
+      }
+      uint32_t shared, non_shared, value_size;
+      p = GetVarint32Ptr(p, limit, &shared);
+      p = p ? GetVarint32Ptr(p, limit, &non_shared) : nullptr;
+      p = p ? GetVarint32Ptr(p, limit, &value_size) : nullptr;
+      if (p == nullptr || shared > key_bytes_.size() ||
+          static_cast<std::size_t>(limit - p) <
+              static_cast<std::size_t>(non_shared) + value_size) {
+        return CorruptionError();
+      }
+      key_bytes_.resize(shared);
+      key_bytes_.append(p, non_shared);
+      const char *key_limit = key_bytes_.data() + key_bytes_.size();
+      if (Coder<K>::Decode(key_bytes_.data(), key_limit, &key_) != key_limit) {
+        return CorruptionError();
+      }
+      value_ = p + non_shared;
+      value_size_ = value_size;
+      next_ = value_ + value_size;
+      valid_ = true;
+      return true;
+    }
+
+    /**
+     * @brief stop the Iterator on a malformed entry
+     * @return false
+     */
+    bool CorruptionError() {
+      status_ = Status::Corruption("bad entry in block");
+      next_ = block_->restarts_;
+      return false;
+    }
+
+    /** the Block being iterated */
+    const Block *block_;
+    /** the start of the entry after the current one */
+    const char *next_ = nullptr;
+    /** if positioned at an entry */
+    bool valid_ = false;
+    /** the encoded key of the current entry */
+    std::string key_bytes_;
+    /** the decoded key of the current entry */
+    K key_{};
+    /** the encoded value of the current entry */
+    const char *value_ = nullptr;
+    /** the size of the encoded value */
+    std::size_t value_size_ = 0;
+    /** why the Iterator stopped early, if it did */
+    Status status_;
+  };
+
+  /**
+   * @brief take over the contents of a block
+   *        malformed contents make every Iterator report Corruption
+   * @param contents the contents, as built by BlockBuilder::Finish
+   */
+  explicit Block(std::string &&contents) : contents_(std::move(contents)) {
+    std::size_t size = contents_.size();
+    if (size < 4) {
+      return;
+    }
+    data_ = contents_.data();
+    num_restarts_ = DecodeFixed32(data_ + size - 4);
+    std::size_t max_restarts = (size - 4) / 4;
+    if (num_restarts_ == 0 || num_restarts_ > max_restarts) {
+      return;
+    }
+    restarts_ = data_ + size - 4 - num_restarts_ * 4;
+  }
+
+  Block(const Block &) = delete;
+  Block &operator=(const Block &) = delete;
+
+  /**
+   * @brief the memory held by the Block
+   * @return the size in bytes
+   */
+  std::size_t GetSize() const { return contents_.size(); }
+
+ private:
+  /**
+   * @brief the offset of a restart point
+   * @param index the restart point
+   * @return the offset of its entry
+   */
+  uint32_t GetRestartPoint(uint32_t index) const {
+    uint32_t offset = DecodeFixed32(restarts_ + index * 4);
+    // an offset out of range ends the walk right away
+    return std::min<uint32_t>(offset, restarts_ - data_);
+  }
+
+  /** the contents of the block */
+  std::string contents_;
+  /** the first entry */
+  const char *data_ = nullptr;
+  /** the restart point array, nullptr if the contents are malformed */
+  const char *restarts_ = nullptr;
+  /** how many restart points */
+  uint32_t num_restarts_ = 0;
+};
+}  // namespace kvstore
+
+#endif
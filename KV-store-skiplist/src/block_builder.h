@@ -0,0 +1,125 @@
+/**
+ * block_builder.h
+ * This is the builder of a block inside a table file, the same layout as
+ * leveldb's. Keys are stored with prefix compression: each entry only keeps
+ * the bytes of its encoded key that differ from the previous one
+ *
+ *   | shared (varint32) | non_shared (varint32) | value_size (varint32) |
+ *   | key bytes[non_shared] | value bytes[value_size] |
+ *
+ * Every restart_interval entries the compression starts over with a full
+ * key: a restart point. The block ends with the fixed32 offsets of all the
+ * restart points followed by their fixed32 count, so a reader can binary
+ * search the restart points and only walk a few entries after that
+ */
+#ifndef KVSTORE_BLOCK_BUILDER_H
+#define KVSTORE_BLOCK_BUILDER_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "coding.h"
+
+namespace kvstore {
+
+/**
+ * @brief BlockBuilder lays out encoded keys and values into a block
+ */
+class BlockBuilder {
+ public:
+  /**
+   * @brief create an empty BlockBuilder
+   * @param restart_interval how many entries between two restart points
+   */
+  explicit BlockBuilder(int restart_interval)
+      : restart_interval_(restart_interval) {
+    assert(restart_interval_ >= 1);
+    restarts_.push_back(0);
+  }
+
+  /**
+   * @brief start over with an empty block
+   */
+  void Reset() {
+    buffer_.clear();
+    restarts_.clear();
+    restarts_.push_back(0);
+    counter_ = 0;
+    finished_ = false;
+    last_key_.clear();
+  }
+
+  /**
+   * @brief append an entry, keys must come in increasing order
+   * @param key the encoded key
+   * @param value the encoded value
+   */
+  void Add(const std::string &key, const std::string &value) {
+    assert(!finished_);
+    std::size_t shared = 0;
+    if (counter_ < restart_interval_) {
+      std::size_t min_length = std::min(last_key_.size(), key.size());
+      while (shared < min_length && last_key_[shared] == key[shared]) {
+        shared++;
+      }
+    } else {
+      restarts_.push_back(static_cast<uint32_t>(buffer_.size()));
+      counter_ = 0;
+    }
+    std::size_t non_shared = key.size() - shared;
+    PutVarint32(&buffer_, static_cast<uint32_t>(shared));
+    PutVarint32(&buffer_, static_cast<uint32_t>(non_shared));
+    PutVarint32(&buffer_, static_cast<uint32_t>(value.size()));
+    buffer_.append(key, shared, non_shared);
+    buffer_.append(value);
+    last_key_ = key;
+    counter_++;
+  }
+
+  /**
+   * @brief append the restart points, no Add is allowed until Reset
+   * @return the contents of the block, valid until Reset
+   */
+  const std::string &Finish() {
+    for (auto restart : restarts_) {
+      PutFixed32(&buffer_, restart);
+    }
+    PutFixed32(&buffer_, static_cast<uint32_t>(restarts_.size()));
+    finished_ = true;
+    return buffer_;
+  }
+
+  /**
+   * @brief the size of the block if it was finished now
+   * @return the size in bytes
+   */
+  std::size_t CurrentSizeEstimate() const {
+    return buffer_.size() + restarts_.size() * 4 + 4;
+  }
+
+  /**
+   * @brief if no entry was added since the last Reset
+   * @return true if empty, false otherwise
+   */
+  bool Empty() const { return buffer_.empty(); }
+
+ private:
+  /** how many entries between two restart points */
+  const int restart_interval_;
+  /** the contents built so far */
+  std::string buffer_;
+  /** the offsets of the restart points */
+  std::vector<uint32_t> restarts_;
+  /** how many entries since the last restart point */
+  int counter_ = 0;
+  /** if Finish was called */
+  bool finished_ = false;
+  /** the encoded key of the last entry */
+  std::string last_key_;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,573 @@
+/**
+ * cache.h
+ * This is leveldb's built-in cache, mapping keys to values with a capacity
+ * in bytes and LRU eviction. A DB caches the data blocks of its tables in
+ * it, so hot blocks are served from memory instead of being read again.
+ *
+ * + HandleTable is a chained hash table of the entries, resized to keep as
+ *   many buckets as entries so a chain is about one entry long
+ * + LRUCache is a single shard. An entry referenced by a client sits in the
+ *   in_use_ list, an entry only referenced by the cache sits in the lru_ list
+ *   ordered by recency, and only those can be evicted. A client holding a
+ *   Handle keeps the value alive even if it is evicted or erased meanwhile
+ * + ShardedLRUCache spreads the entries over 16 shards by the hash of their
+ *   key, each with its own lock, so concurrent lookups rarely contend
+ */
+#ifndef KVSTORE_CACHE_H
+#define KVSTORE_CACHE_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "hash.h"
+
+namespace kvstore {
+
+/**
+ * @brief Cache maps keys to values, evicting the least recently used ones
+ *        once over capacity. All the methods are thread-safe
+ */
+class Cache {
+ public:
+  /** an opaque reference to an entry */
+  struct Handle {};
+
+  /** disposes of a value once it has left the cache and is not referenced */
+  using Deleter = void (*)(const std::string &key, void *value);
+
+  virtual ~Cache() = default;
+
+  /**
+   * @brief insert a key-value mapping, replacing the previous one if any
+   * @param key the key
+   * @param value the value
+   * @param charge how much of the capacity the value takes
+   * @param deleter disposes of the value once it is not needed anymore
+   * @return a Handle to the new entry, to be released by the caller
+   */
+  virtual Handle *Insert(const std::string &key, void *value,
+                         std::size_t charge, Deleter deleter) = 0;
+
+  /**
+   * @brief look up a key
+   * @param key the key
+   * @return a Handle to the entry, to be released by the caller, nullptr if
+   *         there is no entry
+   */
+  virtual Handle *Lookup(const std::string &key) = 0;
+
+  /**
+   * @brief release a Handle returned by Insert or Lookup
+   * @param handle the Handle, not used anymore after this call
+   */
+  virtual void Release(Handle *handle) = 0;
+
+  /**
+   * @brief the value of an entry
+   * @param handle a Handle not released yet
+   * @return the value
+   */
+  virtual void *Value(Handle *handle) = 0;
+
+  /**
+   * @brief remove the entry of a key, if any. Its value lives on until all
+   *        its Handles are released
+   * @param key the key
+   */
+  virtual void Erase(const std::string &key) = 0;
+
+  /**
+   * @brief a new id, distinct from the previous ones. Clients sharing the
+   *        cache prefix their keys with one to partition the key space
+   * @return the id
+   */
+  virtual uint64_t NewId() = 0;
+
+  /**
+   * @brief remove all the entries not referenced by a client
+   */
+  virtual void Prune() = 0;
+
+  /**
+   * @brief the total charge of the entries in the cache
+   * @return the charge
+   */
+  virtual std::size_t TotalCharge() const = 0;
+
+  /**
+   * @brief how many Lookups found an entry
+   * @return the number of hits
+   */
+  virtual uint64_t GetHits() const = 0;
+
+  /**
+   * @brief how many Lookups found no entry
+   * @return the number of misses
+   */
+  virtual uint64_t GetMisses() const = 0;
+};
+
+namespace cache {
+
+/**
+ * @brief LRUHandle is an entry of the cache, linked both into a hash chain
+ *        and into one of the two lists of its shard
+ */
+struct LRUHandle : public Cache::Handle {
+  /** the value */
+  void *value;
+  /** disposes of the value */
+  Cache::Deleter deleter;
+  /** the next entry of the hash chain */
+  LRUHandle *next_hash;
+  /** the next entry of the list */
+  LRUHandle *next;
+  /** the previous entry of the list */
+  LRUHandle *prev;
+  /** how much of the capacity the entry takes */
+  std::size_t charge;
+  /** if the entry is in the cache, false once evicted or erased */
+  bool in_cache;
+  /** the references, including the one of the cache */
+  uint32_t refs;
+  /** the hash of the key */
+  uint32_t hash;
+  /** the key */
+  std::string key;
+};
+
+/**
+ * @brief HandleTable is a chained hash table of LRUHandles, leveldb's own
+ *        since it is faster than the standard containers for this use
+ */
+class HandleTable {
+ public:
+  HandleTable() { Resize(); }
+  ~HandleTable() { delete[] list_; }
+
+  HandleTable(const HandleTable &) = delete;
+  HandleTable &operator=(const HandleTable &) = delete;
+
+  /**
+   * @brief find the entry of a key
+   * @param key the key
+   * @param hash the hash of the key
+   * @return the entry, nullptr if none
+   */
+  LRUHandle *Lookup(const std::string &key, uint32_t hash) {
+    return *FindPointer(key, hash);
+  }
+
+  /**
+   * @brief add an entry, replacing the one with the same key
+   * @param h the entry
+   * @return the replaced entry, nullptr if none
+   */
+  LRUHandle *Insert(LRUHandle *h) {
+    LRUHandle **ptr = FindPointer(h->key, h->hash);
+    LRUHandle *old = *ptr;
+    h->next_hash = (old == nullptr ? nullptr : old->next_hash);
+    *ptr = h;
+    if (old == nullptr) {
+      ++elems_;
+      if (elems_ > length_) {
+        // each entry is large, aim for an average chain length <= 1
+        Resize();
+      }
+    }
+    return old;
+  }
+
+  /**
+   * @brief remove the entry of a key
+   * @param key the key
+   * @param hash the hash of the key
+   * @return the removed entry, nullptr if none
+   */
+  LRUHandle *Remove(const std::string &key, uint32_t hash) {
+    LRUHandle **ptr = FindPointer(key, hash);
+    LRUHandle *result = *ptr;
+    if (result != nullptr) {
+      // whoever pointed to the removed entry now points to its successor
+      *ptr = result->next_hash;
+      --elems_;
+    }
+    return result;
+  }
+
+ private:
+  /**
+   * @brief the slot pointing to the entry of a key, or to the end of the
+   *        chain if there is none
+   * @param key the key
+   * @param hash the hash of the key
+   * @return the slot
+   */
+  LRUHandle **FindPointer(const std::string &key, uint32_t hash) {
+    LRUHandle **ptr = &list_[hash & (length_ - 1)];
+    while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key)) {
+      ptr = &(*ptr)->next_hash;
+    }
+    return ptr;
+  }
+
+  /**
+   * @brief grow the buckets to a power of two at least as large as the
+   *        number of entries, rehashing them
+   */
+  void Resize() {
+    uint32_t new_length = 4;
+    while (new_length < elems_) {
+      new_length *= 2;
+    }
+    LRUHandle **new_list = new LRUHandle *[new_length]();
+    for (uint32_t i = 0; i < length_; i++) {
+      LRUHandle *h = list_[i];
+      while (h != nullptr) {
+        LRUHandle *next = h->next_hash;
+        LRUHandle **ptr = &new_list[h->hash & (new_length - 1)];
+        h->next_hash = *ptr;
+        *ptr = h;
+        h = next;
+      }
+    }
+    delete[] list_;
+    list_ = new_list;
+    length_ = new_length;
+  }
+
+  /** the number of buckets, a power of two */
+  uint32_t length_ = 0;
+  /** the number of entries */
+  uint32_t elems_ = 0;
+  /** the buckets */
+  LRUHandle **list_ = nullptr;
+};
+
+/**
+ * @brief LRUCache is a single shard of the cache
+ */
+class LRUCache {
+ public:
+  LRUCache() {
+    // empty circular lists
+    lru_.next = &lru_;
+    lru_.prev = &lru_;
+    in_use_.next = &in_use_;
+    in_use_.prev = &in_use_;
+  }
+
+  ~LRUCache() {
+    assert(in_use_.next == &in_use_);  // a Handle outlives the cache
+    for (LRUHandle *e = lru_.next; e != &lru_;) {
+      LRUHandle *next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // the only reference left is the cache's
+      Unref(e);
+      e = next;
+    }
+  }
+
+  LRUCache(const LRUCache &) = delete;
+  LRUCache &operator=(const LRUCache &) = delete;
+
+  /**
+   * @brief set the capacity, separate from the constructor so shards can
+   *        live in an array
+   * @param capacity the capacity of the shard
+   */
+  void SetCapacity(std::size_t capacity) { capacity_ = capacity; }
+
+  /** see Cache::Insert */
+  Cache::Handle *Insert(const std::string &key, uint32_t hash, void *value,
+                        std::size_t charge, Cache::Deleter deleter) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    LRUHandle *e = new LRUHandle();
+    e->value = value;
+    e->deleter = deleter;
+    e->charge = charge;
+    e->hash = hash;
+    e->in_cache = false;
+    e->refs = 1;  // for the returned Handle
+    e->key = key;
+
+    if (capacity_ > 0) {
+      e->refs++;  // for the cache's reference
+      e->in_cache = true;
+      LRU_Append(&in_use_, e);
+      usage_ += charge;
+      FinishErase(table_.Insert(e));
+    } else {
+      // capacity 0 turns caching off
+      e->next = nullptr;
+    }
+    while (usage_ > capacity_ && lru_.next != &lru_) {
+      LRUHandle *old = lru_.next;
+      assert(old->refs == 1);
+      FinishErase(table_.Remove(old->key, old->hash));
+    }
+    return e;
+  }
+
+  /** see Cache::Lookup */
+  Cache::Handle *Lookup(const std::string &key, uint32_t hash) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    LRUHandle *e = table_.Lookup(key, hash);
+    if (e != nullptr) {
+      hits_++;
+      Ref(e);
+    } else {
+      misses_++;
+    }
+    return e;
+  }
+
+  /** see Cache::Release */
+  void Release(Cache::Handle *handle) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Unref(static_cast<LRUHandle *>(handle));
+  }
+
+  /** see Cache::Erase */
+  void Erase(const std::string &key, uint32_t hash) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    FinishErase(table_.Remove(key, hash));
+  }
+
+  /** see Cache::Prune */
+  void Prune() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    while (lru_.next != &lru_) {
+      LRUHandle *e = lru_.next;
+      assert(e->refs == 1);
+      FinishErase(table_.Remove(e->key, e->hash));
+    }
+  }
+
+  /** see Cache::TotalCharge */
+  std::size_t TotalCharge() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return usage_;
+  }
+
+  /** see Cache::GetHits */
+  uint64_t GetHits() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return hits_;
+  }
+
+  /** see Cache::GetMisses */
+  uint64_t GetMisses() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return misses_;
+  }
+
+ private:
+  /**
+   * @brief take a reference, moving an entry of lru_ to in_use_
+   * @param e the entry
+   */
+  void Ref(LRUHandle *e) {
+    if (e->refs == 1 && e->in_cache) {
+      LRU_Remove(e);
+      LRU_Append(&in_use_, e);
+    }
+    e->refs++;
+  }
+
+  /**
+   * @brief drop a reference, deleting the entry at the last one, or moving
+   *        it back to lru_ when only the cache's reference is left
+   * @param e the entry
+   */
+  void Unref(LRUHandle *e) {
+    assert(e->refs > 0);
+    e->refs--;
+    if (e->refs == 0) {
+      assert(!e->in_cache);
+      e->deleter(e->key, e->value);
+      delete e;
+    } else if (e->in_cache && e->refs == 1) {
+      // the most recently used end of the list
+      LRU_Remove(e);
+      LRU_Append(&lru_, e);
+    }
+  }
+
+  /**
+   * @brief unlink an entry from its list
+   * @param e the entry
+   */
+  void LRU_Remove(LRUHandle *e) {
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+  }
+
+  /**
+   * @brief link an entry at the newest end of a list
+   * @param list the list
+   * @param e the entry
+   */
+  void LRU_Append(LRUHandle *list, LRUHandle *e) {
+    e->next = list;
+    e->prev = list->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+  }
+
+  /**
+   * @brief finish removing an entry already removed from the hash table
+   * @param e the entry, may be nullptr
+   */
+  void FinishErase(LRUHandle *e) {
+    if (e != nullptr) {
+      assert(e->in_cache);
+      LRU_Remove(e);
+      e->in_cache = false;
+      usage_ -= e->charge;
+      Unref(e);
+    }
+  }
+
+  /** the capacity of the shard */
+  std::size_t capacity_ = 0;
+
+  /** protects the members below */
+  mutable std::mutex mutex_;
+  /** the total charge of the entries */
+  std::size_t usage_ = 0;
+  /** the entries only the cache references, the oldest first */
+  LRUHandle lru_;
+  /** the entries referenced by clients, in no particular order */
+  LRUHandle in_use_;
+  /** all the entries */
+  HandleTable table_;
+  /** how many lookups found an entry */
+  uint64_t hits_ = 0;
+  /** how many lookups found no entry */
+  uint64_t misses_ = 0;
+};
+
+/** the shards are picked by the top bits of the hash */
+static const int kNumShardBits = 4;
+/** the number of shards */
+static const int kNumShards = 1 << kNumShardBits;
+
+/**
+ * @brief ShardedLRUCache spreads the entries over independent shards
+ */
+class ShardedLRUCache : public Cache {
+ public:
+  /**
+   * @brief create an empty cache
+   * @param capacity the capacity, split evenly among the shards
+   */
+  explicit ShardedLRUCache(std::size_t capacity) {
+    const std::size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (int s = 0; s < kNumShards; s++) {
+      shards_[s].SetCapacity(per_shard);
+    }
+  }
+
+  Handle *Insert(const std::string &key, void *value, std::size_t charge,
+                 Deleter deleter) override {
+    const uint32_t hash = HashKey(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+  }
+
+  Handle *Lookup(const std::string &key) override {
+    const uint32_t hash = HashKey(key);
+    return shards_[Shard(hash)].Lookup(key, hash);
+  }
+
+  void Release(Handle *handle) override {
+    LRUHandle *h = static_cast<LRUHandle *>(handle);
+    shards_[Shard(h->hash)].Release(handle);
+  }
+
+  void *Value(Handle *handle) override {
+    return static_cast<LRUHandle *>(handle)->value;
+  }
+
+  void Erase(const std::string &key) override {
+    const uint32_t hash = HashKey(key);
+    shards_[Shard(hash)].Erase(key, hash);
+  }
+
+  uint64_t NewId() override {
+    std::lock_guard<std::mutex> guard(id_mutex_);
+    return ++last_id_;
+  }
+
+  void Prune() override {
+    for (int s = 0; s < kNumShards; s++) {
+      shards_[s].Prune();
+    }
+  }
+
+  std::size_t TotalCharge() const override {
+    std::size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+
+  uint64_t GetHits() const override {
+    uint64_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shards_[s].GetHits();
+    }
+    return total;
+  }
+
+  uint64_t GetMisses() const override {
+    uint64_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shards_[s].GetMisses();
+    }
+    return total;
+  }
+
+ private:
+  /**
+   * @brief hash a key
+   * @param key the key
+   * @return the hash value
+   */
+  static uint32_t HashKey(const std::string &key) {
+    return Hash(key.data(), key.size(), 0);
+  }
+
+  /**
+   * @brief the shard of a hash
+   * @param hash the hash value
+   * @return the shard index
+   */
+  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+  /** the shards */
+  LRUCache shards_[kNumShards];
+  /** protects last_id_ */
+  std::mutex id_mutex_;
+  /** the last id handed out */
+  uint64_t last_id_ = 0;
+};
+}  // namespace cache
+
+/**
+ * @brief create a sharded LRU cache, the usual way to set
+ *        Options::block_cache
+ * @param capacity the capacity in bytes
+ * @return the cache
+ */
+inline std::shared_ptr<Cache> NewLRUCache(std::size_t capacity) {
+  return std::make_shared<cache::ShardedLRUCache>(capacity);
+}
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,529 @@
+/**
+ * cache_skiplist.h
+ * This is a SkipList used as a cache: keys may carry a time to live, and the
+ * bytes held can be bounded. Each key maps to a shared, immutable Item with
+ * the value, its deadline, its charge in bytes and a reference bit.
+ *
+ * Expiry is lazy: a Get of an expired key removes it and misses. A
+ * background reaper thread also walks a bounded batch of keys every
+ * reap_interval and removes the expired ones it meets, resuming where it
+ * stopped, so keys nobody reads again are dropped too. It sleeps while no
+ * key has a deadline.
+ *
+ * Eviction is CLOCK, an approximation of LRU. A Get sets the reference bit
+ * of its Item. When the charges go over max_bytes, the writer that pushed
+ * them over advances the clock hand, a cursor walking the keys in key order
+ * and wrapping around: a referenced Item loses its bit and is kept, the
+ * others are evicted, until the charges fit again or max_sweep keys were
+ * visited. New keys start unreferenced: were they referenced, the first
+ * pass over a full cache would clear every bit and wrap around to evict in
+ * key order, whatever was read.
+ *
+ * No step holds a lock over the whole list. Every removal is a plain
+ * SkipRemoveIf, locking a handful of nodes, and removes the Item only if it
+ * is still the one read, so a concurrent SkipInsert of a fresh value is
+ * never lost. The hand is guarded by a mutex that writers only try: while
+ * one writer evicts, the others go on, and the charges may overshoot the
+ * budget by what they insert meanwhile. A step visits at most max_sweep
+ * keys, so the latency an eviction adds to a write is bounded.
+ */
+#ifndef KVSTORE_CACHE_SKIPLIST_H
+#define KVSTORE_CACHE_SKIPLIST_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "skiplist.h"
+
+namespace kvstore {
+
+/**
+ * @brief CacheSkipListOptions controls the expiry and eviction of a
+ *        CacheSkipList
+ */
+struct CacheSkipListOptions {
+  /** evict once the charges of the keys exceed this, 0 for no bound */
+  std::size_t max_bytes = 0;
+  /** how often the reaper removes expired keys, 0 for no reaper thread */
+  std::chrono::milliseconds reap_interval{1000};
+  /** the most keys one reaper or eviction step visits */
+  std::size_t max_sweep = 256;
+  /**
+   * reads the current time of the deadlines, nullptr for
+   * std::chrono::steady_clock::now. Tests set it to advance time by hand
+   */
+  std::function<std::chrono::steady_clock::time_point()> clock;
+};
+
+/**
+ * @brief CacheCharge is the default charge of a key-value pair: the bytes
+ *        they hold on the heap, counted as the size of byte strings, on top
+ *        of the fixed per-key overhead the CacheSkipList adds itself
+ */
+struct CacheCharge {
+  /**
+   * @brief the charge of a key-value pair
+   * @param key the key
+   * @param value the value
+   * @return the number of bytes
+   */
+  template <typename K, typename V>
+  std::size_t operator()(const K &key, const V &value) const {
+    return HeapSize(key) + HeapSize(value);
+  }
+
+ private:
+  template <typename T>
+  static std::size_t HeapSize(const T &object) {
+    if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+      return std::string_view(object).size();
+    } else {
+      return 0;
+    }
+  }
+};
+
+/**
+ * @brief CacheSkipList is a SkipList with per-key TTL and a byte budget
+ * @tparam K key type
+ * @tparam V value type
+ * @tparam Comparator the less-than ordering of the keys, as in SkipList
+ * @tparam Charge computes the bytes a key-value pair holds on the heap,
+ *         invoked as charge(key, value)
+ */
+template <typename K, typename V, typename Comparator = std::less<>,
+          typename Charge = CacheCharge>
+class CacheSkipList {
+ public:
+  /** the clock of the deadlines */
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief create an empty CacheSkipList, and start its reaper
+   * @param options the expiry and eviction options
+   * @param compare the ordering of the keys
+   * @param charge the charge of a key-value pair
+   */
+  explicit CacheSkipList(const CacheSkipListOptions &options =
+                             CacheSkipListOptions(),
+                         const Comparator &compare = Comparator(),
+                         const Charge &charge = Charge())
+      : options_(options), charge_(charge), list_(10, compare) {
+    if (options_.reap_interval.count() > 0) {
+      reaper_ = std::thread([this]() { RunReaper(); });
+    }
+  }
+
+  CacheSkipList(const CacheSkipList &) = delete;
+  CacheSkipList &operator=(const CacheSkipList &) = delete;
+
+  /**
+   * @brief stop the reaper
+   */
+  ~CacheSkipList() {
+    if (reaper_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(reaper_mutex_);
+        stop_ = true;
+      }
+      reaper_cv_.notify_one();
+      reaper_.join();
+    }
+  }
+
+  /**
+   * @brief insert a key-value pair, copying them, then evict if over budget
+   * @param key the key
+   * @param value the value
+   * @param ttl how long the key lives, zero or less for ever
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(const K &key, const V &value,
+                  Clock::duration ttl = Clock::duration::zero()) {
+    return InsertImpl(K(key), V(value), ttl);
+  }
+
+  /**
+   * @brief insert a key-value pair, moving them, then evict if over budget
+   * @param key the key
+   * @param value the value
+   * @param ttl how long the key lives, zero or less for ever
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(K &&key, V &&value,
+                  Clock::duration ttl = Clock::duration::zero()) {
+    return InsertImpl(std::move(key), std::move(value), ttl);
+  }
+
+  /**
+   * @brief remove a key
+   * @param key the key
+   * @return true if removal is successful, false otherwise, an expired key
+   *         not reaped yet is removed but counts as absent
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool SkipRemove(const Q &key) {
+    Entry removed;
+    if (!list_.SkipRemoveIf(key, [&removed](const Entry &item) {
+          removed = item;
+          return true;
+        })) {
+      return false;
+    }
+    Release(*removed);
+    return !IsExpired(*removed);
+  }
+
+  /**
+   * @brief look up a key, marking it referenced, or removing it if expired
+   * @param key the key
+   * @param value where to store the value, untouched if not found
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool Get(const Q &key, V *value) {
+    Entry item;
+    if (!list_.Get(key, &item)) {
+      return false;
+    }
+    if (IsExpired(*item)) {
+      RemoveItem(key, item, &num_expired_);
+      return false;
+    }
+    // only write the bit when it changes, a hot key's line stays shared
+    if (!item->referenced.load(std::memory_order_relaxed)) {
+      item->referenced.store(true, std::memory_order_relaxed);
+    }
+    *value = item->value;
+    return true;
+  }
+
+  /**
+   * @brief how long a key has left to live
+   * @param key the key
+   * @param ttl set to the time left, Clock::duration::max() if it never
+   *        expires
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool GetTtl(const Q &key, Clock::duration *ttl) const {
+    Entry item;
+    if (!list_.Get(key, &item) || IsExpired(*item)) {
+      return false;
+    }
+    *ttl = item->deadline == kNever ? Clock::duration::max()
+                                    : item->deadline - Now();
+    return true;
+  }
+
+  /**
+   * @brief visit every live key-value pair with lo <= key < hi in key order,
+   *        copying the values under the nodes' locks like
+   *        SkipList::LockedScan, and skipping the expired keys. It does not
+   *        count as a reference
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
+   */
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t LockedScan(const Lo &lo, const Hi &hi,
+                         Callback &&callback) const {
+    std::size_t count = 0;
+    Clock::time_point now = Now();
+    list_.LockedScan(lo, hi, [&](const K &key, const Entry &item) {
+      if (item->deadline <= now) {
+        return true;
+      }
+      count++;
+      return static_cast<bool>(callback(key, item->value));
+    });
+    return count;
+  }
+
+  /**
+   * @brief remove the expired keys among the next batch, one step of the
+   *        reaper, for callers running without the reaper thread
+   * @param max_visits the most keys to visit
+   * @return how many expired keys were removed
+   */
+  std::size_t ReapExpired(std::size_t max_visits) {
+    if (num_expiring_.load(std::memory_order_relaxed) == 0) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(reap_mutex_);
+    std::size_t removed = 0;
+    Clock::time_point now = Now();
+    Sweep(&reap_hand_, max_visits, [&](const K &key, const Entry &item) {
+      if (item->deadline <= now && RemoveItem(key, item, &num_expired_)) {
+        removed++;
+      }
+      return true;
+    });
+    return removed;
+  }
+
+  /**
+   * @brief how many keys, the expired ones not removed yet included
+   * @return the number of keys
+   */
+  std::size_t GetSize() const { return list_.GetSize(); }
+
+  /**
+   * @brief the charges of all the keys, what max_bytes bounds
+   * @return the number of bytes
+   */
+  std::size_t GetUsage() const {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief how many keys were evicted to fit the budget
+   * @return the number of keys
+   */
+  std::size_t GetNumEvicted() const {
+    return num_evicted_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief how many expired keys were removed, lazily or by the reaper
+   * @return the number of keys
+   */
+  std::size_t GetNumExpired() const {
+    return num_expired_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /** the deadline of a key that never expires */
+  static constexpr Clock::time_point kNever = Clock::time_point::max();
+
+  /**
+   * @brief Item is what a key maps to, never modified once published but
+   *        for its reference bit
+   */
+  struct Item {
+    Item(V v, Clock::time_point d, std::size_t c)
+        : value(std::move(v)), deadline(d), charge(c) {}
+
+    /** the value */
+    V value;
+    /** when the key expires, kNever if it does not */
+    Clock::time_point deadline;
+    /** the bytes charged for the key */
+    std::size_t charge;
+    /** set by Get, cleared by the clock hand */
+    mutable std::atomic<bool> referenced{false};
+  };
+
+  /**
+   * @brief the current time
+   * @return options_.clock(), or Clock::now() if none was given
+   */
+  Clock::time_point Now() const {
+    return options_.clock ? options_.clock() : Clock::now();
+  }
+
+  /**
+   * @brief if the deadline of an Item has passed, without reading the clock
+   *        for a key that never expires
+   * @param item the Item
+   * @return true if expired, false otherwise
+   */
+  bool IsExpired(const Item &item) const {
+    return item.deadline != kNever && item.deadline <= Now();
+  }
+
+  /** a reference to an Item, what the SkipList stores */
+  using Entry = std::shared_ptr<const Item>;
+  using List = SkipList<K, Entry, Comparator>;
+
+  /** the bytes of a key charged on top of Charge: the node of the SkipList,
+   *  the Item and the control block of its shared_ptr */
+  static constexpr std::size_t kEntryOverhead =
+      sizeof(SkipNode<K, Entry>) + sizeof(Item) + 2 * sizeof(long);
+
+  /**
+   * @brief insert a key-value pair, then evict if over budget
+   * @param key the key
+   * @param value the value
+   * @param ttl how long the key lives, zero or less for ever
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool InsertImpl(K &&key, V &&value, Clock::duration ttl) {
+    Clock::time_point deadline =
+        ttl > Clock::duration::zero() ? Now() + ttl : kNever;
+    std::size_t charge = kEntryOverhead + charge_(key, value);
+    Entry item = std::make_shared<const Item>(std::move(value), deadline,
+                                              charge);
+    usage_.fetch_add(charge, std::memory_order_relaxed);
+    if (deadline != kNever) {
+      num_expiring_.fetch_add(1, std::memory_order_relaxed);
+    }
+    Entry replaced;
+    bool inserted = list_.SkipInsert(std::move(key), std::move(item), &replaced);
+    if (!inserted) {
+      Release(*replaced);
+    }
+    EvictIfNeeded();
+    return inserted;
+  }
+
+  /**
+   * @brief remove a key if it still maps to an Item
+   * @param key the key
+   * @param item the Item read before
+   * @param counter what to count the removal in
+   * @return true if removed, false if the key was removed or replaced since
+   */
+  template <typename Q>
+  bool RemoveItem(const Q &key, const Entry &item,
+                  std::atomic<std::size_t> *counter) {
+    if (!list_.SkipRemoveIf(
+            key, [&item](const Entry &current) { return current == item; })) {
+      return false;
+    }
+    Release(*item);
+    counter->fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief stop accounting for an Item no longer in the list
+   * @param item the Item
+   */
+  void Release(const Item &item) {
+    usage_.fetch_sub(item.charge, std::memory_order_relaxed);
+    if (item.deadline != kNever) {
+      num_expiring_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief advance the clock hand while over budget, unless another thread
+   *        already is
+   */
+  void EvictIfNeeded() {
+    if (options_.max_bytes == 0 || GetUsage() <= options_.max_bytes) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(clock_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return;
+    }
+    Clock::time_point now = Now();
+    Sweep(&clock_hand_, options_.max_sweep,
+          [&](const K &key, const Entry &item) {
+            if (item->deadline <= now) {
+              RemoveItem(key, item, &num_expired_);
+            } else if (item->referenced.load(std::memory_order_relaxed)) {
+              item->referenced.store(false, std::memory_order_relaxed);
+            } else {
+              RemoveItem(key, item, &num_evicted_);
+            }
+            return GetUsage() > options_.max_bytes;
+          });
+  }
+
+  /**
+   * @brief walk the keys from a cursor, wrapping around at the end, and
+   *        leave the cursor where the walk stopped. Removing the key being
+   *        visited is safe, the Iterator keeps its node from reclamation
+   * @param hand the cursor, the key to resume from, none for the first
+   * @param max_visits the most keys to visit
+   * @param visit invoked as visit(key, item), returns false to stop
+   */
+  template <typename Visit>
+  void Sweep(std::optional<K> *hand, std::size_t max_visits, Visit &&visit) {
+    typename List::Iterator iter(&list_);
+    if (hand->has_value()) {
+      iter.Seek(**hand);
+    } else {
+      iter.SeekToFirst();
+    }
+    for (std::size_t i = 0; i < max_visits; i++) {
+      if (!iter.Valid()) {
+        iter.SeekToFirst();
+        if (!iter.Valid()) {
+          break;
+        }
+      }
+      bool more = visit(iter.GetKey(), iter.GetValueLocked());
+      iter.Next();
+      if (!more) {
+        break;
+      }
+    }
+    if (iter.Valid()) {
+      *hand = iter.GetKey();
+    } else {
+      hand->reset();
+    }
+  }
+
+  /**
+   * @brief the reaper thread: a step every reap_interval until stopped,
+   *        also catching up on the budget if writers left it exceeded
+   */
+  void RunReaper() {
+    std::unique_lock<std::mutex> lock(reaper_mutex_);
+    while (!reaper_cv_.wait_for(lock, options_.reap_interval,
+                                [this]() { return stop_; })) {
+      lock.unlock();
+      ReapExpired(options_.max_sweep);
+      EvictIfNeeded();
+      lock.lock();
+    }
+  }
+
+  /** the expiry and eviction options */
+  const CacheSkipListOptions options_;
+  /** the charge of a key-value pair */
+  Charge charge_;
+  /** the keys and their Items */
+  List list_;
+
+  /** the charges of all the keys */
+  std::atomic<std::size_t> usage_{0};
+  /** how many keys have a deadline, the reaper sleeps while there are none */
+  std::atomic<std::size_t> num_expiring_{0};
+  /** how many keys were evicted */
+  std::atomic<std::size_t> num_evicted_{0};
+  /** how many expired keys were removed */
+  std::atomic<std::size_t> num_expired_{0};
+
+  /** guards the clock hand, only ever tried by writers */
+  std::mutex clock_mutex_;
+  /** the key the clock hand resumes from */
+  std::optional<K> clock_hand_;
+  /** guards the reaper's cursor */
+  std::mutex reap_mutex_;
+  /** the key the reaper resumes from */
+  std::optional<K> reap_hand_;
+
+  /** guards stop_ */
+  std::mutex reaper_mutex_;
+  /** wakes the reaper up to stop */
+  std::condition_variable reaper_cv_;
+  /** if the reaper should stop */
+  bool stop_ = false;
+  /** the reaper thread, not joinable without reap_interval */
+  std::thread reaper_;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,306 @@
+/**
+ * codec.h
+ * This is the compression of the values of a CompressedSkipList, a pluggable
+ * Codec like the FilterPolicy of the tables. Every codec has a type byte,
+ * stored with each value it compressed, 0 being reserved for values stored
+ * as they are.
+ *
+ * LzCodec is an LZ77 codec in the spirit of LZ4, trading ratio for speed:
+ * one hash table probe per position, no entropy coding. Its output is the
+ * varint32 length of the input, then a run of sequences, each one a token
+ * byte, literals and a match:
+ *
+ *   | token | extra literal length | literals | offset (fixed16) |
+ *   | extra match length |
+ *
+ * The high nibble of the token is the number of literals, the low nibble the
+ * match length minus 4, kMinMatch. A nibble of 15 is followed by extra bytes
+ * added to it, 255 meaning that another one follows. The match copies its
+ * bytes from offset bytes back in the output, possibly overlapping what it
+ * writes, so a run of one byte is a single match. The last sequence has
+ * literals only
+ */
+#ifndef KVSTORE_CODEC_H
+#define KVSTORE_CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "coding.h"
+
+namespace kvstore {
+
+/**
+ * @brief the type bytes of the built-in codecs
+ */
+enum CodecType : uint8_t { kNoCodec = 0, kLzCodec = 1 };
+
+/**
+ * @brief Codec compresses and uncompresses values
+ *        implementations must be thread-safe
+ */
+class Codec {
+ public:
+  virtual ~Codec() = default;
+
+  /**
+   * @brief the name of the codec
+   * @return the name
+   */
+  virtual const char *Name() const = 0;
+
+  /**
+   * @brief the type byte stored with the values compressed by the codec,
+   *        distinct among the codecs in use, 0 only for NoCodec
+   * @return the type
+   */
+  virtual uint8_t Type() const = 0;
+
+  /**
+   * @brief append the compressed form of a value
+   * @param input the value
+   * @param output the string to append to
+   */
+  virtual void Compress(std::string_view input, std::string *output) const = 0;
+
+  /**
+   * @brief append the value a Compress output holds
+   * @param input the output of Compress
+   * @param output the string to append to, holding garbage on failure
+   * @return true on success, false if input is corrupted
+   */
+  virtual bool Uncompress(std::string_view input,
+                          std::string *output) const = 0;
+};
+
+/**
+ * @brief NoCodec stores the values as they are
+ */
+class NoCodec : public Codec {
+ public:
+  const char *Name() const override { return "kvstore.NoCodec"; }
+
+  uint8_t Type() const override { return kNoCodec; }
+
+  void Compress(std::string_view input, std::string *output) const override {
+    output->append(input);
+  }
+
+  bool Uncompress(std::string_view input, std::string *output) const override {
+    output->append(input);
+    return true;
+  }
+};
+
+/**
+ * @brief LzCodec is the LZ77 codec described at the top of this file
+ */
+class LzCodec : public Codec {
+ public:
+  /** the shortest match, shorter repeats are cheaper as literals */
+  static constexpr int kMinMatch = 4;
+  /** the farthest a match may start back, what the offset can encode */
+  static constexpr std::size_t kMaxOffset = 65535;
+
+  const char *Name() const override { return "kvstore.LzCodec"; }
+
+  uint8_t Type() const override { return kLzCodec; }
+
+  void Compress(std::string_view input, std::string *output) const override {
+    const std::size_t n = input.size();
+    PutVarint32(output, static_cast<uint32_t>(n));
+    output->reserve(output->size() + n + n / 255 + 16);
+    const char *base = input.data();
+    // the table of the last position of each hash of 4 bytes, sized to the
+    // input, so a short value does not pay for clearing a large one
+    int bits = 8;
+    while (bits < kMaxHashBits && (std::size_t(1) << bits) < n) {
+      bits++;
+    }
+    uint32_t table[1 << kMaxHashBits];
+    memset(table, 0, sizeof(uint32_t) << bits);
+    std::size_t anchor = 0;
+    std::size_t pos = 1;
+    uint32_t misses = 0;
+    while (pos + kMinMatch <= n) {
+      uint32_t word = Load32(base + pos);
+      uint32_t hash = (word * 2654435761u) >> (32 - bits);
+      std::size_t candidate = table[hash];
+      table[hash] = static_cast<uint32_t>(pos);
+      if (pos - candidate > kMaxOffset || Load32(base + candidate) != word) {
+        // skip faster through data that does not compress, like LZ4
+        pos += 1 + (misses++ >> 5);
+        continue;
+      }
+      misses = 0;
+      std::size_t length = kMinMatch;
+      while (pos + length < n &&
+             base[candidate + length] == base[pos + length]) {
+        length++;
+      }
+      AppendSequence(input.substr(anchor, pos - anchor), pos - candidate,
+                     length, output);
+      pos += length;
+      anchor = pos;
+    }
+    AppendSequence(input.substr(anchor), 0, 0, output);
+  }
+
+  bool Uncompress(std::string_view input, std::string *output) const override {
+    const char *p = input.data();
+    const char *limit = p + input.size();
+    uint32_t length;
+    p = GetVarint32Ptr(p, limit, &length);
+    // a match byte expands to at most 255 bytes, reject absurd lengths
+    // before reserving for them
+    if (p == nullptr || length > input.size() * 255) {
+      return false;
+    }
+    const std::size_t start = output->size();
+    const std::size_t end = start + length;
+    output->reserve(end);
+    while (true) {
+      if (p == limit) {
+        return false;
+      }
+      uint8_t token = static_cast<uint8_t>(*p++);
+      std::size_t literals = token >> 4;
+      if (!GetLength(&p, limit, &literals) ||
+          static_cast<std::size_t>(limit - p) < literals ||
+          output->size() + literals > end) {
+        return false;
+      }
+      output->append(p, literals);
+      p += literals;
+      if (p == limit) {
+        return output->size() == end;
+      }
+      if (limit - p < 2) {
+        return false;
+      }
+      std::size_t offset = static_cast<uint8_t>(p[0]) |
+                           static_cast<std::size_t>(static_cast<uint8_t>(p[1]))
+                               << 8;
+      p += 2;
+      std::size_t match = token & 15;
+      if (!GetLength(&p, limit, &match)) {
+        return false;
+      }
+      match += kMinMatch;
+      std::size_t size = output->size();
+      if (offset == 0 || offset > size - start || size + match > end) {
+        return false;
+      }
+      if (offset >= match) {
+        output->append(*output, size - offset, match);
+        continue;
+      }
+      // byte by byte, the match overlaps the bytes it writes
+      output->resize(size + match);
+      char *dst = &(*output)[size];
+      const char *src = dst - offset;
+      for (std::size_t i = 0; i < match; i++) {
+        dst[i] = src[i];
+      }
+    }
+  }
+
+ private:
+  /** the largest hash table, 4K entries on the stack like LZ4's */
+  static constexpr int kMaxHashBits = 12;
+
+  /**
+   * @brief read 4 bytes that may not be aligned
+   * @param p where to read
+   * @return the bytes
+   */
+  static uint32_t Load32(const char *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+  }
+
+  /**
+   * @brief append a sequence
+   * @param literals the bytes to copy as they are
+   * @param offset how far back the match starts, unused if length is 0
+   * @param length the length of the match, 0 for the last sequence
+   * @param output the string to append to
+   */
+  static void AppendSequence(std::string_view literals, std::size_t offset,
+                             std::size_t length, std::string *output) {
+    std::size_t match = length == 0 ? 0 : length - kMinMatch;
+    output->push_back(static_cast<char>(
+        (std::min<std::size_t>(literals.size(), 15) << 4) |
+        std::min<std::size_t>(match, 15)));
+    PutLength(literals.size(), output);
+    output->append(literals);
+    if (length == 0) {
+      return;
+    }
+    output->push_back(static_cast<char>(offset & 0xff));
+    output->push_back(static_cast<char>(offset >> 8));
+    PutLength(match, output);
+  }
+
+  /**
+   * @brief append the extra bytes of a length that does not fit its nibble
+   * @param length the length
+   * @param output the string to append to
+   */
+  static void PutLength(std::size_t length, std::string *output) {
+    if (length < 15) {
+      return;
+    }
+    for (length -= 15; length >= 255; length -= 255) {
+      output->push_back(static_cast<char>(255));
+    }
+    output->push_back(static_cast<char>(length));
+  }
+
+  /**
+   * @brief add the extra bytes of a length to its nibble
+   * @param p the extra bytes, moved past them
+   * @param limit the end of the input
+   * @param length the nibble, then the whole length
+   * @return true on success, false if truncated
+   */
+  static bool GetLength(const char **p, const char *limit,
+                        std::size_t *length) {
+    if (*length < 15) {
+      return true;
+    }
+    while (*p < limit) {
+      uint8_t extra = static_cast<uint8_t>(*(*p)++);
+      *length += extra;
+      if (extra < 255) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+/**
+ * @brief the codec storing the values as they are
+ * @return the codec
+ */
+inline std::shared_ptr<const Codec> NewNoCodec() {
+  return std::make_shared<NoCodec>();
+}
+
+/**
+ * @brief create the built-in LZ77 codec, the usual way to set
+ *        CompressedSkipListOptions::codec
+ * @return the codec
+ */
+inline std::shared_ptr<const Codec> NewLzCodec() {
+  return std::make_shared<LzCodec>();
+}
+}  // namespace kvstore
+
+#endif
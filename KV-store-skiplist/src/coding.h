@@ -0,0 +1,261 @@
+/**
+ * coding.h
+ * This is the endian-neutral encoding of integers and of the key and value
+ * types stored on disk, following leveldb's coding schema:
+ * + Fixed-length numbers are encoded with least-significant byte first
+ * + Variable-length numbers (varint) use 7 bits per byte, the highest bit
+ *   tells if more bytes follow
+ * + A string is prefixed with its varint32 length
+ */
+#ifndef KVSTORE_CODING_H
+#define KVSTORE_CODING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+namespace kvstore {
+
+/**
+ * @brief write a 32-bit number into 4 bytes
+ * @param dst the buffer, at least 4 bytes long
+ * @param value the number
+ */
+inline void EncodeFixed32(char *dst, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    dst[i] = static_cast<char>(value >> (8 * i));
+  }
+}
+
+/**
+ * @brief write a 64-bit number into 8 bytes
+ * @param dst the buffer, at least 8 bytes long
+ * @param value the number
+ */
+inline void EncodeFixed64(char *dst, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    dst[i] = static_cast<char>(value >> (8 * i));
+  }
+}
+
+/**
+ * @brief read a 32-bit number from 4 bytes
+ * @param ptr the buffer, at least 4 bytes long
+ * @return the number
+ */
+inline uint32_t DecodeFixed32(const char *ptr) {
+  uint32_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    result |= static_cast<uint32_t>(static_cast<unsigned char>(ptr[i]))
+              << (8 * i);
+  }
+  return result;
+}
+
+/**
+ * @brief read a 64-bit number from 8 bytes
+ * @param ptr the buffer, at least 8 bytes long
+ * @return the number
+ */
+inline uint64_t DecodeFixed64(const char *ptr) {
+  uint64_t result = 0;
+  for (int i = 0; i < 8; i++) {
+    result |= static_cast<uint64_t>(static_cast<unsigned char>(ptr[i]))
+              << (8 * i);
+  }
+  return result;
+}
+
+/**
+ * @brief append a 32-bit number as 4 bytes
+ * @param dst the string to append to
+ * @param value the number
+ */
+inline void PutFixed32(std::string *dst, uint32_t value) {
+  char buf[4];
+  EncodeFixed32(buf, value);
+  dst->append(buf, 4);
+}
+
+/**
+ * @brief append a 64-bit number as 8 bytes
+ * @param dst the string to append to
+ * @param value the number
+ */
+inline void PutFixed64(std::string *dst, uint64_t value) {
+  char buf[8];
+  EncodeFixed64(buf, value);
+  dst->append(buf, 8);
+}
+
+/**
+ * @brief append a number as a varint
+ * @param dst the string to append to
+ * @param value the number
+ */
+inline void PutVarint64(std::string *dst, uint64_t value) {
+  while (value >= 128) {
+    dst->push_back(static_cast<char>(value | 128));
+    value >>= 7;
+  }
+  dst->push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief append a 32-bit number as a varint
+ * @param dst the string to append to
+ * @param value the number
+ */
+inline void PutVarint32(std::string *dst, uint32_t value) {
+  PutVarint64(dst, value);
+}
+
+/**
+ * @brief how many bytes a number takes as a varint
+ * @param value the number
+ * @return the encoded length
+ */
+inline int VarintLength(uint64_t value) {
+  int len = 1;
+  while (value >= 128) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+}
+
+/**
+ * @brief parse a varint from a buffer
+ * @param p the start of the buffer
+ * @param limit the end of the buffer
+ * @param value where to store the number
+ * @return pointer past the varint, nullptr if malformed or truncated
+ */
+inline const char *GetVarint64Ptr(const char *p, const char *limit,
+                                  uint64_t *value) {
+  uint64_t result = 0;
+  for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
+    uint64_t byte = static_cast<unsigned char>(*p);
+    p++;
+    result |= (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      *value = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief parse a varint that must fit in 32 bits from a buffer
+ * @param p the start of the buffer
+ * @param limit the end of the buffer
+ * @param value where to store the number
+ * @return pointer past the varint, nullptr if malformed or truncated
+ */
+inline const char *GetVarint32Ptr(const char *p, const char *limit,
+                                  uint32_t *value) {
+  uint64_t result;
+  p = GetVarint64Ptr(p, limit, &result);
+  if (p == nullptr || result > 0xffffffffu) {
+    return nullptr;
+  }
+  *value = static_cast<uint32_t>(result);
+  return p;
+}
+
+/**
+ * @brief Coder turns a key or value type into bytes and back
+ *        specialized below for arithmetic types and std::string, other types
+ *        could be stored on disk by providing their own specialization
+ * @tparam T the type to encode
+ */
+template <typename T, typename Enable = void>
+struct Coder;
+
+/**
+ * @brief arithmetic types are stored in sizeof(T) bytes, integers least
+ *        significant byte first
+ */
+template <typename T>
+struct Coder<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+  /**
+   * @brief append the encoding of a value
+   * @param value the value
+   * @param dst the string to append to
+   */
+  static void Encode(const T &value, std::string *dst) {
+    char buf[sizeof(T)];
+    if (std::is_integral<T>::value) {
+      uint64_t bits = static_cast<uint64_t>(value);
+      for (std::size_t i = 0; i < sizeof(T); i++) {
+        buf[i] = static_cast<char>(bits >> (8 * i));
+      }
+    } else {
+      memcpy(buf, &value, sizeof(T));
+    }
+    dst->append(buf, sizeof(T));
+  }
+
+  /**
+   * @brief parse a value from a buffer
+   * @param p the start of the buffer
+   * @param limit the end of the buffer
+   * @param value where to store the value
+   * @return pointer past the value, nullptr if truncated
+   */
+  static const char *Decode(const char *p, const char *limit, T *value) {
+    if (limit - p < static_cast<std::ptrdiff_t>(sizeof(T))) {
+      return nullptr;
+    }
+    if (std::is_integral<T>::value) {
+      uint64_t bits = 0;
+      for (std::size_t i = 0; i < sizeof(T); i++) {
+        bits |= static_cast<uint64_t>(static_cast<unsigned char>(p[i]))
+                << (8 * i);
+      }
+      *value = static_cast<T>(bits);
+    } else {
+      memcpy(value, p, sizeof(T));
+    }
+    return p + sizeof(T);
+  }
+};
+
+/**
+ * @brief strings are stored as varint32 length followed by the bytes
+ */
+template <>
+struct Coder<std::string> {
+  /**
+   * @brief append the encoding of a string
+   * @param value the string
+   * @param dst the string to append to
+   */
+  static void Encode(const std::string &value, std::string *dst) {
+    PutVarint32(dst, static_cast<uint32_t>(value.size()));
+    dst->append(value);
+  }
+
+  /**
+   * @brief parse a string from a buffer
+   * @param p the start of the buffer
+   * @param limit the end of the buffer
+   * @param value where to store the string
+   * @return pointer past the string, nullptr if malformed or truncated
+   */
+  static const char *Decode(const char *p, const char *limit,
+                            std::string *value) {
+    uint32_t len;
+    p = GetVarint32Ptr(p, limit, &len);
+    if (p == nullptr || static_cast<std::size_t>(limit - p) < len) {
+      return nullptr;
+    }
+    value->assign(p, len);
+    return p + len;
+  }
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * comparator.h
+ * This is the ordering of byte-string keys, leveldb's BytewiseComparator: keys
+ * compare as unsigned bytes, lexicographically, the same order as std::string.
+ * It is transparent, like std::less<>, so a SkipList of std::string keys can be
+ * probed with a std::string_view or a C string without building a std::string.
+ *
+ * It also knows how to shorten keys while keeping them in between two others,
+ * which the table files use to keep their index blocks small
+ */
+#ifndef KVSTORE_COMPARATOR_H
+#define KVSTORE_COMPARATOR_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+namespace kvstore {
+
+/**
+ * @brief BytewiseComparator orders anything convertible to std::string_view
+ *        as unsigned bytes
+ */
+struct BytewiseComparator {
+  /** allows heterogeneous lookups, e.g. std::string_view probes */
+  using is_transparent = void;
+
+  /**
+   * @brief the name of the ordering
+   * @return the name
+   */
+  static const char *Name() { return "kvstore.BytewiseComparator"; }
+
+  /**
+   * @brief three-way comparison of two keys
+   * @param a a key
+   * @param b another key
+   * @return negative if a < b, 0 if equal, positive if a > b
+   */
+  static int Compare(std::string_view a, std::string_view b) {
+    return a.compare(b);
+  }
+
+  /**
+   * @brief if a key orders before another
+   * @param a a key
+   * @param b another key
+   * @return true if a < b, false otherwise
+   */
+  bool operator()(std::string_view a, std::string_view b) const {
+    return a.compare(b) < 0;
+  }
+
+  /**
+   * @brief shorten a key as long as it stays in [start, limit)
+   * @param start the key to shorten, smaller than limit
+   * @param limit the upper bound
+   */
+  static void FindShortestSeparator(std::string *start,
+                                    std::string_view limit) {
+    std::size_t min_length = std::min(start->size(), limit.size());
+    std::size_t diff_index = 0;
+    while (diff_index < min_length &&
+           (*start)[diff_index] == limit[diff_index]) {
+      diff_index++;
+    }
+    if (diff_index >= min_length) {
+      return;  // one is a prefix of the other, nothing to cut
+    }
+    uint8_t diff_byte = static_cast<uint8_t>((*start)[diff_index]);
+    if (diff_byte < 0xff &&
+        diff_byte + 1 < static_cast<uint8_t>(limit[diff_index])) {
+      (*start)[diff_index] = static_cast<char>(diff_byte + 1);
+      start->resize(diff_index + 1);
+    }
+  }
+
+  /**
+   * @brief shorten a key to a short one no smaller than it
+   * @param key the key to shorten, left alone if it is all 0xff bytes
+   */
+  static void FindShortestSuccessor(std::string *key) {
+    for (std::size_t i = 0; i < key->size(); i++) {
+      uint8_t byte = static_cast<uint8_t>((*key)[i]);
+      if (byte != 0xff) {
+        (*key)[i] = static_cast<char>(byte + 1);
+        key->resize(i + 1);
+        return;
+      }
+    }
+  }
+};
+}  // namespace kvstore
+
+#endif
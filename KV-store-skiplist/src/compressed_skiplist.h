@@ -0,0 +1,318 @@
+/**
+ * compressed_skiplist.h
+ * This is a SkipList of byte string values kept compressed, for large
+ * values that compress well, like JSON documents. Each key maps to a shared,
+ * immutable Blob: the one compressed copy of its value, the type byte of the
+ * codec that compressed it, and an id no other value of the list gets.
+ *
+ * Values are compressed by a pluggable Codec (see codec.h) on SkipInsert. A
+ * value the codec does not shrink by at least an eighth is stored as it is,
+ * with the type byte 0, like leveldb does with its blocks, so incompressible
+ * values cost no decompression.
+ *
+ * Decompression is lazy, on Get. The decompressed values are kept in a small
+ * LRU Cache (see cache.h) keyed by the id of their Blob, so the hot values
+ * are decompressed once. A new value of a key gets a new id, the stale entry
+ * is erased, and can never be returned meanwhile. Scans decompress each
+ * value without filling the cache, so a long scan does not flush it.
+ */
+#ifndef KVSTORE_COMPRESSED_SKIPLIST_H
+#define KVSTORE_COMPRESSED_SKIPLIST_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "cache.h"
+#include "codec.h"
+#include "coding.h"
+#include "skiplist.h"
+
+namespace kvstore {
+
+/**
+ * @brief CompressedSkipListOptions controls how a CompressedSkipList stores
+ *        its values
+ */
+struct CompressedSkipListOptions {
+  /** the codec of the values. See NewLzCodec and NewNoCodec */
+  std::shared_ptr<const Codec> codec = NewLzCodec();
+
+  /**
+   * the cache of the decompressed values, it may be shared by several
+   * lists. nullptr makes the list create a 1MB one, NewLRUCache(0) caches
+   * nothing. See NewLRUCache
+   */
+  std::shared_ptr<Cache> value_cache;
+};
+
+/**
+ * @brief CompressedSkipList is a SkipList of compressed std::string values
+ * @tparam K key type
+ * @tparam Comparator the ordering of the keys, see SkipList
+ */
+template <typename K, typename Comparator = std::less<>>
+class CompressedSkipList {
+ public:
+  /**
+   * @brief create an empty list
+   * @param options how to store the values
+   * @param compare the ordering of the keys
+   */
+  explicit CompressedSkipList(
+      const CompressedSkipListOptions &options = CompressedSkipListOptions(),
+      const Comparator &compare = Comparator())
+      : codec_(options.codec),
+        cache_(options.value_cache != nullptr
+                   ? options.value_cache
+                   : NewLRUCache(kDefaultValueCacheSize)),
+        cache_id_(cache_->NewId()),
+        list_(10, compare) {}
+
+  /**
+   * @brief insert a key-value pair, compressing the value
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(const K &key, std::string_view value) {
+    auto blob = std::make_shared<Blob>();
+    blob->id = next_id_.fetch_add(1, std::memory_order_relaxed);
+    blob->raw_size = value.size();
+    codec_->Compress(value, &blob->data);
+    if (codec_->Type() == kNoCodec ||
+        blob->data.size() > value.size() - value.size() / 8) {
+      blob->type = kNoCodec;
+      blob->data.assign(value.data(), value.size());
+    } else {
+      blob->type = codec_->Type();
+    }
+    blob->data.shrink_to_fit();
+    raw_bytes_.fetch_add(blob->raw_size, std::memory_order_relaxed);
+    stored_bytes_.fetch_add(blob->data.size(), std::memory_order_relaxed);
+    Entry replaced;
+    bool inserted = list_.SkipInsert(K(key), Entry(std::move(blob)), &replaced);
+    if (replaced != nullptr) {
+      Release(*replaced);
+    }
+    return inserted;
+  }
+
+  /**
+   * @brief look up a key and decompress its value, unless the cache holds it
+   * @param key the key
+   * @param value where to store the value, untouched if not found
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool Get(const Q &key, std::string *value) const {
+    Entry blob;
+    if (!list_.Get(key, &blob)) {
+      return false;
+    }
+    if (blob->type == kNoCodec) {
+      *value = blob->data;
+      return true;
+    }
+    std::string cache_key = CacheKey(*blob);
+    Cache::Handle *handle = cache_->Lookup(cache_key);
+    if (handle == nullptr) {
+      std::string *decompressed = new std::string();
+      Decompress(*blob, decompressed);
+      handle = cache_->Insert(cache_key, decompressed, decompressed->size(),
+                              &DeleteCachedValue);
+      // a writer may have replaced or removed the value, and erased its
+      // entry, before it was inserted. Then nobody would erase it again
+      Entry current;
+      if (!list_.Get(key, &current) || current->id != blob->id) {
+        cache_->Erase(cache_key);
+      }
+    }
+    *value = *static_cast<const std::string *>(cache_->Value(handle));
+    cache_->Release(handle);
+    return true;
+  }
+
+  /**
+   * @brief remove a key
+   * @param key the key
+   * @return true if removal is successful, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool SkipRemove(const Q &key) {
+    Entry removed;
+    if (!list_.SkipRemoveIf(key, [&removed](const Entry &blob) {
+          removed = blob;
+          return true;
+        })) {
+      return false;
+    }
+    Release(*removed);
+    return true;
+  }
+
+  /**
+   * @brief visit every key-value pair with lo <= key < hi in key order,
+   *        decompressing each value, without going through the cache
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
+   */
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t Scan(const Lo &lo, const Hi &hi, Callback &&callback) const {
+    std::string value;
+    return list_.LockedScan(lo, hi, [&](const K &key, const Entry &blob) {
+      value.clear();
+      Decompress(*blob, &value);
+      return callback(key, value);
+    });
+  }
+
+  /**
+   * @brief the number of keys
+   * @return the number of keys
+   */
+  std::size_t GetSize() const { return list_.GetSize(); }
+
+  /**
+   * @brief the bytes of the values as they were inserted
+   * @return the number of bytes
+   */
+  std::size_t GetRawBytes() const {
+    return raw_bytes_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief the bytes the values take once compressed
+   * @return the number of bytes
+   */
+  std::size_t GetStoredBytes() const {
+    return stored_bytes_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief how many times smaller the values are stored than inserted
+   * @return GetRawBytes() / GetStoredBytes(), 1 when empty
+   */
+  double GetCompressionRatio() const {
+    std::size_t stored = GetStoredBytes();
+    return stored == 0 ? 1.0 : static_cast<double>(GetRawBytes()) / stored;
+  }
+
+  /**
+   * @brief the cache of the decompressed values, to read its hits and misses
+   * @return the cache
+   */
+  const std::shared_ptr<Cache> &GetValueCache() const { return cache_; }
+
+  /**
+   * @brief the memory held by the list and its stored values, without the
+   *        cache
+   * @return the number of bytes
+   */
+  std::size_t ApproximateMemoryUsage() const {
+    return list_.ApproximateMemoryUsage() + GetStoredBytes() +
+           GetSize() * sizeof(Blob);
+  }
+
+ private:
+  /** the capacity of the cache created when none is given */
+  static const std::size_t kDefaultValueCacheSize = 1024 * 1024;
+
+  /**
+   * @brief Blob is the stored form of a value, never modified once shared
+   */
+  struct Blob {
+    /** distinct among the values of the list, the key of its cache entry */
+    uint64_t id;
+    /** the type of the codec that compressed data, kNoCodec if raw */
+    uint8_t type;
+    /** the size of the value before compression */
+    std::size_t raw_size;
+    /** the compressed value */
+    std::string data;
+  };
+
+  /** a reference to a Blob, what the SkipList stores */
+  using Entry = std::shared_ptr<const Blob>;
+
+  /**
+   * @brief the key of the cache entry of a value
+   * @param blob the stored value
+   * @return the key, the id of the list then the id of the value
+   */
+  std::string CacheKey(const Blob &blob) const {
+    std::string key;
+    PutFixed64(&key, cache_id_);
+    PutFixed64(&key, blob.id);
+    return key;
+  }
+
+  /**
+   * @brief append the value a Blob holds
+   * @param blob the stored value
+   * @param value the string to append to
+   */
+  void Decompress(const Blob &blob, std::string *value) const {
+    if (blob.type == kNoCodec) {
+      value->append(blob.data);
+      return;
+    }
+    std::size_t start = value->size();
+    bool ok = codec_->Uncompress(blob.data, value);
+    // the data never leaves memory, only a bug could corrupt it
+    assert(ok && value->size() - start == blob.raw_size);
+    (void)ok;
+    (void)start;
+  }
+
+  /**
+   * @brief account for a value replaced or removed, and drop its cache entry
+   * @param blob the stored value
+   */
+  void Release(const Blob &blob) {
+    raw_bytes_.fetch_sub(blob.raw_size, std::memory_order_relaxed);
+    stored_bytes_.fetch_sub(blob.data.size(), std::memory_order_relaxed);
+    if (blob.type != kNoCodec) {
+      cache_->Erase(CacheKey(blob));
+    }
+  }
+
+  /**
+   * @brief the deleter of the values in the cache
+   * @param key the key of the entry
+   * @param value the decompressed value
+   */
+  static void DeleteCachedValue(const std::string &key, void *value) {
+    (void)key;
+    delete static_cast<std::string *>(value);
+  }
+
+  /** the codec of the values */
+  const std::shared_ptr<const Codec> codec_;
+  /** the cache of the decompressed values */
+  const std::shared_ptr<Cache> cache_;
+  /** the id of the list in the cache, which may be shared */
+  const uint64_t cache_id_;
+  /** the values, compressed */
+  SkipList<K, Entry, Comparator> list_;
+  /** the id of the next value stored */
+  std::atomic<uint64_t> next_id_{0};
+  /** the bytes of the values stored, as inserted */
+  std::atomic<std::size_t> raw_bytes_{0};
+  /** the bytes of the values stored, compressed */
+  std::atomic<std::size_t> stored_bytes_{0};
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * crc32c.h
+ * This is the CRC-32C (Castagnoli) checksum used to protect on-disk records,
+ * computed byte by byte from a lookup table. The Mask trick is borrowed from
+ * leveldb: storing the CRC of a string that itself contains CRCs is
+ * problematic, so the stored value is rotated and offset
+ */
+#ifndef KVSTORE_CRC32C_H
+#define KVSTORE_CRC32C_H
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace kvstore {
+namespace crc32c {
+
+/**
+ * @brief the lookup table of the reflected Castagnoli polynomial, built once
+ * @return pointer to the 256-entry table
+ */
+inline const uint32_t *Table() {
+  struct Builder {
+    uint32_t table[256];
+    Builder() {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+          crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78u : 0);
+        }
+        table[i] = crc;
+      }
+    }
+  };
+  static const Builder builder;
+  return builder.table;
+}
+
+/**
+ * @brief extend the CRC of some data with more data
+ * @param init_crc the CRC of the data so far, 0 to start
+ * @param data the new data
+ * @param n the length of the new data
+ * @return the CRC of the concatenation
+ */
+inline uint32_t Extend(uint32_t init_crc, const char *data, std::size_t n) {
+  const uint32_t *table = Table();
+  uint32_t crc = init_crc ^ 0xffffffffu;
+  auto p = reinterpret_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < n; i++) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+/**
+ * @brief the CRC of some data
+ * @param data the data
+ * @param n the length of the data
+ * @return the CRC
+ */
+inline uint32_t Value(const char *data, std::size_t n) {
+  return Extend(0, data, n);
+}
+
+/** the offset added when masking a CRC */
+static const uint32_t kMaskDelta = 0xa282ead8u;
+
+/**
+ * @brief turn a CRC into the form that is stored on disk
+ * @param crc the CRC
+ * @return the masked CRC
+ */
+inline uint32_t Mask(uint32_t crc) {
+  return ((crc >> 15) | (crc << 17)) + kMaskDelta;
+}
+
+/**
+ * @brief recover the CRC from its stored form
+ * @param masked_crc the masked CRC
+ * @return the CRC
+ */
+inline uint32_t Unmask(uint32_t masked_crc) {
+  uint32_t rot = masked_crc - kMaskDelta;
+  return ((rot >> 17) | (rot << 15));
+}
+}  // namespace crc32c
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,1363 @@
+/**
+ * db.h
+ * This is the durable mode of the key-value store, a log-structured merge
+ * tree in the spirit of leveldb's DBImpl: a SkipList in memory (the MemTable)
+ * backed by a write-ahead log, in front of immutable table files on disk
+ *
+ * Every write is appended to the log before it is applied to the MemTable.
+ * Concurrent writers are grouped: the writer at the front of the queue
+ * becomes the leader, folds the batches queued behind it into one log record,
+ * appends and (if asked to) syncs it once for the whole group, applies it,
+ * and then wakes the followers up.
+ *
+ * Once the MemTable grows past Options::write_buffer_size, the leader freezes
+ * it into the immutable MemTable, switches to a fresh MemTable and a fresh
+ * log, and a background thread flushes the frozen one into a table file.
+ * The log of the frozen MemTable is deleted once its table is in place. If
+ * the previous flush is still running when the next freeze is due, writers
+ * wait for it.
+ *
+ * The tables are arranged into levels (see version.h). Flushed tables land
+ * in level 0, where they may overlap. The same background thread compacts
+ * the levels like leveldb: once level 0 has too many tables, or another
+ * level too many bytes, some of its tables are merged with the overlapping
+ * tables of the next level into new tables of that level. The merge keeps
+ * only the newest entry of each key, and drops a tombstone once no deeper
+ * level might hold the key. A compaction checks for a frozen MemTable
+ * between its writes and flushes it first, so writers never wait for a whole
+ * compaction, and it can be rate limited to leave disk bandwidth to reads.
+ * Writes do wait when level 0 piles up beyond level0_stop_writes_trigger.
+ *
+ * Reads consult the MemTable, then the immutable MemTable, then the tables
+ * of level 0 from the newest to the oldest, then at most one table per
+ * deeper level, and stop at the first one knowing the key. A deletion is
+ * kept as a tombstone, shadowing the older values.
+ *
+ * The manifest lists the live tables and their levels, it is rewritten
+ * before a flush or a compaction deletes any file. On Open, the listed tables
+ * are opened, the leftovers of an interrupted flush or compaction are
+ * deleted, and the logs are replayed into the MemTable, skipping the records
+ * already flushed into a table. Whatever was replayed is flushed into a table
+ * right away, so a restart only replays at most one or two MemTables worth of
+ * log
+ */
+#ifndef KVSTORE_DB_H
+#define KVSTORE_DB_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dbformat.h"
+#include "env.h"
+#include "filename.h"
+#include "log_reader.h"
+#include "log_writer.h"
+#include "memtable.h"
+#include "merger.h"
+#include "options.h"
+#include "rate_limiter.h"
+#include "status.h"
+#include "table.h"
+#include "table_builder.h"
+#include "version.h"
+#include "write_batch.h"
+
+namespace kvstore {
+
+/**
+ * @brief DB is a durable key-value store
+ *        all the methods are thread-safe
+ * @tparam K key type, must have a Coder
+ * @tparam V value type, must have a Coder
+ */
+template <typename K, typename V>
+class DB {
+ public:
+  /**
+   * @brief open the DB stored in a directory, recovering its content
+   * @param options the options of the DB
+   * @param dbname the DB directory
+   * @param result where to store the opened DB
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const Options &options, const std::string &dbname,
+                     std::unique_ptr<DB> *result) {
+    result->reset();
+    if (options.create_if_missing) {
+      Status s = CreateDir(dbname);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    std::unique_ptr<DB> db(new DB(options, dbname));
+    Status s = db->Recover();
+    if (s.ok()) {
+      db->bg_thread_ = std::thread(&DB::BackgroundWork, db.get());
+      *result = std::move(db);
+    }
+    return s;
+  }
+
+  /**
+   * @brief close the DB, everything written so far is handed to the OS
+   *        a flush in progress is finished first, a compaction is abandoned
+   */
+  ~DB() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      shutting_down_ = true;
+    }
+    bg_cv_.notify_all();
+    if (bg_thread_.joinable()) {
+      bg_thread_.join();
+    }
+    if (logfile_) {
+      logfile_->Close();
+    }
+  }
+
+  DB(const DB &) = delete;
+  DB &operator=(const DB &) = delete;
+
+  /**
+   * @brief set a key to a value
+   * @param options the options of this write
+   * @param key the key
+   * @param value the value
+   * @return OK on success, the error otherwise
+   */
+  Status Put(const WriteOptions &options, K key, V value) {
+    WriteBatch<K, V> batch;
+    batch.Put(key, value);
+    return Write(options, batch);
+  }
+
+  /**
+   * @brief remove a key, it is fine if the key doesn't exist
+   * @param options the options of this write
+   * @param key the key
+   * @return OK on success, the error otherwise
+   */
+  Status Delete(const WriteOptions &options, K key) {
+    WriteBatch<K, V> batch;
+    batch.Delete(key);
+    return Write(options, batch);
+  }
+
+  /**
+   * @brief apply a batch of operations atomically with respect to recovery
+   * @param options the options of this write
+   * @param batch the operations
+   * @return OK on success, the error otherwise
+   */
+  Status Write(const WriteOptions &options, const WriteBatch<K, V> &batch) {
+    return WriteImpl(options, &batch);
+  }
+
+  /**
+   * @brief freeze the MemTable and wait until it is flushed into a table
+   * @return OK on success, the error otherwise
+   */
+  Status FlushMemTable() {
+    Status s = WriteImpl(WriteOptions(), nullptr);
+    if (!s.ok()) {
+      return s;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (imm_ != nullptr && bg_error_.ok()) {
+      bg_cv_.wait(lock);
+    }
+    return bg_error_;
+  }
+
+  /**
+   * @brief wait until the background thread is idle: no MemTable to flush
+   *        and no level to compact
+   * @return OK on success, the error of the background work otherwise
+   */
+  Status WaitForCompactions() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (bg_error_.ok() && (imm_ != nullptr || bg_busy_ ||
+                              PickCompactionLevel(*current_) >= 0)) {
+      bg_cv_.wait(lock);
+    }
+    return bg_error_;
+  }
+
+  /**
+   * @brief look up the value of a key
+   *        the MemTables first, then the tables level by level
+   * @param key the key
+   * @param value where to store the value
+   * @return OK if found, NotFound if not, the error otherwise
+   */
+  Status Get(K key, V *value) const {
+    std::shared_ptr<MemTable<K, V>> mem;
+    std::shared_ptr<MemTable<K, V>> imm;
+    std::shared_ptr<const VersionType> version;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      mem = mem_;
+      imm = imm_;
+      version = current_;
+    }
+    Status s;
+    if (mem->Get(key, value, &s)) {
+      return s;
+    }
+    if (imm != nullptr && imm->Get(key, value, &s)) {
+      return s;
+    }
+    TaggedValue<V> tagged;
+    s = version->Get(key, &tagged);
+    if (s.ok()) {
+      if (tagged.type == ValueType::kDeletion) {
+        return Status::NotFound("key");
+      }
+      *value = std::move(tagged.value);
+    }
+    return s;
+  }
+
+  /**
+   * @brief look up the values of several keys
+   *        the keys missing from the MemTables are probed against the filter
+   *        of each table all at once, and only the possible matches are
+   *        searched in that table
+   * @param keys the keys
+   * @param values where to store the values, resized to the number of keys
+   * @return the result of Get for each key
+   */
+  std::vector<Status> MultiGet(const std::vector<K> &keys,
+                               std::vector<V> *values) const {
+    std::shared_ptr<MemTable<K, V>> mem;
+    std::shared_ptr<MemTable<K, V>> imm;
+    std::shared_ptr<const VersionType> version;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      mem = mem_;
+      imm = imm_;
+      version = current_;
+    }
+    std::vector<Status> statuses(keys.size(), Status::NotFound("key"));
+    values->resize(keys.size());
+    // the positions of the keys still to be found
+    std::vector<std::size_t> pending;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      if (!mem->Get(keys[i], &(*values)[i], &statuses[i]) &&
+          (imm == nullptr || !imm->Get(keys[i], &(*values)[i], &statuses[i]))) {
+        pending.push_back(i);
+      }
+    }
+
+    // every level is visited in lookup order, so each key meets the tables
+    // that might hold it in the same order as in Get
+    std::vector<K> probe;
+    std::vector<std::size_t> candidates;
+    std::unique_ptr<bool[]> may_match(new bool[keys.size()]);
+    TaggedValue<V> tagged;
+    for (int level = 0; level < kNumLevels; level++) {
+      for (auto &file : version->GetFiles(level)) {
+        if (pending.empty()) {
+          break;
+        }
+        probe.clear();
+        candidates.clear();
+        std::size_t remaining = 0;
+        for (auto i : pending) {
+          if (keys[i] < file->GetSmallestKey() ||
+              file->GetLargestKey() < keys[i]) {
+            pending[remaining++] = i;  // out of the range of this table
+          } else {
+            probe.push_back(keys[i]);
+            candidates.push_back(i);
+          }
+        }
+        pending.resize(remaining);
+        if (candidates.empty()) {
+          continue;
+        }
+        file->table->KeysMayMatch(probe, may_match.get());
+        for (std::size_t j = 0; j < candidates.size(); j++) {
+          std::size_t i = candidates[j];
+          Status s = may_match[j] ? file->table->Get(keys[i], &tagged)
+                                  : Status::NotFound("key");
+          if (s.IsNotFound()) {
+            pending.push_back(i);  // try the older tables
+            continue;
+          }
+          if (s.ok() && tagged.type == ValueType::kDeletion) {
+            s = Status::NotFound("key");
+          } else if (s.ok()) {
+            (*values)[i] = std::move(tagged.value);
+          }
+          statuses[i] = s;
+        }
+      }
+    }
+    return statuses;
+  }
+
+  /**
+   * @brief visit every key-value pair with lo <= key < hi in key order
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   */
+  template <typename Callback>
+  std::size_t Scan(K lo, K hi, Callback &&callback) const {
+    std::size_t count = 0;
+    std::shared_ptr<MemTable<K, V>> mem;
+    std::shared_ptr<MemTable<K, V>> imm;
+    std::shared_ptr<const VersionType> version;
+    auto iter = NewInternalIterator(&mem, &imm, &version);
+    for (iter->Seek(lo); iter->Valid() && iter->GetKey() < hi; iter->Next()) {
+      auto tagged = iter->GetValue();
+      if (tagged.type == ValueType::kDeletion) {
+        continue;
+      }
+      count++;
+      if (!callback(iter->GetKey(), tagged.value)) {
+        break;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief how many key-value pairs are in the DB
+   *        the MemTables and the tables may overlap, so this is a full merge
+   *        of all of them, O(n)
+   * @return the number of key-value pairs
+   */
+  std::size_t GetSize() const {
+    std::size_t count = 0;
+    std::shared_ptr<MemTable<K, V>> mem;
+    std::shared_ptr<MemTable<K, V>> imm;
+    std::shared_ptr<const VersionType> version;
+    auto iter = NewInternalIterator(&mem, &imm, &version);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (iter->GetValue().type == ValueType::kValue) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief how many table files the DB has
+   * @return the number of table files
+   */
+  std::size_t GetNumTables() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return current_->NumFiles();
+  }
+
+  /**
+   * @brief how many table files a level has
+   * @param level the level
+   * @return the number of table files
+   */
+  std::size_t GetNumLevelTables(int level) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return current_->GetFiles(level).size();
+  }
+
+  /**
+   * @brief the sequence number of the latest operation applied
+   * @return the sequence number
+   */
+  uint64_t GetLastSequence() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return last_sequence_;
+  }
+
+ private:
+  /** an opened table file */
+  using TableType = Table<K, TaggedValue<V>>;
+  /** a live table file */
+  using FileMeta = FileMetaData<K, TaggedValue<V>>;
+  /** the live table files */
+  using VersionType = Version<K, TaggedValue<V>>;
+
+  /**
+   * @brief a write waiting in the queue for its turn
+   */
+  struct PendingWriter {
+    PendingWriter(const WriteBatch<K, V> *b, bool s) : batch(b), sync(s) {}
+
+    /** the operations to write, nullptr to force a MemTable flush */
+    const WriteBatch<K, V> *batch;
+    /** if the writer asked for a sync */
+    bool sync;
+    /** set by the leader once the write is done */
+    bool done = false;
+    /** the result of the write, set by the leader */
+    Status status;
+    /** signaled when done, or when this writer becomes the leader */
+    std::condition_variable cv;
+  };
+
+  /** how many replayed operations are applied to the MemTable together */
+  static const std::size_t kReplayBatchSize = 65536;
+
+  /** the capacity of the block cache created when none is given */
+  static const std::size_t kDefaultBlockCacheSize = 8 * 1024 * 1024;
+
+  /**
+   * @brief fill in the options left to the DB
+   * @param options the options given to Open
+   * @return the options the DB runs with
+   */
+  static Options SanitizeOptions(const Options &options) {
+    Options result = options;
+    if (result.block_cache == nullptr) {
+      result.block_cache = NewLRUCache(kDefaultBlockCacheSize);
+    }
+    return result;
+  }
+
+  DB(const Options &options, const std::string &dbname)
+      : options_(SanitizeOptions(options)),
+        dbname_(dbname),
+        mem_(new MemTable<K, V>(options.max_height)),
+        current_(new VersionType()) {
+    if (options_.compaction_bytes_per_second > 0) {
+      rate_limiter_.reset(
+          new RateLimiter(options_.compaction_bytes_per_second));
+    }
+  }
+
+  /**
+   * @brief queue a write and either wait for a leader to do it, or lead a
+   *        group of writes
+   * @param options the options of this write
+   * @param batch the operations, nullptr to force a MemTable flush
+   * @return OK on success, the error otherwise
+   */
+  Status WriteImpl(const WriteOptions &options, const WriteBatch<K, V> *batch) {
+    PendingWriter w(batch, options.sync);
+    std::unique_lock<std::mutex> lock(mutex_);
+    writers_.push_back(&w);
+    while (!w.done && &w != writers_.front()) {
+      w.cv.wait(lock);
+    }
+    if (w.done) {
+      return w.status;  // a leader has written it for us
+    }
+
+    // we are the leader of a group now
+    Status s = MakeRoomForWrite(&lock, batch == nullptr);
+    PendingWriter *last_writer = &w;
+    if (s.ok() && batch != nullptr) {
+      bool sync = false;
+      const WriteBatch<K, V> *group = BuildBatchGroup(&last_writer, &sync);
+      uint64_t sequence = last_sequence_ + 1;
+      last_sequence_ += group->Count();
+      std::shared_ptr<MemTable<K, V>> mem = mem_;
+
+      // the queue keeps the followers waiting, the log and the MemTable are
+      // only written by the leader, so the lock could be released meanwhile
+      lock.unlock();
+      s = AppendToLog(*group, sequence, sync);
+      if (s.ok()) {
+        mem->Write(*group, sequence);
+      }
+      lock.lock();
+      if (!s.ok()) {
+        // the log might be half written, refuse any further write
+        bg_error_ = s;
+      }
+      if (group == &tmp_batch_) {
+        tmp_batch_.Clear();
+      }
+    }
+
+    while (true) {
+      PendingWriter *ready = writers_.front();
+      writers_.pop_front();
+      if (ready != &w) {
+        ready->status = s;
+        ready->done = true;
+        ready->cv.notify_one();
+      }
+      if (ready == last_writer) {
+        break;
+      }
+    }
+    if (!writers_.empty()) {
+      writers_.front()->cv.notify_one();
+    }
+    return s;
+  }
+
+  /**
+   * @brief make sure the MemTable has room for a write, freezing it and
+   *        switching to a new log when it is full. Requires the lock, which
+   *        is released while waiting for the previous flush
+   * @param lock the held lock
+   * @param force if to freeze the MemTable even if it isn't full
+   * @return OK on success, the error otherwise
+   */
+  Status MakeRoomForWrite(std::unique_lock<std::mutex> *lock, bool force) {
+    while (true) {
+      if (!bg_error_.ok()) {
+        return bg_error_;
+      }
+      if (!force &&
+          mem_->ApproximateMemoryUsage() < options_.write_buffer_size) {
+        return Status::OK();
+      }
+      if (imm_ != nullptr) {
+        // the previous MemTable is still being flushed
+        bg_cv_.wait(*lock);
+        continue;
+      }
+      if (current_->GetFiles(0).size() >=
+          static_cast<std::size_t>(options_.level0_stop_writes_trigger)) {
+        // too many tables for a lookup to go through, let compaction catch up
+        bg_cv_.wait(*lock);
+        continue;
+      }
+      if (mem_->GetSize() == 0) {
+        return Status::OK();  // nothing to flush
+      }
+      uint64_t new_log_number = next_file_number_++;
+      std::unique_ptr<WritableFile> lfile;
+      Status s = WritableFile::Open(LogFileName(dbname_, new_log_number),
+                                    true, &lfile);
+      if (s.ok()) {
+        s = logfile_->Close();
+      }
+      if (!s.ok()) {
+        bg_error_ = s;
+        return s;
+      }
+      logfile_ = std::move(lfile);
+      log_.reset(new log::Writer(logfile_.get()));
+      unsynced_bytes_ = 0;
+      imm_log_number_ = logfile_number_;
+      logfile_number_ = new_log_number;
+      imm_ = std::move(mem_);
+      has_imm_.store(true, std::memory_order_release);
+      imm_sequence_ = last_sequence_;
+      mem_.reset(new MemTable<K, V>(options_.max_height));
+      bg_cv_.notify_all();
+      force = false;
+    }
+  }
+
+  /**
+   * @brief fold the batches queued behind the leader into one group
+   *        requires the lock
+   * @param last_writer in: the leader, out: the last writer in the group
+   * @param sync where to store if any writer in the group asked for a sync
+   * @return the batch of the whole group
+   */
+  const WriteBatch<K, V> *BuildBatchGroup(PendingWriter **last_writer,
+                                          bool *sync) {
+    PendingWriter *first = writers_.front();
+    const WriteBatch<K, V> *result = first->batch;
+    *sync = first->sync;
+    std::size_t size = first->batch->Count();
+    *last_writer = first;
+    for (auto iter = writers_.begin() + 1; iter != writers_.end(); ++iter) {
+      PendingWriter *w = *iter;
+      if (w->batch == nullptr) {
+        break;  // a flush request leads its own group
+      }
+      size += w->batch->Count();
+      if (size > options_.max_group_ops) {
+        break;  // don't make the group too big
+      }
+      if (result == first->batch) {
+        // switch to the temporary batch instead of touching the caller's
+        result = &tmp_batch_;
+        tmp_batch_.Append(*first->batch);
+      }
+      tmp_batch_.Append(*w->batch);
+      *sync = *sync || w->sync;
+      *last_writer = w;
+    }
+    return result;
+  }
+
+  /**
+   * @brief append a batch as one log record, syncing as configured
+   *        only called by the leader, without the lock
+   * @param batch the operations
+   * @param sequence the sequence number of the first operation
+   * @param sync if the group asked for a sync
+   * @return OK on success, the error otherwise
+   */
+  Status AppendToLog(const WriteBatch<K, V> &batch, uint64_t sequence,
+                     bool sync) {
+    record_.clear();
+    batch.EncodeTo(sequence, &record_);
+    Status s = log_->AddRecord(record_);
+    if (!s.ok()) {
+      return s;
+    }
+    unsynced_bytes_ += record_.size();
+    if (sync ||
+        (options_.sync_bytes > 0 && unsynced_bytes_ >= options_.sync_bytes)) {
+      unsynced_bytes_ = 0;
+      return logfile_->Sync();
+    }
+    // hand it to the OS, so the write survives a crash of the process
+    return logfile_->Flush();
+  }
+
+  /**
+   * @brief the background thread, flushing each frozen MemTable into a
+   *        table file and compacting the levels until the DB is closed
+   */
+  void BackgroundWork() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!shutting_down_ &&
+             (!bg_error_.ok() ||
+              (imm_ == nullptr && PickCompactionLevel(*current_) < 0))) {
+        bg_cv_.wait(lock);
+      }
+      if (shutting_down_) {
+        break;  // a pending MemTable is still in its log
+      }
+      bg_busy_ = true;
+      if (imm_ != nullptr) {
+        CompactMemTable(&lock);
+      } else {
+        BackgroundCompaction(&lock);
+      }
+      bg_busy_ = false;
+      bg_cv_.notify_all();
+    }
+  }
+
+  /**
+   * @brief flush the immutable MemTable into a table of level 0, then delete
+   *        its log. Requires the lock, which is released while writing
+   * @param lock the held lock
+   */
+  void CompactMemTable(std::unique_lock<std::mutex> *lock) {
+    std::shared_ptr<MemTable<K, V>> imm = imm_;
+    uint64_t number = next_file_number_++;
+    uint64_t sequence = imm_sequence_;
+    uint64_t log_number = imm_log_number_;
+
+    lock->unlock();
+    std::shared_ptr<TableType> table;
+    Status s = WriteTable(*imm, number, sequence, &table);
+    lock->lock();
+
+    if (s.ok()) {
+      std::shared_ptr<VersionType> version(new VersionType(*current_));
+      version->AddFile(0, NewFileMeta(number, table));
+      s = InstallVersion(lock, version);
+    }
+    if (s.ok()) {
+      imm_.reset();
+      has_imm_.store(false, std::memory_order_release);
+      RemoveFile(LogFileName(dbname_, log_number));
+    } else {
+      bg_error_ = s;
+    }
+    bg_cv_.notify_all();
+  }
+
+  /**
+   * @brief the level most in need of a compaction
+   *        level 0 is scored by its number of tables, since each one costs
+   *        a lookup a probe, the other levels by their bytes
+   * @param version the tables
+   * @return the level, -1 if none needs a compaction
+   */
+  int PickCompactionLevel(const VersionType &version) const {
+    int best_level = -1;
+    double best_score = 1;
+    for (int level = 0; level < kNumLevels - 1; level++) {
+      double score;
+      if (level == 0) {
+        score = static_cast<double>(version.GetFiles(0).size()) /
+                options_.level0_compaction_trigger;
+      } else {
+        score = static_cast<double>(version.NumLevelBytes(level)) /
+                MaxBytesForLevel(level);
+      }
+      if (score >= best_score) {
+        best_level = level;
+        best_score = score;
+      }
+    }
+    return best_level;
+  }
+
+  /**
+   * @brief the bytes a level is allowed before it is compacted
+   * @param level the level, at least 1
+   * @return the number of bytes
+   */
+  double MaxBytesForLevel(int level) const {
+    double result = static_cast<double>(options_.max_bytes_for_level_base);
+    for (int i = 1; i < level; i++) {
+      result *= 10;
+    }
+    return result;
+  }
+
+  /**
+   * @brief compact the level most in need of it into the next one
+   *        Requires the lock, which is released while merging
+   * @param lock the held lock
+   */
+  void BackgroundCompaction(std::unique_lock<std::mutex> *lock) {
+    int level = PickCompactionLevel(*current_);
+    if (level < 0) {
+      return;
+    }
+    std::shared_ptr<const VersionType> version = current_;
+
+    // all of level 0, since its tables overlap, or one table of another
+    // level, taken round robin through the key space
+    typename VersionType::FileList inputs;
+    if (level == 0) {
+      inputs = version->GetFiles(0);
+    } else {
+      for (auto &file : version->GetFiles(level)) {
+        if (!has_compact_pointer_[level] ||
+            compact_pointer_[level] < file->GetSmallestKey()) {
+          inputs.push_back(file);
+          break;
+        }
+      }
+      if (inputs.empty()) {
+        inputs.push_back(version->GetFiles(level).front());
+      }
+    }
+    K smallest = inputs.front()->GetSmallestKey();
+    K largest = inputs.front()->GetLargestKey();
+    uint64_t sequence = 0;
+    for (auto &file : inputs) {
+      smallest = std::min(smallest, file->GetSmallestKey());
+      largest = std::max(largest, file->GetLargestKey());
+      sequence = std::max(sequence, file->table->GetSequence());
+    }
+    typename VersionType::FileList next_inputs;
+    version->GetOverlappingInputs(level + 1, smallest, largest, &next_inputs);
+    for (auto &file : next_inputs) {
+      sequence = std::max(sequence, file->table->GetSequence());
+    }
+    compact_pointer_[level] = largest;
+    has_compact_pointer_[level] = true;
+
+    Status s;
+    if (inputs.size() == 1 && next_inputs.empty()) {
+      // nothing to merge with, just move the table down
+      std::shared_ptr<VersionType> edited(new VersionType(*current_));
+      edited->RemoveFile(level, inputs.front()->number);
+      edited->AddFile(level + 1, inputs.front());
+      s = InstallVersion(lock, edited);
+      if (!s.ok()) {
+        bg_error_ = s;
+      }
+      return;
+    }
+
+    lock->unlock();
+    typename VersionType::FileList outputs;
+    s = DoCompactionWork(*version, level, inputs, next_inputs, sequence,
+                         &outputs);
+    lock->lock();
+
+    if (s.ok()) {
+      // flushes may have added tables to level 0 meanwhile, start from the
+      // current Version rather than the one compacted
+      std::shared_ptr<VersionType> edited(new VersionType(*current_));
+      for (auto &file : inputs) {
+        edited->RemoveFile(level, file->number);
+      }
+      for (auto &file : next_inputs) {
+        edited->RemoveFile(level + 1, file->number);
+      }
+      for (auto &file : outputs) {
+        edited->AddFile(level + 1, file);
+      }
+      s = InstallVersion(lock, edited);
+    }
+    if (s.ok()) {
+      // readers still holding the old Version keep the files open
+      for (auto &file : inputs) {
+        RemoveFile(TableFileName(dbname_, file->number));
+      }
+      for (auto &file : next_inputs) {
+        RemoveFile(TableFileName(dbname_, file->number));
+      }
+    } else {
+      for (auto &file : outputs) {
+        RemoveFile(TableFileName(dbname_, file->number));
+      }
+      if (!shutting_down_) {
+        bg_error_ = s;
+      }
+    }
+  }
+
+  /**
+   * @brief merge the input tables into new tables, keeping the newest entry
+   *        of every key. Runs without the lock
+   * @param version the Version the inputs belong to
+   * @param level the level compacted
+   * @param inputs the tables of that level, newest first
+   * @param next_inputs the overlapping tables of the next level
+   * @param sequence the largest sequence number in the inputs
+   * @param outputs where to store the new tables, for the next level
+   * @return OK on success, the error otherwise
+   */
+  Status DoCompactionWork(const VersionType &version, int level,
+                          const typename VersionType::FileList &inputs,
+                          const typename VersionType::FileList &next_inputs,
+                          uint64_t sequence,
+                          typename VersionType::FileList *outputs) {
+    std::vector<std::unique_ptr<Iterator<K, TaggedValue<V>>>> children;
+    for (auto &file : inputs) {
+      children.push_back(file->table->NewIterator());
+    }
+    for (auto &file : next_inputs) {
+      children.push_back(file->table->NewIterator());
+    }
+    MergingIterator<K, TaggedValue<V>> iter(std::move(children));
+
+    uint64_t number = 0;
+    std::unique_ptr<WritableFile> file;
+    std::unique_ptr<TableBuilder<K, TaggedValue<V>>> builder;
+    uint64_t charged = 0;
+    Status s;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+      if (has_imm_.load(std::memory_order_acquire)) {
+        // don't keep the writers waiting for the whole compaction
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (imm_ != nullptr) {
+          CompactMemTable(&lock);
+        }
+      }
+      if (shutting_down_) {
+        s = Status::IOError("DB is closing, compaction abandoned");
+        break;
+      }
+      TaggedValue<V> value = iter.GetValue();
+      if (value.type == ValueType::kDeletion &&
+          version.IsBaseLevelForKey(level + 1, iter.GetKey())) {
+        continue;  // nothing older left to shadow
+      }
+      if (builder == nullptr) {
+        {
+          std::lock_guard<std::mutex> guard(mutex_);
+          number = next_file_number_++;
+        }
+        s = WritableFile::Open(TableFileName(dbname_, number), true, &file);
+        if (!s.ok()) {
+          break;
+        }
+        builder.reset(new TableBuilder<K, TaggedValue<V>>(options_, file.get()));
+        charged = 0;
+      }
+      s = builder->Add(iter.GetKey(), value);
+      if (s.ok() && rate_limiter_ != nullptr) {
+        // charge the blocks written so far
+        rate_limiter_->Request(builder->GetFileSize() - charged);
+        charged = builder->GetFileSize();
+      }
+      if (s.ok() && builder->GetFileSize() >= options_.max_file_size) {
+        s = FinishCompactionOutput(number, sequence, &file, &builder, outputs);
+      }
+      if (!s.ok()) {
+        break;
+      }
+    }
+    if (s.ok()) {
+      s = iter.GetStatus();
+    }
+    if (s.ok() && builder != nullptr) {
+      s = FinishCompactionOutput(number, sequence, &file, &builder, outputs);
+    }
+    if (!s.ok() && file != nullptr) {
+      file->Close();
+      RemoveFile(TableFileName(dbname_, number));
+    }
+    return s;
+  }
+
+  /**
+   * @brief complete a table written by a compaction and open it
+   *        it becomes live once the manifest lists it
+   * @param number the file number of the table
+   * @param sequence the largest sequence number in the table
+   * @param file the table file, reset once closed
+   * @param builder the builder of the table, reset once finished
+   * @param outputs where to append the table
+   * @return OK on success, the error otherwise
+   */
+  Status FinishCompactionOutput(
+      uint64_t number, uint64_t sequence, std::unique_ptr<WritableFile> *file,
+      std::unique_ptr<TableBuilder<K, TaggedValue<V>>> *builder,
+      typename VersionType::FileList *outputs) {
+    Status s = (*builder)->Finish(sequence);
+    builder->reset();
+    if (s.ok()) {
+      s = (*file)->Sync();
+    }
+    Status close = (*file)->Close();
+    file->reset();
+    if (s.ok()) {
+      s = close;
+    }
+    std::unique_ptr<TableType> table;
+    if (s.ok()) {
+      s = TableType::Open(options_, TableFileName(dbname_, number), &table);
+    }
+    if (!s.ok()) {
+      RemoveFile(TableFileName(dbname_, number));
+      return s;
+    }
+    outputs->push_back(NewFileMeta(number, std::move(table)));
+    return Status::OK();
+  }
+
+  /**
+   * @brief record a new Version into the manifest, then publish it
+   *        only the background thread (or Recover) changes the Version, so
+   *        the lock can be released while the manifest is written
+   * @param lock the held lock
+   * @param version the new Version
+   * @return OK on success, the error otherwise
+   */
+  Status InstallVersion(std::unique_lock<std::mutex> *lock,
+                        const std::shared_ptr<const VersionType> &version) {
+    uint64_t number = next_file_number_++;
+    lock->unlock();
+    Status s = WriteManifest(*version, number);
+    lock->lock();
+    if (s.ok()) {
+      current_ = version;
+    }
+    return s;
+  }
+
+  /**
+   * @brief rewrite the manifest, under a temporary name renamed once durable
+   * @param version the tables to list
+   * @param number the file number of the temporary file
+   * @return OK on success, the error otherwise
+   */
+  Status WriteManifest(const VersionType &version, uint64_t number) {
+    std::string tmp = TempFileName(dbname_, number);
+    std::unique_ptr<WritableFile> file;
+    Status s = WritableFile::Open(tmp, true, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string record;
+    version.EncodeTo(&record);
+    log::Writer writer(file.get());
+    s = writer.AddRecord(record);
+    if (s.ok()) {
+      s = file->Sync();
+    }
+    Status close = file->Close();
+    if (s.ok()) {
+      s = close;
+    }
+    if (s.ok()) {
+      s = RenameFile(tmp, ManifestFileName(dbname_));
+    }
+    if (s.ok()) {
+      // also makes the new tables the manifest lists durable
+      s = SyncDir(dbname_);
+    }
+    if (!s.ok()) {
+      RemoveFile(tmp);
+    }
+    return s;
+  }
+
+  /**
+   * @brief read the manifest
+   * @param files where to store the (level, number) of every live table
+   * @return OK on success, the error otherwise
+   */
+  Status ReadManifest(std::vector<std::pair<int, uint64_t>> *files) {
+    std::string fname = ManifestFileName(dbname_);
+    std::unique_ptr<SequentialFile> file;
+    Status s = SequentialFile::Open(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    log::Reader reader(file.get());
+    std::string record;
+    if (!reader.ReadRecord(&record) || !VersionType::DecodeFrom(record, files)) {
+      return Status::Corruption(fname + ": malformed manifest");
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief describe a new live table
+   * @param number the file number of the table
+   * @param table the opened table
+   * @return the description
+   */
+  static std::shared_ptr<const FileMeta> NewFileMeta(
+      uint64_t number, std::shared_ptr<TableType> table) {
+    std::shared_ptr<FileMeta> file(new FileMeta());
+    file->number = number;
+    file->table = std::move(table);
+    return file;
+  }
+
+  /**
+   * @brief write the content of a MemTable into a new table file
+   *        it is written under a temporary name and renamed once durable, so
+   *        a crash never leaves a half-written table behind
+   * @param mem the MemTable, not written anymore
+   * @param number the file number of the table
+   * @param sequence the largest sequence number in the MemTable
+   * @param table where to store the opened table
+   * @return OK on success, the error otherwise
+   */
+  Status WriteTable(const MemTable<K, V> &mem, uint64_t number,
+                    uint64_t sequence, std::shared_ptr<TableType> *table) {
+    std::string tmp = TempFileName(dbname_, number);
+    std::string fname = TableFileName(dbname_, number);
+    std::unique_ptr<WritableFile> file;
+    Status s = WritableFile::Open(tmp, true, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    TableBuilder<K, TaggedValue<V>> builder(options_, file.get());
+    auto iter = mem.NewIterator();
+    for (iter->SeekToFirst(); iter->Valid() && s.ok(); iter->Next()) {
+      s = builder.Add(iter->GetKey(), iter->GetValue());
+    }
+    if (s.ok()) {
+      s = builder.Finish(sequence);
+    }
+    if (s.ok()) {
+      s = file->Sync();
+    }
+    Status close = file->Close();
+    if (s.ok()) {
+      s = close;
+    }
+    if (s.ok()) {
+      s = RenameFile(tmp, fname);
+    }
+    if (s.ok()) {
+      s = SyncDir(dbname_);
+    }
+    if (!s.ok()) {
+      RemoveFile(tmp);
+      return s;
+    }
+    std::unique_ptr<TableType> opened;
+    s = TableType::Open(options_, fname, &opened);
+    *table = std::move(opened);
+    return s;
+  }
+
+  /**
+   * @brief merge the MemTables and the tables into one Iterator
+   * @param mem where to keep the MemTable alive while iterating
+   * @param imm where to keep the immutable MemTable alive while iterating
+   * @param version where to keep the tables alive while iterating
+   * @return the Iterator, including the tombstones
+   */
+  std::unique_ptr<Iterator<K, TaggedValue<V>>> NewInternalIterator(
+      std::shared_ptr<MemTable<K, V>> *mem,
+      std::shared_ptr<MemTable<K, V>> *imm,
+      std::shared_ptr<const VersionType> *version) const {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      *mem = mem_;
+      *imm = imm_;
+      *version = current_;
+    }
+    std::vector<std::unique_ptr<Iterator<K, TaggedValue<V>>>> children;
+    children.push_back((*mem)->NewIterator());
+    if (*imm != nullptr) {
+      children.push_back((*imm)->NewIterator());
+    }
+    (*version)->AddIterators(&children);
+    return std::unique_ptr<Iterator<K, TaggedValue<V>>>(
+        new MergingIterator<K, TaggedValue<V>>(std::move(children)));
+  }
+
+  /**
+   * @brief open the tables listed in the manifest, replay the logs written
+   *        after them, flush the replayed content into a table and start a
+   *        new log. Runs before the background thread starts
+   * @return OK on success, the error otherwise
+   */
+  Status Recover() {
+    std::vector<std::string> filenames;
+    Status s = GetChildren(dbname_, &filenames);
+    if (!s.ok()) {
+      return s;
+    }
+    std::vector<uint64_t> logs;
+    std::vector<uint64_t> table_numbers;
+    bool has_manifest = false;
+    uint64_t max_number = 0;
+    for (auto &filename : filenames) {
+      uint64_t number;
+      FileType type = ParseFileName(filename, &number);
+      if (type == FileType::kLogFile) {
+        logs.push_back(number);
+      } else if (type == FileType::kTableFile) {
+        table_numbers.push_back(number);
+      } else if (type == FileType::kTempFile) {
+        RemoveFile(dbname_ + "/" + filename);  // an unfinished flush
+      } else if (type == FileType::kManifestFile) {
+        has_manifest = true;
+      }
+      if (type != FileType::kUnknown) {
+        max_number = std::max(max_number, number);
+      }
+    }
+    next_file_number_ = max_number + 1;
+
+    std::vector<std::pair<int, uint64_t>> live;
+    if (has_manifest) {
+      s = ReadManifest(&live);
+      if (!s.ok()) {
+        return s;
+      }
+    } else {
+      // no manifest yet, every table is a flushed one
+      for (auto number : table_numbers) {
+        live.emplace_back(0, number);
+      }
+    }
+    std::shared_ptr<VersionType> version(new VersionType());
+    for (auto &entry : live) {
+      std::unique_ptr<TableType> table;
+      s = TableType::Open(options_, TableFileName(dbname_, entry.second),
+                          &table);
+      if (!s.ok()) {
+        return s;
+      }
+      version->AddFile(entry.first, NewFileMeta(entry.second, std::move(table)));
+    }
+    for (auto number : table_numbers) {
+      if (std::find_if(live.begin(), live.end(),
+                       [number](const std::pair<int, uint64_t> &entry) {
+                         return entry.second == number;
+                       }) == live.end()) {
+        // the output of a flush or a compaction cut short
+        RemoveFile(TableFileName(dbname_, number));
+      }
+    }
+    current_ = version;
+    last_sequence_ = version->GetMaxSequence();
+
+    // the logs may still hold records flushed right before a crash
+    uint64_t flushed_sequence = last_sequence_;
+    std::sort(logs.begin(), logs.end());
+    for (auto number : logs) {
+      s = ReplayLog(LogFileName(dbname_, number), flushed_sequence);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (mem_->GetSize() > 0) {
+      s = FlushRecoveredMemTable();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+
+    logfile_number_ = next_file_number_++;
+    s = WritableFile::Open(LogFileName(dbname_, logfile_number_), true,
+                           &logfile_);
+    if (!s.ok()) {
+      return s;
+    }
+    log_.reset(new log::Writer(logfile_.get()));
+    s = WriteManifest(*current_, next_file_number_++);
+    if (!s.ok()) {
+      return s;
+    }
+    // everything in the old logs is in the tables now
+    for (auto number : logs) {
+      RemoveFile(LogFileName(dbname_, number));
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief apply the records of a log to the MemTable
+   *        consecutive records are folded into one big batch before being
+   *        applied, so the replay enjoys the sorted, finger-searched path of
+   *        SkipList::Write instead of a full search per operation
+   * @param fname the log file
+   * @param flushed_sequence records up to this sequence number are already
+   *        in the tables and skipped
+   * @return OK on success, the error otherwise
+   */
+  Status ReplayLog(const std::string &fname, uint64_t flushed_sequence) {
+    std::unique_ptr<SequentialFile> file;
+    Status s = SequentialFile::Open(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    log::Reader reader(file.get());
+    std::string record;
+    WriteBatch<K, V> batch;
+    WriteBatch<K, V> pending;
+    uint64_t pending_sequence = 0;
+    while (reader.ReadRecord(&record)) {
+      uint64_t sequence;
+      if (!batch.DecodeFrom(record, &sequence)) {
+        if (options_.paranoid_checks) {
+          return Status::Corruption(fname + ": malformed batch");
+        }
+        continue;
+      }
+      if (batch.Count() == 0 ||
+          sequence + batch.Count() - 1 <= flushed_sequence) {
+        continue;
+      }
+      if (pending.Count() == 0) {
+        pending_sequence = sequence;
+      }
+      pending.Append(batch);
+      last_sequence_ = std::max(last_sequence_, sequence + batch.Count() - 1);
+      if (pending.Count() >= kReplayBatchSize) {
+        mem_->Write(pending, pending_sequence);
+        pending.Clear();
+        if (mem_->ApproximateMemoryUsage() >= options_.write_buffer_size) {
+          s = FlushRecoveredMemTable();
+          if (!s.ok()) {
+            return s;
+          }
+        }
+      }
+    }
+    mem_->Write(pending, pending_sequence);
+    if (options_.paranoid_checks && !reader.GetStatus().ok()) {
+      return Status::Corruption(fname + ": " + reader.GetStatus().ToString());
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief flush the MemTable filled by the replay into a table of level 0,
+   *        and start a new MemTable, only used by Recover
+   * @return OK on success, the error otherwise
+   */
+  Status FlushRecoveredMemTable() {
+    uint64_t number = next_file_number_++;
+    std::shared_ptr<TableType> table;
+    Status s = WriteTable(*mem_, number, last_sequence_, &table);
+    if (!s.ok()) {
+      return s;
+    }
+    // the manifest is written once the recovery is over
+    std::shared_ptr<VersionType> version(new VersionType(*current_));
+    version->AddFile(0, NewFileMeta(number, table));
+    current_ = version;
+    mem_.reset(new MemTable<K, V>(options_.max_height));
+    return Status::OK();
+  }
+
+  /** the options of the DB */
+  const Options options_;
+  /** the DB directory */
+  const std::string dbname_;
+  /** the current log file */
+  std::unique_ptr<WritableFile> logfile_;
+  /** the writer of the current log file */
+  std::unique_ptr<log::Writer> log_;
+  /** bytes appended to the log since the last sync, leader only */
+  std::size_t unsynced_bytes_ = 0;
+  /** the encoding buffer of a log record, leader only */
+  std::string record_;
+  /** the background thread flushing and compacting */
+  std::thread bg_thread_;
+  /** throttles the compactions, nullptr if they are not limited */
+  std::unique_ptr<RateLimiter> rate_limiter_;
+  /** if imm_ is set, checked by a compaction without taking the lock */
+  std::atomic<bool> has_imm_{false};
+  /** if the DB is closing, set under the lock */
+  std::atomic<bool> shutting_down_{false};
+
+  /** protects the members below */
+  mutable std::mutex mutex_;
+  /** signaled when a flush is due, background work is done, or the DB is
+   *  closing */
+  std::condition_variable bg_cv_;
+  /** the MemTable taking the writes */
+  std::shared_ptr<MemTable<K, V>> mem_;
+  /** the frozen MemTable being flushed, nullptr if none */
+  std::shared_ptr<MemTable<K, V>> imm_;
+  /** the live tables, replaced as a whole on every change */
+  std::shared_ptr<const VersionType> current_;
+  /** if the background thread is flushing or compacting */
+  bool bg_busy_ = false;
+  /** where the last compaction of each level ended, background thread only */
+  K compact_pointer_[kNumLevels];
+  /** if a level has been compacted yet, background thread only */
+  bool has_compact_pointer_[kNumLevels] = {};
+  /** the file number of the current log */
+  uint64_t logfile_number_ = 0;
+  /** the file number of the log of the immutable MemTable */
+  uint64_t imm_log_number_ = 0;
+  /** the largest sequence number in the immutable MemTable */
+  uint64_t imm_sequence_ = 0;
+  /** the next file number to hand out */
+  uint64_t next_file_number_ = 1;
+  /** the writers waiting for their turn, the front one is the leader */
+  std::deque<PendingWriter *> writers_;
+  /** the batch a group is folded into */
+  WriteBatch<K, V> tmp_batch_;
+  /** the sequence number of the latest operation */
+  uint64_t last_sequence_ = 0;
+  /** the first error writing the log or a table, no write is accepted after */
+  Status bg_error_;
+};
+
+/**
+ * @brief delete a DB directory and everything in it
+ * @param dbname the DB directory
+ * @return OK on success, the error otherwise
+ */
+inline Status DestroyDB(const std::string &dbname) {
+  std::vector<std::string> filenames;
+  Status s = GetChildren(dbname, &filenames);
+  if (!s.ok()) {
+    return s.IsNotFound() ? Status::OK() : s;
+  }
+  for (auto &filename : filenames) {
+    uint64_t number;
+    if (ParseFileName(filename, &number) != FileType::kUnknown) {
+      Status remove = RemoveFile(dbname + "/" + filename);
+      if (s.ok() && !remove.ok()) {
+        s = remove;
+      }
+    }
+  }
+  ::rmdir(dbname.c_str());
+  return s;
+}
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * dbformat.h
+ * This is how a DB tells a value from a deletion once the SkipList acts as a
+ * memtable in front of table files: a deleted key can't simply be removed,
+ * since an older table might still hold it. Instead a deletion marker (a
+ * tombstone) is stored, shadowing the older values, the same role as
+ * leveldb's kTypeValue and kTypeDeletion.
+ *
+ * With multiple versions of a key kept side by side (see mvcc_skiplist.h),
+ * each one is stored under an InternalKey: the user key followed by a tag
+ * packing the sequence number of the write and its type, leveldb's memtable
+ * key format. InternalKeys order by user key, then by decreasing sequence
+ * number, so the newest version of a key comes first
+ */
+#ifndef KVSTORE_DBFORMAT_H
+#define KVSTORE_DBFORMAT_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+#include "coding.h"
+
+namespace kvstore {
+
+/**
+ * @brief if an entry is a value or a deletion marker
+ */
+enum class ValueType : uint8_t { kDeletion = 0, kValue = 1 };
+
+/** the sequence number of an operation, increasing with every write */
+using SequenceNumber = uint64_t;
+
+/** sequence numbers take 56 bits, leaving the low 8 bits of a tag to the type */
+static const SequenceNumber kMaxSequenceNumber = ((0x1ull << 56) - 1);
+
+/**
+ * @brief InternalKey is a version of a user key
+ * @tparam K user key type
+ */
+template <typename K>
+struct InternalKey {
+  /** the user key */
+  K user_key{};
+  /** sequence number << 8 | type */
+  uint64_t tag = 0;
+
+  InternalKey() = default;
+
+  /**
+   * @brief create an InternalKey
+   * @param key the user key
+   * @param sequence the sequence number, at most kMaxSequenceNumber
+   * @param type value or deletion
+   */
+  InternalKey(K key, SequenceNumber sequence, ValueType type)
+      : user_key(std::move(key)),
+        tag((sequence << 8) | static_cast<uint64_t>(type)) {}
+
+  /**
+   * @brief the sequence number of the version
+   * @return the sequence number
+   */
+  SequenceNumber GetSequence() const { return tag >> 8; }
+
+  /**
+   * @brief the type of the version
+   * @return value or deletion
+   */
+  ValueType GetType() const { return static_cast<ValueType>(tag & 0xff); }
+};
+
+/**
+ * @brief order InternalKeys by increasing user key, then decreasing tag
+ */
+template <typename K>
+inline bool operator<(const InternalKey<K> &lhs, const InternalKey<K> &rhs) {
+  if (lhs.user_key < rhs.user_key) {
+    return true;
+  }
+  if (rhs.user_key < lhs.user_key) {
+    return false;
+  }
+  return lhs.tag > rhs.tag;
+}
+
+template <typename K>
+inline bool operator==(const InternalKey<K> &lhs, const InternalKey<K> &rhs) {
+  return lhs.tag == rhs.tag && lhs.user_key == rhs.user_key;
+}
+
+template <typename K>
+inline bool operator!=(const InternalKey<K> &lhs, const InternalKey<K> &rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief TaggedValue is a value, or the marker of its deletion
+ * @tparam V value type
+ */
+template <typename V>
+struct TaggedValue {
+  /** value or deletion */
+  ValueType type = ValueType::kValue;
+  /** the value, default constructed for a deletion */
+  V value{};
+};
+
+/**
+ * @brief a tagged value is stored as its type byte, followed by the value
+ *        unless it is a deletion
+ */
+template <typename V>
+struct Coder<TaggedValue<V>> {
+  /**
+   * @brief append the encoding of a tagged value
+   * @param tagged the tagged value
+   * @param dst the string to append to
+   */
+  static void Encode(const TaggedValue<V> &tagged, std::string *dst) {
+    dst->push_back(static_cast<char>(tagged.type));
+    if (tagged.type == ValueType::kValue) {
+      Coder<V>::Encode(tagged.value, dst);
+    }
+  }
+
+  /**
+   * @brief parse a tagged value from a buffer
+   * @param p the start of the buffer
+   * @param limit the end of the buffer
+   * @param tagged where to store the tagged value
+   * @return pointer past the tagged value, nullptr if malformed or truncated
+   */
+  static const char *Decode(const char *p, const char *limit,
+                            TaggedValue<V> *tagged) {
+    if (p == limit) {
+      return nullptr;
+    }
+    auto type = static_cast<ValueType>(*p++);
+    tagged->type = type;
+    if (type == ValueType::kDeletion) {
+      tagged->value = V{};
+      return p;
+    }
+    if (type != ValueType::kValue) {
+      return nullptr;
+    }
+    return Coder<V>::Decode(p, limit, &tagged->value);
+  }
+};
+
+/**
+ * @brief how many bytes a key or value holds outside of its SkipNode
+ *        arithmetic types hold none
+ * @return the number of bytes on the heap
+ */
+template <typename T>
+inline std::size_t HeapSize(const T &) {
+  return 0;
+}
+
+/**
+ * @brief how many bytes a string holds outside of its SkipNode
+ * @param s the string
+ * @return the number of bytes on the heap
+ */
+inline std::size_t HeapSize(const std::string &s) { return s.size(); }
+}  // namespace kvstore
+
+#endif
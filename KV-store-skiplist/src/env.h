@@ -0,0 +1,523 @@
+/**
+ * env.h
+ * This is a thin layer over the POSIX file system calls, a much reduced
+ * version of leveldb's Env: sequential files for reading logs back, buffered
+ * writable files for appending to logs and tables, random access files for
+ * reading table blocks, memory-mapped files for reading snapshots in place,
+ * and a few directory helpers
+ */
+#ifndef KVSTORE_ENV_H
+#define KVSTORE_ENV_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "status.h"
+
+namespace kvstore {
+
+/**
+ * @brief translate the current errno into a Status
+ * @param context the file or operation that failed
+ * @param error_number the errno
+ * @return IOError Status, or NotFound if the file doesn't exist
+ */
+inline Status PosixError(const std::string &context, int error_number) {
+  if (error_number == ENOENT) {
+    return Status::NotFound(context + ": " + strerror(error_number));
+  }
+  return Status::IOError(context + ": " + strerror(error_number));
+}
+
+/**
+ * @brief SequentialFile reads a file from the beginning to the end
+ */
+class SequentialFile {
+ public:
+  /**
+   * @brief open a file for sequential reading
+   * @param fname the file name
+   * @param result where to store the opened file
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const std::string &fname,
+                     std::unique_ptr<SequentialFile> *result) {
+    int fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return PosixError(fname, errno);
+    }
+    result->reset(new SequentialFile(fname, fd));
+    return Status::OK();
+  }
+
+  ~SequentialFile() { ::close(fd_); }
+
+  SequentialFile(const SequentialFile &) = delete;
+  SequentialFile &operator=(const SequentialFile &) = delete;
+
+  /**
+   * @brief read up to n bytes, fewer only at the end of the file
+   * @param n how many bytes to read
+   * @param scratch buffer of at least n bytes to read into
+   * @param bytes_read where to store the number of bytes actually read
+   * @return OK on success, the error otherwise
+   */
+  Status Read(std::size_t n, char *scratch, std::size_t *bytes_read) {
+    *bytes_read = 0;
+    while (*bytes_read < n) {
+      ::ssize_t r = ::read(fd_, scratch + *bytes_read, n - *bytes_read);
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return PosixError(fname_, errno);
+      }
+      if (r == 0) {
+        break;  // end of file
+      }
+      *bytes_read += r;
+    }
+    return Status::OK();
+  }
+
+ private:
+  SequentialFile(const std::string &fname, int fd) : fname_(fname), fd_(fd) {}
+
+  /** the file name, for error messages */
+  std::string fname_;
+  /** the file descriptor */
+  int fd_;
+};
+
+/**
+ * @brief WritableFile appends to a file through a user space buffer
+ *        Flush hands the buffer to the OS, Sync makes it durable
+ */
+class WritableFile {
+ public:
+  /** the size of the user space buffer */
+  static const std::size_t kBufferSize = 65536;
+
+  /**
+   * @brief open a file for appending, created if missing
+   * @param fname the file name
+   * @param truncate if to drop the existing content
+   * @param result where to store the opened file
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const std::string &fname, bool truncate,
+                     std::unique_ptr<WritableFile> *result) {
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    if (truncate) {
+      flags |= O_TRUNC;
+    }
+    int fd = ::open(fname.c_str(), flags, 0644);
+    if (fd < 0) {
+      return PosixError(fname, errno);
+    }
+    result->reset(new WritableFile(fname, fd));
+    return Status::OK();
+  }
+
+  /**
+   * @brief flush the buffer and close the file, errors are ignored here
+   */
+  ~WritableFile() {
+    if (fd_ >= 0) {
+      Close();
+    }
+  }
+
+  WritableFile(const WritableFile &) = delete;
+  WritableFile &operator=(const WritableFile &) = delete;
+
+  /**
+   * @brief append data to the end of the file
+   * @param data the data
+   * @param n the length of the data
+   * @return OK on success, the error otherwise
+   */
+  Status Append(const char *data, std::size_t n) {
+    // fill the buffer as much as possible first
+    std::size_t copy = std::min(n, kBufferSize - pos_);
+    memcpy(buf_ + pos_, data, copy);
+    data += copy;
+    n -= copy;
+    pos_ += copy;
+    if (n == 0) {
+      return Status::OK();
+    }
+    Status s = Flush();
+    if (!s.ok()) {
+      return s;
+    }
+    // small leftover goes to the buffer, big one straight to the file
+    if (n < kBufferSize) {
+      memcpy(buf_, data, n);
+      pos_ = n;
+      return Status::OK();
+    }
+    return WriteUnbuffered(data, n);
+  }
+
+  /**
+   * @brief append a string to the end of the file
+   * @param data the data
+   * @return OK on success, the error otherwise
+   */
+  Status Append(const std::string &data) {
+    return Append(data.data(), data.size());
+  }
+
+  /**
+   * @brief hand the buffered data to the OS
+   * @return OK on success, the error otherwise
+   */
+  Status Flush() {
+    Status s = WriteUnbuffered(buf_, pos_);
+    pos_ = 0;
+    return s;
+  }
+
+  /**
+   * @brief make everything appended so far durable on the storage device
+   * @return OK on success, the error otherwise
+   */
+  Status Sync() {
+    Status s = Flush();
+    if (!s.ok()) {
+      return s;
+    }
+    if (::fdatasync(fd_) != 0) {
+      return PosixError(fname_, errno);
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief flush the buffer and close the file
+   * @return OK on success, the error otherwise
+   */
+  Status Close() {
+    Status s = Flush();
+    if (::close(fd_) < 0 && s.ok()) {
+      s = PosixError(fname_, errno);
+    }
+    fd_ = -1;
+    return s;
+  }
+
+ private:
+  WritableFile(const std::string &fname, int fd) : fname_(fname), fd_(fd) {}
+
+  /**
+   * @brief write data to the file, bypassing the buffer
+   * @param data the data
+   * @param n the length of the data
+   * @return OK on success, the error otherwise
+   */
+  Status WriteUnbuffered(const char *data, std::size_t n) {
+    while (n > 0) {
+      ::ssize_t r = ::write(fd_, data, n);
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return PosixError(fname_, errno);
+      }
+      data += r;
+      n -= r;
+    }
+    return Status::OK();
+  }
+
+  /** the file name, for error messages */
+  std::string fname_;
+  /** the file descriptor, -1 once closed */
+  int fd_;
+  /** the user space buffer */
+  char buf_[kBufferSize];
+  /** how many bytes of the buffer are in use */
+  std::size_t pos_ = 0;
+};
+
+/**
+ * @brief RandomAccessFile reads pieces of a file at given offsets
+ *        it is thread-safe, concurrent reads don't share a file position
+ */
+class RandomAccessFile {
+ public:
+  /**
+   * @brief open a file for random reading
+   * @param fname the file name
+   * @param result where to store the opened file
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const std::string &fname,
+                     std::unique_ptr<RandomAccessFile> *result) {
+    int fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return PosixError(fname, errno);
+    }
+    result->reset(new RandomAccessFile(fname, fd));
+    return Status::OK();
+  }
+
+  ~RandomAccessFile() { ::close(fd_); }
+
+  RandomAccessFile(const RandomAccessFile &) = delete;
+  RandomAccessFile &operator=(const RandomAccessFile &) = delete;
+
+  /**
+   * @brief read exactly n bytes starting at an offset
+   * @param offset where to start reading
+   * @param n how many bytes to read
+   * @param scratch buffer of at least n bytes to read into
+   * @return OK on success, Corruption if the file ends before, the error
+   *         otherwise
+   */
+  Status Read(uint64_t offset, std::size_t n, char *scratch) const {
+    std::size_t bytes_read = 0;
+    while (bytes_read < n) {
+      ::ssize_t r = ::pread(fd_, scratch + bytes_read, n - bytes_read,
+                            static_cast<off_t>(offset + bytes_read));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return PosixError(fname_, errno);
+      }
+      if (r == 0) {
+        return Status::Corruption(fname_ + ": unexpected end of file");
+      }
+      bytes_read += r;
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief the file name, for error messages
+   * @return the file name
+   */
+  const std::string &GetName() const { return fname_; }
+
+ private:
+  RandomAccessFile(const std::string &fname, int fd) : fname_(fname), fd_(fd) {}
+
+  /** the file name, for error messages */
+  std::string fname_;
+  /** the file descriptor */
+  int fd_;
+};
+
+/**
+ * @brief MmapReadableFile maps a whole file read-only into memory
+ *        the content is paged in lazily by the OS on first touch, so opening
+ *        is O(1) whatever the size of the file
+ */
+class MmapReadableFile {
+ public:
+  /**
+   * @brief map a file into memory
+   * @param fname the file name
+   * @param result where to store the mapped file
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const std::string &fname,
+                     std::unique_ptr<MmapReadableFile> *result) {
+    int fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return PosixError(fname, errno);
+    }
+    struct ::stat file_stat;
+    if (::fstat(fd, &file_stat) != 0) {
+      Status s = PosixError(fname, errno);
+      ::close(fd);
+      return s;
+    }
+    std::size_t size = file_stat.st_size;
+    void *base = nullptr;
+    if (size > 0) {
+      base = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (base == MAP_FAILED) {
+        Status s = PosixError(fname, errno);
+        ::close(fd);
+        return s;
+      }
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    result->reset(
+        new MmapReadableFile(fname, static_cast<const char *>(base), size));
+    return Status::OK();
+  }
+
+  ~MmapReadableFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  MmapReadableFile(const MmapReadableFile &) = delete;
+  MmapReadableFile &operator=(const MmapReadableFile &) = delete;
+
+  /**
+   * @brief the mapped content of the file
+   * @return pointer to the first byte, nullptr if the file is empty
+   */
+  const char *GetData() const { return data_; }
+
+  /**
+   * @brief the size of the file
+   * @return the size in bytes
+   */
+  std::size_t GetSize() const { return size_; }
+
+  /**
+   * @brief tell the OS the file is about to be read from the beginning to
+   *        the end, so it reads ahead aggressively and drops pages behind
+   */
+  void AdviseSequential() const {
+    if (data_ != nullptr) {
+      ::madvise(const_cast<char *>(data_), size_, MADV_SEQUENTIAL);
+    }
+  }
+
+  /**
+   * @brief tell the OS the file is read at random places, so it doesn't
+   *        waste I/O reading ahead of every page fault
+   */
+  void AdviseRandom() const {
+    if (data_ != nullptr) {
+      ::madvise(const_cast<char *>(data_), size_, MADV_RANDOM);
+    }
+  }
+
+  /**
+   * @brief the file name, for error messages
+   * @return the file name
+   */
+  const std::string &GetName() const { return fname_; }
+
+ private:
+  MmapReadableFile(const std::string &fname, const char *data,
+                   std::size_t size)
+      : fname_(fname), data_(data), size_(size) {}
+
+  /** the file name, for error messages */
+  std::string fname_;
+  /** the mapped content, nullptr if the file is empty */
+  const char *data_;
+  /** the size of the mapping */
+  std::size_t size_;
+};
+
+/**
+ * @brief create a directory, it is fine if it already exists
+ * @param dirname the directory name
+ * @return OK on success, the error otherwise
+ */
+inline Status CreateDir(const std::string &dirname) {
+  if (::mkdir(dirname.c_str(), 0755) != 0 && errno != EEXIST) {
+    return PosixError(dirname, errno);
+  }
+  return Status::OK();
+}
+
+/**
+ * @brief list the names of the entries in a directory
+ * @param dirname the directory name
+ * @param result where to store the names, without "." and ".."
+ * @return OK on success, the error otherwise
+ */
+inline Status GetChildren(const std::string &dirname,
+                          std::vector<std::string> *result) {
+  result->clear();
+  DIR *dir = ::opendir(dirname.c_str());
+  if (dir == nullptr) {
+    return PosixError(dirname, errno);
+  }
+  struct dirent *entry;
+  while ((entry = ::readdir(dir)) != nullptr) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..") {
+      result->push_back(name);
+    }
+  }
+  ::closedir(dir);
+  return Status::OK();
+}
+
+/**
+ * @brief delete a file
+ * @param fname the file name
+ * @return OK on success, the error otherwise
+ */
+inline Status RemoveFile(const std::string &fname) {
+  if (::unlink(fname.c_str()) != 0) {
+    return PosixError(fname, errno);
+  }
+  return Status::OK();
+}
+
+/**
+ * @brief rename a file, atomically replacing the target if it exists
+ * @param src the current file name
+ * @param target the new file name
+ * @return OK on success, the error otherwise
+ */
+inline Status RenameFile(const std::string &src, const std::string &target) {
+  if (::rename(src.c_str(), target.c_str()) != 0) {
+    return PosixError(src, errno);
+  }
+  return Status::OK();
+}
+
+/**
+ * @brief make the entries of a directory durable, e.g. after a rename
+ * @param dirname the directory name
+ * @return OK on success, the error otherwise
+ */
+inline Status SyncDir(const std::string &dirname) {
+  int fd = ::open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return PosixError(dirname, errno);
+  }
+  Status s;
+  if (::fsync(fd) != 0) {
+    s = PosixError(dirname, errno);
+  }
+  ::close(fd);
+  return s;
+}
+
+/**
+ * @brief the size of a file
+ * @param fname the file name
+ * @param size where to store the size in bytes
+ * @return OK on success, the error otherwise
+ */
+inline Status GetFileSize(const std::string &fname, uint64_t *size) {
+  struct ::stat file_stat;
+  if (::stat(fname.c_str(), &file_stat) != 0) {
+    *size = 0;
+    return PosixError(fname, errno);
+  }
+  *size = file_stat.st_size;
+  return Status::OK();
+}
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * epoch.h
+ * This is an epoch-based reclamation scheme, in the spirit of Fraser's and of
+ * crossbeam-epoch, for memory unlinked from a lock-free structure while
+ * readers might still be traversing it.
+ *
+ * A global epoch counter only moves forward. A thread pins itself before
+ * touching shared nodes, recording the epoch it saw, and unpins once it holds
+ * no pointer to them any more. The epoch may only advance from e to e + 1 when
+ * every pinned thread has seen e. A node is retired with the epoch read right
+ * after it was unlinked, and once the global epoch is two past it, any thread
+ * that could have reached the node has unpinned, so it can be freed. Writers
+ * pay one atomic store to pin and one to unpin, readers never wait.
+ *
+ * There is a single process-wide EpochManager, like the one crossbeam uses by
+ * default: each thread owns one record in it, released when the thread exits
+ */
+#ifndef KVSTORE_EPOCH_H
+#define KVSTORE_EPOCH_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace kvstore {
+
+/**
+ * @brief EpochManager keeps the global epoch and the epoch pinned by each
+ *        thread. All its methods are thread-safe
+ */
+class EpochManager {
+ public:
+  /**
+   * @brief the process-wide EpochManager
+   * @return the EpochManager, never destroyed
+   */
+  static EpochManager *Default() {
+    static EpochManager *manager = new EpochManager();
+    return manager;
+  }
+
+  EpochManager(const EpochManager &) = delete;
+  EpochManager &operator=(const EpochManager &) = delete;
+
+  /**
+   * @brief pin the calling thread at the current epoch, may be nested, only
+   *        the outermost call pins
+   */
+  void Enter() {
+    Record *record = LocalRecord();
+    if (record->depth++ > 0) {
+      return;
+    }
+    // pinning a stale epoch would only hold the epoch back, read it again to
+    // make sure it did not move before the pin became visible
+    uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+    while (true) {
+      record->epoch.store(epoch, std::memory_order_seq_cst);
+      uint64_t current = epoch_.load(std::memory_order_seq_cst);
+      if (current == epoch) {
+        break;
+      }
+      epoch = current;
+    }
+  }
+
+  /**
+   * @brief unpin the calling thread, requires a matching Enter
+   */
+  void Exit() {
+    Record *record = LocalRecord();
+    assert(record->depth > 0 && "Exit without Enter");
+    if (--record->depth == 0) {
+      record->epoch.store(kIdle, std::memory_order_release);
+    }
+  }
+
+  /**
+   * @brief if the calling thread is pinned
+   * @return true if pinned, false otherwise
+   */
+  bool IsPinned() { return LocalRecord()->depth > 0; }
+
+  /**
+   * @brief the current global epoch, to retire a node just unlinked with
+   * @return the epoch
+   */
+  uint64_t GetEpoch() const { return epoch_.load(std::memory_order_seq_cst); }
+
+  /**
+   * @brief advance the global epoch if every pinned thread has seen it, it
+   *        walks all the thread records, so it is meant to be called once
+   *        per batch of retired nodes
+   * @return the global epoch after the attempt
+   */
+  uint64_t TryAdvance() {
+    uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+    for (Record *record = records_.load(std::memory_order_acquire);
+         record != nullptr; record = record->next) {
+      uint64_t pinned = record->epoch.load(std::memory_order_seq_cst);
+      if (pinned != kIdle && pinned != epoch) {
+        return epoch;  // a thread is still pinned at an older epoch
+      }
+    }
+    epoch_.compare_exchange_strong(epoch, epoch + 1,
+                                   std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+
+  /**
+   * @brief if a node retired at an epoch can no longer be reached by any
+   *        pinned thread
+   * @param retired the epoch read right after the node was unlinked
+   * @return true if it could be freed, false otherwise
+   */
+  bool IsSafe(uint64_t retired) const { return GetEpoch() >= retired + 2; }
+
+ private:
+  /** the epoch of a thread that is not pinned */
+  static const uint64_t kIdle = 0;
+
+  /**
+   * @brief Record is the state of one thread, padded to its own cache line
+   *        so that pinning does not bounce the records of other threads.
+   *        Records are reused by later threads and never freed
+   */
+  struct Record {
+    /** the epoch this thread is pinned at, kIdle if not pinned */
+    std::atomic<uint64_t> epoch{kIdle};
+    /** if a live thread owns this record */
+    std::atomic<bool> in_use{true};
+    /** how many Enter calls are not exited yet, owner thread only */
+    int depth = 0;
+    /** the next record, fixed once published */
+    Record *next = nullptr;
+    /** keeps the next record off this cache line */
+    char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>) -
+                 sizeof(int) - sizeof(Record *)];
+  };
+
+  /**
+   * @brief LocalHandle ties a record to the lifetime of its thread
+   */
+  struct LocalHandle {
+    /** the record owned by this thread */
+    Record *record = nullptr;
+
+    /**
+     * @brief hand the record back once the thread exits
+     */
+    ~LocalHandle() {
+      if (record != nullptr) {
+        record->epoch.store(kIdle, std::memory_order_release);
+        record->in_use.store(false, std::memory_order_release);
+      }
+    }
+  };
+
+  /**
+   * @brief create the EpochManager, the epoch starts above kIdle
+   */
+  EpochManager() = default;
+
+  /**
+   * @brief the record of the calling thread, acquired on first use
+   * @return the record
+   */
+  Record *LocalRecord() {
+    static thread_local LocalHandle handle;
+    if (handle.record == nullptr) {
+      handle.record = AcquireRecord();
+    }
+    return handle.record;
+  }
+
+  /**
+   * @brief take over the record of an exited thread, or publish a new one
+   * @return the record, owned by the calling thread
+   */
+  Record *AcquireRecord() {
+    for (Record *record = records_.load(std::memory_order_acquire);
+         record != nullptr; record = record->next) {
+      bool in_use = false;
+      if (!record->in_use.load(std::memory_order_relaxed) &&
+          record->in_use.compare_exchange_strong(in_use, true,
+                                                 std::memory_order_acquire)) {
+        record->depth = 0;
+        return record;
+      }
+    }
+    Record *record = new Record();
+    record->next = records_.load(std::memory_order_relaxed);
+    while (!records_.compare_exchange_weak(record->next, record,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+    }
+    return record;
+  }
+
+  /** the global epoch, starts at 1 so that it never equals kIdle */
+  std::atomic<uint64_t> epoch_{1};
+  /** the records of all the threads ever pinned, newest first */
+  std::atomic<Record *> records_{nullptr};
+};
+
+/**
+ * @brief EpochGuard pins the calling thread for its scope, it must be
+ *        destroyed on the thread that created it
+ */
+class EpochGuard {
+ public:
+  /**
+   * @brief pin the calling thread
+   */
+  EpochGuard() : manager_(EpochManager::Default()) { manager_->Enter(); }
+
+  EpochGuard(const EpochGuard &) = delete;
+  EpochGuard &operator=(const EpochGuard &) = delete;
+
+  /**
+   * @brief unpin the calling thread
+   */
+  ~EpochGuard() { manager_->Exit(); }
+
+ private:
+  /** the EpochManager pinned */
+  EpochManager *manager_;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,808 @@
+/**
+ * fat_skiplist.h
+ * This is a cache-conscious variant of SkipList, a B-skiplist: instead of
+ * one SkipNode per key, each level is a linked list of fat nodes holding
+ * several sorted keys, 64 bytes of them, i.e. a cache line, so a search pays
+ * about one cache miss per node instead of one per key it steps over. A key
+ * of height h is in the nodes of levels 0 to h - 1, and at every level but
+ * its top one it is the first key of its node, where the entry of the key on
+ * the level above points down to. The heights are drawn with p = 2 / fanout,
+ * so a node holds about half a fanout of keys. A node that overflows is
+ * split in halves, the second half just hangs off the first, reached by
+ * moving right as in a SkipList. Leaf nodes, at level 0, hold the values.
+ *
+ * Inside a node, a search counts the keys smaller than the target instead of
+ * branching on each one: for integer keys under std::less the unused slots
+ * are padded with the largest key, and the count runs over the whole cache
+ * line with SSE2 or AVX2 compares of 32- and 64-bit keys when the compiler
+ * targets them, a plain loop otherwise. Any other key type or Comparator is
+ * binary searched in its node.
+ *
+ * Thread safety: keys move between nodes on splits and merges, so unlike
+ * SkipList readers cannot run without a lock. Writers (SkipInsert,
+ * SkipRemove) take a std::shared_mutex exclusively, readers (Get, Iterator,
+ * Scan) share it. An Iterator holds it for its whole lifetime, so a thread
+ * must not write while it has an Iterator open.
+ *
+ * Keys and values must be default constructible, a node holds arrays of them.
+ */
+#ifndef KVSTORE_FAT_SKIPLIST_H
+#define KVSTORE_FAT_SKIPLIST_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace kvstore {
+
+/**
+ * @brief FatNode is a node of one level of a FatSkipList: up to kFanout
+ *        sorted keys, each with a payload, a value in a leaf node and the
+ *        node below in an inner node. The keys come first, on their own
+ *        cache lines
+ * @tparam K key type
+ * @tparam Payload the value type, or a pointer to the node below
+ * @tparam kFanout the capacity of the node
+ */
+template <typename K, typename Payload, int kFanout>
+struct alignas(64) FatNode {
+  /** the keys, sorted, the first count slots are in use */
+  K keys[kFanout];
+  /** how many keys are in use */
+  int count = 0;
+  /** if this is the head node of its level, whose first key is a sentinel
+   *  smaller than any key */
+  bool head = false;
+  /** the next node on the same level */
+  FatNode *next = nullptr;
+  /** the payload of each key */
+  Payload payload[kFanout];
+};
+
+/**
+ * @brief FatSkipList is a B-skiplist with the interface of SkipList
+ * @tparam K key type
+ * @tparam V value type
+ * @tparam Comparator the less-than ordering of the keys, as in SkipList
+ * @tparam kKeyBytes how many bytes of keys a node holds, 64 or 128 for one or
+ *         two cache lines, at least 8 keys either way
+ */
+template <typename K, typename V, typename Comparator = std::less<>,
+          std::size_t kKeyBytes = 64>
+class FatSkipList {
+ public:
+  /** how many keys fit in a node */
+  static constexpr int kFanout =
+      static_cast<int>(std::max<std::size_t>(8, kKeyBytes / sizeof(K)));
+
+  /** the maximum number of levels */
+  static constexpr int kMaxHeight = 20;
+
+ private:
+  using Leaf = FatNode<K, V, kFanout>;
+  using Inner = FatNode<K, void *, kFanout>;
+
+  /** if the keys are integers ordered by <, searched with vector compares
+   *  over a whole node padded with the largest key */
+  static constexpr bool kVectorKeys =
+      std::is_integral_v<K> && (std::is_same_v<Comparator, std::less<>> ||
+                                std::is_same_v<Comparator, std::less<K>>);
+
+ public:
+  /**
+   * @brief Iterator walks the key-value pairs in key order, over the leaf
+   *        nodes. It holds the read lock of the list for its whole lifetime
+   */
+  class Iterator {
+   public:
+    /**
+     * @brief create an Iterator over the list, initially not Valid
+     * @param list the FatSkipList to iterate, must outlive the Iterator
+     */
+    explicit Iterator(const FatSkipList *list)
+        : list_(list), lock_(list->mutex_) {}
+
+    /**
+     * @brief if the Iterator is positioned at a key-value pair
+     * @return true if positioned, false otherwise
+     */
+    bool Valid() const { return node_ != nullptr; }
+
+    /**
+     * @brief the key at the current position, requires Valid()
+     * @return key
+     */
+    const K &GetKey() const { return node_->keys[index_]; }
+
+    /**
+     * @brief the value at the current position, requires Valid()
+     * @return value
+     */
+    const V &GetValue() const { return node_->payload[index_]; }
+
+    /**
+     * @brief advance to the next key-value pair, requires Valid()
+     */
+    void Next() {
+      index_++;
+      Settle();
+    }
+
+    /**
+     * @brief position at the first key-value pair with key >= target
+     * @param target the key to seek
+     * @tparam Q K, or any key type a transparent Comparator compares with K
+     */
+    template <typename Q>
+    void Seek(const Q &target) {
+      int index;
+      node_ = list_->template FindLeaf<false>(target, &index, nullptr);
+      index_ = index + 1;
+      Settle();
+    }
+
+    /**
+     * @brief position at the smallest key
+     */
+    void SeekToFirst() {
+      node_ = static_cast<const Leaf *>(list_->heads_[0]);
+      index_ = 1;
+      Settle();
+    }
+
+   private:
+    /**
+     * @brief move on to the next leaf while past the last key of the node
+     */
+    void Settle() {
+      while (node_ != nullptr && index_ >= node_->count) {
+        node_ = node_->next;
+        index_ = 0;
+      }
+    }
+
+    /** the FatSkipList being iterated */
+    const FatSkipList *list_;
+    /** the read lock, held while the Iterator lives */
+    std::shared_lock<std::shared_mutex> lock_;
+    /** the current leaf, nullptr if not Valid */
+    const Leaf *node_ = nullptr;
+    /** the position in the current leaf */
+    int index_ = 0;
+  };
+
+  /**
+   * @brief create an empty FatSkipList
+   * @param compare the ordering of the keys
+   */
+  explicit FatSkipList(const Comparator &compare = Comparator())
+      : compare_(compare) {
+    heads_[0] = NewNode<Leaf>(true);
+  }
+
+  FatSkipList(const FatSkipList &) = delete;
+  FatSkipList &operator=(const FatSkipList &) = delete;
+
+  ~FatSkipList() {
+    for (int level = 0; level < height_; level++) {
+      if (level == 0) {
+        FreeLevel(static_cast<Leaf *>(heads_[0]));
+      } else {
+        FreeLevel(static_cast<Inner *>(heads_[level]));
+      }
+    }
+  }
+
+  /**
+   * @brief insert a key-value pair, copying them
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(const K &key, const V &value) {
+    return InsertImpl(K(key), V(value));
+  }
+
+  /**
+   * @brief insert a key-value pair, moving them
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(K &&key, V &&value) {
+    return InsertImpl(std::move(key), std::move(value));
+  }
+
+  /**
+   * @brief remove a key, merging its node into the previous one if they fit
+   * @param key the key
+   * @return true if removal is successful, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool SkipRemove(const Q &key) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    // the last node at each level whose first key is smaller than the key,
+    // the key is either in it or the first key of the next node
+    void *preds[kMaxHeight];
+    void *node = heads_[height_ - 1];
+    for (int level = height_ - 1; level > 0; level--) {
+      Inner *inner = MoveRight<false>(static_cast<Inner *>(node), key, nullptr);
+      preds[level] = inner;
+      node = inner->payload[FindIndex<false>(inner, key)];
+    }
+    preds[0] = MoveRight<false>(static_cast<Leaf *>(node), key, nullptr);
+
+    if (!RemoveFrom(static_cast<Leaf *>(preds[0]), key)) {
+      return false;
+    }
+    for (int level = 1; level < height_; level++) {
+      if (!RemoveFrom(static_cast<Inner *>(preds[level]), key)) {
+        break;
+      }
+    }
+    // drop the levels left with their sentinel only
+    while (height_ > 1) {
+      Inner *top = static_cast<Inner *>(heads_[height_ - 1]);
+      if (top->count > 1 || top->next != nullptr) {
+        break;
+      }
+      FreeNode(top);
+      heads_[--height_] = nullptr;
+    }
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief look up a key and copy its value
+   * @param key the key
+   * @param value where to store the value, untouched if not found
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool Get(const Q &key, V *value) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    int index;
+    const Leaf *leaf = FindLeaf<true>(key, &index, nullptr);
+    if (!IsKeyAt(leaf, index, key)) {
+      return false;
+    }
+    *value = leaf->payload[index];
+    return true;
+  }
+
+  /**
+   * @brief if a key is present
+   * @param key the key
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool Contains(const Q &key) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    int index;
+    const Leaf *leaf = FindLeaf<true>(key, &index, nullptr);
+    return IsKeyAt(leaf, index, key);
+  }
+
+  /**
+   * @brief visit every key-value pair with lo <= key < hi in key order
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
+   */
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t Scan(const Lo &lo, const Hi &hi, Callback &&callback) const {
+    std::size_t count = 0;
+    Iterator iter(this);
+    for (iter.Seek(lo); iter.Valid() && compare_(iter.GetKey(), hi);
+         iter.Next()) {
+      count++;
+      if (!callback(iter.GetKey(), iter.GetValue())) {
+        break;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief how many nodes a search for a key visits, each one a cache line
+   *        of keys, the counterpart of SkipList::GetSearchPathLength
+   * @param key the key for search
+   * @return the number of nodes
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  std::size_t GetSearchPathLength(const Q &key) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::size_t visited = 0;
+    int index;
+    FindLeaf<true>(key, &index, &visited);
+    return visited;
+  }
+
+  /**
+   * @brief the number of levels in use
+   * @return the height of the tallest key
+   */
+  int GetHeight() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return height_;
+  }
+
+  /**
+   * @brief return how many key-value pair are present in the FatSkipList
+   * @return the number of key-value pairs
+   */
+  std::size_t GetSize() const { return size_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief the memory held by the nodes, not counting what keys and values
+   *        allocate themselves
+   * @return the number of bytes
+   */
+  std::size_t ApproximateMemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /**
+   * @brief allocate an empty node, its key slots padded
+   * @param head if it is the head node of its level
+   * @return the node
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node>
+  Node *NewNode(bool head) {
+    Node *node = new Node;
+    node->head = head;
+    if constexpr (kVectorKeys) {
+      std::fill(node->keys, node->keys + kFanout, std::numeric_limits<K>::max());
+      if (head) {
+        node->keys[0] = std::numeric_limits<K>::min();
+      }
+    }
+    if (head) {
+      node->count = 1;
+    }
+    memory_usage_.fetch_add(sizeof(Node), std::memory_order_relaxed);
+    return node;
+  }
+
+  /**
+   * @brief free a node
+   * @param node the node
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node>
+  void FreeNode(Node *node) {
+    memory_usage_.fetch_sub(sizeof(Node), std::memory_order_relaxed);
+    delete node;
+  }
+
+  /**
+   * @brief free a whole level
+   * @param node the head node of the level
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node>
+  void FreeLevel(Node *node) {
+    while (node != nullptr) {
+      Node *next = node->next;
+      FreeNode(node);
+      node = next;
+    }
+  }
+
+  /**
+   * @brief count the keys of a padded node smaller than a target, or smaller
+   *        or equal, comparing the whole node at once
+   * @param keys the keys of the node
+   * @param target the target
+   * @return the count, the padding included when the target is the largest
+   *         key
+   * @tparam kOrEqual if to count the keys equal to the target as well
+   */
+  template <bool kOrEqual>
+  static int CountSmaller(const K *keys, K target) {
+#if defined(__AVX2__)
+    if constexpr (sizeof(K) == 4 && std::is_signed_v<K> && kFanout % 8 == 0) {
+      __m256i t = _mm256_set1_epi32(target);
+      int count = 0;
+      for (int i = 0; i < kFanout; i += 8) {
+        __m256i k =
+            _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+        __m256i m = kOrEqual ? _mm256_cmpgt_epi32(k, t) : _mm256_cmpgt_epi32(t, k);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+      }
+      return kOrEqual ? kFanout - count : count;
+    }
+    if constexpr (sizeof(K) == 8 && std::is_signed_v<K> && kFanout % 4 == 0) {
+      __m256i t = _mm256_set1_epi64x(target);
+      int count = 0;
+      for (int i = 0; i < kFanout; i += 4) {
+        __m256i k =
+            _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+        __m256i m = kOrEqual ? _mm256_cmpgt_epi64(k, t) : _mm256_cmpgt_epi64(t, k);
+        count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+      }
+      return kOrEqual ? kFanout - count : count;
+    }
+#endif
+#if defined(__SSE2__)
+    if constexpr (sizeof(K) == 4 && std::is_signed_v<K> && kFanout % 4 == 0) {
+      __m128i t = _mm_set1_epi32(target);
+      int count = 0;
+      for (int i = 0; i < kFanout; i += 4) {
+        __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(keys + i));
+        __m128i m = kOrEqual ? _mm_cmpgt_epi32(k, t) : _mm_cmpgt_epi32(t, k);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+      }
+      return kOrEqual ? kFanout - count : count;
+    }
+#endif
+    // branch-free, so the compiler is free to vectorize it
+    int count = 0;
+    for (int i = 0; i < kFanout; i++) {
+      count += kOrEqual ? !(target < keys[i]) : keys[i] < target;
+    }
+    return count;
+  }
+
+  /**
+   * @brief the index of the last key of a node smaller than a target, or
+   *        smaller or equal, the sentinel of a head node being smaller than
+   *        any target. Moving right made sure there is one
+   * @param node the node
+   * @param target the target
+   * @return the index
+   * @tparam kOrEqual if a key equal to the target qualifies
+   * @tparam Node Leaf or Inner
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <bool kOrEqual, typename Node, typename Q>
+  int FindIndex(const Node *node, const Q &target) const {
+    if constexpr (kVectorKeys && std::is_same_v<Q, K>) {
+      int count = std::min(CountSmaller<kOrEqual>(node->keys, target),
+                           node->count);
+      // only a head node, for the smallest key, counts no key at all
+      return std::max(count - 1, 0);
+    } else {
+      const K *first = node->keys + (node->head ? 1 : 0);
+      const K *last = node->keys + node->count;
+      const K *bound;
+      if (kOrEqual) {
+        bound = std::upper_bound(
+            first, last, target,
+            [this](const Q &t, const K &key) { return compare_(t, key); });
+      } else {
+        bound = std::lower_bound(
+            first, last, target,
+            [this](const K &key, const Q &t) { return compare_(key, t); });
+      }
+      return static_cast<int>(bound - node->keys) - 1;
+    }
+  }
+
+  /**
+   * @brief move right along a level while the first key of the next node is
+   *        smaller than a target, or smaller or equal
+   * @param node where to start
+   * @param target the target
+   * @param visited if not nullptr, incremented for every node visited
+   * @return the node the target belongs to
+   * @tparam kOrEqual if a first key equal to the target moves right
+   * @tparam Node Leaf or Inner
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <bool kOrEqual, typename Node, typename Q>
+  Node *MoveRight(Node *node, const Q &target, std::size_t *visited) const {
+    if (visited != nullptr) {
+      (*visited)++;
+    }
+    while (node->next != nullptr &&
+           (kOrEqual ? !compare_(target, node->next->keys[0])
+                     : compare_(node->next->keys[0], target))) {
+      node = node->next;
+      if (visited != nullptr) {
+        (*visited)++;
+      }
+    }
+    return node;
+  }
+
+  /**
+   * @brief descend to the leaf node a target belongs to
+   * @param target the target
+   * @param index set to the index of the last key of the leaf smaller than
+   *        the target, or smaller or equal
+   * @param visited if not nullptr, incremented for every node visited
+   * @return the leaf node
+   * @tparam kOrEqual if a key equal to the target qualifies
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <bool kOrEqual, typename Q>
+  const Leaf *FindLeaf(const Q &target, int *index,
+                       std::size_t *visited) const {
+    void *node = heads_[height_ - 1];
+    for (int level = height_ - 1; level > 0; level--) {
+      const Inner *inner =
+          MoveRight<kOrEqual>(static_cast<const Inner *>(node), target, visited);
+      node = inner->payload[FindIndex<kOrEqual>(inner, target)];
+    }
+    const Leaf *leaf =
+        MoveRight<kOrEqual>(static_cast<const Leaf *>(node), target, visited);
+    *index = FindIndex<kOrEqual>(leaf, target);
+    return leaf;
+  }
+
+  /**
+   * @brief if the key at an index of a node is a target, found by FindIndex
+   *        with kOrEqual, so it is not greater than the target
+   * @param node the node
+   * @param index the index
+   * @param target the target
+   * @return true if equal, false otherwise
+   * @tparam Node Leaf or Inner
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Node, typename Q>
+  bool IsKeyAt(const Node *node, int index, const Q &target) const {
+    return !(node->head && index == 0) &&
+           !compare_(node->keys[index], target);
+  }
+
+  /**
+   * @brief reset the slots of a node past its last key, releasing what the
+   *        keys and values held and padding the keys
+   * @param node the node
+   * @param from the first slot to reset
+   * @param to one past the last slot to reset
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node>
+  static void ClearSlots(Node *node, int from, int to) {
+    using Payload = std::remove_reference_t<decltype(node->payload[0])>;
+    for (int i = from; i < to; i++) {
+      if constexpr (kVectorKeys) {
+        node->keys[i] = std::numeric_limits<K>::max();
+      } else {
+        node->keys[i] = K();
+      }
+      node->payload[i] = Payload();
+    }
+  }
+
+  /**
+   * @brief insert a key into a node with room for it
+   * @param node the node
+   * @param index where to insert it
+   * @param key the key
+   * @param payload its payload
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node, typename Payload>
+  static void InsertAt(Node *node, int index, K &&key, Payload &&payload) {
+    assert(node->count < kFanout);
+    std::move_backward(node->keys + index, node->keys + node->count,
+                       node->keys + node->count + 1);
+    std::move_backward(node->payload + index, node->payload + node->count,
+                       node->payload + node->count + 1);
+    node->keys[index] = std::move(key);
+    node->payload[index] = std::forward<Payload>(payload);
+    node->count++;
+  }
+
+  /**
+   * @brief move the keys of a node from an index on to the end of another
+   *        node with room for them
+   * @param from the node giving the keys
+   * @param index the first key to move
+   * @param to the node taking the keys
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node>
+  static void MoveKeys(Node *from, int index, Node *to) {
+    assert(to->count + from->count - index <= kFanout);
+    std::move(from->keys + index, from->keys + from->count,
+              to->keys + to->count);
+    std::move(from->payload + index, from->payload + from->count,
+              to->payload + to->count);
+    to->count += from->count - index;
+    ClearSlots(from, index, from->count);
+    from->count = index;
+  }
+
+  /**
+   * @brief link a new node after another one, taking its keys from an index
+   *        on
+   * @param node the node to split
+   * @param index the first key of the new node
+   * @return the new node
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node>
+  Node *Split(Node *node, int index) {
+    Node *next = NewNode<Node>(false);
+    MoveKeys(node, index, next);
+    next->next = node->next;
+    node->next = next;
+    return next;
+  }
+
+  /**
+   * @brief insert a new key into a level
+   * @param node the node holding the last key smaller than the key
+   * @param index the index of that key
+   * @param key the key
+   * @param payload its payload
+   * @param first if the key must start its own node, being taller
+   * @return the node the key went into
+   * @tparam Node Leaf or Inner
+   */
+  template <typename Node, typename Payload>
+  Node *InsertInto(Node *node, int index, K &&key, Payload &&payload,
+                   bool first) {
+    index++;
+    if (first) {
+      // the keys after it are not taller, so the new node fits them
+      Node *next = Split(node, index);
+      InsertAt(next, 0, std::move(key), std::forward<Payload>(payload));
+      return next;
+    }
+    if (node->count == kFanout) {
+      // only the first key of a node may be taller, not the moved ones
+      Node *next = Split(node, kFanout / 2);
+      if (index >= kFanout / 2) {
+        node = next;
+        index -= kFanout / 2;
+      }
+    }
+    InsertAt(node, index, std::move(key), std::forward<Payload>(payload));
+    return node;
+  }
+
+  /**
+   * @brief remove a key from a level
+   * @param pred the last node of the level whose first key is smaller than
+   *        the key
+   * @param key the key
+   * @return true if the key was on the level, false otherwise
+   * @tparam Node Leaf or Inner
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Node, typename Q>
+  bool RemoveFrom(Node *pred, const Q &key) {
+    int index = FindIndex<false>(pred, key) + 1;
+    Node *node = pred;
+    if (index == pred->count) {
+      node = pred->next;
+      index = 0;
+    }
+    if (node == nullptr || index >= node->count ||
+        compare_(key, node->keys[index])) {
+      return false;
+    }
+    std::move(node->keys + index + 1, node->keys + node->count,
+              node->keys + index);
+    std::move(node->payload + index + 1, node->payload + node->count,
+              node->payload + index);
+    node->count--;
+    ClearSlots(node, node->count, node->count + 1);
+    if (node != pred && pred->count + node->count <= kFanout) {
+      // the key started the node, the rest are not taller and nothing above
+      // points to them, so they can join the previous node
+      MoveKeys(node, 0, pred);
+      pred->next = node->next;
+      FreeNode(node);
+    }
+    return true;
+  }
+
+  /**
+   * @brief insert a key-value pair, or replace the value of the key
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool InsertImpl(K &&key, V &&value) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    // the node at each level holding the last key smaller or equal
+    void *preds[kMaxHeight];
+    int indexes[kMaxHeight];
+    void *node = heads_[height_ - 1];
+    for (int level = height_ - 1; level > 0; level--) {
+      Inner *inner = MoveRight<true>(static_cast<Inner *>(node), key, nullptr);
+      preds[level] = inner;
+      indexes[level] = FindIndex<true>(inner, key);
+      node = inner->payload[indexes[level]];
+    }
+    Leaf *leaf = MoveRight<true>(static_cast<Leaf *>(node), key, nullptr);
+    int index = FindIndex<true>(leaf, key);
+    if (IsKeyAt(leaf, index, key)) {
+      leaf->payload[index] = std::move(value);
+      return false;
+    }
+
+    int height = RandomHeight();
+    for (; height_ < height; height_++) {
+      Inner *head = NewNode<Inner>(true);
+      head->payload[0] = heads_[height_ - 1];
+      heads_[height_] = head;
+      preds[height_] = head;
+      indexes[height_] = 0;
+    }
+    // bottom-up, each level points down to the node the key starts below
+    void *below = InsertInto(leaf, index, K(key), std::move(value), height > 1);
+    for (int level = 1; level < height; level++) {
+      below = InsertInto(static_cast<Inner *>(preds[level]), indexes[level],
+                         K(key), below, level < height - 1);
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief pick a random height, each level above the first with a 2 in
+   *        kFanout chance, so a node holds about kFanout / 2 keys
+   * @return the height, between 1 and kMaxHeight
+   */
+  static int RandomHeight() {
+    int height = 1;
+    while (height < kMaxHeight && NextRandom() % (kFanout / 2) == 0) {
+      height++;
+    }
+    return height;
+  }
+
+  /**
+   * @brief the next number of a xorshift64 generator, one per thread
+   * @return a random 64-bit word
+   */
+  static uint64_t NextRandom() {
+    static thread_local uint64_t state =
+        0x9e3779b97f4a7c15ull ^
+        reinterpret_cast<uintptr_t>(&state);  // distinct for each thread
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  /** the ordering of the keys */
+  Comparator compare_;
+
+  /** writers hold it exclusively, readers share it */
+  mutable std::shared_mutex mutex_;
+
+  /** the head node of each level in use, a Leaf at level 0 and Inner above */
+  void *heads_[kMaxHeight] = {};
+
+  /** the number of levels in use */
+  int height_ = 1;
+
+  /** the number of key-value pairs */
+  std::atomic<std::size_t> size_{0};
+
+  /** the bytes of all the nodes */
+  std::atomic<std::size_t> memory_usage_{0};
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * filename.h
+ * This is the naming scheme of the files inside a DB directory, following
+ * leveldb's: every file carries a number that only ever grows, e.g.
+ * dbname/000012.log is a write-ahead log, dbname/000011.sst is a table file
+ * and dbname/000011.tmp is a file being written. dbname/MANIFEST lists the
+ * live table files and their levels
+ */
+#ifndef KVSTORE_FILENAME_H
+#define KVSTORE_FILENAME_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+namespace kvstore {
+
+/**
+ * @brief the kinds of files in a DB directory
+ */
+enum class FileType {
+  kLogFile,
+  kTableFile,
+  kTempFile,
+  kManifestFile,
+  kUnknown
+};
+
+/**
+ * @brief build the name of a numbered file
+ * @param dbname the DB directory
+ * @param number the file number
+ * @param suffix the file extension
+ * @return the full file name
+ */
+inline std::string MakeFileName(const std::string &dbname, uint64_t number,
+                                const char *suffix) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "/%06llu.%s",
+           static_cast<unsigned long long>(number), suffix);
+  return dbname + buf;
+}
+
+/**
+ * @brief the name of a write-ahead log
+ * @param dbname the DB directory
+ * @param number the file number
+ * @return the full file name
+ */
+inline std::string LogFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "log");
+}
+
+/**
+ * @brief the name of a table file, an immutable sorted run
+ * @param dbname the DB directory
+ * @param number the file number
+ * @return the full file name
+ */
+inline std::string TableFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "sst");
+}
+
+/**
+ * @brief the name of a file being written, renamed once complete
+ * @param dbname the DB directory
+ * @param number the file number
+ * @return the full file name
+ */
+inline std::string TempFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "tmp");
+}
+
+/**
+ * @brief the name of the manifest, the list of the live table files
+ * @param dbname the DB directory
+ * @return the full file name
+ */
+inline std::string ManifestFileName(const std::string &dbname) {
+  return dbname + "/MANIFEST";
+}
+
+/**
+ * @brief recognize a file inside a DB directory
+ * @param filename the file name without the directory
+ * @param number where to store the file number
+ * @return the kind of file, kUnknown if it isn't one of ours
+ */
+inline FileType ParseFileName(const std::string &filename, uint64_t *number) {
+  if (filename == "MANIFEST") {
+    *number = 0;
+    return FileType::kManifestFile;
+  }
+  std::size_t dot = filename.find('.');
+  if (dot == 0 || dot == std::string::npos) {
+    return FileType::kUnknown;
+  }
+  uint64_t result = 0;
+  for (std::size_t i = 0; i < dot; i++) {
+    char c = filename[i];
+    if (c < '0' || c > '9') {
+      return FileType::kUnknown;
+    }
+    result = result * 10 + (c - '0');
+  }
+  std::string suffix = filename.substr(dot + 1);
+  *number = result;
+  if (suffix == "log") {
+    return FileType::kLogFile;
+  }
+  if (suffix == "sst") {
+    return FileType::kTableFile;
+  }
+  if (suffix == "tmp") {
+    return FileType::kTempFile;
+  }
+  return FileType::kUnknown;
+}
+}  // namespace kvstore
+
+#endif
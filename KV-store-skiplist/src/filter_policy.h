@@ -0,0 +1,232 @@
+/**
+ * filter_policy.h
+ * This is the policy building a small summary (a filter) of the keys of a
+ * table file, following leveldb's FilterPolicy. A filter answers "maybe" or
+ * "definitely not" for a key, so a lookup for a key missing from a table is
+ * answered from the filter kept in memory instead of reading a data block.
+ *
+ * BloomFilterPolicy is leveldb's Bloom filter: bits_per_key bits per key and
+ * k = bits_per_key * ln2 probes generated by double hashing, i.e. from one
+ * hash h and a delta, the i-th probe is bit (h + i * delta) % bits. The
+ * number of probes is stored in the last byte of the filter, so filters built
+ * with different settings remain readable
+ */
+#ifndef KVSTORE_FILTER_POLICY_H
+#define KVSTORE_FILTER_POLICY_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "port.h"
+
+namespace kvstore {
+
+/**
+ * @brief FilterPolicy builds and probes the filters of the table files
+ *        implementations must be thread-safe
+ */
+class FilterPolicy {
+ public:
+  virtual ~FilterPolicy() = default;
+
+  /**
+   * @brief the name of the policy
+   * @return the name
+   */
+  virtual const char *Name() const = 0;
+
+  /**
+   * @brief append a filter summarizing a list of keys
+   * @param keys the encoded keys, duplicates are allowed
+   * @param n how many keys
+   * @param dst the string to append the filter to
+   */
+  virtual void CreateFilter(const std::string *keys, int n,
+                            std::string *dst) const = 0;
+
+  /**
+   * @brief probe a filter built by CreateFilter
+   * @param key the encoded key
+   * @param filter the filter
+   * @return false if the key was definitely not in the list, true if it
+   *         may have been
+   */
+  virtual bool KeyMayMatch(const std::string &key,
+                           const std::string &filter) const = 0;
+
+  /**
+   * @brief probe a filter for several keys at once
+   *        the default probes them one by one
+   * @param keys the encoded keys
+   * @param n how many keys
+   * @param filter the filter
+   * @param results where to store KeyMayMatch of each key
+   */
+  virtual void KeysMayMatch(const std::string *keys, int n,
+                            const std::string &filter, bool *results) const {
+    for (int i = 0; i < n; i++) {
+      results[i] = KeyMayMatch(keys[i], filter);
+    }
+  }
+};
+
+/**
+ * @brief BloomFilterPolicy is a Bloom filter with double hashing
+ */
+class BloomFilterPolicy : public FilterPolicy {
+ public:
+  /**
+   * @brief create a Bloom filter policy
+   * @param bits_per_key the bits spent per key, 10 gives about 1% false
+   *        positives
+   */
+  explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
+    // round down to reduce the probing cost a little
+    k_ = static_cast<std::size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) {
+      k_ = 1;
+    }
+    if (k_ > 30) {
+      k_ = 30;
+    }
+  }
+
+  const char *Name() const override { return "kvstore.BuiltinBloomFilter"; }
+
+  void CreateFilter(const std::string *keys, int n,
+                    std::string *dst) const override {
+    // a tiny filter has a high false positive rate, make it at least 64 bits
+    std::size_t bits = n * bits_per_key_;
+    if (bits < 64) {
+      bits = 64;
+    }
+    std::size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+
+    std::size_t init_size = dst->size();
+    dst->resize(init_size + bytes, 0);
+    dst->push_back(static_cast<char>(k_));  // remember the probe count
+    char *array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      uint32_t h = BloomHash(keys[i]);
+      const uint32_t delta = (h >> 17) | (h << 15);  // rotate right 17 bits
+      for (std::size_t j = 0; j < k_; j++) {
+        const uint32_t bitpos = h % bits;
+        array[bitpos / 8] |= (1 << (bitpos % 8));
+        h += delta;
+      }
+    }
+  }
+
+  bool KeyMayMatch(const std::string &key,
+                   const std::string &filter) const override {
+    std::size_t bits;
+    std::size_t k;
+    if (!ParseFilter(filter, &bits, &k)) {
+      return k != 0;
+    }
+    const char *array = filter.data();
+    uint32_t h = BloomHash(key);
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (std::size_t j = 0; j < k; j++) {
+      const uint32_t bitpos = h % bits;
+      if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) {
+        return false;
+      }
+      h += delta;
+    }
+    return true;
+  }
+
+  /**
+   * @brief probe a filter for several keys at once
+   *        the probes of a single key depend on each other only through
+   *        the early exit, so the keys are probed in lockstep: all the hashes
+   *        are computed first and the first cache line of every key is
+   *        prefetched, then each round probes one bit of every key still
+   *        alive. The misses of different keys overlap instead of being paid
+   *        one after another
+   */
+  void KeysMayMatch(const std::string *keys, int n, const std::string &filter,
+                    bool *results) const override {
+    std::size_t bits;
+    std::size_t k;
+    if (!ParseFilter(filter, &bits, &k)) {
+      for (int i = 0; i < n; i++) {
+        results[i] = (k != 0);
+      }
+      return;
+    }
+    const char *array = filter.data();
+    std::vector<uint32_t> h(n);
+    std::vector<uint32_t> delta(n);
+    for (int i = 0; i < n; i++) {
+      h[i] = BloomHash(keys[i]);
+      delta[i] = (h[i] >> 17) | (h[i] << 15);
+      KVSTORE_PREFETCH(array + (h[i] % bits) / 8);
+      results[i] = true;
+    }
+    for (std::size_t j = 0; j < k; j++) {
+      for (int i = 0; i < n; i++) {
+        const uint32_t bitpos = h[i] % bits;
+        results[i] = results[i] && (array[bitpos / 8] & (1 << (bitpos % 8)));
+        h[i] += delta[i];
+      }
+    }
+  }
+
+ private:
+  /**
+   * @brief the hash the probes are derived from
+   * @param key the encoded key
+   * @return the hash value
+   */
+  static uint32_t BloomHash(const std::string &key) {
+    return Hash(key.data(), key.size(), 0xbc9f1d34);
+  }
+
+  /**
+   * @brief read the size and the probe count of a filter
+   * @param filter the filter
+   * @param bits where to store the number of bits
+   * @param k where to store the probe count, 0 for a malformed filter
+   * @return true if the filter can be probed, false if every key has to be
+   *         treated as a match (k != 0) or as a miss (k == 0)
+   */
+  static bool ParseFilter(const std::string &filter, std::size_t *bits,
+                          std::size_t *k) {
+    std::size_t len = filter.size();
+    if (len < 2) {
+      *k = 0;
+      return false;
+    }
+    *bits = (len - 1) * 8;
+    *k = static_cast<uint8_t>(filter[len - 1]);
+    // reserved for potentially new encodings of short Bloom filters,
+    // consider it a match
+    return *k <= 30;
+  }
+
+  /** the bits spent per key */
+  std::size_t bits_per_key_;
+  /** the number of probes per key */
+  std::size_t k_;
+};
+
+/**
+ * @brief create a Bloom filter policy, the usual way to set
+ *        Options::filter_policy
+ * @param bits_per_key the bits spent per key, 10 gives about 1% false
+ *        positives
+ * @return the policy
+ */
+inline std::shared_ptr<const FilterPolicy> NewBloomFilterPolicy(
+    int bits_per_key) {
+  return std::make_shared<BloomFilterPolicy>(bits_per_key);
+}
+}  // namespace kvstore
+
+#endif
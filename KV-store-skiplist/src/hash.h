@@ -0,0 +1,57 @@
+/**
+ * hash.h
+ * This is leveldb's 32-bit hash of a byte string, similar to murmur hash. It
+ * is fast and mixes well enough for the Bloom filters of the table files,
+ * but is not meant to resist collisions on purpose
+ */
+#ifndef KVSTORE_HASH_H
+#define KVSTORE_HASH_H
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "coding.h"
+
+namespace kvstore {
+
+/**
+ * @brief hash a byte string
+ * @param data the bytes
+ * @param n how many bytes
+ * @param seed the seed, different seeds give unrelated hashes
+ * @return the hash value
+ */
+inline uint32_t Hash(const char *data, std::size_t n, uint32_t seed) {
+  const uint32_t m = 0xc6a4a793;
+  const uint32_t r = 24;
+  const char *limit = data + n;
+  uint32_t h = seed ^ static_cast<uint32_t>(n * m);
+
+  // pick up four bytes at a time
+  while (data + 4 <= limit) {
+    uint32_t w = DecodeFixed32(data);
+    data += 4;
+    h += w;
+    h *= m;
+    h ^= (h >> 16);
+  }
+
+  // pick up the remaining bytes
+  switch (limit - data) {
+    case 3:
+      h += static_cast<uint32_t>(static_cast<uint8_t>(data[2])) << 16;
+      // fall through
+    case 2:
+      h += static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 8;
+      // fall through
+    case 1:
+      h += static_cast<uint8_t>(data[0]);
+      h *= m;
+      h ^= (h >> r);
+      break;
+  }
+  return h;
+}
+}  // namespace kvstore
+
+#endif
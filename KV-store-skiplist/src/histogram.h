@@ -0,0 +1,217 @@
+/**
+ * histogram.h
+ * This is leveldb's Histogram, for benchmarks: recording every latency to
+ * compute exact percentiles costs too much memory, so the samples are
+ * counted in 154 buckets whose limits grow roughly geometrically from 1 to
+ * 1e200 (1, 2, ..., 10, 12, 14, ..., 100, 120, ...). A sample lands in the
+ * first bucket whose limit is larger than it. A percentile is interpolated
+ * linearly between the limits of the two buckets around it, and clamped to
+ * the smallest and largest samples seen
+ */
+#ifndef KVSTORE_HISTOGRAM_H
+#define KVSTORE_HISTOGRAM_H
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+
+namespace kvstore {
+
+/**
+ * @brief Histogram summarizes a stream of samples, e.g. latencies
+ *        it is not thread-safe, give each thread its own and Merge them
+ */
+class Histogram {
+ public:
+  /**
+   * @brief create an empty Histogram
+   */
+  Histogram() { Clear(); }
+
+  /**
+   * @brief forget all the samples
+   */
+  void Clear() {
+    min_ = kBucketLimit[kNumBuckets - 1];
+    max_ = 0;
+    num_ = 0;
+    sum_ = 0;
+    sum_squares_ = 0;
+    std::fill(buckets_, buckets_ + kNumBuckets, 0.0);
+  }
+
+  /**
+   * @brief record a sample
+   * @param value the sample, non-negative
+   */
+  void Add(double value) {
+    // the first bucket whose limit is larger than value, the last one catches
+    // anything larger
+    int b = static_cast<int>(
+        std::upper_bound(kBucketLimit, kBucketLimit + kNumBuckets - 1, value) -
+        kBucketLimit);
+    buckets_[b] += 1.0;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    num_++;
+    sum_ += value;
+    sum_squares_ += value * value;
+  }
+
+  /**
+   * @brief add the samples of another Histogram to this one
+   * @param other the other Histogram
+   */
+  void Merge(const Histogram &other) {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    num_ += other.num_;
+    sum_ += other.sum_;
+    sum_squares_ += other.sum_squares_;
+    for (int b = 0; b < kNumBuckets; b++) {
+      buckets_[b] += other.buckets_[b];
+    }
+  }
+
+  /**
+   * @brief the number of samples
+   * @return how many samples were added
+   */
+  double Count() const { return num_; }
+
+  /**
+   * @brief the smallest sample
+   * @return the minimum, 0 without samples
+   */
+  double Min() const { return num_ == 0 ? 0 : min_; }
+
+  /**
+   * @brief the largest sample
+   * @return the maximum, 0 without samples
+   */
+  double Max() const { return max_; }
+
+  /**
+   * @brief the median of the samples, approximated
+   * @return the 50th percentile
+   */
+  double Median() const { return Percentile(50.0); }
+
+  /**
+   * @brief a percentile of the samples, interpolated within its bucket
+   * @param p the percentile, between 0 and 100
+   * @return the approximate value below which p% of the samples fall
+   */
+  double Percentile(double p) const {
+    double threshold = num_ * (p / 100.0);
+    double sum = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+      sum += buckets_[b];
+      if (sum >= threshold && buckets_[b] > 0) {
+        // scale linearly within this bucket
+        double left_point = (b == 0) ? 0 : kBucketLimit[b - 1];
+        double right_point = kBucketLimit[b];
+        double left_sum = sum - buckets_[b];
+        double right_sum = sum;
+        double pos = (threshold - left_sum) / (right_sum - left_sum);
+        double r = left_point + (right_point - left_point) * pos;
+        return std::min(std::max(r, min_), max_);
+      }
+    }
+    return max_;
+  }
+
+  /**
+   * @brief the mean of the samples
+   * @return the average, 0 without samples
+   */
+  double Average() const { return num_ == 0 ? 0 : sum_ / num_; }
+
+  /**
+   * @brief the standard deviation of the samples
+   * @return the standard deviation, 0 without samples
+   */
+  double StandardDeviation() const {
+    if (num_ == 0) {
+      return 0;
+    }
+    double variance = (sum_squares_ * num_ - sum_ * sum_) / (num_ * num_);
+    return sqrt(std::max(variance, 0.0));
+  }
+
+  /**
+   * @brief a human readable summary, leveldb's format: the statistics, then
+   *        one line per non-empty bucket with its share and a bar
+   * @return the summary
+   */
+  std::string ToString() const {
+    std::string r;
+    char buf[200];
+    snprintf(buf, sizeof(buf), "Count: %.0f  Average: %.4f  StdDev: %.2f\n",
+             num_, Average(), StandardDeviation());
+    r.append(buf);
+    snprintf(buf, sizeof(buf), "Min: %.4f  Median: %.4f  Max: %.4f\n", Min(),
+             Median(), max_);
+    r.append(buf);
+    r.append("------------------------------------------------------\n");
+    const double mult = num_ == 0 ? 0 : 100.0 / num_;
+    double sum = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+      if (buckets_[b] <= 0.0) {
+        continue;
+      }
+      sum += buckets_[b];
+      snprintf(buf, sizeof(buf), "[ %7.0f, %7.0f ) %7.0f %7.3f%% %7.3f%% ",
+               (b == 0) ? 0.0 : kBucketLimit[b - 1], kBucketLimit[b],
+               buckets_[b], mult * buckets_[b], mult * sum);
+      r.append(buf);
+      // add hash marks based on percentage, 20 marks for 100%
+      int marks = static_cast<int>(20 * (buckets_[b] / num_) + 0.5);
+      r.append(marks, '#');
+      r.push_back('\n');
+    }
+    return r;
+  }
+
+ private:
+  /** the number of buckets */
+  static constexpr int kNumBuckets = 154;
+
+  /** the exclusive upper limit of each bucket */
+  static constexpr double kBucketLimit[kNumBuckets] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 16, 18, 20, 25, 30, 35, 40, 45, 50,
+    60, 70, 80, 90, 100, 120, 140, 160, 180, 200, 250, 300, 350, 400, 450, 500,
+    600, 700, 800, 900, 1000, 1200, 1400, 1600, 1800, 2000, 2500, 3000, 3500,
+    4000, 4500, 5000, 6000, 7000, 8000, 9000, 10000, 12000, 14000, 16000,
+    18000, 20000, 25000, 30000, 35000, 40000, 45000, 50000, 60000, 70000,
+    80000, 90000, 100000, 120000, 140000, 160000, 180000, 200000, 250000,
+    300000, 350000, 400000, 450000, 500000, 600000, 700000, 800000, 900000,
+    1000000, 1200000, 1400000, 1600000, 1800000, 2000000, 2500000, 3000000,
+    3500000, 4000000, 4500000, 5000000, 6000000, 7000000, 8000000, 9000000,
+    10000000, 12000000, 14000000, 16000000, 18000000, 20000000, 25000000,
+    30000000, 35000000, 40000000, 45000000, 50000000, 60000000, 70000000,
+    80000000, 90000000, 100000000, 120000000, 140000000, 160000000, 180000000,
+    200000000, 250000000, 300000000, 350000000, 400000000, 450000000,
+    500000000, 600000000, 700000000, 800000000, 900000000, 1000000000,
+    1200000000, 1400000000, 1600000000, 1800000000, 2000000000, 2500000000.0,
+    3000000000.0, 3500000000.0, 4000000000.0, 4500000000.0, 5000000000.0,
+    6000000000.0, 7000000000.0, 8000000000.0, 9000000000.0, 1e200,
+  };
+
+  /** the smallest sample */
+  double min_;
+  /** the largest sample */
+  double max_;
+  /** the number of samples */
+  double num_;
+  /** the sum of the samples */
+  double sum_;
+  /** the sum of the squares of the samples */
+  double sum_squares_;
+  /** the number of samples in each bucket */
+  double buckets_[kNumBuckets];
+};
+}  // namespace kvstore
+
+#endif
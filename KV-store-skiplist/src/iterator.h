@@ -0,0 +1,66 @@
+/**
+ * iterator.h
+ * This is the common interface of the forward iterators over the sorted
+ * sources of a DB: the memtables and the table files. Having one interface
+ * lets them be merged into a single ordered view, as leveldb's Iterator does
+ */
+#ifndef KVSTORE_ITERATOR_H
+#define KVSTORE_ITERATOR_H
+
+#include "status.h"
+
+namespace kvstore {
+
+/**
+ * @brief Iterator walks key-value pairs in key order
+ * @tparam K key type
+ * @tparam V value type
+ */
+template <typename K, typename V>
+class Iterator {
+ public:
+  virtual ~Iterator() = default;
+
+  /**
+   * @brief if the Iterator is positioned at a key-value pair
+   * @return true if positioned, false otherwise
+   */
+  virtual bool Valid() const = 0;
+
+  /**
+   * @brief position at the first key-value pair
+   */
+  virtual void SeekToFirst() = 0;
+
+  /**
+   * @brief position at the first key-value pair with key >= target
+   * @param target the key to seek
+   */
+  virtual void Seek(const K &target) = 0;
+
+  /**
+   * @brief advance to the next key-value pair, requires Valid()
+   */
+  virtual void Next() = 0;
+
+  /**
+   * @brief the key at the current position, requires Valid()
+   * @return key
+   */
+  virtual K GetKey() const = 0;
+
+  /**
+   * @brief the value at the current position, requires Valid()
+   * @return value
+   */
+  virtual V GetValue() const = 0;
+
+  /**
+   * @brief OK, unless an error stopped the Iterator
+   * @return the status
+   */
+  virtual Status GetStatus() const = 0;
+};
+}  // namespace kvstore
+
+#endif
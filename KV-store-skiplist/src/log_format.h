@@ -0,0 +1,46 @@
+/**
+ * log_format.h
+ * This is the physical format of the write-ahead log, the same as leveldb's:
+ * the file is a sequence of 32KB blocks, and each block is a sequence of
+ * fragments, each with a 7 byte header
+ *
+ *   | crc32c (4 bytes) | length (2 bytes) | type (1 byte) | payload |
+ *
+ * The crc covers the type and the payload. A record that doesn't fit in the
+ * rest of a block is split into a FIRST, zero or more MIDDLE and a LAST
+ * fragment. A block trailer too small for a header is zero-filled.
+ */
+#ifndef KVSTORE_LOG_FORMAT_H
+#define KVSTORE_LOG_FORMAT_H
+
+namespace kvstore {
+namespace log {
+
+/**
+ * @brief the type of a fragment
+ */
+enum RecordType {
+  /** reserved for preallocated, zero-filled files */
+  kZeroType = 0,
+  /** the whole record fits in this fragment */
+  kFullType = 1,
+  /** the first fragment of a record */
+  kFirstType = 2,
+  /** a fragment in the middle of a record */
+  kMiddleType = 3,
+  /** the last fragment of a record */
+  kLastType = 4
+};
+
+/** the largest valid fragment type */
+static const int kMaxRecordType = kLastType;
+
+/** the size of a block */
+static const int kBlockSize = 32768;
+
+/** the size of a fragment header: checksum (4), length (2), type (1) */
+static const int kHeaderSize = 4 + 2 + 1;
+}  // namespace log
+}  // namespace kvstore
+
+#endif
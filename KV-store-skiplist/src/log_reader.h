@@ -0,0 +1,238 @@
+/**
+ * log_reader.h
+ * This is the reader of the write-ahead log, it reads the log back block by
+ * block and reassembles the fragments described in log_format.h into records
+ * A fragment with a bad checksum or an unknown type is dropped together with
+ * the rest of its block. A record cut short by the end of the file is what a
+ * crash in the middle of a write leaves behind, it is silently ignored
+ */
+#ifndef KVSTORE_LOG_READER_H
+#define KVSTORE_LOG_READER_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "coding.h"
+#include "crc32c.h"
+#include "env.h"
+#include "log_format.h"
+#include "status.h"
+
+namespace kvstore {
+namespace log {
+
+/**
+ * @brief Reader reads records from a log file in the order they were added
+ */
+class Reader {
+ public:
+  /**
+   * @brief create a Reader over a file
+   * @param file the file, must outlive the Reader
+   */
+  explicit Reader(SequentialFile *file)
+      : file_(file), backing_store_(new char[kBlockSize]) {}
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  /**
+   * @brief read the next record
+   * @param record where to store the record
+   * @return true if a record is read, false at the end of the log
+   */
+  bool ReadRecord(std::string *record) {
+    record->clear();
+    bool in_fragmented_record = false;
+    std::string fragment;
+    while (true) {
+      const unsigned int record_type = ReadPhysicalRecord(&fragment);
+      switch (record_type) {
+        case kFullType:
+          if (in_fragmented_record) {
+            ReportCorruption(record->size(), "partial record without end");
+          }
+          *record = fragment;
+          return true;
+
+        case kFirstType:
+          if (in_fragmented_record) {
+            ReportCorruption(record->size(), "partial record without end");
+          }
+          *record = fragment;
+          in_fragmented_record = true;
+          break;
+
+        case kMiddleType:
+          if (!in_fragmented_record) {
+            ReportCorruption(fragment.size(),
+                             "missing start of fragmented record");
+          } else {
+            record->append(fragment);
+          }
+          break;
+
+        case kLastType:
+          if (!in_fragmented_record) {
+            ReportCorruption(fragment.size(),
+                             "missing start of fragmented record");
+          } else {
+            record->append(fragment);
+            return true;
+          }
+          break;
+
+        case kEof:
+          // a record cut by the end of the file is a torn write, drop it
+          record->clear();
+          return false;
+
+        case kBadRecord:
+          if (in_fragmented_record) {
+            ReportCorruption(record->size(), "error in middle of record");
+            in_fragmented_record = false;
+            record->clear();
+          }
+          break;
+
+        default:
+          ReportCorruption(fragment.size() + (in_fragmented_record
+                                                  ? record->size()
+                                                  : 0),
+                           "unknown record type");
+          in_fragmented_record = false;
+          record->clear();
+          break;
+      }
+    }
+  }
+
+  /**
+   * @brief the first corruption met so far, if any
+   * @return OK if none, the Corruption otherwise
+   */
+  Status GetStatus() const { return status_; }
+
+  /**
+   * @brief how many bytes were dropped because of corruption
+   * @return the number of bytes dropped
+   */
+  uint64_t DroppedBytes() const { return dropped_bytes_; }
+
+ private:
+  /** extra record types used internally by the Reader */
+  enum {
+    /** the end of the file is reached */
+    kEof = kMaxRecordType + 1,
+    /** a fragment with a bad checksum, or a zero-filled trailer */
+    kBadRecord = kMaxRecordType + 2
+  };
+
+  /**
+   * @brief read the next fragment, loading a new block when needed
+   * @param result where to store the payload
+   * @return the fragment type, or one of the internal types
+   */
+  unsigned int ReadPhysicalRecord(std::string *result) {
+    while (true) {
+      if (buffer_size_ < static_cast<std::size_t>(kHeaderSize)) {
+        if (!eof_) {
+          // the trailer of the last block is skipped, read the next block
+          buffer_ = backing_store_.get();
+          Status s = file_->Read(kBlockSize, buffer_, &buffer_size_);
+          if (!s.ok()) {
+            ReportDrop(kBlockSize, s);
+            buffer_size_ = 0;
+            eof_ = true;
+            return kEof;
+          }
+          if (buffer_size_ < static_cast<std::size_t>(kBlockSize)) {
+            eof_ = true;
+          }
+          continue;
+        }
+        // a truncated header at the end of the file is a torn write
+        buffer_size_ = 0;
+        return kEof;
+      }
+
+      const char *header = buffer_;
+      const uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
+      const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
+      const unsigned int type = static_cast<unsigned char>(header[6]);
+      const uint32_t length = a | (b << 8);
+      if (kHeaderSize + length > buffer_size_) {
+        std::size_t drop_size = buffer_size_;
+        buffer_size_ = 0;
+        if (!eof_) {
+          ReportCorruption(drop_size, "bad record length");
+          return kBadRecord;
+        }
+        // a truncated payload at the end of the file is a torn write
+        return kEof;
+      }
+
+      if (type == kZeroType && length == 0) {
+        // zero-filled space, skip the rest of the block
+        buffer_size_ = 0;
+        return kBadRecord;
+      }
+
+      uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
+      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      if (actual_crc != expected_crc) {
+        // the length itself might be corrupted, drop the rest of the block
+        std::size_t drop_size = buffer_size_;
+        buffer_size_ = 0;
+        ReportCorruption(drop_size, "checksum mismatch");
+        return kBadRecord;
+      }
+
+      buffer_ += kHeaderSize + length;
+      buffer_size_ -= kHeaderSize + length;
+      result->assign(header + kHeaderSize, length);
+      return type;
+    }
+  }
+
+  /**
+   * @brief remember a corruption
+   * @param bytes how many bytes are dropped
+   * @param reason what is wrong
+   */
+  void ReportCorruption(uint64_t bytes, const char *reason) {
+    ReportDrop(bytes, Status::Corruption(reason));
+  }
+
+  /**
+   * @brief remember dropped bytes and the first error
+   * @param bytes how many bytes are dropped
+   * @param reason the error
+   */
+  void ReportDrop(uint64_t bytes, const Status &reason) {
+    dropped_bytes_ += bytes;
+    if (status_.ok()) {
+      status_ = reason;
+    }
+  }
+
+  /** the log file */
+  SequentialFile *file_;
+  /** the memory of the current block */
+  std::unique_ptr<char[]> backing_store_;
+  /** the unread part of the current block */
+  char *buffer_ = nullptr;
+  /** the length of the unread part */
+  std::size_t buffer_size_ = 0;
+  /** if the last read returned less than a full block */
+  bool eof_ = false;
+  /** the first corruption met */
+  Status status_;
+  /** how many bytes were dropped */
+  uint64_t dropped_bytes_ = 0;
+};
+}  // namespace log
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * log_writer.h
+ * This is the writer of the write-ahead log, it frames each record into one
+ * or more checksummed fragments as described in log_format.h
+ */
+#ifndef KVSTORE_LOG_WRITER_H
+#define KVSTORE_LOG_WRITER_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+
+#include "coding.h"
+#include "crc32c.h"
+#include "env.h"
+#include "log_format.h"
+#include "status.h"
+
+namespace kvstore {
+namespace log {
+
+/**
+ * @brief Writer appends records to a log file
+ *        it is not thread-safe, the owner serializes the callers
+ */
+class Writer {
+ public:
+  /**
+   * @brief create a Writer appending to a file
+   * @param dest the file, must outlive the Writer
+   * @param dest_length the current length of the file, to resume a block
+   */
+  explicit Writer(WritableFile *dest, uint64_t dest_length = 0)
+      : dest_(dest), block_offset_(dest_length % kBlockSize) {
+    // the checksum of the type byte is the same for every fragment
+    for (int i = 0; i <= kMaxRecordType; i++) {
+      char t = static_cast<char>(i);
+      type_crc_[i] = crc32c::Value(&t, 1);
+    }
+  }
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  /**
+   * @brief append a record, fragmenting it across blocks as needed
+   *        the data is handed to the file's buffer, call Sync on the file
+   *        to make it durable
+   * @param record the record
+   * @return OK on success, the error otherwise
+   */
+  Status AddRecord(const std::string &record) {
+    const char *ptr = record.data();
+    std::size_t left = record.size();
+
+    // an empty record still emits a single zero-length fragment
+    Status s;
+    bool begin = true;
+    do {
+      const int leftover = kBlockSize - block_offset_;
+      assert(leftover >= 0);
+      if (leftover < kHeaderSize) {
+        // switch to a new block, zero-filling the trailer
+        if (leftover > 0) {
+          static const char kZeros[kHeaderSize] = {0};
+          s = dest_->Append(kZeros, leftover);
+          if (!s.ok()) {
+            return s;
+          }
+        }
+        block_offset_ = 0;
+      }
+
+      const std::size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+      const std::size_t fragment_length = std::min(left, avail);
+      const bool end = (left == fragment_length);
+      RecordType type;
+      if (begin && end) {
+        type = kFullType;
+      } else if (begin) {
+        type = kFirstType;
+      } else if (end) {
+        type = kLastType;
+      } else {
+        type = kMiddleType;
+      }
+
+      s = EmitPhysicalRecord(type, ptr, fragment_length);
+      ptr += fragment_length;
+      left -= fragment_length;
+      begin = false;
+    } while (s.ok() && left > 0);
+    return s;
+  }
+
+ private:
+  /**
+   * @brief write one fragment with its header
+   * @param type the fragment type
+   * @param ptr the payload
+   * @param length the payload length, fits in 2 bytes
+   * @return OK on success, the error otherwise
+   */
+  Status EmitPhysicalRecord(RecordType type, const char *ptr,
+                            std::size_t length) {
+    assert(length <= 0xffff);
+    assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+
+    char buf[kHeaderSize];
+    buf[4] = static_cast<char>(length & 0xff);
+    buf[5] = static_cast<char>(length >> 8);
+    buf[6] = static_cast<char>(type);
+    uint32_t crc = crc32c::Extend(type_crc_[type], ptr, length);
+    EncodeFixed32(buf, crc32c::Mask(crc));
+
+    Status s = dest_->Append(buf, kHeaderSize);
+    if (s.ok()) {
+      s = dest_->Append(ptr, length);
+    }
+    block_offset_ += kHeaderSize + length;
+    return s;
+  }
+
+  /** the log file */
+  WritableFile *dest_;
+  /** the offset in the current block */
+  int block_offset_;
+  /** precomputed checksum of each type byte */
+  uint32_t type_crc_[kMaxRecordType + 1];
+};
+}  // namespace log
+}  // namespace kvstore
+
+#endif
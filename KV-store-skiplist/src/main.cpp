@@ -1,6 +1,65 @@
+/**
+ * A tiny command line front-end of the durable key-value store
+ * every invocation opens the DB, recovering it from its write-ahead log,
+ * runs one command and closes it again
+ */
+
 #include <iostream>
-#include "skiplist.h"
+#include <memory>
+#include <string>
+#include "db.h"
+
+/**
+ * @brief print how to use this program
+ * @param program the name of the program
+ */
+void printUsage(const char *program) {
+    std::cerr << "usage: " << program << " [db directory] put [key] [value]" << std::endl;
+    std::cerr << "       " << program << " [db directory] get [key]" << std::endl;
+    std::cerr << "       " << program << " [db directory] del [key]" << std::endl;
+    std::cerr << "       " << program << " [db directory] scan [lo] [hi]" << std::endl;
+}
 
 int main(int argc, const char *argv[]) {
-    std::cout << "Hello World" << std::endl;
-}
\ No newline at end of file
+    if (argc < 4) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    std::string dbname = argv[1];
+    std::string command = argv[2];
+
+    std::unique_ptr<kvstore::DB<std::string, std::string>> db;
+    kvstore::Status s = kvstore::DB<std::string, std::string>::Open(kvstore::Options(), dbname, &db);
+    if (!s.ok()) {
+        std::cerr << "cannot open " << dbname << ": " << s.ToString() << std::endl;
+        return 1;
+    }
+
+    kvstore::WriteOptions write_options;
+    write_options.sync = true;
+    if (command == "put" && argc == 5) {
+        s = db->Put(write_options, argv[3], argv[4]);
+    } else if (command == "get" && argc == 4) {
+        std::string value;
+        s = db->Get(argv[3], &value);
+        if (s.ok()) {
+            std::cout << value << std::endl;
+        }
+    } else if (command == "del" && argc == 4) {
+        s = db->Delete(write_options, argv[3]);
+    } else if (command == "scan" && argc == 5) {
+        db->Scan(argv[3], argv[4], [](const std::string &key, const std::string &value) {
+            std::cout << key << " " << value << std::endl;
+            return true;
+        });
+    } else {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!s.ok()) {
+        std::cerr << s.ToString() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * memtable.h
+ * This is the SkipList acting as the in-memory table of a DB, in the spirit
+ * of leveldb's MemTable. It takes writes until it grows past a size
+ * threshold, then it is frozen (no more writes) and flushed into a table file
+ * in the background while a fresh MemTable takes over.
+ *
+ * A deletion is stored as a tombstone rather than removing the key, so that
+ * it still shadows an older value living in a table file. Every write is a
+ * new version numbered with the sequence number of its log record (see
+ * mvcc_skiplist.h), so a lookup racing with an overwrite of the same key
+ * reads either the old value or the new one, never a torn mix of both
+ */
+#ifndef KVSTORE_MEMTABLE_H
+#define KVSTORE_MEMTABLE_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "dbformat.h"
+#include "iterator.h"
+#include "mvcc_skiplist.h"
+#include "status.h"
+#include "write_batch.h"
+
+namespace kvstore {
+
+/**
+ * @brief MemTable is a MVCCSkipList of values and tombstones
+ *        reads are lock-free and may run concurrently with the single writer
+ * @tparam K key type
+ * @tparam V value type
+ */
+template <typename K, typename V>
+class MemTable {
+ public:
+  /**
+   * @brief create an empty MemTable
+   * @param max_height the initial max height of the SkipList
+   */
+  explicit MemTable(int max_height = 10) : table_(max_height) {}
+
+  MemTable(const MemTable &) = delete;
+  MemTable &operator=(const MemTable &) = delete;
+
+  /**
+   * @brief apply a batch, turning deletions into tombstones
+   * @param batch the operations
+   * @param sequence the sequence number of the first operation, larger than
+   *        those already applied
+   */
+  void Write(const WriteBatch<K, V> &batch, SequenceNumber sequence) {
+    table_.Write(batch, sequence);
+    AddHeapBytes(batch);
+  }
+
+  /**
+   * @brief apply a batch under the sequence numbers following the last one
+   * @param batch the operations
+   */
+  void Write(const WriteBatch<K, V> &batch) {
+    table_.Write(batch);
+    AddHeapBytes(batch);
+  }
+
+  /**
+   * @brief look up a key, never blocks on the writer
+   * @param key the key
+   * @param value where to store the value if found
+   * @param s where to store OK if found, NotFound if deleted
+   * @return true if the MemTable knows about the key, false if older data
+   *         has to be consulted
+   */
+  bool Get(const K &key, V *value, Status *s) const {
+    TaggedValue<V> tagged;
+    if (!table_.Find(key, table_.GetSnapshot(), &tagged)) {
+      return false;
+    }
+    if (tagged.type == ValueType::kDeletion) {
+      *s = Status::NotFound("key");
+    } else {
+      *value = std::move(tagged.value);
+      *s = Status::OK();
+    }
+    return true;
+  }
+
+  /**
+   * @brief an Iterator over the latest values and tombstones in key order,
+   *        the writes applied after its creation are not visible to it
+   * @return the Iterator, must not outlive the MemTable
+   */
+  std::unique_ptr<Iterator<K, TaggedValue<V>>> NewIterator() const {
+    return std::unique_ptr<Iterator<K, TaggedValue<V>>>(
+        new MemTableIterator(&table_, table_.GetSnapshot()));
+  }
+
+  /**
+   * @brief an estimate of the memory held, nodes and heap-allocated payload
+   * @return the number of bytes
+   */
+  std::size_t ApproximateMemoryUsage() const {
+    return table_.ApproximateMemoryUsage() +
+           heap_bytes_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief how many versions are in the MemTable, values and tombstones
+   * @return the number of entries
+   */
+  std::size_t GetSize() const { return table_.GetNumVersions(); }
+
+ private:
+  /**
+   * @brief MemTableIterator adapts MVCCSkipList::Iterator to the Iterator
+   *        interface shared with the table files
+   */
+  class MemTableIterator : public Iterator<K, TaggedValue<V>> {
+   public:
+    MemTableIterator(const MVCCSkipList<K, V> *table, const Snapshot &snapshot)
+        : iter_(table, snapshot) {}
+
+    bool Valid() const override { return iter_.Valid(); }
+    void SeekToFirst() override { iter_.SeekToFirst(); }
+    void Seek(const K &target) override { iter_.Seek(target); }
+    void Next() override { iter_.Next(); }
+    K GetKey() const override { return iter_.GetKey(); }
+    TaggedValue<V> GetValue() const override {
+      TaggedValue<V> tagged;
+      tagged.type = iter_.GetType();
+      tagged.value = iter_.GetValue();
+      return tagged;
+    }
+    Status GetStatus() const override { return Status::OK(); }
+
+   private:
+    /** the underlying MVCCSkipList Iterator */
+    typename MVCCSkipList<K, V>::Iterator iter_;
+  };
+
+  /**
+   * @brief account for the keys and values of a batch held on the heap
+   * @param batch the operations just applied
+   */
+  void AddHeapBytes(const WriteBatch<K, V> &batch) {
+    std::size_t heap_bytes = 0;
+    for (auto &op : batch.GetOps()) {
+      heap_bytes += HeapSize(op.key) + HeapSize(op.value);
+    }
+    heap_bytes_.fetch_add(heap_bytes, std::memory_order_relaxed);
+  }
+
+  /** every version of the values and tombstones */
+  MVCCSkipList<K, V> table_;
+  /** the bytes held by keys and values outside of the SkipNodes */
+  std::atomic<std::size_t> heap_bytes_{0};
+};
+}  // namespace kvstore
+
+#endif
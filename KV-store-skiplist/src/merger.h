@@ -0,0 +1,138 @@
+/**
+ * merger.h
+ * This is the merged view over several sorted sources, e.g. the memtables
+ * and the table files of a DB. The sources are given newest first: when
+ * several hold the same key, only the entry of the newest one is yielded,
+ * the older ones are skipped.
+ *
+ * The children are kept in a binary min-heap ordered by their current key,
+ * ties broken by age, so a step costs O(log k) for k children instead of a
+ * scan of all of them. A compaction merging dozens of tables relies on it
+ */
+#ifndef KVSTORE_MERGER_H
+#define KVSTORE_MERGER_H
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "iterator.h"
+#include "status.h"
+
+namespace kvstore {
+
+/**
+ * @brief MergingIterator yields the union of its children in key order
+ * @tparam K key type
+ * @tparam V value type
+ */
+template <typename K, typename V>
+class MergingIterator : public Iterator<K, V> {
+ public:
+  /**
+   * @brief merge some Iterators
+   * @param children the Iterators, newest first
+   */
+  explicit MergingIterator(
+      std::vector<std::unique_ptr<Iterator<K, V>>> &&children)
+      : children_(std::move(children)) {}
+
+  bool Valid() const override { return !heap_.empty(); }
+
+  void SeekToFirst() override {
+    for (auto &child : children_) {
+      child->SeekToFirst();
+    }
+    BuildHeap();
+  }
+
+  void Seek(const K &target) override {
+    for (auto &child : children_) {
+      child->Seek(target);
+    }
+    BuildHeap();
+  }
+
+  void Next() override {
+    // step every child off the current key, the older duplicates included,
+    // they all sit at the top of the heap
+    K key = heap_.front().key;
+    while (!heap_.empty() && !(key < heap_.front().key)) {
+      std::pop_heap(heap_.begin(), heap_.end(), Greater());
+      Entry &entry = heap_.back();
+      Iterator<K, V> *child = children_[entry.index].get();
+      child->Next();
+      if (child->Valid()) {
+        entry.key = child->GetKey();
+        std::push_heap(heap_.begin(), heap_.end(), Greater());
+      } else {
+        heap_.pop_back();
+      }
+    }
+  }
+
+  K GetKey() const override { return heap_.front().key; }
+
+  V GetValue() const override {
+    return children_[heap_.front().index]->GetValue();
+  }
+
+  Status GetStatus() const override {
+    for (auto &child : children_) {
+      Status s = child->GetStatus();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+ private:
+  /**
+   * @brief a child in the heap, with its current key cached
+   */
+  struct Entry {
+    /** the current key of the child */
+    K key;
+    /** the position of the child, the smaller the newer */
+    std::size_t index;
+  };
+
+  /**
+   * @brief the heap order: the smallest key on top, the newest child among
+   *        equal keys
+   */
+  struct Greater {
+    bool operator()(const Entry &a, const Entry &b) const {
+      if (a.key < b.key) {
+        return false;
+      }
+      if (b.key < a.key) {
+        return true;
+      }
+      return a.index > b.index;
+    }
+  };
+
+  /**
+   * @brief rebuild the heap from the children positioned by a seek
+   */
+  void BuildHeap() {
+    heap_.clear();
+    for (std::size_t i = 0; i < children_.size(); i++) {
+      if (children_[i]->Valid()) {
+        heap_.push_back(Entry{children_[i]->GetKey(), i});
+      }
+    }
+    std::make_heap(heap_.begin(), heap_.end(), Greater());
+  }
+
+  /** the merged Iterators, newest first */
+  std::vector<std::unique_ptr<Iterator<K, V>>> children_;
+  /** the Valid children, the current position on top */
+  std::vector<Entry> heap_;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,363 @@
+/**
+ * mvcc_skiplist.h
+ * This is the multi-version mode of the SkipList. SkipList::SkipInsert
+ * overwrites the value of an existing key in place, so a reader copying it
+ * at the same time may see it torn. Here a write never touches an existing
+ * node: every operation gets the next sequence number and is inserted as a
+ * new version, a deletion as a tombstone, under an InternalKey (see
+ * dbformat.h). The versions of a key are adjacent, the newest first.
+ *
+ * A Snapshot is the last sequence number published. A read through it skips
+ * the versions newer than it and takes the first one left, so point reads and
+ * range scans see the state as of the Snapshot, without taking any lock and
+ * while writers go on. A batch gets consecutive sequence numbers and is only
+ * published once all its versions are linked, so a Snapshot sees either the
+ * whole batch or none of it.
+ *
+ * Old versions are never reclaimed, a MVCCSkipList grows with every write
+ * until it is destroyed, like leveldb's MemTable
+ */
+#ifndef KVSTORE_MVCC_SKIPLIST_H
+#define KVSTORE_MVCC_SKIPLIST_H
+
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
+
+#include "dbformat.h"
+#include "skiplist.h"
+#include "status.h"
+#include "write_batch.h"
+
+namespace kvstore {
+
+/**
+ * @brief Snapshot is a consistent read view of a MVCCSkipList, it sees the
+ *        writes up to its sequence number. It holds no resource, so it can
+ *        be copied and dropped freely
+ */
+class Snapshot {
+ public:
+  /**
+   * @brief a Snapshot as of a sequence number
+   * @param sequence the sequence number of the last visible write
+   */
+  explicit Snapshot(SequenceNumber sequence) : sequence_(sequence) {}
+
+  /**
+   * @brief the sequence number of the last visible write
+   * @return the sequence number
+   */
+  SequenceNumber GetSequence() const { return sequence_; }
+
+ private:
+  /** the sequence number of the last visible write */
+  SequenceNumber sequence_;
+};
+
+/**
+ * @brief MVCCSkipList is a SkipList keeping every version of every key
+ *        reads are lock-free, writers serialize on an internal mutex
+ * @tparam K key type
+ * @tparam V value type
+ */
+template <typename K, typename V>
+class MVCCSkipList {
+ public:
+  /**
+   * @brief Iterator walks the keys visible in a Snapshot in key order,
+   *        positioned on the newest visible version of each, tombstones
+   *        included
+   */
+  class Iterator {
+   public:
+    /**
+     * @brief create an Iterator, initially not Valid
+     * @param list the MVCCSkipList to iterate, must outlive the Iterator
+     * @param snapshot the read view
+     */
+    Iterator(const MVCCSkipList *list, const Snapshot &snapshot)
+        : iter_(&list->table_), sequence_(snapshot.GetSequence()) {}
+
+    /**
+     * @brief if the Iterator is positioned at a key
+     * @return true if positioned, false otherwise
+     */
+    bool Valid() const { return iter_.Valid(); }
+
+    /**
+     * @brief the key at the current position, requires Valid()
+     * @return key
+     */
+    K GetKey() const { return iter_.GetKey().user_key; }
+
+    /**
+     * @brief the value at the current position, requires Valid()
+     * @return value, default constructed for a tombstone
+     */
+    V GetValue() const { return iter_.GetValue(); }
+
+    /**
+     * @brief if the current version is a value or a tombstone, requires
+     *        Valid()
+     * @return value or deletion
+     */
+    ValueType GetType() const { return iter_.GetKey().GetType(); }
+
+    /**
+     * @brief the sequence number of the current version, requires Valid()
+     * @return the sequence number
+     */
+    SequenceNumber GetSequence() const { return iter_.GetKey().GetSequence(); }
+
+    /**
+     * @brief advance to the next key, skipping the older versions of the
+     *        current one, requires Valid()
+     */
+    void Next() {
+      K key = GetKey();
+      do {
+        iter_.Next();
+      } while (iter_.Valid() && iter_.GetKey().user_key == key);
+      SkipInvisible();
+    }
+
+    /**
+     * @brief position at the first key >= target
+     * @param target the key to seek
+     */
+    void Seek(const K &target) {
+      // the versions of target newer than the snapshot order before this,
+      // but one linked while seeking may still land in front of it
+      iter_.Seek(InternalKey<K>(target, sequence_, ValueType::kValue));
+      SkipInvisible();
+    }
+
+    /**
+     * @brief position at the first key
+     */
+    void SeekToFirst() {
+      iter_.SeekToFirst();
+      SkipInvisible();
+    }
+
+   private:
+    /**
+     * @brief move past the versions newer than the snapshot, the first
+     *        version left is the newest visible one of its key
+     */
+    void SkipInvisible() {
+      while (iter_.Valid() && iter_.GetKey().GetSequence() > sequence_) {
+        iter_.Next();
+      }
+    }
+
+    /** the position among the versions */
+    typename SkipList<InternalKey<K>, V>::Iterator iter_;
+    /** the sequence number of the read view */
+    SequenceNumber sequence_;
+  };
+
+  /**
+   * @brief create an empty MVCCSkipList
+   * @param max_height the initial max height of the SkipList
+   */
+  explicit MVCCSkipList(int max_height = 10) : table_(max_height) {}
+
+  MVCCSkipList(const MVCCSkipList &) = delete;
+  MVCCSkipList &operator=(const MVCCSkipList &) = delete;
+
+  /**
+   * @brief insert a new version of a key
+   * @param key the key
+   * @param value the value
+   * @return the sequence number of the write
+   */
+  SequenceNumber Put(K key, V value) {
+    WriteBatch<K, V> batch;
+    batch.Put(std::move(key), std::move(value));
+    return Write(batch);
+  }
+
+  /**
+   * @brief insert a tombstone for a key
+   * @param key the key
+   * @return the sequence number of the write
+   */
+  SequenceNumber Delete(K key) {
+    WriteBatch<K, V> batch;
+    batch.Delete(std::move(key));
+    return Write(batch);
+  }
+
+  /**
+   * @brief apply a batch, its operations get the sequence numbers following
+   *        the last one
+   * @param batch the operations, a later one on the same key wins
+   * @return the sequence number of the last operation
+   */
+  SequenceNumber Write(const WriteBatch<K, V> &batch) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return WriteLocked(batch, GetLastSequence() + 1);
+  }
+
+  /**
+   * @brief apply a batch under sequence numbers assigned by the caller, e.g.
+   *        a DB numbering its log records
+   * @param batch the operations, a later one on the same key wins
+   * @param sequence the sequence number of the first operation, larger than
+   *        the last one applied
+   * @return the sequence number of the last operation
+   */
+  SequenceNumber Write(const WriteBatch<K, V> &batch,
+                       SequenceNumber sequence) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return WriteLocked(batch, sequence);
+  }
+
+  /**
+   * @brief a read view of the writes applied so far
+   * @return the Snapshot
+   */
+  Snapshot GetSnapshot() const { return Snapshot(GetLastSequence()); }
+
+  /**
+   * @brief find the newest version of a key visible in a Snapshot
+   * @param key the key
+   * @param snapshot the read view
+   * @param tagged where to store the version, value or tombstone
+   * @return true if a version is visible, false if the key didn't exist then
+   */
+  bool Find(const K &key, const Snapshot &snapshot,
+            TaggedValue<V> *tagged) const {
+    typename SkipList<InternalKey<K>, V>::Iterator iter(&table_);
+    iter.Seek(InternalKey<K>(key, snapshot.GetSequence(), ValueType::kValue));
+    // a newer version linked while seeking may land in front of the target
+    while (iter.Valid() &&
+           iter.GetKey().GetSequence() > snapshot.GetSequence()) {
+      iter.Next();
+    }
+    if (!iter.Valid() || iter.GetKey().user_key != key) {
+      return false;
+    }
+    tagged->type = iter.GetKey().GetType();
+    tagged->value = iter.GetValue();
+    return true;
+  }
+
+  /**
+   * @brief look up the value of a key as of a Snapshot, never blocks
+   * @param key the key
+   * @param value where to store the value
+   * @param snapshot the read view
+   * @return OK if found, NotFound if missing or deleted then
+   */
+  Status Get(const K &key, V *value, const Snapshot &snapshot) const {
+    TaggedValue<V> tagged;
+    if (!Find(key, snapshot, &tagged) ||
+        tagged.type == ValueType::kDeletion) {
+      return Status::NotFound("key");
+    }
+    *value = std::move(tagged.value);
+    return Status::OK();
+  }
+
+  /**
+   * @brief look up the latest value of a key, never blocks
+   * @param key the key
+   * @param value where to store the value
+   * @return OK if found, NotFound if missing or deleted
+   */
+  Status Get(const K &key, V *value) const {
+    return Get(key, value, GetSnapshot());
+  }
+
+  /**
+   * @brief visit every live key-value pair with lo <= key < hi as of a
+   *        Snapshot, in key order
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param snapshot the read view
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   */
+  template <typename Callback>
+  std::size_t Scan(const K &lo, const K &hi, const Snapshot &snapshot,
+                   Callback &&callback) const {
+    std::size_t count = 0;
+    Iterator iter(this, snapshot);
+    for (iter.Seek(lo); iter.Valid() && iter.GetKey() < hi; iter.Next()) {
+      if (iter.GetType() == ValueType::kDeletion) {
+        continue;
+      }
+      count++;
+      if (!callback(iter.GetKey(), iter.GetValue())) {
+        break;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief the sequence number of the last write published
+   * @return the sequence number, 0 before any write
+   */
+  SequenceNumber GetLastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief how many versions are stored, tombstones included
+   * @return the number of versions
+   */
+  std::size_t GetNumVersions() const { return table_.GetSize(); }
+
+  /**
+   * @brief an estimate of the memory held by the SkipList nodes
+   * @return the number of bytes allocated by the underlying Arena
+   */
+  std::size_t ApproximateMemoryUsage() const {
+    return table_.ApproximateMemoryUsage();
+  }
+
+ private:
+  /**
+   * @brief insert the versions of a batch, then publish them at once
+   *        requires the writer lock
+   * @param batch the operations
+   * @param sequence the sequence number of the first operation
+   * @return the sequence number of the last operation
+   */
+  SequenceNumber WriteLocked(const WriteBatch<K, V> &batch,
+                             SequenceNumber sequence) {
+    if (batch.Count() == 0) {
+      return GetLastSequence();
+    }
+    assert(sequence > GetLastSequence() && "sequence numbers must increase");
+    WriteBatch<InternalKey<K>, V> versions;
+    for (auto &op : batch.GetOps()) {
+      if (op.type == OpType::kPut) {
+        versions.Put(InternalKey<K>(op.key, sequence++, ValueType::kValue),
+                     op.value);
+      } else {
+        versions.Put(InternalKey<K>(op.key, sequence++, ValueType::kDeletion),
+                     V{});
+      }
+    }
+    // every version is a distinct key, nothing is overwritten in place
+    table_.Write(versions);
+    last_sequence_.store(sequence - 1, std::memory_order_release);
+    return sequence - 1;
+  }
+
+  /** every version of every key */
+  SkipList<InternalKey<K>, V> table_;
+  /** serializes the writers, so sequence numbers follow the insert order */
+  std::mutex mutex_;
+  /** the last sequence number visible to new Snapshots */
+  std::atomic<SequenceNumber> last_sequence_{0};
+};
+}  // namespace kvstore
+
+#endif
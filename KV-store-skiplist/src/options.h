@@ -0,0 +1,107 @@
+/**
+ * options.h
+ * This is the set of knobs controlling a durable DB, modeled after leveldb's
+ * Options and WriteOptions
+ */
+#ifndef KVSTORE_OPTIONS_H
+#define KVSTORE_OPTIONS_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+
+#include "cache.h"
+#include "filter_policy.h"
+
+namespace kvstore {
+
+/**
+ * @brief Options control the behavior of a DB for its whole lifetime
+ */
+struct Options {
+  /** create the DB directory if it is missing */
+  bool create_if_missing = true;
+
+  /** fail to open on a corrupted log instead of skipping the bad records */
+  bool paranoid_checks = false;
+
+  /** the initial max height of the in-memory SkipList */
+  int max_height = 10;
+
+  /**
+   * fsync batching: the log is synced once at least this many bytes have
+   * been appended since the last sync, even if no write asked for it.
+   * 0 leaves syncing to WriteOptions::sync only
+   */
+  std::size_t sync_bytes = 0;
+
+  /**
+   * group commit: the most operations a leading writer folds into one log
+   * record together with the writes queued behind it
+   */
+  std::size_t max_group_ops = 4096;
+
+  /**
+   * the MemTable is frozen and flushed into a table file once it holds about
+   * this many bytes. A bigger one means fewer, bigger tables, but a longer
+   * log to replay on restart
+   */
+  std::size_t write_buffer_size = 4 * 1024 * 1024;
+
+  /** a compaction starts new output tables once they reach this size */
+  std::size_t max_file_size = 2 * 1024 * 1024;
+
+  /** level 0 is compacted once it has this many tables */
+  int level0_compaction_trigger = 4;
+
+  /**
+   * writes wait for the compaction of level 0 once it has this many tables,
+   * bounding the number of tables a lookup might consult
+   */
+  int level0_stop_writes_trigger = 12;
+
+  /**
+   * level 1 is compacted once its tables hold this many bytes, every deeper
+   * level is allowed ten times more than the previous one
+   */
+  uint64_t max_bytes_for_level_base = 10 * 1024 * 1024;
+
+  /**
+   * the rate compactions write at, in bytes per second, so they don't starve
+   * the foreground reads of disk bandwidth. 0 doesn't limit them
+   */
+  uint64_t compaction_bytes_per_second = 0;
+
+  /** the approximate size of the data blocks of a table file */
+  std::size_t block_size = 4096;
+
+  /** how many keys between two restart points of a block */
+  int block_restart_interval = 16;
+
+  /**
+   * the policy building a filter for every table file, so that a lookup for
+   * a key missing from a table rarely reads from it. nullptr builds no
+   * filter. See NewBloomFilterPolicy
+   */
+  std::shared_ptr<const FilterPolicy> filter_policy;
+
+  /**
+   * the cache of the data blocks read from the table files, it may be shared
+   * by several DBs. nullptr makes DB::Open create an 8MB one. See NewLRUCache
+   */
+  std::shared_ptr<Cache> block_cache;
+};
+
+/**
+ * @brief WriteOptions control a single write
+ */
+struct WriteOptions {
+  /**
+   * if to fsync the log before the write returns. Without it, a write
+   * survives a process crash but might be lost on a machine crash
+   */
+  bool sync = false;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * port.h
+ * This is the small set of compiler-specific hints and platform primitives
+ * used across the store, each with a portable fallback
+ */
+#ifndef KVSTORE_PORT_H
+#define KVSTORE_PORT_H
+
+#include <atomic>
+#include <thread>
+
+/** hint the CPU to pull the cache line at addr, which we will read soon */
+#if defined(__GNUC__) || defined(__clang__)
+#define KVSTORE_PREFETCH(addr) __builtin_prefetch(addr, 0, 1)
+#else
+#define KVSTORE_PREFETCH(addr) ((void)(addr))
+#endif
+
+/** tell the CPU we are busy waiting, so a spinning loop yields resources */
+#if defined(__x86_64__) || defined(__i386__)
+#define KVSTORE_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define KVSTORE_CPU_RELAX() asm volatile("yield")
+#else
+#define KVSTORE_CPU_RELAX() ((void)0)
+#endif
+
+namespace kvstore {
+
+/**
+ * @brief SpinLock is a test-and-test-and-set lock for very short critical
+ *        sections, one byte wide so it can live in every SkipNode. A waiter
+ *        spins on a plain load, and yields its time slice after a while in
+ *        case the holder was preempted. It is BasicLockable, so it works with
+ *        std::lock_guard
+ */
+class SpinLock {
+ public:
+  SpinLock() = default;
+
+  SpinLock(const SpinLock &) = delete;
+  SpinLock &operator=(const SpinLock &) = delete;
+
+  /**
+   * @brief acquire the lock, spinning until it is free
+   */
+  void lock() {
+    int spins = 0;
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+      while (locked_.load(std::memory_order_relaxed)) {
+        if (++spins < kSpinsBeforeYield) {
+          KVSTORE_CPU_RELAX();
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief acquire the lock if it is free
+   * @return true if acquired, false otherwise
+   */
+  bool try_lock() {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+  }
+
+  /**
+   * @brief release the lock, requires holding it
+   */
+  void unlock() { locked_.store(false, std::memory_order_release); }
+
+ private:
+  /** how long to spin before giving the CPU away */
+  static const int kSpinsBeforeYield = 100;
+
+  /** if the lock is held */
+  std::atomic<bool> locked_{false};
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * rate_limiter.h
+ * This is a token bucket throttling the background I/O of a DB, in the
+ * spirit of RocksDB's RateLimiter. Tokens (bytes) refill continuously at a
+ * fixed rate, up to a burst of a tenth of a second worth of them. A caller
+ * asking for more than what is available sleeps until the bucket has refilled
+ * enough, so a compaction writes at a steady pace instead of saturating the
+ * disk and starving the foreground reads
+ */
+#ifndef KVSTORE_RATE_LIMITER_H
+#define KVSTORE_RATE_LIMITER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace kvstore {
+
+/**
+ * @brief RateLimiter hands out bytes at a fixed rate, thread-safe
+ */
+class RateLimiter {
+ public:
+  /**
+   * @brief create a RateLimiter, initially full
+   * @param bytes_per_second the rate, must be positive
+   */
+  explicit RateLimiter(uint64_t bytes_per_second)
+      : bytes_per_second_(static_cast<double>(bytes_per_second)),
+        burst_(std::max(1.0, bytes_per_second_ / 10)),
+        available_(burst_),
+        last_refill_(std::chrono::steady_clock::now()) {}
+
+  RateLimiter(const RateLimiter &) = delete;
+  RateLimiter &operator=(const RateLimiter &) = delete;
+
+  /**
+   * @brief take some bytes out of the bucket, sleeping until they are
+   *        available. A request larger than the burst is served too, it
+   *        just waits longer
+   * @param bytes how many bytes
+   */
+  void Request(uint64_t bytes) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Refill();
+    // go into debt, then sleep it off, so big requests are not starved
+    available_ -= static_cast<double>(bytes);
+    if (available_ < 0) {
+      std::chrono::duration<double> wait(-available_ / bytes_per_second_);
+      std::this_thread::sleep_for(wait);
+      Refill();
+    }
+  }
+
+ private:
+  /**
+   * @brief add the tokens accrued since the last refill
+   */
+  void Refill() {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - last_refill_;
+    last_refill_ = now;
+    available_ =
+        std::min(burst_, available_ + elapsed.count() * bytes_per_second_);
+  }
+
+  /** the refill rate */
+  const double bytes_per_second_;
+  /** the capacity of the bucket */
+  const double burst_;
+  /** the bytes in the bucket, negative while a caller sleeps off its debt */
+  double available_;
+  /** when the bucket was last refilled */
+  std::chrono::steady_clock::time_point last_refill_;
+  /** serializes the callers */
+  std::mutex mutex_;
+};
+}  // namespace kvstore
+
+#endif
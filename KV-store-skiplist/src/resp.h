@@ -0,0 +1,322 @@
+/**
+ * resp.h
+ * This is the subset of RESP, the Redis serialization protocol, spoken by
+ * the key-value server, so that redis-cli and redis-benchmark can talk to it.
+ *
+ * A request is an array of bulk strings, "*2\r\n$3\r\nGET\r\n$3\r\nfoo\r\n",
+ * or an inline command, a line of words separated by spaces, "GET foo\r\n",
+ * as typed in a telnet session. A reply is one of
+ *   +OK\r\n             a simple string
+ *   -ERR message\r\n    an error
+ *   :42\r\n             an integer
+ *   $3\r\nbar\r\n       a bulk string, $-1\r\n if there is none
+ *   *2\r\n...           an array of replies
+ * Requests may be pipelined: a client sends many before reading the replies,
+ * which come back in order
+ */
+#ifndef KVSTORE_RESP_H
+#define KVSTORE_RESP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvstore {
+namespace resp {
+
+/** the longest bulk string accepted, like Redis' proto-max-bulk-len */
+static const std::size_t kMaxBulkLength = 512 << 20;
+/** the most arguments accepted in a request */
+static const std::size_t kMaxArguments = 1 << 20;
+/** the longest inline command or length line accepted */
+static const std::size_t kMaxLineLength = 64 << 10;
+
+/**
+ * @brief the outcome of parsing a request
+ */
+enum class ParseResult {
+  /** a whole request was parsed */
+  kComplete,
+  /** the request is not all there yet, read more and try again */
+  kIncomplete,
+  /** the request is malformed, the connection cannot be resynchronized */
+  kError,
+};
+
+/**
+ * @brief find the end of the line starting at data
+ * @param data the buffer
+ * @param size the size of the buffer
+ * @return the offset of the '\r' of the "\r\n", size if there is none yet
+ */
+inline std::size_t FindLineEnd(const char *data, std::size_t size) {
+  const char *end = static_cast<const char *>(memchr(data, '\r', size));
+  while (end != nullptr) {
+    std::size_t offset = end - data;
+    if (offset + 1 >= size) {
+      return size;
+    }
+    if (data[offset + 1] == '\n') {
+      return offset;
+    }
+    end = static_cast<const char *>(
+        memchr(end + 1, '\r', size - offset - 1));
+  }
+  return size;
+}
+
+/**
+ * @brief parse the length line of an array or a bulk string, e.g. "*3\r\n"
+ * @param data the buffer, starting at the type byte
+ * @param size the size of the buffer
+ * @param length where to store the length
+ * @param consumed where to store the size of the line, with its "\r\n"
+ * @return kComplete, kIncomplete, or kError if it is not a number
+ */
+inline ParseResult ParseLength(const char *data, std::size_t size,
+                               int64_t *length, std::size_t *consumed) {
+  std::size_t end = FindLineEnd(data, size);
+  if (end == size) {
+    return size > kMaxLineLength ? ParseResult::kError
+                                 : ParseResult::kIncomplete;
+  }
+  // at most 18 digits, so the value cannot overflow
+  if (end < 2 || end > 19) {
+    return ParseResult::kError;
+  }
+  int64_t value = 0;
+  for (std::size_t i = 1; i < end; i++) {
+    if (data[i] < '0' || data[i] > '9') {
+      return ParseResult::kError;
+    }
+    value = value * 10 + (data[i] - '0');
+  }
+  *length = value;
+  *consumed = end + 2;
+  return ParseResult::kComplete;
+}
+
+/**
+ * @brief parse one request from the front of a buffer
+ * @param data the buffer
+ * @param size the size of the buffer
+ * @param args where to store the arguments, pointing into the buffer, the
+ *        command name first. An empty inline line gives no arguments
+ * @param consumed where to store how many bytes the request took
+ * @return kComplete, kIncomplete, or kError
+ */
+inline ParseResult ParseRequest(const char *data, std::size_t size,
+                                std::vector<std::string_view> *args,
+                                std::size_t *consumed) {
+  args->clear();
+  if (size == 0) {
+    return ParseResult::kIncomplete;
+  }
+  if (data[0] != '*') {
+    // an inline command, the words of one line
+    const char *newline = static_cast<const char *>(memchr(data, '\n', size));
+    if (newline == nullptr) {
+      return size > kMaxLineLength ? ParseResult::kError
+                                   : ParseResult::kIncomplete;
+    }
+    std::size_t end = newline - data;
+    *consumed = end + 1;
+    if (end > 0 && data[end - 1] == '\r') {
+      end--;
+    }
+    std::size_t pos = 0;
+    while (pos < end) {
+      while (pos < end && data[pos] == ' ') {
+        pos++;
+      }
+      std::size_t start = pos;
+      while (pos < end && data[pos] != ' ') {
+        pos++;
+      }
+      if (pos > start) {
+        args->emplace_back(data + start, pos - start);
+      }
+    }
+    return ParseResult::kComplete;
+  }
+
+  int64_t count;
+  std::size_t pos;
+  ParseResult result = ParseLength(data, size, &count, &pos);
+  if (result != ParseResult::kComplete) {
+    return result;
+  }
+  if (count < 0 || count > static_cast<int64_t>(kMaxArguments)) {
+    return ParseResult::kError;
+  }
+  for (int64_t i = 0; i < count; i++) {
+    if (pos == size) {
+      return ParseResult::kIncomplete;
+    }
+    if (data[pos] != '$') {
+      return ParseResult::kError;
+    }
+    int64_t length;
+    std::size_t line;
+    result = ParseLength(data + pos, size - pos, &length, &line);
+    if (result != ParseResult::kComplete) {
+      return result;
+    }
+    if (length < 0 || length > static_cast<int64_t>(kMaxBulkLength)) {
+      return ParseResult::kError;
+    }
+    pos += line;
+    if (size - pos < static_cast<std::size_t>(length) + 2) {
+      return ParseResult::kIncomplete;
+    }
+    if (data[pos + length] != '\r' || data[pos + length + 1] != '\n') {
+      return ParseResult::kError;
+    }
+    args->emplace_back(data + pos, length);
+    pos += length + 2;
+  }
+  *consumed = pos;
+  return ParseResult::kComplete;
+}
+
+/**
+ * @brief find the end of the reply at the front of a buffer, what a client
+ *        does to match pipelined replies with its requests
+ * @param data the buffer
+ * @param size the size of the buffer
+ * @param consumed where to store how many bytes the reply took
+ * @return kComplete, kIncomplete, or kError
+ */
+inline ParseResult SkipReply(const char *data, std::size_t size,
+                             std::size_t *consumed) {
+  if (size == 0) {
+    return ParseResult::kIncomplete;
+  }
+  std::size_t end = FindLineEnd(data, size);
+  if (end == size) {
+    return size > kMaxLineLength ? ParseResult::kError
+                                 : ParseResult::kIncomplete;
+  }
+  switch (data[0]) {
+    case '+':
+    case '-':
+    case ':':
+      *consumed = end + 2;
+      return ParseResult::kComplete;
+    case '$':
+    case '*': {
+      if (end == 3 && data[1] == '-' && data[2] == '1') {
+        *consumed = end + 2;  // a null bulk string or array
+        return ParseResult::kComplete;
+      }
+      int64_t length;
+      std::size_t pos;
+      ParseResult result = ParseLength(data, size, &length, &pos);
+      if (result != ParseResult::kComplete) {
+        return result;
+      }
+      if (data[0] == '$') {
+        if (size - pos < static_cast<std::size_t>(length) + 2) {
+          return ParseResult::kIncomplete;
+        }
+        *consumed = pos + length + 2;
+        return ParseResult::kComplete;
+      }
+      for (int64_t i = 0; i < length; i++) {
+        std::size_t element;
+        result = SkipReply(data + pos, size - pos, &element);
+        if (result != ParseResult::kComplete) {
+          return result;
+        }
+        pos += element;
+      }
+      *consumed = pos;
+      return ParseResult::kComplete;
+    }
+    default:
+      return ParseResult::kError;
+  }
+}
+
+/**
+ * @brief append a simple string reply, e.g. +OK
+ * @param out the output buffer
+ * @param value the string, without "\r\n"
+ */
+inline void AppendSimpleString(std::string *out, std::string_view value) {
+  out->push_back('+');
+  out->append(value.data(), value.size());
+  out->append("\r\n", 2);
+}
+
+/**
+ * @brief append an error reply
+ * @param out the output buffer
+ * @param message the message, conventionally starting with "ERR "
+ */
+inline void AppendError(std::string *out, std::string_view message) {
+  out->push_back('-');
+  out->append(message.data(), message.size());
+  out->append("\r\n", 2);
+}
+
+/**
+ * @brief append an integer reply
+ * @param out the output buffer
+ * @param value the integer
+ */
+inline void AppendInteger(std::string *out, int64_t value) {
+  out->push_back(':');
+  out->append(std::to_string(value));
+  out->append("\r\n", 2);
+}
+
+/**
+ * @brief append the header of an array reply, its elements follow
+ * @param out the output buffer
+ * @param count how many elements
+ */
+inline void AppendArrayHeader(std::string *out, std::size_t count) {
+  out->push_back('*');
+  out->append(std::to_string(count));
+  out->append("\r\n", 2);
+}
+
+/**
+ * @brief append a bulk string reply
+ * @param out the output buffer
+ * @param value the string, may hold any byte
+ */
+inline void AppendBulkString(std::string *out, std::string_view value) {
+  out->push_back('$');
+  out->append(std::to_string(value.size()));
+  out->append("\r\n", 2);
+  out->append(value.data(), value.size());
+  out->append("\r\n", 2);
+}
+
+/**
+ * @brief append the reply of a missing value
+ * @param out the output buffer
+ */
+inline void AppendNull(std::string *out) { out->append("$-1\r\n", 5); }
+
+/**
+ * @brief append a request in its array form, what a client sends
+ * @param out the output buffer
+ * @param args the command name and its arguments
+ */
+inline void AppendRequest(std::string *out,
+                          const std::vector<std::string_view> &args) {
+  AppendArrayHeader(out, args.size());
+  for (auto &arg : args) {
+    AppendBulkString(out, arg);
+  }
+}
+}  // namespace resp
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,664 @@
+/**
+ * server.h
+ * This is a TCP front-end serving a SkipList as a standalone in-memory
+ * key-value cache, speaking a subset of RESP (see resp.h):
+ *   PING [message]         +PONG, or the message
+ *   GET key                the value, or a null bulk string
+ *   SET key value [EX seconds | PX milliseconds]
+ *                          +OK, PUT is an alias, the key expires after the
+ *                          time given if any
+ *   TTL key                the seconds left to live, -1 if the key does not
+ *                          expire, -2 if it does not exist
+ *   DEL key [key ...]      how many keys were removed
+ *   SCAN lo hi [count]     the pairs with lo <= key < hi, flattened as
+ *                          key, value, key, value..., at most count (100) pairs
+ *   DBSIZE                 how many keys are stored
+ *   QUIT                   +OK, then the connection is closed
+ *
+ * It runs one reactor per core, Linux only. Each reactor is a thread owning
+ * an epoll instance and its own listening socket, all bound to the same port
+ * with SO_REUSEPORT, so the kernel spreads the new connections over them and
+ * a connection is served by a single thread for its whole life, without any
+ * handoff. The sockets are non-blocking and level-triggered. A readable
+ * connection is read in big chunks, and every complete request in its input
+ * buffer is executed before the replies are written back with one send, so
+ * pipelined requests share system calls. Replies that do not fit in the
+ * socket wait for EPOLLOUT, and a connection stops being read while its
+ * pending replies are over a limit, which pushes back on a client that never
+ * reads them.
+ *
+ * The reactors share the store, a CacheSkipList (see cache_skiplist.h)
+ * whose writers run concurrently, and which expires keys and evicts them to
+ * fit its byte budget. Values are read with Get and LockedScan, which copy
+ * them under the node's lock, so a GET never sees a half-replaced value
+ */
+#ifndef KVSTORE_SERVER_H
+#define KVSTORE_SERVER_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "comparator.h"
+#include "cache_skiplist.h"
+#include "env.h"
+#include "resp.h"
+#include "status.h"
+
+namespace kvstore {
+
+/**
+ * @brief ServerOptions controls the behavior of a Server
+ */
+struct ServerOptions {
+  /** the IPv4 address to listen on */
+  std::string host = "0.0.0.0";
+  /** the port to listen on, 0 picks a free one, see Server::GetPort */
+  int port = 6380;
+  /** how many reactor threads, 0 means one per core */
+  int num_reactors = 0;
+  /** stop reading a connection while its pending replies exceed this */
+  std::size_t max_pending_output = 16 << 20;
+  /**
+   * close a connection whose incomplete request exceeds this, so a client
+   * cannot grow the server's memory without end
+   */
+  std::size_t max_pending_input = resp::kMaxBulkLength + resp::kMaxLineLength;
+  /** the most pairs a SCAN returns */
+  int max_scan_count = 10000;
+};
+
+/**
+ * @brief Server serves a SkipList over TCP until it is stopped
+ */
+class Server {
+ public:
+  /** the store served, transparent so keys are probed without a copy */
+  using Store = CacheSkipList<std::string, std::string, BytewiseComparator>;
+
+  /**
+   * @brief create a Server, it does not listen until Start
+   * @param store the store to serve, must outlive the Server
+   * @param options the options
+   */
+  Server(Store *store, const ServerOptions &options)
+      : store_(store), options_(options) {}
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  /**
+   * @brief stop the Server if still running
+   */
+  ~Server() { Stop(); }
+
+  /**
+   * @brief bind the listening sockets and start the reactor threads
+   * @return OK on success, the error otherwise
+   */
+  Status Start() {
+    int num_reactors = options_.num_reactors;
+    if (num_reactors <= 0) {
+      num_reactors = std::max(1u, std::thread::hardware_concurrency());
+    }
+    port_ = options_.port;
+    for (int i = 0; i < num_reactors; i++) {
+      std::unique_ptr<Reactor> reactor(new Reactor(this));
+      Status s = reactor->Open(options_.host, &port_);
+      if (!s.ok()) {
+        reactors_.clear();
+        return s;
+      }
+      reactors_.push_back(std::move(reactor));
+    }
+    for (auto &reactor : reactors_) {
+      reactor->Start();
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief wake the reactors up, close all the connections and join the
+   *        threads
+   */
+  void Stop() {
+    for (auto &reactor : reactors_) {
+      reactor->Stop();
+    }
+    reactors_.clear();
+  }
+
+  /**
+   * @brief the port the Server listens on, once started
+   * @return the port, the one picked by the system if ServerOptions::port
+   *         was 0
+   */
+  int GetPort() const { return port_; }
+
+  /**
+   * @brief execute one request against the store and append its reply
+   * @param args the command name and its arguments
+   * @param out the output buffer
+   * @return false if the connection should be closed after the reply
+   */
+  bool Execute(const std::vector<std::string_view> &args, std::string *out) {
+    std::string_view command = args[0];
+    if (Is(command, "GET")) {
+      if (args.size() != 2) {
+        return WrongArity(command, out);
+      }
+      std::string value;
+      if (store_->Get(args[1], &value)) {
+        resp::AppendBulkString(out, value);
+      } else {
+        resp::AppendNull(out);
+      }
+    } else if (Is(command, "SET") || Is(command, "PUT")) {
+      if (args.size() != 3 && args.size() != 5) {
+        return WrongArity(command, out);
+      }
+      Store::Clock::duration ttl = Store::Clock::duration::zero();
+      if (args.size() == 5) {
+        int amount;
+        if (!Is(args[3], "EX") && !Is(args[3], "PX")) {
+          resp::AppendError(out, "ERR syntax error");
+          return true;
+        }
+        if (!ParseCount(args[4], &amount)) {
+          resp::AppendError(out, "ERR invalid expire time in 'SET' command");
+          return true;
+        }
+        ttl = Is(args[3], "EX") ? Store::Clock::duration(
+                                      std::chrono::seconds(amount))
+                                : Store::Clock::duration(
+                                      std::chrono::milliseconds(amount));
+      }
+      store_->SkipInsert(std::string(args[1]), std::string(args[2]), ttl);
+      resp::AppendSimpleString(out, "OK");
+    } else if (Is(command, "TTL")) {
+      if (args.size() != 2) {
+        return WrongArity(command, out);
+      }
+      Store::Clock::duration ttl;
+      if (!store_->GetTtl(args[1], &ttl)) {
+        resp::AppendInteger(out, -2);
+      } else if (ttl == Store::Clock::duration::max()) {
+        resp::AppendInteger(out, -1);
+      } else {
+        // rounded up like Redis, a key about to expire still shows 1
+        auto millis =
+            std::chrono::duration_cast<std::chrono::milliseconds>(ttl).count();
+        resp::AppendInteger(out, (millis + 999) / 1000);
+      }
+    } else if (Is(command, "DEL")) {
+      if (args.size() < 2) {
+        return WrongArity(command, out);
+      }
+      int64_t removed = 0;
+      for (std::size_t i = 1; i < args.size(); i++) {
+        removed += store_->SkipRemove(args[i]) ? 1 : 0;
+      }
+      resp::AppendInteger(out, removed);
+    } else if (Is(command, "SCAN")) {
+      if (args.size() != 3 && args.size() != 4) {
+        return WrongArity(command, out);
+      }
+      int count = 100;
+      if (args.size() == 4 && !ParseCount(args[3], &count)) {
+        resp::AppendError(out, "ERR count is not a positive integer");
+        return true;
+      }
+      count = std::min(count, options_.max_scan_count);
+      std::vector<std::pair<std::string, std::string>> pairs;
+      store_->LockedScan(args[1], args[2],
+                         [&pairs, count](const std::string &key,
+                                         std::string value) {
+                           pairs.emplace_back(key, std::move(value));
+                           return static_cast<int>(pairs.size()) < count;
+                         });
+      resp::AppendArrayHeader(out, pairs.size() * 2);
+      for (auto &pair : pairs) {
+        resp::AppendBulkString(out, pair.first);
+        resp::AppendBulkString(out, pair.second);
+      }
+    } else if (Is(command, "PING")) {
+      if (args.size() > 2) {
+        return WrongArity(command, out);
+      }
+      if (args.size() == 2) {
+        resp::AppendBulkString(out, args[1]);
+      } else {
+        resp::AppendSimpleString(out, "PONG");
+      }
+    } else if (Is(command, "DBSIZE")) {
+      resp::AppendInteger(out, store_->GetSize());
+    } else if (Is(command, "QUIT")) {
+      resp::AppendSimpleString(out, "OK");
+      return false;
+    } else {
+      resp::AppendError(out, "ERR unknown command '" +
+                                 std::string(command.substr(0, 64)) + "'");
+    }
+    return true;
+  }
+
+ private:
+  /**
+   * @brief Connection is the state of one client, owned by one reactor
+   */
+  struct Connection {
+    /** the socket */
+    int fd;
+    /** the bytes read but not parsed yet */
+    std::string input;
+    /** the replies not sent yet, from output_offset on */
+    std::string output;
+    /** how much of output was sent */
+    std::size_t output_offset = 0;
+    /** the epoll events registered for the socket */
+    uint32_t events = EPOLLIN;
+    /** close once the pending replies are sent, after QUIT or an error */
+    bool closing = false;
+  };
+
+  /**
+   * @brief Reactor is one event loop thread with its own listening socket
+   */
+  class Reactor {
+   public:
+    /**
+     * @brief create a Reactor, not listening yet
+     * @param server the Server executing the requests
+     */
+    explicit Reactor(Server *server) : server_(server) {}
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    /**
+     * @brief stop the thread if running, close all the sockets
+     */
+    ~Reactor() {
+      Stop();
+      for (auto &entry : connections_) {
+        close(entry.first);
+      }
+      for (int fd : {listen_fd_, wakeup_fd_, epoll_fd_}) {
+        if (fd >= 0) {
+          close(fd);
+        }
+      }
+    }
+
+    /**
+     * @brief create the epoll instance and the listening socket
+     * @param host the address to listen on
+     * @param port the port, 0 to pick one, then set to the port picked so
+     *        that the next reactors share it
+     * @return OK on success, the error otherwise
+     */
+    Status Open(const std::string &host, int *port) {
+      epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+      if (epoll_fd_ < 0) {
+        return PosixError("epoll_create1", errno);
+      }
+      wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (wakeup_fd_ < 0) {
+        return PosixError("eventfd", errno);
+      }
+      listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (listen_fd_ < 0) {
+        return PosixError("socket", errno);
+      }
+      int one = 1;
+      setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &one,
+                     sizeof(one)) < 0) {
+        return PosixError("SO_REUSEPORT", errno);
+      }
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(static_cast<uint16_t>(*port));
+      if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        return Status::InvalidArgument("not an IPv4 address: " + host);
+      }
+      std::string endpoint = host + ":" + std::to_string(*port);
+      if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr),
+               sizeof(addr)) < 0) {
+        return PosixError("bind " + endpoint, errno);
+      }
+      if (listen(listen_fd_, SOMAXCONN) < 0) {
+        return PosixError("listen " + endpoint, errno);
+      }
+      socklen_t length = sizeof(addr);
+      getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &length);
+      *port = ntohs(addr.sin_port);
+      for (int fd : {listen_fd_, wakeup_fd_}) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+          return PosixError("epoll_ctl", errno);
+        }
+      }
+      return Status::OK();
+    }
+
+    /**
+     * @brief start the event loop thread
+     */
+    void Start() {
+      thread_ = std::thread([this]() { Loop(); });
+    }
+
+    /**
+     * @brief wake the event loop up and wait for it to return
+     */
+    void Stop() {
+      if (!thread_.joinable()) {
+        return;
+      }
+      stopping_.store(true, std::memory_order_release);
+      uint64_t one = 1;
+      ssize_t n = write(wakeup_fd_, &one, sizeof(one));
+      (void)n;
+      thread_.join();
+    }
+
+   private:
+    /** how many events one epoll_wait returns at most */
+    static const int kMaxEvents = 256;
+    /** how much is read from a socket at once */
+    static const std::size_t kReadSize = 64 << 10;
+    /** how many reads of one socket per event, so others are not starved */
+    static const int kMaxReadsPerEvent = 4;
+
+    /**
+     * @brief serve the sockets until stopped
+     */
+    void Loop() {
+      epoll_event events[kMaxEvents];
+      while (!stopping_.load(std::memory_order_acquire)) {
+        int n = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+        if (n < 0 && errno != EINTR) {
+          break;
+        }
+        for (int i = 0; i < n; i++) {
+          int fd = events[i].data.fd;
+          if (fd == wakeup_fd_) {
+            continue;  // stopping_ is checked by the loop
+          }
+          if (fd == listen_fd_) {
+            Accept();
+            continue;
+          }
+          auto it = connections_.find(fd);
+          if (it == connections_.end()) {
+            continue;
+          }
+          Connection *conn = it->second.get();
+          bool open = true;
+          if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            // read what is left, a half-closed client still gets replies
+            open = (events[i].events & EPOLLIN) && OnReadable(conn);
+            open = open && !(events[i].events & EPOLLERR);
+          } else {
+            if (events[i].events & EPOLLIN) {
+              open = OnReadable(conn);
+            }
+            if (open && (events[i].events & EPOLLOUT)) {
+              open = Flush(conn);
+            }
+          }
+          if (!open) {
+            Close(conn);
+          }
+        }
+      }
+    }
+
+    /**
+     * @brief accept all the pending connections
+     */
+    void Accept() {
+      while (true) {
+        int fd = accept4(listen_fd_, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+          return;  // EAGAIN once the backlog is drained, or a transient error
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+          close(fd);
+          continue;
+        }
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->fd = fd;
+        connections_[fd] = std::move(conn);
+      }
+    }
+
+    /**
+     * @brief read what the client sent, execute every complete request and
+     *        send the replies
+     * @param conn the connection
+     * @return false if the connection should be closed now
+     */
+    bool OnReadable(Connection *conn) {
+      bool eof = false;
+      for (int i = 0; i < kMaxReadsPerEvent; i++) {
+        std::size_t size = conn->input.size();
+        conn->input.resize(size + kReadSize);
+        ssize_t n = recv(conn->fd, &conn->input[size], kReadSize, 0);
+        conn->input.resize(size + std::max<ssize_t>(n, 0));
+        if (n == 0) {
+          eof = true;
+          break;
+        }
+        if (n < 0) {
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+          }
+          if (errno == EINTR) {
+            continue;
+          }
+          return false;
+        }
+        if (static_cast<std::size_t>(n) < kReadSize) {
+          break;  // drained, save a recv that would return EAGAIN
+        }
+      }
+      Process(conn);
+      if (eof) {
+        conn->closing = true;
+      }
+      return Flush(conn);
+    }
+
+    /**
+     * @brief execute the complete requests at the front of the input buffer
+     * @param conn the connection
+     */
+    void Process(Connection *conn) {
+      std::size_t pos = 0;
+      while (!conn->closing && pos < conn->input.size()) {
+        std::size_t consumed = 0;
+        resp::ParseResult result =
+            resp::ParseRequest(conn->input.data() + pos,
+                               conn->input.size() - pos, &args_, &consumed);
+        if (result == resp::ParseResult::kIncomplete) {
+          break;
+        }
+        if (result == resp::ParseResult::kError) {
+          resp::AppendError(&conn->output, "ERR Protocol error");
+          conn->closing = true;
+          break;
+        }
+        pos += consumed;
+        if (!args_.empty() && !server_->Execute(args_, &conn->output)) {
+          conn->closing = true;
+        }
+      }
+      conn->input.erase(0, pos);
+      if (!conn->closing &&
+          conn->input.size() > server_->options_.max_pending_input) {
+        resp::AppendError(&conn->output, "ERR Protocol error: too big request");
+        conn->closing = true;
+      }
+    }
+
+    /**
+     * @brief send as much of the pending replies as the socket takes, and
+     *        wait for EPOLLOUT or pause reading as needed
+     * @param conn the connection
+     * @return false if the connection should be closed now
+     */
+    bool Flush(Connection *conn) {
+      while (conn->output_offset < conn->output.size()) {
+        ssize_t n = send(conn->fd, conn->output.data() + conn->output_offset,
+                         conn->output.size() - conn->output_offset,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+          }
+          return false;
+        }
+        conn->output_offset += n;
+      }
+      std::size_t pending = conn->output.size() - conn->output_offset;
+      if (pending == 0) {
+        conn->output.clear();
+        conn->output_offset = 0;
+        if (conn->closing) {
+          return false;
+        }
+      }
+      uint32_t events = 0;
+      if (pending > 0) {
+        events |= EPOLLOUT;
+      }
+      if (!conn->closing &&
+          pending <= server_->options_.max_pending_output) {
+        events |= EPOLLIN;
+      }
+      if (events != conn->events) {
+        epoll_event event;
+        event.events = events;
+        event.data.fd = conn->fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+      }
+      return true;
+    }
+
+    /**
+     * @brief close a connection and forget it
+     * @param conn the connection
+     */
+    void Close(Connection *conn) {
+      int fd = conn->fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+      close(fd);
+      connections_.erase(fd);
+    }
+
+    /** the Server executing the requests */
+    Server *server_;
+    /** the epoll instance */
+    int epoll_fd_ = -1;
+    /** the listening socket */
+    int listen_fd_ = -1;
+    /** written to by Stop to wake the loop up */
+    int wakeup_fd_ = -1;
+    /** set by Stop */
+    std::atomic<bool> stopping_{false};
+    /** the event loop thread */
+    std::thread thread_;
+    /** the open connections by socket */
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    /** the arguments of the request being executed, reused */
+    std::vector<std::string_view> args_;
+  };
+
+  /**
+   * @brief if a command name matches, case-insensitively
+   * @param command the command name received
+   * @param name the command name, in upper case
+   * @return true if they match, false otherwise
+   */
+  static bool Is(std::string_view command, const char *name) {
+    return command.size() == strlen(name) &&
+           strncasecmp(command.data(), name, command.size()) == 0;
+  }
+
+  /**
+   * @brief append the reply of a command called with the wrong arguments
+   * @param command the command name
+   * @param out the output buffer
+   * @return true, the connection stays open
+   */
+  static bool WrongArity(std::string_view command, std::string *out) {
+    resp::AppendError(out, "ERR wrong number of arguments for '" +
+                               std::string(command) + "' command");
+    return true;
+  }
+
+  /**
+   * @brief parse the count argument of SCAN
+   * @param arg the argument
+   * @param count where to store the count
+   * @return true if it is a positive integer, false otherwise
+   */
+  static bool ParseCount(std::string_view arg, int *count) {
+    if (arg.empty() || arg.size() > 9) {
+      return false;
+    }
+    int value = 0;
+    for (char c : arg) {
+      if (c < '0' || c > '9') {
+        return false;
+      }
+      value = value * 10 + (c - '0');
+    }
+    *count = value;
+    return value > 0;
+  }
+
+  /** the store served */
+  Store *store_;
+  /** the options */
+  ServerOptions options_;
+  /** the port listened on */
+  int port_ = 0;
+  /** the reactors, one thread each */
+  std::vector<std::unique_ptr<Reactor>> reactors_;
+};
+}  // namespace kvstore
+
+#endif
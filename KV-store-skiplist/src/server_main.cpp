@@ -0,0 +1,60 @@
+/**
+ * The standalone key-value cache server, a SkipList served over TCP (see
+ * server.h). It runs until SIGINT or SIGTERM
+ *
+ * Usage:
+ *   ./kvstore_server [port] [number-of-reactors] [max-bytes]
+ * the port defaults to 6380, the reactors to one per core, and the memory
+ * is not bounded unless max-bytes is given, past which keys are evicted.
+ * Try it with
+ *   redis-cli -p 6380 SET foo bar EX 60
+ */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include "server.h"
+
+int main(int argc, const char *argv[]) {
+    if (argc > 4) {
+        std::cerr << "usage: " << argv[0] << " [port] [number-of-reactors] [max-bytes]" << std::endl;
+        return 1;
+    }
+    kvstore::ServerOptions options;
+    if (argc > 1) {
+        options.port = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        options.num_reactors = atoi(argv[2]);
+    }
+    kvstore::CacheSkipListOptions store_options;
+    if (argc > 3) {
+        store_options.max_bytes = strtoull(argv[3], nullptr, 10);
+    }
+
+    // block the signals before the reactors start, so they are only ever
+    // delivered to this thread's sigwait
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    kvstore::Server::Store store(store_options);
+    kvstore::Server server(&store, options);
+    kvstore::Status s = server.Start();
+    if (!s.ok()) {
+        std::cerr << "cannot start the server: " << s.ToString() << std::endl;
+        return 1;
+    }
+    std::cerr << "listening on " << options.host << ":" << server.GetPort() << std::endl;
+
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    std::cerr << "shutting down, " << store.GetSize() << " keys, "
+              << store.GetNumEvicted() << " evicted, " << store.GetNumExpired()
+              << " expired" << std::endl;
+    server.Stop();
+    return 0;
+}
@@ -0,0 +1,379 @@
+/**
+ * sharded_skiplist.h
+ * This is a SkipList split into independent shards by the hash of the keys.
+ * Each shard is a whole SkipList, with its own head, its own tower height and
+ * its own arena, so writers on different shards never touch the same memory:
+ * not the head node's locks, which every tall insert of a single SkipList
+ * takes, nor its arena. Point operations go to a single shard. Ordered
+ * access merges the shards with a binary min-heap of one SkipList::Iterator
+ * per shard, O(log n) per step for n shards.
+ *
+ * Hashing balances the shards whatever the key distribution, at the price of
+ * every ordered scan visiting all of them. Keys are hashed as bytes when
+ * they convert to std::string_view, so a std::string key and a
+ * std::string_view probe land on the same shard
+ */
+#ifndef KVSTORE_SHARDED_SKIPLIST_H
+#define KVSTORE_SHARDED_SKIPLIST_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "skiplist.h"
+
+namespace kvstore {
+
+/**
+ * @brief ShardHash is the default hash picking the shard of a key: byte
+ *        strings by their bytes, anything else by std::hash
+ */
+struct ShardHash {
+  /**
+   * @brief hash a key
+   * @param key the key
+   * @return the hash value
+   */
+  template <typename Q>
+  std::size_t operator()(const Q &key) const {
+    if constexpr (std::is_convertible_v<const Q &, std::string_view>) {
+      return std::hash<std::string_view>()(key);
+    } else {
+      return std::hash<Q>()(key);
+    }
+  }
+};
+
+/**
+ * @brief ShardedSkipList spreads its keys over several SkipLists
+ * @tparam K key type
+ * @tparam V value type
+ * @tparam Comparator the less-than ordering of the keys, as in SkipList
+ * @tparam Hash picks the shard of a key, it must give the same value to a
+ *         key and to any probe of another type equal to it
+ */
+template <typename K, typename V, typename Comparator = std::less<>,
+          typename Hash = ShardHash>
+class ShardedSkipList {
+ public:
+  /** the SkipList type of each shard */
+  using Shard = SkipList<K, V, Comparator>;
+
+  /**
+   * @brief Iterator walks the key-value pairs of all the shards in key order
+   *        it has the guarantees of SkipList::Iterator on every shard, and
+   *        pins its thread for its whole lifetime as well. GetValue reads
+   *        the value without a lock, only GetValueLocked is safe while
+   *        writers replace the values of existing keys
+   */
+  class Iterator {
+   public:
+    /**
+     * @brief create an Iterator over the list, initially not Valid
+     * @param list the ShardedSkipList to iterate, must outlive the Iterator
+     */
+    explicit Iterator(const ShardedSkipList *list) : list_(list) {
+      for (auto &shard : list->shards_) {
+        children_.emplace_back(new typename Shard::Iterator(shard.get()));
+      }
+      heap_.reserve(children_.size());
+    }
+
+    /**
+     * @brief if the Iterator is positioned at a key-value pair
+     * @return true if positioned, false otherwise
+     */
+    bool Valid() const { return !heap_.empty(); }
+
+    /**
+     * @brief the key at the current position, requires Valid()
+     * @return key, valid until the Iterator moves or is destroyed
+     */
+    const K &GetKey() const { return children_[heap_.front()]->GetKey(); }
+
+    /**
+     * @brief the value at the current position, requires Valid()
+     * @return value
+     */
+    V GetValue() const { return children_[heap_.front()]->GetValue(); }
+
+    /**
+     * @brief the value at the current position copied under its node's lock,
+     *        like Get, requires Valid()
+     * @return value
+     */
+    V GetValueLocked() const {
+      return children_[heap_.front()]->GetValueLocked();
+    }
+
+    /**
+     * @brief advance to the next key-value pair, requires Valid()
+     *        the shards hold disjoint keys, so only the smallest one moves
+     */
+    void Next() {
+      std::pop_heap(heap_.begin(), heap_.end(), Greater{this});
+      typename Shard::Iterator *child = children_[heap_.back()].get();
+      child->Next();
+      if (child->Valid()) {
+        std::push_heap(heap_.begin(), heap_.end(), Greater{this});
+      } else {
+        heap_.pop_back();
+      }
+    }
+
+    /**
+     * @brief position at the first key-value pair with key >= target
+     * @param target the key to seek
+     * @tparam Q K, or any key type a transparent Comparator compares with K
+     */
+    template <typename Q>
+    void Seek(const Q &target) {
+      for (auto &child : children_) {
+        child->Seek(target);
+      }
+      BuildHeap();
+    }
+
+    /**
+     * @brief position at the first key-value pair of all the shards
+     */
+    void SeekToFirst() {
+      for (auto &child : children_) {
+        child->SeekToFirst();
+      }
+      BuildHeap();
+    }
+
+   private:
+    /**
+     * @brief Greater orders the heap so that the smallest key is on top
+     */
+    struct Greater {
+      /** the Iterator whose children are compared */
+      const Iterator *iter;
+
+      bool operator()(int a, int b) const {
+        return iter->list_->compare_(iter->children_[b]->GetKey(),
+                                     iter->children_[a]->GetKey());
+      }
+    };
+
+    /**
+     * @brief gather the valid children into the heap
+     */
+    void BuildHeap() {
+      heap_.clear();
+      for (int i = 0; i < static_cast<int>(children_.size()); i++) {
+        if (children_[i]->Valid()) {
+          heap_.push_back(i);
+        }
+      }
+      std::make_heap(heap_.begin(), heap_.end(), Greater{this});
+    }
+
+    /** the ShardedSkipList being iterated */
+    const ShardedSkipList *list_;
+    /** one Iterator per shard, each pinning the thread */
+    std::vector<std::unique_ptr<typename Shard::Iterator>> children_;
+    /** the indexes of the valid children, a min-heap by their keys */
+    std::vector<int> heap_;
+  };
+
+  /**
+   * @brief create an empty ShardedSkipList
+   * @param num_shards how many shards, must be positive
+   * @param max_height the initial max height of each shard
+   * @param compare the ordering of the keys
+   * @param hash the hash picking the shard of a key
+   */
+  explicit ShardedSkipList(int num_shards = 16, int max_height = 10,
+                           const Comparator &compare = Comparator(),
+                           const Hash &hash = Hash())
+      : compare_(compare), hash_(hash) {
+    assert(num_shards > 0);
+    for (int i = 0; i < num_shards; i++) {
+      shards_.emplace_back(new Shard(max_height, compare));
+    }
+  }
+
+  ShardedSkipList(const ShardedSkipList &) = delete;
+  ShardedSkipList &operator=(const ShardedSkipList &) = delete;
+
+  /**
+   * @brief insert a key-value pair into its shard, copying them
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(const K &key, const V &value) {
+    return ShardOf(key)->SkipInsert(key, value);
+  }
+
+  /**
+   * @brief insert a key-value pair into its shard, moving them
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(K &&key, V &&value) {
+    Shard *shard = ShardOf(key);
+    return shard->SkipInsert(std::move(key), std::move(value));
+  }
+
+  /**
+   * @brief remove a key from its shard
+   * @param key the key
+   * @return true if removal is successful, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool SkipRemove(const Q &key) {
+    return ShardOf(key)->SkipRemove(key);
+  }
+
+  /**
+   * @brief look up a key in its shard, see SkipList::Get
+   * @param key the key
+   * @param value where to store the value, untouched if not found
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool Get(const Q &key, V *value) const {
+    return ShardOf(key)->Get(key, value);
+  }
+
+  /**
+   * @brief visit every key-value pair with lo <= key < hi in key order,
+   *        over all the shards
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
+   */
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t Scan(const Lo &lo, const Hi &hi, Callback &&callback) const {
+    return ScanImpl<false>(lo, hi, callback);
+  }
+
+  /**
+   * @brief like Scan, but copy each value under its node's lock, like Get,
+   *        for callers that replace values concurrently. It costs one
+   *        uncontended lock per key visited
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
+   */
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t LockedScan(const Lo &lo, const Hi &hi,
+                         Callback &&callback) const {
+    return ScanImpl<true>(lo, hi, callback);
+  }
+
+  /**
+   * @brief how many keys over all the shards
+   * @return the number of keys, a snapshot while writers are running
+   */
+  std::size_t GetSize() const {
+    std::size_t size = 0;
+    for (auto &shard : shards_) {
+      size += shard->GetSize();
+    }
+    return size;
+  }
+
+  /**
+   * @brief the memory held by the arenas of all the shards
+   * @return the number of bytes
+   */
+  std::size_t ApproximateMemoryUsage() const {
+    std::size_t usage = 0;
+    for (auto &shard : shards_) {
+      usage += shard->ApproximateMemoryUsage();
+    }
+    return usage;
+  }
+
+  /**
+   * @brief the stats of all the shards added up, see SkipList::GetStats
+   * @return the stats, not exact while writers are running
+   */
+  SkipListStats GetStats() const {
+    SkipListStats stats;
+    for (auto &shard : shards_) {
+      stats.Merge(shard->GetStats());
+    }
+    return stats;
+  }
+
+  /**
+   * @brief how many shards
+   * @return the number of shards
+   */
+  int GetNumShards() const { return static_cast<int>(shards_.size()); }
+
+  /**
+   * @brief give access to one shard, e.g. to check the balance
+   * @param index the shard index, smaller than GetNumShards()
+   * @return the shard
+   */
+  const Shard &GetShard(int index) const { return *shards_[index]; }
+
+ private:
+  /**
+   * @brief the shard of a key: the hash is mixed with a multiplicative
+   *        hash, as std::hash of an integer is often the integer itself
+   * @param key the key
+   * @return the shard
+   */
+  template <typename Q>
+  Shard *ShardOf(const Q &key) const {
+    uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9e3779b97f4a7c15ull;
+    return shards_[(h >> 32) % shards_.size()].get();
+  }
+
+  /**
+   * @brief merge the shards from lo up to hi, the body of Scan and
+   *        LockedScan
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam kLockValues if to copy the values under the nodes' locks
+   */
+  template <bool kLockValues, typename Lo, typename Hi, typename Callback>
+  std::size_t ScanImpl(const Lo &lo, const Hi &hi, Callback &callback) const {
+    std::size_t count = 0;
+    Iterator iter(this);
+    for (iter.Seek(lo); iter.Valid() && compare_(iter.GetKey(), hi);
+         iter.Next()) {
+      count++;
+      if (!callback(iter.GetKey(), kLockValues ? iter.GetValueLocked()
+                                               : iter.GetValue())) {
+        break;
+      }
+    }
+    return count;
+  }
+
+  /** the ordering of the keys, shared with the shards */
+  Comparator compare_;
+  /** the hash picking the shard of a key */
+  Hash hash_;
+  /** the shards */
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+}  // namespace kvstore
+
+#endif
@@ -1,23 +1,86 @@
 /**
  * skiplist.h
  * This is the implementation of a simple SkipList data structure using linked
- * list It supports three main APIs: SkipSearch, SkipInsert and SkipRemove We
- * use linked node of 4-directional links to connect the list and maintain the
- * top-left header
+ * list It supports three main APIs: SkipSearch, SkipInsert and SkipRemove
+ * Each key is stored exactly once, in a single SkipNode carrying a tower of
+ * next links, one per level it participates in. The nodes are carved out of
+ * an Arena, the same layout as leveldb's SkipList
+ *
+ * Thread safety: readers (SkipSearch, Iterator, Scan) never take a lock. The
+ * next links are atomics: a writer fully builds a node before publishing it
+ * with a release store, and readers follow links with acquire loads, like
+ * leveldb's SkipList. Writers (SkipInsert, SkipRemove, Write) run
+ * concurrently, following Herlihy's lazy SkipList: a writer searches without
+ * locking, then locks only the predecessors it is about to relink, bottom-up,
+ * and validates that they are still in place (not removed, still pointing to
+ * the same successor). If not, it searches again. A removal first marks its
+ * node, so an insert racing with it retries instead of linking to it. Every
+ * writer locks nodes in decreasing key order, so they never deadlock, and
+ * writers of disjoint key ranges never touch the same lock. Nodes are carved
+ * from a ConcurrentArena.
+ *
+ * A removed node might still be under a concurrent reader, so it is only
+ * retired, and reclaimed through epochs (see epoch.h): every operation pins
+ * its thread, and once no pinned thread can reach a batch of retired nodes,
+ * their keys and values are destructed and their memory goes to a free list
+ * of its height, reused by the next inserts. A SkipNode returned by
+ * SkipSearch may be reclaimed once the call returns if another thread removes
+ * it, hold an EpochGuard around the search and the use of the node then.
+ *
+ * SkipInsert of an existing key replaces its value in place, under the node's
+ * lock. Get and LockedScan copy values under that lock as well, so they are
+ * isolated from it, while the node SkipSearch returns, Iterator and Scan read
+ * values without it.
+ *
+ * Keys are ordered by the Comparator template parameter, a less-than functor
+ * like std::map's, std::less<> by default. When it is transparent (defines
+ * is_transparent), searches take any key type it can compare, e.g. a
+ * std::string_view probe of std::string keys, without building a key.
+ *
+ * Ordered access goes through SkipList::Iterator (Seek, Next, Prev) or
+ * SkipList::Scan, both walking the bottom level. They are stable under
+ * concurrent inserts: each key present during the whole walk is visited
+ * exactly once and in order, a concurrently inserted key may or may not be.
+ *
+ * SaveSnapshot streams the bottom level into a sorted file (see snapshot.h),
+ * and LoadSnapshot bulk-builds a SkipList back from it in a single pass.
  */
 #ifndef KVSTORE_SKIPLIST_H
 #define KVSTORE_SKIPLIST_H
 
+#include <assert.h>
 #include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <new>
 #include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <mutex>
+#include <thread>
+
+#include "arena.h"
+#include "epoch.h"
+#include "port.h"
+#include "snapshot.h"
+#include "statistics.h"
+#include "write_batch.h"
 
 namespace kvstore {
 
 /**
  * @brief SkipNode is a single node resides in the SkipList
- * it has 4-directional links to adjacent nodes
+ *        it holds one key-value pair and a tower of next links, next_[0]
+ *        being the lowest level link. The tower is allocated together with
+ *        the node, so a SkipNode must be created by NewNode
  * @tparam K key type
  * @tparam V value type
  */
@@ -25,18 +88,56 @@ template <typename K, typename V>
 class SkipNode {
  public:
   /**
-   * @brief create a new SkipNode object with the provided key and value
+   * @brief allocate a new SkipNode with a tower of given height from an Arena
+   * @param arena the Arena to carve the memory from
+   * @param key key
+   * @param value value
+   * @param height how many levels this node participates in
+   * @param is_sentinel if this node is the head sentinel
+   * @return pointer to the new SkipNode, all next links are nullptr
+   * @tparam Alloc Arena or ConcurrentArena
+   */
+  template <typename Alloc>
+  static SkipNode *NewNode(Alloc *arena, K key, V value, int height,
+                           bool is_sentinel = false) {
+    return NewNodeAt(arena->AllocateAligned(AllocationSize(height)),
+                     std::move(key), std::move(value), height, is_sentinel);
+  }
+
+  /**
+   * @brief how much memory a SkipNode of a given height takes
+   * @param height how many levels the node participates in
+   * @return the size in bytes
+   */
+  static std::size_t AllocationSize(int height) {
+    return sizeof(SkipNode) + sizeof(std::atomic<SkipNode *>) * (height - 1);
+  }
+
+  /**
+   * @brief create a new SkipNode in memory already allocated, e.g. the
+   *        memory of a reclaimed node of the same height
+   * @param memory at least AllocationSize(height) bytes, pointer aligned
    * @param key key
    * @param value value
+   * @param height how many levels this node participates in
+   * @param is_sentinel if this node is the head sentinel
+   * @return pointer to the new SkipNode, all next links are nullptr
    */
-  explicit SkipNode(K key, V value, bool is_sentinel = false)
-      : key_(key), value_(value), is_sentinel_(is_sentinel) {}
+  static SkipNode *NewNodeAt(char *memory, K key, V value, int height,
+                             bool is_sentinel = false) {
+    auto node = new (memory)
+        SkipNode(std::move(key), std::move(value), height, is_sentinel);
+    for (int i = 1; i < height; i++) {
+      new (&node->next_[i]) std::atomic<SkipNode *>(nullptr);
+    }
+    return node;
+  }
 
   /**
    * @brief get the key this node is holding
-   * @return key
+   * @return key, valid as long as the node
    */
-  K GetKey() const { return key_; }
+  const K &GetKey() const { return key_; }
 
   /**
    * @brief get the value this node is holding
@@ -46,119 +147,358 @@ class SkipNode {
 
   /**
    * @brief overwrite the existing value by new value
+   *        note this is an in-place write, a concurrent reader of the same
+   *        node is not isolated from it (see MVCCSkipList), concurrent
+   *        writers hold the node's lock
    * @param value the new value to be updated
    */
-  void SetValue(V value) { value_ = value; }
+  void SetValue(V value) { value_ = std::move(value); }
 
   /**
-   * @brief give access to the SkipNode before this node
-   * @return pointer to SkipNode
+   * @brief copy the value out under the node's lock, so it is isolated from
+   *        a writer replacing it concurrently
+   * @return value
    */
-  SkipNode *GetBefore() const { return before_; }
+  V GetValueLocked() {
+    Lock();
+    V value = value_;
+    Unlock();
+    return value;
+  }
 
   /**
-   * @brief give access to the SkipNode after this node
-   * @return pointer to SkipNode
+   * @brief acquire the lock guarding the next links of this node against
+   *        other writers, readers never take it
    */
-  SkipNode *GetAfter() const { return after_; }
+  void Lock() { lock_.lock(); }
 
   /**
-   * @brief give access to the SkipNode below this node
-   * @return pointer to SkipNode
+   * @brief acquire the lock of this node if it is free, without waiting
+   * @return true if acquired, false otherwise
    */
-  SkipNode *GetBelow() const { return below_; }
+  bool TryLock() { return lock_.try_lock(); }
 
   /**
-   * @brief give access to the SkipNode above this node
-   * @return pointer to SkipNode
+   * @brief release the lock of this node
    */
-  SkipNode *GetAbove() const { return above_; }
+  void Unlock() { lock_.unlock(); }
 
   /**
-   * @brief if this node's value is a sentinel node
-   * @return true if positive infinity, false otherwise
+   * @brief if the node is being removed, set before it is unlinked
+   * @return true if removed, false otherwise
    */
-  bool IsSentinel() const { return is_sentinel_; }
+  bool IsMarked() const { return marked_.load(std::memory_order_acquire); }
+
+  /**
+   * @brief flag the node as removed, requires holding its lock
+   */
+  void Mark() { marked_.store(true, std::memory_order_release); }
+
+  /**
+   * @brief if the node is linked on all its levels
+   * @return true if fully linked, false while being inserted
+   */
+  bool IsFullyLinked() const {
+    return fully_linked_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief flag the node as linked on all its levels
+   */
+  void SetFullyLinked() { fully_linked_.store(true, std::memory_order_release); }
+
+  /**
+   * @brief how many levels this node participates in
+   * @return the height of the tower
+   */
+  int GetHeight() const { return height_; }
 
   /**
-   * @brief set the before node
-   * @param node the pointer to SkipNode as the before node
+   * @brief give access to the next SkipNode on a level
+   * @param level the level, must be smaller than the height
+   * @return pointer to SkipNode, nullptr if this is the last one
    */
-  void SetBefore(SkipNode *node) { before_ = node; }
+  SkipNode *GetNext(int level) const {
+    return next_[level].load(std::memory_order_acquire);
+  }
 
   /**
-   * @brief set the after node
-   * @param node the pointer to SkipNode as the after node
+   * @brief set the next node on a level, publishing it to concurrent readers
+   * @param level the level, must be smaller than the height
+   * @param node the pointer to SkipNode as the next node
    */
-  void SetAfter(SkipNode *node) { after_ = node; }
+  void SetNext(int level, SkipNode *node) {
+    next_[level].store(node, std::memory_order_release);
+  }
 
   /**
-   * @brief set the below node
-   * @param node the pointer to SkipNode as the below node
+   * @brief if this node is a sentinel node
+   * @return true if the head sentinel, false otherwise
    */
-  void SetBelow(SkipNode *node) { below_ = node; }
+  bool IsSentinel() const { return is_sentinel_; }
 
   /**
-   * @brief set the above node
-   * @param node the pointer to SkipNode as the above node
+   * @brief starting from this node on the given level, search the node with
+   *        biggest key that's smaller or equal to the one provided, and
+   *        record the path of the search without any allocation
+   * @param key the key for search
+   * @param level the level to start the search from
+   * @param path caller-provided buffer of at least level + 1 entries, filled
+   * with the rightmost node whose key is strictly smaller than the one
+   * provided, path[i] being the one on level i
+   * @param less the ordering of the keys
+   * @return pointer to SkipNode found
+   * @tparam Q a key type less can compare with K
    */
-  void SetAbove(SkipNode *node) { above_ = node; }
+  template <typename Q, typename Compare = std::less<>>
+  SkipNode *SkipSearch(const Q &key, int level, SkipNode **path,
+                       const Compare &less = Compare()) const {
+    auto curr = this;
+    while (true) {
+      while (curr->ShouldSkipRight(key, level, less)) {
+        curr = curr->GetNext(level);
+      }
+      path[level] = const_cast<SkipNode *>(curr);
+      if (level == 0) {
+        break;
+      }
+      level--;
+    }
+    return MatchOrSelf(curr, key, less);
+  }
 
   /**
-   * @brief set this node's value to represent positive infinity
+   * @brief the path-free version of SkipSearch for read-only lookups
+   * @param key the key for search
+   * @param level the level to start the search from
+   * @param less the ordering of the keys
+   * @param hops if not nullptr, where to add the steps taken, see
+   *        FindLessThan
+   * @return pointer to SkipNode with biggest key that's smaller or equal to key
+   * @tparam Q a key type less can compare with K
    */
-  void SetSentinel() { is_sentinel_ = true; }
+  template <typename Q, typename Compare = std::less<>>
+  SkipNode *FindLessOrEqual(const Q &key, int level,
+                            const Compare &less = Compare(),
+                            uint64_t *hops = nullptr) const {
+    return MatchOrSelf(FindLessThan(key, level, less, hops), key, less);
+  }
 
   /**
-   * @brief starting from this node, search the node with
-   *        biggest key that's smaller or equal to the one provided
+   * @brief search the node with biggest key that's strictly smaller than key
    * @param key the key for search
-   * @return pair of pointer to SkipNode and path of rightmost nodes traversed
-   * on each level
+   * @param level the level to start the search from
+   * @param less the ordering of the keys
+   * @param hops if not nullptr, where to add the steps taken, a step being
+   *        a move to the right or down one level
+   * @return pointer to SkipNode found, this node if there is none
+   * @tparam Q a key type less can compare with K
    */
-  std::pair<SkipNode *, std::vector<SkipNode *>> SkipSearch(K key) const {
-    std::vector<SkipNode *> path;
+  template <typename Q, typename Compare = std::less<>>
+  SkipNode *FindLessThan(const Q &key, int level,
+                         const Compare &less = Compare(),
+                         uint64_t *hops = nullptr) const {
     auto curr = this;
+    uint64_t steps = 0;
     while (true) {
-      while (curr->ShouldSkipRight(key)) {
-        curr = curr->GetAfter();
+      while (curr->ShouldSkipRight(key, level, less)) {
+        curr = curr->GetNext(level);
+        steps++;
       }
-      path.push_back(const_cast<SkipNode *>(curr));
-      if (curr->GetBelow() != nullptr) {
-        curr = curr->GetBelow();
-      } else {
+      steps++;
+      if (level == 0) {
+        break;
+      }
+      level--;
+    }
+    if (hops != nullptr) {
+      *hops += steps;
+    }
+    return const_cast<SkipNode *>(curr);
+  }
+
+  /**
+   * @brief search the last node on the bottom level
+   * @param level the level to start the search from
+   * @return pointer to the last SkipNode, this node if there is none
+   */
+  SkipNode *FindLast(int level) const {
+    auto curr = this;
+    while (true) {
+      auto next = curr->GetNext(level);
+      if (next != nullptr) {
+        curr = next;
+      } else if (level == 0) {
         break;
+      } else {
+        level--;
       }
     }
-    return {const_cast<SkipNode *>(curr), path};
+    return const_cast<SkipNode *>(curr);
   }
 
  private:
   /**
-   * @brief compare with the key, if should proceed going right
+   * @brief create a new SkipNode object with only the lowest level link
+   * @param key key
+   * @param value value
+   * @param height how many levels this node participates in
+   * @param is_sentinel if this node is the head sentinel
+   */
+  SkipNode(K key, V value, int height, bool is_sentinel)
+      : key_(std::move(key)),
+        value_(std::move(value)),
+        height_(height),
+        is_sentinel_(is_sentinel) {
+    next_[0].store(nullptr, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief finish a search standing on the last node smaller than key
+   * @param node the rightmost node on the bottom level smaller than key
+   * @param key the key for search
+   * @param less the ordering of the keys
+   * @return the next node if it holds the key exactly, otherwise node itself
+   */
+  template <typename Q, typename Compare>
+  static SkipNode *MatchOrSelf(const SkipNode *node, const Q &key,
+                               const Compare &less) {
+    // the next node is the first one not smaller than key
+    auto next = node->GetNext(0);
+    if (next != nullptr && !less(key, next->GetKey())) {
+      return next;
+    }
+    return const_cast<SkipNode *>(node);
+  }
+
+  /**
+   * @brief compare with the key, if should proceed going right on a level
    * @param key the provided key
+   * @param level the level
+   * @param less the ordering of the keys
    * @return true if should proceed, false otherwise
    */
-  bool ShouldSkipRight(K key) const {
-    if (after_ == nullptr || after_->IsSentinel()) {
-      return false;
-    }
-    return after_->GetKey() <= key;
+  template <typename Q, typename Compare>
+  bool ShouldSkipRight(const Q &key, int level, const Compare &less) const {
+    auto next = GetNext(level);
+    return next != nullptr && less(next->GetKey(), key);
   }
-  /** if the node is a sentinel node */
-  bool is_sentinel_ = false;
-  /** the pointer to the SkipNode before */
-  SkipNode *before_ = nullptr;
-  /** the pointer to the SkipNode after */
-  SkipNode *after_ = nullptr;
-  /** the pointer to the SkipNode below */
-  SkipNode *below_ = nullptr;
-  /** the pointer to the SkipNode above */
-  SkipNode *above_ = nullptr;
+
   /** key for this node */
   K key_;
-  /** real value for this node (dominated by neg_inf or inf) */
+  /** real value for this node */
   V value_;
+  /** how many levels this node participates in */
+  int height_;
+  /** if the node is a sentinel node */
+  bool is_sentinel_;
+  /** guards the next links against concurrent writers */
+  SpinLock lock_;
+  /** set once the node is logically removed */
+  std::atomic<bool> marked_{false};
+  /** set once the node is linked on all its levels */
+  std::atomic<bool> fully_linked_{false};
+  /** the tower of next links, its real length is height_, must be the last */
+  std::atomic<SkipNode *> next_[1];
+};
+
+/**
+ * @brief SkipListStats is a snapshot of the footprint and the activity of a
+ *        SkipList, see SkipList::GetStats
+ */
+struct SkipListStats {
+  /** how many keys */
+  std::size_t num_keys = 0;
+  /** the bytes the arena took from the heap: the nodes, the free lists and
+   *  the unused tails of the blocks */
+  std::size_t memory_usage = 0;
+  /** the bytes of the linked nodes, towers included, not counting the heap
+   *  memory their keys and values own, e.g. long std::string payloads */
+  std::size_t node_bytes = 0;
+  /** the height of the tallest tower */
+  int height = 0;
+  /** how many linked nodes are of each height, height h at index h - 1 */
+  std::vector<std::size_t> level_histogram;
+  /** how many searches: lookups, and writer searches including retries */
+  uint64_t num_searches = 0;
+  /** the steps taken by all the searches, a move right or down one level */
+  uint64_t search_hops = 0;
+  /** how many times a writer found a node lock taken and had to wait */
+  uint64_t lock_waits = 0;
+  /** the time writers spent waiting for node locks, in nanoseconds */
+  uint64_t lock_wait_nanos = 0;
+  /** removed nodes waiting to be reclaimed */
+  std::size_t num_retired = 0;
+  /** removed nodes reclaimed so far */
+  std::size_t num_reclaimed = 0;
+
+  /**
+   * @brief the memory taken per key
+   * @return memory_usage / num_keys, 0 if empty
+   */
+  double BytesPerKey() const {
+    return num_keys == 0 ? 0 : static_cast<double>(memory_usage) / num_keys;
+  }
+
+  /**
+   * @brief how many steps a search takes on average
+   * @return search_hops / num_searches, 0 if none
+   */
+  double AverageSearchHops() const {
+    return num_searches == 0
+               ? 0
+               : static_cast<double>(search_hops) / num_searches;
+  }
+
+  /**
+   * @brief add the stats of another SkipList, e.g. another shard
+   * @param other the other stats
+   */
+  void Merge(const SkipListStats &other) {
+    num_keys += other.num_keys;
+    memory_usage += other.memory_usage;
+    node_bytes += other.node_bytes;
+    height = std::max(height, other.height);
+    if (level_histogram.size() < other.level_histogram.size()) {
+      level_histogram.resize(other.level_histogram.size(), 0);
+    }
+    for (std::size_t i = 0; i < other.level_histogram.size(); i++) {
+      level_histogram[i] += other.level_histogram[i];
+    }
+    num_searches += other.num_searches;
+    search_hops += other.search_hops;
+    lock_waits += other.lock_waits;
+    lock_wait_nanos += other.lock_wait_nanos;
+    num_retired += other.num_retired;
+    num_reclaimed += other.num_reclaimed;
+  }
+
+  /**
+   * @brief a human-readable dump, one figure per line
+   * @return the dump
+   */
+  std::string ToString() const {
+    std::ostringstream out;
+    out << "keys: " << num_keys << "\n";
+    out << "memory: " << memory_usage << " bytes, " << BytesPerKey()
+        << " bytes per key, " << node_bytes << " bytes in nodes\n";
+    out << "height: " << height << "\n";
+    std::size_t nodes = 0;
+    for (auto count : level_histogram) {
+      nodes += count;
+    }
+    for (std::size_t i = 0; i < level_histogram.size(); i++) {
+      out << "  height " << i + 1 << ": " << level_histogram[i] << " nodes ("
+          << (nodes == 0 ? 0 : 100.0 * level_histogram[i] / nodes) << "%)\n";
+    }
+    out << "searches: " << num_searches << ", " << AverageSearchHops()
+        << " hops on average\n";
+    out << "lock waits: " << lock_waits << ", " << lock_wait_nanos
+        << " ns in total\n";
+    out << "removed: " << num_retired << " retired, " << num_reclaimed
+        << " reclaimed\n";
+    return out.str();
+  }
 };
 
 /**
@@ -166,199 +506,1287 @@ class SkipNode {
  *        it uses the SkipNode implemented above as unit of storage
  * @tparam K key type
  * @tparam V value type
+ * @tparam Comparator the less-than ordering of the keys, transparent ones
+ *         allow searching with other key types
  */
-template <typename K, typename V>
+template <typename K, typename V, typename Comparator = std::less<>>
 class SkipList {
  public:
+  /** the hard cap of the tower height, the head sentinel is this tall */
+  enum { kMaxHeight = 32 };
+
+  /**
+   * @brief Iterator walks the key-value pairs of a SkipList in key order
+   *        it never takes a lock, and stays valid while other threads insert
+   *        or remove, since it pins its thread for its whole lifetime: no
+   *        node is reclaimed meanwhile, so a long-lived Iterator holds back
+   *        the reclamation. It must be destroyed on the thread that created it
+   */
+  class Iterator {
+   public:
+    /**
+     * @brief create an Iterator over the list, initially not Valid
+     * @param list the SkipList to iterate, must outlive the Iterator
+     */
+    explicit Iterator(const SkipList *list) : list_(list) {}
+
+    /**
+     * @brief if the Iterator is positioned at a key-value pair
+     * @return true if positioned, false otherwise
+     */
+    bool Valid() const { return node_ != nullptr; }
+
+    /**
+     * @brief the key at the current position, requires Valid()
+     * @return key, valid until the Iterator moves or is destroyed
+     */
+    const K &GetKey() const { return node_->GetKey(); }
+
+    /**
+     * @brief the value at the current position, requires Valid()
+     * @return value
+     */
+    V GetValue() const { return node_->GetValue(); }
+
+    /**
+     * @brief the value at the current position copied under its node's lock,
+     *        like Get, requires Valid()
+     * @return value
+     */
+    V GetValueLocked() const { return node_->GetValueLocked(); }
+
+    /**
+     * @brief advance to the next key-value pair, requires Valid()
+     */
+    void Next() {
+      node_ = node_->GetNext(0);
+      if (node_ != nullptr) {
+        KVSTORE_PREFETCH(node_->GetNext(0));
+      }
+    }
+
+    /**
+     * @brief step back to the previous key-value pair, requires Valid()
+     *        there is no backward link, so this is a search of O(logn)
+     */
+    void Prev() {
+      node_ = list_->head->FindLessThan(
+          node_->GetKey(), list_->GetCurrHeight() - 1, list_->compare_);
+      if (node_->IsSentinel()) {
+        node_ = nullptr;
+      }
+    }
+
+    /**
+     * @brief position at the first key-value pair with key >= target
+     * @param target the key to seek
+     * @tparam Q K, or any key type a transparent Comparator compares with K
+     */
+    template <typename Q>
+    void Seek(const Q &target) {
+      node_ = list_->head
+                  ->FindLessThan(target, list_->GetCurrHeight() - 1,
+                                 list_->compare_)
+                  ->GetNext(0);
+    }
+
+    /**
+     * @brief position at the first key-value pair in the SkipList
+     */
+    void SeekToFirst() { node_ = list_->head->GetNext(0); }
+
+    /**
+     * @brief position at the last key-value pair in the SkipList
+     */
+    void SeekToLast() {
+      node_ = list_->head->FindLast(list_->GetCurrHeight() - 1);
+      if (node_->IsSentinel()) {
+        node_ = nullptr;
+      }
+    }
+
+   private:
+    /** keeps the nodes from being reclaimed under the Iterator */
+    EpochGuard guard_;
+    /** the SkipList being iterated */
+    const SkipList *list_;
+    /** the current position, nullptr if not Valid */
+    SkipNode<K, V> *node_ = nullptr;
+  };
+
+  /**
+   * @brief Cursor runs point operations on a SkipList from a finger: it
+   *        remembers the search path of its last operation, and the next
+   *        search climbs from the bottom of that path to the lowest level
+   *        that still brackets the new key, then goes down from there. A
+   *        search costs O(log d) steps, d being how many keys lie between
+   *        the previous key and the new one, instead of O(logn) from the
+   *        head, so a stream of ascending keys, like timestamps, is inserted
+   *        in O(1) amortized steps. Unlike an Iterator it pins its thread
+   *        only for the length of an operation, and forgets the finger when
+   *        its nodes may have been reclaimed since. It is not thread-safe,
+   *        give each writer thread its own
+   */
+  class Cursor {
+   public:
+    /**
+     * @brief create a Cursor over the list, with no finger yet
+     * @param list the SkipList to modify, must outlive the Cursor
+     */
+    explicit Cursor(SkipList *list) : list_(list) {}
+
+    /**
+     * @brief insert a key-value pair, copying them, like SkipInsert
+     * @param key the key
+     * @param value the value
+     * @return true if insertion is new, false if replace old key-value pair
+     */
+    bool Insert(const K &key, const V &value) {
+      return Run([&]() {
+        return list_->InsertImpl(key, value, preds_, succs_, &hint_height_);
+      });
+    }
+
+    /**
+     * @brief insert a key-value pair, moving them into the node, like
+     *        SkipInsert
+     * @param key the key
+     * @param value the value
+     * @return true if insertion is new, false if replace old key-value pair
+     */
+    bool Insert(K &&key, V &&value) {
+      return Run([&]() {
+        return list_->InsertImpl(std::move(key), std::move(value), preds_,
+                                 succs_, &hint_height_);
+      });
+    }
+
+    /**
+     * @brief remove a key, like SkipRemove
+     * @param key the key
+     * @return true if removal is successful, false otherwise
+     * @tparam Q K, or any key type a transparent Comparator compares with K
+     */
+    template <typename Q>
+    bool Remove(const Q &key) {
+      return Run([&]() {
+        return list_->RemoveImpl(key, preds_, succs_, &hint_height_,
+                                 nullptr);
+      });
+    }
+
+    /**
+     * @brief look up a key and copy its value out under the node's lock,
+     *        like Get, moving the finger to it
+     * @param key the key
+     * @param value where to store the value, untouched if not found
+     * @return true if found, false otherwise
+     * @tparam Q K, or any key type a transparent Comparator compares with K
+     */
+    template <typename Q>
+    bool Get(const Q &key, V *value) {
+      return Run([&]() {
+        int found = list_->FindNeighbors(key, 1, preds_, succs_, &hint_height_);
+        if (found == -1) {
+          return false;
+        }
+        SkipNode<K, V> *node = succs_[found];
+        if (!node->IsFullyLinked() || node->IsMarked()) {
+          return false;
+        }
+        *value = node->GetValueLocked();
+        for (int i = 0; i <= found; i++) {
+          preds_[i] = node;
+        }
+        return true;
+      });
+    }
+
+   private:
+    /**
+     * @brief run an operation pinned, keeping the finger only if no node of
+     *        it can have been reclaimed since the last operation: the nodes
+     *        it reached were unlinked at an epoch no older than the one read
+     *        before it pinned, and are not freed before the global epoch is
+     *        two past that, so while the epoch has not moved they are safe
+     *        for one more pinned operation
+     * @param op the operation, using preds_, succs_ and hint_height_
+     * @return what op returns
+     */
+    template <typename Op>
+    bool Run(Op &&op) {
+      EpochManager *epochs = EpochManager::Default();
+      uint64_t epoch = epochs->GetEpoch();
+      EpochGuard guard;
+      if (epochs->GetEpoch() != epoch_) {
+        hint_height_ = 0;
+      }
+      bool result = op();
+      epoch_ = epoch;
+      return result;
+    }
+
+    /** the SkipList being modified */
+    SkipList *list_;
+    /** the finger, the predecessors of the last key on each level */
+    SkipNode<K, V> *preds_[kMaxHeight];
+    /** the successors of the last key, only a buffer for the searches */
+    SkipNode<K, V> *succs_[kMaxHeight];
+    /** how many levels of preds_ hold the finger, 0 for none */
+    int hint_height_ = 0;
+    /** the global epoch read before the last operation pinned */
+    uint64_t epoch_ = 0;
+  };
+
   /**
    * @brief create a new SkipList object
    * @param max_height the maximum height allowed to grow
+   * @param compare the ordering of the keys
    */
-  explicit SkipList(int max_height = 10) : max_height_(max_height) {
-    // create the first layer of sentinel nodes
-    head = new SkipNode<K, V>(K{}, V{}, true);
-    auto tail = new SkipNode<K, V>(K{}, V{}, true);
-    head->SetAfter(tail);
-    tail->SetBefore(head);
-    curr_height_ = 1;
+  explicit SkipList(int max_height = 10,
+                    const Comparator &compare = Comparator())
+      : compare_(compare), max_height_(std::min<int>(max_height, kMaxHeight)) {
+    head = SkipNode<K, V>::NewNode(&arena_, K{}, V{}, kMaxHeight, true);
   }
 
   /**
    * @brief dtor to release all the SkipNodes in the SkipList
+   *        the memory goes away with the Arena in O(blocks), the nodes only
+   *        need to be visited when the key or value has a destructor to run
    */
   ~SkipList() {
-    // level-by-level dynamic memory release
-    auto curr = head;
-    while (curr) {
-      auto temp = curr->GetBelow();
-      ReleaseLevel(curr);
-      curr = temp;
+    if (!std::is_trivially_destructible<K>::value ||
+        !std::is_trivially_destructible<V>::value) {
+      auto curr = head;
+      while (curr) {
+        auto temp = curr->GetNext(0);
+        curr->~SkipNode();
+        curr = temp;
+      }
+      for (auto &retired : retired_) {
+        retired.node->~SkipNode();
+      }
+    }
+  }
+
+  /**
+   * @brief build a SkipList from key-value pairs already sorted by key in a
+   *        single linear pass, without any search. Tower heights are
+   *        deterministic and perfectly balanced: the i-th key (1-based) is
+   *        1 + ctz(i) tall, so level l holds every 2^l-th key
+   * @param first iterator to the first std::pair of key and value
+   * @param last iterator past the last pair
+   * @param max_height the maximum height allowed for later insertions
+   * @param compare the ordering of the keys, the one they are sorted by
+   * @return the newly built SkipList, a repeated key keeps the later value
+   */
+  template <typename InputIt>
+  static std::unique_ptr<SkipList> BuildFromSorted(
+      InputIt first, InputIt last, int max_height = 10,
+      const Comparator &compare = Comparator()) {
+    std::unique_ptr<SkipList> list(new SkipList(max_height, compare));
+    BulkBuilder builder(list.get());
+    for (; first != last; ++first) {
+      builder.Add(first->first, first->second);
+    }
+    builder.Finish();
+    return list;
+  }
+
+  /**
+   * @brief write the key-value pairs into a snapshot file and sync it
+   *        it walks the bottom level like LockedScan, copying each value
+   *        under its node's lock, so a concurrent replace is written whole,
+   *        as either its old or its new value. Writes racing with the walk
+   *        may or may not make it into the file
+   * @param fname the file name, overwritten if it exists
+   * @param sequence a sequence number to keep in the file, 0 if unused
+   * @return OK on success, the error otherwise
+   */
+  Status SaveSnapshot(const std::string &fname, uint64_t sequence = 0) const {
+    std::unique_ptr<WritableFile> file;
+    Status s = WritableFile::Open(fname, true, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    EpochGuard guard;
+    snapshot::Writer<K, V> writer(file.get());
+    for (auto curr = head->GetNext(0); curr != nullptr && s.ok();
+         curr = curr->GetNext(0)) {
+      s = writer.Add(curr->GetKey(), curr->GetValueLocked());
+    }
+    if (s.ok()) {
+      s = writer.Finish(sequence);
+    }
+    if (s.ok()) {
+      s = file->Sync();
+    }
+    Status close = file->Close();
+    return s.ok() ? close : s;
+  }
+
+  /**
+   * @brief build a SkipList from a snapshot file written by SaveSnapshot
+   *        the file is mapped and decoded straight into a bulk build, in one
+   *        sequential pass with no search
+   * @param fname the file name
+   * @param result where to store the newly built SkipList
+   * @param max_height the maximum height allowed for later insertions
+   * @param sequence where to store the sequence number kept in the file,
+   *        may be nullptr
+   * @param verify_checksums if to check the crc of all the records first
+   * @param compare the ordering of the keys, the one of the list saved
+   * @return OK on success, the error otherwise
+   */
+  static Status LoadSnapshot(const std::string &fname,
+                             std::unique_ptr<SkipList> *result,
+                             int max_height = 10, uint64_t *sequence = nullptr,
+                             bool verify_checksums = false,
+                             const Comparator &compare = Comparator()) {
+    result->reset();
+    std::unique_ptr<snapshot::Reader<K, V, Comparator>> reader;
+    Status s = snapshot::Reader<K, V, Comparator>::Open(
+        fname, verify_checksums, &reader, compare);
+    if (!s.ok()) {
+      return s;
     }
+    reader->AdviseSequential();
+    std::unique_ptr<SkipList> list(new SkipList(max_height, compare));
+    BulkBuilder builder(list.get());
+    typename snapshot::Reader<K, V, Comparator>::Iterator iter(reader.get());
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+      builder.Add(iter.GetKey(), iter.GetValue());
+    }
+    if (!iter.GetStatus().ok()) {
+      return iter.GetStatus();
+    }
+    builder.Finish();
+    if (sequence != nullptr) {
+      *sequence = reader->GetSequence();
+    }
+    *result = std::move(list);
+    return Status::OK();
   }
 
   /**
-   * @brief search in the SkipList with given key
+   * @brief search in the SkipList with given key, never blocks on writers
+   *        if another thread may remove the node found, hold an EpochGuard
+   *        for as long as the node is used
    * @param key key for search
    * @return the SkipNode with largest key that's smaller or equal to key
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  SkipNode<K, V> *SkipSearch(const Q &key) const {
+    EpochGuard guard;
+    uint64_t hops = 0;
+    auto node = head->FindLessOrEqual(key, GetCurrHeight() - 1, compare_, &hops);
+    RecordSearch(hops);
+    return node;
+  }
+
+  /**
+   * @brief look up a key and copy its value out under the node's lock, so
+   *        unlike reading the node SkipSearch returns, it is safe while other
+   *        threads replace or remove the same key
+   * @param key the key
+   * @param value where to store the value, untouched if not found
+   * @return true if found, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool Get(const Q &key, V *value) const {
+    EpochGuard guard;
+    uint64_t hops = 0;
+    auto node = head->FindLessOrEqual(key, GetCurrHeight() - 1, compare_, &hops);
+    RecordSearch(hops);
+    if (node->IsSentinel() || compare_(node->GetKey(), key) ||
+        !node->IsFullyLinked() || node->IsMarked()) {
+      return false;  // absent, or its insert or removal is still under way
+    }
+    *value = node->GetValueLocked();
+    return true;
+  }
+
+  /**
+   * @brief visit every key-value pair with lo <= key < hi in key order
+   *        it walks the bottom level sequentially without taking the lock,
+   *        prefetching the node after next while visiting the current one
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
+   */
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t Scan(const Lo &lo, const Hi &hi, Callback &&callback) const {
+    return ScanImpl<false>(lo, hi, callback);
+  }
+
+  /**
+   * @brief like Scan, but copy each value under its node's lock, like Get,
+   *        for callers that replace values concurrently. It costs one
+   *        uncontended lock per key visited
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam Lo, Hi K, or any key types a transparent Comparator compares
+   *         with K
    */
-  SkipNode<K, V> *SkipSearch(K key) {
-      return head->SkipSearch(key).first;
+  template <typename Lo, typename Hi, typename Callback>
+  std::size_t LockedScan(const Lo &lo, const Hi &hi,
+                         Callback &&callback) const {
+    return ScanImpl<true>(lo, hi, callback);
   }
 
   /**
-   * @brief insert into the SkipList of a key-value pair
+   * @brief insert into the SkipList of a key-value pair, copying them
    * @param key the key
    * @param value the value
    * @return true if insertion is new, false if replace old key-value pair
    */
-  bool SkipInsert(K key, V value) {
-    std::lock_guard<std::mutex> guard(mutex_);
-    auto search_pair = head->SkipSearch(key);
-    auto match = search_pair.first;
-    auto path = search_pair.second;
-    if (match->GetKey() == key && !match->IsSentinel()) {
-      // 1. already exist, replace the whole column's value by new value
-      while (match) {
-        auto temp = match->GetAbove();
-        match->SetValue(value);
-        match = temp;
-      }
-      return false;  // indicate a new value replacement for whole column
-    } else {
-      // 2. a new key-value to be inserted
-      int extend_height = rand() % max_height_ + 1;
-      if (extend_height > curr_height_) {
-        // build new sentinel layer until enough
-        int diff = extend_height - curr_height_;
-        while (diff--) {
-          BuildExtraLayer();
+  bool SkipInsert(const K &key, const V &value) {
+    SkipNode<K, V> *preds[kMaxHeight];
+    SkipNode<K, V> *succs[kMaxHeight];
+    int hint_height = 0;
+    EpochGuard guard;
+    return InsertImpl(key, value, preds, succs, &hint_height);
+  }
+
+  /**
+   * @brief insert into the SkipList of a key-value pair, moving them into
+   *        the node. The key is left alone if it already exists
+   * @param key the key
+   * @param value the value
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(K &&key, V &&value) {
+    SkipNode<K, V> *preds[kMaxHeight];
+    SkipNode<K, V> *succs[kMaxHeight];
+    int hint_height = 0;
+    EpochGuard guard;
+    return InsertImpl(std::move(key), std::move(value), preds, succs,
+                      &hint_height);
+  }
+
+  /**
+   * @brief like SkipInsert, and hand back the value it replaces, copied
+   *        under the node's lock, so each replaced value is seen by exactly
+   *        one writer
+   * @param key the key
+   * @param value the value
+   * @param replaced set to the old value if the key existed
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  bool SkipInsert(K &&key, V &&value, V *replaced) {
+    SkipNode<K, V> *preds[kMaxHeight];
+    SkipNode<K, V> *succs[kMaxHeight];
+    int hint_height = 0;
+    EpochGuard guard;
+    return InsertImpl(std::move(key), std::move(value), preds, succs,
+                      &hint_height, replaced);
+  }
+
+  /**
+   * @brief remove a key from the SkipList
+   * @param key the key
+   * @return true if removal is successful, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  bool SkipRemove(const Q &key) {
+    SkipNode<K, V> *preds[kMaxHeight];
+    SkipNode<K, V> *succs[kMaxHeight];
+    int hint_height = 0;
+    EpochGuard guard;
+    return RemoveImpl(key, preds, succs, &hint_height, nullptr);
+  }
+
+  /**
+   * @brief remove a key only if its value passes a test, run under the
+   *        node's lock so no writer replaces the value in between, e.g. to
+   *        remove a value only if it is still the one read before
+   * @param key the key
+   * @param pred invoked as pred(value), returns true to remove
+   * @return true if removal is successful, false otherwise
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q, typename Pred>
+  bool SkipRemoveIf(const Q &key, const Pred &pred) {
+    SkipNode<K, V> *preds[kMaxHeight];
+    SkipNode<K, V> *succs[kMaxHeight];
+    int hint_height = 0;
+    EpochGuard guard;
+    return RemoveImpl(key, preds, succs, &hint_height, pred);
+  }
+
+  /**
+   * @brief apply all the operations of a WriteBatch
+   *        the operations are stably sorted by key, so the last one issued on
+   *        a key still wins, and each search resumes from the previous search
+   *        path (a finger) instead of the top-left head. On sorted input every
+   *        search only moves as far as the distance to the previous key. The
+   *        batch is not atomic: readers and other writers may see it half
+   *        applied
+   * @param batch the operations to apply
+   */
+  void Write(const WriteBatch<K, V> &batch) {
+    auto &ops = batch.GetOps();
+    if (ops.empty()) {
+      return;
+    }
+    std::vector<const typename WriteBatch<K, V>::Op *> sorted;
+    sorted.reserve(ops.size());
+    for (auto &op : ops) {
+      sorted.push_back(&op);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [this](const typename WriteBatch<K, V>::Op *lhs,
+                            const typename WriteBatch<K, V>::Op *rhs) {
+                       return compare_(lhs->key, rhs->key);
+                     });
+
+    SkipNode<K, V> *preds[kMaxHeight];
+    SkipNode<K, V> *succs[kMaxHeight];
+    int hint_height = 0;
+    // the hints stay valid across the operations as long as we are pinned
+    EpochGuard guard;
+    for (auto op : sorted) {
+      if (op->type == OpType::kPut) {
+        InsertImpl(op->key, op->value, preds, succs, &hint_height);
+      } else {
+        RemoveImpl(op->key, preds, succs, &hint_height, nullptr);
+      }
+    }
+  }
+
+  /**
+   * @brief how many steps a search for a key takes, a step being a move to
+   *        the right or down one level. It measures how well balanced the
+   *        towers are, about 2 * log2(n) for a geometric distribution
+   * @param key the key for search
+   * @return the number of steps
+   * @tparam Q K, or any key type a transparent Comparator compares with K
+   */
+  template <typename Q>
+  std::size_t GetSearchPathLength(const Q &key) const {
+    std::size_t steps = 0;
+    EpochGuard guard;
+    const SkipNode<K, V> *curr = head;
+    for (int level = GetCurrHeight() - 1; level >= 0; level--) {
+      while (curr->GetNext(level) != nullptr &&
+             compare_(curr->GetNext(level)->GetKey(), key)) {
+        curr = curr->GetNext(level);
+        steps++;
+      }
+      steps++;
+    }
+    return steps;
+  }
+
+  /**
+   * @brief the number of levels in use
+   * @return the height of the tallest tower
+   */
+  int GetHeight() const { return GetCurrHeight(); }
+
+  /**
+   * @brief return how many key-value pair are present in the SkipList
+   * @return the number of key-value pairs in the SkipList
+   */
+  std::size_t GetSize() const {
+    return curr_size_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief an estimate of the memory held by the SkipList nodes
+   * @return the number of bytes allocated by the underlying Arena
+   */
+  std::size_t ApproximateMemoryUsage() const { return arena_.MemoryUsage(); }
+
+  /**
+   * @brief how many removed nodes wait to be reclaimed
+   * @return the number of retired nodes
+   */
+  std::size_t GetNumRetired() const {
+    std::lock_guard<SpinLock> guard(removed_lock_);
+    return retired_.size();
+  }
+
+  /**
+   * @brief how many removed nodes were reclaimed so far
+   * @return the number of reclaimed nodes
+   */
+  std::size_t GetNumReclaimed() const {
+    return num_reclaimed_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief a snapshot of the footprint and the activity of the SkipList
+   *        the counters behind it are kept per thread slot (see
+   *        statistics.h), so they are always on, and summed here
+   * @return the stats, not exact while writers are running
+   */
+  SkipListStats GetStats() const {
+    SkipListStats stats;
+    stats.num_keys = GetSize();
+    stats.memory_usage = ApproximateMemoryUsage();
+    stats.height = GetCurrHeight();
+    for (int height = 1; height <= kMaxHeight; height++) {
+      // an insert may be counted after the removal of its node, clamp
+      auto count = static_cast<int64_t>(
+          stats_.Get(kNodesOfHeight + height - 1));
+      if (count > 0) {
+        stats.level_histogram.resize(height, 0);
+        stats.level_histogram[height - 1] = count;
+        stats.node_bytes += count * SkipNode<K, V>::AllocationSize(height);
+      }
+    }
+    stats.num_searches = stats_.Get(kSearches);
+    stats.search_hops = stats_.Get(kSearchHops);
+    stats.lock_waits = stats_.Get(kLockWaits);
+    stats.lock_wait_nanos = stats_.Get(kLockWaitNanos);
+    stats.num_retired = GetNumRetired();
+    stats.num_reclaimed = GetNumReclaimed();
+    return stats;
+  }
+
+  /**
+   * @brief reassign the max height allowed for this SkipList
+   * @param height the new max height allowed, capped by kMaxHeight
+   */
+  void SetMaxHeight(int height) {
+    max_height_.store(std::min<int>(height, kMaxHeight),
+                      std::memory_order_relaxed);
+  }
+
+ private:
+  /**
+   * @brief walk the bottom level from lo up to hi, the body of Scan and
+   *        LockedScan
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   * @tparam kLockValues if to copy the values under the nodes' locks
+   */
+  template <bool kLockValues, typename Lo, typename Hi, typename Callback>
+  std::size_t ScanImpl(const Lo &lo, const Hi &hi, Callback &callback) const {
+    std::size_t count = 0;
+    EpochGuard guard;
+    auto curr =
+        head->FindLessThan(lo, GetCurrHeight() - 1, compare_)->GetNext(0);
+    while (curr != nullptr && compare_(curr->GetKey(), hi)) {
+      auto next = curr->GetNext(0);
+      if (next != nullptr) {
+        KVSTORE_PREFETCH(next->GetNext(0));
+      }
+      count++;
+      if (!callback(curr->GetKey(), kLockValues ? curr->GetValueLocked()
+                                                : curr->GetValue())) {
+        break;
+      }
+      curr = next;
+    }
+    return count;
+  }
+
+  /**
+   * @brief BulkBuilder appends key-value pairs, sorted by key, at the tail of
+   *        a SkipList nobody else uses yet. Tower heights are deterministic
+   *        and perfectly balanced: the i-th key (1-based) is 1 + ctz(i) tall,
+   *        so level l holds every 2^l-th key
+   */
+  class BulkBuilder {
+   public:
+    /**
+     * @brief start building into an empty SkipList
+     * @param list the SkipList to fill
+     */
+    explicit BulkBuilder(SkipList *list) : list_(list) {
+      std::fill(tails_, tails_ + kMaxHeight, list->head);
+    }
+
+    /**
+     * @brief append a key-value pair, a repeated key keeps the later value
+     * @param key the key, no smaller than the previous one
+     * @param value the value
+     */
+    void Add(const K &key, const V &value) {
+      auto tail = tails_[0];
+      if (!tail->IsSentinel() && !list_->compare_(tail->GetKey(), key)) {
+        assert(!list_->compare_(key, tail->GetKey()) && "input must be sorted");
+        tail->SetValue(value);
+        return;
+      }
+      count_++;
+      int height = std::min<int>(CountTrailingZeros(count_) + 1, kMaxHeight);
+      auto node = SkipNode<K, V>::NewNode(&list_->arena_, key, value, height);
+      node->SetFullyLinked();
+      heights_[height - 1]++;
+      for (int i = 0; i < height; i++) {
+        tails_[i]->SetNext(i, node);
+        tails_[i] = node;
+      }
+      curr_height_ = std::max(curr_height_, height);
+    }
+
+    /**
+     * @brief publish the height and the size of the built SkipList
+     */
+    void Finish() {
+      list_->curr_height_.store(curr_height_, std::memory_order_relaxed);
+      list_->curr_size_.store(count_, std::memory_order_relaxed);
+      for (int i = 0; i < kMaxHeight; i++) {
+        if (heights_[i] > 0) {
+          list_->stats_.Add(kNodesOfHeight + i, heights_[i]);
+        }
+      }
+      list_->max_height_.store(
+          std::max(list_->max_height_.load(std::memory_order_relaxed),
+                   curr_height_),
+          std::memory_order_relaxed);
+    }
+
+   private:
+    /** the SkipList being built */
+    SkipList *list_;
+    /** the last node linked on each level */
+    SkipNode<K, V> *tails_[kMaxHeight];
+    /** the height of the tallest tower so far */
+    int curr_height_ = 1;
+    /** how many distinct keys were appended */
+    uint64_t count_ = 0;
+    /** how many nodes of each height were appended, by height - 1 */
+    uint64_t heights_[kMaxHeight] = {};
+  };
+
+  /**
+   * @brief search the neighbors of a key on the levels below a height,
+   *        without locking. With a finger left in preds by a previous search,
+   *        it climbs from the bottom to the lowest level whose hint still
+   *        brackets the key, i.e. is smaller than it and links to a node not
+   *        smaller, and searches down from there, so a search near the
+   *        previous key takes a few steps instead of starting from the
+   *        top-left head. Otherwise it searches down from the top, resuming
+   *        each level from the further of the node found on the level above
+   *        and the hint, if not removed since
+   * @param key the key for search
+   * @param height how many levels of preds and succs to fill at least
+   * @param preds on each level, the last node with a key smaller than key,
+   *        holds the hint on entry
+   * @param succs on each level, the node following preds
+   * @param hint_height how many levels of preds hold a valid hint, 0 for
+   *        none, updated to the levels filled, the ones above keep theirs
+   * @return the highest level searched where succs holds the key, -1 if not
+   *         found
+   */
+  template <typename Q>
+  int FindNeighbors(const Q &key, int height, SkipNode<K, V> **preds,
+                    SkipNode<K, V> **succs, int *hint_height) const {
+    int found = -1;
+    uint64_t hops = 0;
+    int top = std::max(GetCurrHeight(), height) - 1;
+    for (int level = 0; level < *hint_height; level++) {
+      SkipNode<K, V> *hint = preds[level];
+      hops++;
+      if (!IsHintFor(hint, key)) {
+        continue;
+      }
+      SkipNode<K, V> *next = hint->GetNext(level);
+      if (next == nullptr || !compare_(next->GetKey(), key)) {
+        // the levels above bracket it too, but the ones to fill are searched
+        int start = std::max(level, height - 1);
+        if (start < *hint_height && IsHintFor(preds[start], key)) {
+          top = start;
+        }
+        break;
+      }
+    }
+    SkipNode<K, V> *pred = head;
+    for (int level = top; level >= 0; level--) {
+      if (level < *hint_height) {
+        SkipNode<K, V> *hint = preds[level];
+        if (!hint->IsSentinel() && IsHintFor(hint, key) &&
+            (pred->IsSentinel() || compare_(pred->GetKey(), hint->GetKey()))) {
+          pred = hint;
+        }
+      }
+      SkipNode<K, V> *curr = pred->GetNext(level);
+      while (curr != nullptr && compare_(curr->GetKey(), key)) {
+        pred = curr;
+        curr = pred->GetNext(level);
+        hops++;
+      }
+      hops++;
+      // curr is the first node not smaller than key
+      if (found == -1 && curr != nullptr && !compare_(key, curr->GetKey())) {
+        found = level;
+      }
+      preds[level] = pred;
+      succs[level] = curr;
+    }
+    *hint_height = std::max(*hint_height, top + 1);
+    RecordSearch(hops);
+    return found;
+  }
+
+  /**
+   * @brief if a node left in preds may still start a search for a key: the
+   *        head, or a node smaller than the key and not removed since
+   * @param hint the node
+   * @param key the key for search
+   * @return true if the search may start from it, false otherwise
+   */
+  template <typename Q>
+  bool IsHintFor(const SkipNode<K, V> *hint, const Q &key) const {
+    return hint->IsSentinel() ||
+           (!hint->IsMarked() && compare_(hint->GetKey(), key));
+  }
+
+  /**
+   * @brief count a search and its steps
+   * @param hops the steps taken
+   */
+  void RecordSearch(uint64_t hops) const {
+    stats_.Add(kSearches, 1);
+    stats_.Add(kSearchHops, hops);
+  }
+
+  /**
+   * @brief lock a node, timing the wait if another writer holds it
+   * @param node the node
+   */
+  void LockNode(SkipNode<K, V> *node) {
+    if (node->TryLock()) {
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    node->Lock();
+    auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    stats_.Add(kLockWaits, 1);
+    stats_.Add(kLockWaitNanos, waited.count());
+  }
+
+  /**
+   * @brief lock the distinct predecessors of the levels below a height,
+   *        bottom-up, i.e. in decreasing key order, and check that each
+   *        still links to its successor
+   * @param preds the predecessors found by FindNeighbors
+   * @param succs the successors found by FindNeighbors
+   * @param height how many levels to lock
+   * @param removing the node being removed, allowed to be marked, nullptr
+   *        for an insert
+   * @param locked where to store how many levels were locked, to be passed
+   *        to UnlockPredecessors even on failure
+   * @return true if every level is still valid, false to search again
+   */
+  bool LockPredecessors(SkipNode<K, V> **preds, SkipNode<K, V> **succs,
+                        int height, const SkipNode<K, V> *removing,
+                        int *locked) {
+    SkipNode<K, V> *prev = nullptr;
+    *locked = 0;
+    for (int level = 0; level < height; level++) {
+      SkipNode<K, V> *pred = preds[level];
+      SkipNode<K, V> *succ = succs[level];
+      if (pred != prev) {
+        LockNode(pred);
+        prev = pred;
+      }
+      *locked = level + 1;
+      if (pred->IsMarked() || pred->GetNext(level) != succ ||
+          (succ != nullptr && succ != removing && succ->IsMarked())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief release the locks taken by LockPredecessors
+   * @param preds the predecessors
+   * @param locked how many levels were locked
+   */
+  static void UnlockPredecessors(SkipNode<K, V> **preds, int locked) {
+    SkipNode<K, V> *prev = nullptr;
+    for (int level = 0; level < locked; level++) {
+      if (preds[level] != prev) {
+        preds[level]->Unlock();
+        prev = preds[level];
+      }
+    }
+  }
+
+  /**
+   * @brief insert a key-value pair, safe to run concurrently with other
+   *        writers
+   * @param key the key, moved into a new node if it is an rvalue
+   * @param value the value, moved into the node if it is an rvalue
+   * @param preds buffer of kMaxHeight entries, holding the hint of a
+   *        previous search for a smaller key, updated by this search
+   * @param succs buffer of kMaxHeight entries
+   * @param hint_height how many levels of preds hold a valid hint, updated
+   * @param replaced if not nullptr, set to the old value on a replacement
+   * @return true if insertion is new, false if replace old key-value pair
+   */
+  template <typename KeyArg, typename ValueArg>
+  bool InsertImpl(KeyArg &&key, ValueArg &&value, SkipNode<K, V> **preds,
+                  SkipNode<K, V> **succs, int *hint_height,
+                  V *replaced = nullptr) {
+    const int top_level = RandomHeight();
+    while (true) {
+      int found = FindNeighbors(key, top_level, preds, succs, hint_height);
+      if (found != -1) {
+        // 1. already exist, replace the value in the only copy
+        SkipNode<K, V> *node = succs[found];
+        while (!node->IsFullyLinked() && !node->IsMarked()) {
+          std::this_thread::yield();
+        }
+        LockNode(node);
+        if (node->IsMarked()) {
+          node->Unlock();
+          std::this_thread::yield();
+          continue;  // being removed, try again once it is gone
+        }
+        if (replaced != nullptr) {
+          *replaced = node->GetValue();
         }
-        // re-fetch the search path (not optimal)
-        auto research_pair = head->SkipSearch(key);
-        match = research_pair.first;
-        path = research_pair.second;
-      }
-      // build the new node all the way up, after each path[i]
-      SkipNode<K, V> *last = nullptr;
-      for (int i = path.size() - 1; i >= 0; i--) {
-        auto pre_node = path[i];
-        auto after_node = pre_node->GetAfter();
-        auto new_node = new SkipNode<K, V>(key, value);
-        pre_node->SetAfter(new_node);
-        after_node->SetBefore(new_node);
-        new_node->SetBefore(pre_node);
-        new_node->SetAfter(after_node);
-        new_node->SetBelow(last);
-        if (last) {
-          last->SetAbove(new_node);
+        node->SetValue(std::forward<ValueArg>(value));
+        node->Unlock();
+        for (int i = 0; i <= found; i++) {
+          preds[i] = node;
         }
-        last = new_node;
+        return false;  // indicate a new value replacement
+      }
+      // 2. a new key-value to be inserted
+      int locked;
+      if (!LockPredecessors(preds, succs, top_level, nullptr, &locked)) {
+        UnlockPredecessors(preds, locked);
+        *hint_height = 0;
+        continue;
+      }
+      // build the tower and link it bottom-up after each preds[i]
+      // the new node is fully built before preds[i] publishes it, so a
+      // concurrent reader either skips it or sees a consistent node
+      auto new_node = AllocateNode(std::forward<KeyArg>(key),
+                                   std::forward<ValueArg>(value), top_level);
+      for (int i = 0; i < top_level; i++) {
+        new_node->SetNext(i, succs[i]);
+        preds[i]->SetNext(i, new_node);
       }
-      curr_size_++;
+      new_node->SetFullyLinked();
+      UnlockPredecessors(preds, locked);
+      // the next key of an ascending stream starts right after this one
+      for (int i = 0; i < top_level; i++) {
+        preds[i] = new_node;
+      }
+      stats_.Add(kNodesOfHeight + top_level - 1, 1);
+      // the head sentinel is already kMaxHeight tall, a new level just
+      // starts from it. A reader that sees the old height misses a shortcut
+      int curr_height = GetCurrHeight();
+      while (top_level > curr_height &&
+             !curr_height_.compare_exchange_weak(curr_height, top_level,
+                                                 std::memory_order_relaxed)) {
+      }
+      curr_size_.fetch_add(1, std::memory_order_relaxed);
       // self-adjust the max height as the SkipList grows
-      max_height_ = std::max(max_height_, ExpectedHeight());
+      int max_height = max_height_.load(std::memory_order_relaxed);
+      int expected = std::min<int>(ExpectedHeight(), kMaxHeight);
+      if (expected > max_height) {
+        max_height_.compare_exchange_strong(max_height, expected,
+                                            std::memory_order_relaxed);
+      }
       return true;
     }
   }
 
   /**
-   * @brief remove a key from the SkipList
+   * @brief remove a key, safe to run concurrently with other writers
    * @param key the key
+   * @param preds buffer of kMaxHeight entries, holding the hint of a
+   *        previous search for a smaller key, updated by this search
+   * @param succs buffer of kMaxHeight entries
+   * @param hint_height how many levels of preds hold a valid hint, updated
+   * @param pred the test the value must pass under the node's lock, see
+   *        SkipRemoveIf, nullptr to remove unconditionally
    * @return true if removal is successful, false otherwise
    */
-  bool SkipRemove(K key) {
-    std::lock_guard<std::mutex> guard(mutex_);
-    auto match = SkipSearch(key);
-    if (match->GetKey() != key || match->IsSentinel()) {
-      // not exist in SkipList or is sentinel node
-      return false;
-    } else {
-      // remove the whole column
-      auto curr = match;
-      while (curr) {
-        auto temp = curr->GetAbove();
-        auto prev = curr->GetBefore();
-        auto next = curr->GetAfter();
-        prev->SetAfter(next);
-        next->SetBefore(prev);
-        delete curr;
-        curr = temp;
+  template <typename Q, typename Pred>
+  bool RemoveImpl(const Q &key, SkipNode<K, V> **preds,
+                  SkipNode<K, V> **succs, int *hint_height,
+                  const Pred &pred) {
+    SkipNode<K, V> *victim = nullptr;
+    int min_height = 0;
+    while (true) {
+      int found = FindNeighbors(key, std::max(min_height, 1), preds, succs,
+                                hint_height);
+      if (victim == nullptr) {
+        if (found == -1) {
+          return false;  // not exist in SkipList
+        }
+        SkipNode<K, V> *node = succs[found];
+        if (node->IsMarked()) {
+          return false;  // another writer is removing it
+        }
+        if (!node->IsFullyLinked() || found != node->GetHeight() - 1) {
+          // still being inserted, or taller than the levels searched
+          min_height = node->GetHeight();
+          if (!node->IsFullyLinked()) {
+            std::this_thread::yield();
+          }
+          continue;
+        }
+        LockNode(node);
+        if (node->IsMarked()) {
+          node->Unlock();
+          return false;
+        }
+        if constexpr (!std::is_same_v<Pred, std::nullptr_t>) {
+          if (!pred(node->GetValue())) {
+            node->Unlock();
+            return false;
+          }
+        }
+        // from now on the node is logically removed
+        node->Mark();
+        victim = node;
+        min_height = node->GetHeight();
       }
+      int locked;
+      if (!LockPredecessors(preds, succs, victim->GetHeight(), victim,
+                            &locked)) {
+        UnlockPredecessors(preds, locked);
+        *hint_height = 0;
+        continue;
+      }
+      // unlink the whole tower, top-down so that a reader never steps down
+      // from a still-linked level into an already unlinked one
+      for (int i = victim->GetHeight() - 1; i >= 0; i--) {
+        preds[i]->SetNext(i, victim->GetNext(i));
+      }
+      victim->Unlock();
+      UnlockPredecessors(preds, locked);
+      stats_.Add(kNodesOfHeight + victim->GetHeight() - 1,
+                 static_cast<uint64_t>(-1));
+      // a concurrent reader might be standing on this node
+      Retire(victim);
+      curr_size_.fetch_sub(1, std::memory_order_relaxed);
       return true;
     }
   }
 
   /**
-   * @brief return how many key-value pair are present in the SkipList
-   * @return the number of key-value pairs in the SkipList
+   * @brief allocate a node, reusing the memory of a reclaimed node of the
+   *        same height if there is one
+   * @param key key
+   * @param value value
+   * @param height how many levels the node participates in
+   * @return pointer to the new SkipNode, all next links are nullptr
    */
-  std::size_t GetSize() { return curr_size_; }
+  SkipNode<K, V> *AllocateNode(K key, V value, int height) {
+    if (num_free_.load(std::memory_order_relaxed) > 0) {
+      char *memory = nullptr;
+      {
+        std::lock_guard<SpinLock> guard(removed_lock_);
+        auto &free_list = free_[height - 1];
+        if (!free_list.empty()) {
+          memory = free_list.back();
+          free_list.pop_back();
+          num_free_.fetch_sub(1, std::memory_order_relaxed);
+        }
+      }
+      if (memory != nullptr) {
+        return SkipNode<K, V>::NewNodeAt(memory, std::move(key),
+                                         std::move(value), height);
+      }
+    }
+    return SkipNode<K, V>::NewNode(&arena_, std::move(key), std::move(value),
+                                   height);
+  }
 
   /**
-   * @brief reassign the max height allowed for this SkipList
-   * @param height the new max height allowed
+   * @brief retire a node just unlinked, and once a batch of them is
+   *        pending, reclaim those no pinned thread can reach any more
+   * @param node the node, unlinked from every level
    */
-  void SetMaxHeight(int height) { max_height_ = height; }
+  void Retire(SkipNode<K, V> *node) {
+    EpochManager *epochs = EpochManager::Default();
+    std::vector<SkipNode<K, V> *> reclaimed;
+    {
+      std::lock_guard<SpinLock> guard(removed_lock_);
+      retired_.push_back(Retired{node, epochs->GetEpoch()});
+      if (retired_.size() < next_reclaim_) {
+        return;
+      }
+      epochs->TryAdvance();
+      // retired in order, so the safe ones come first
+      while (!retired_.empty() && epochs->IsSafe(retired_.front().epoch)) {
+        reclaimed.push_back(retired_.front().node);
+        retired_.pop_front();
+      }
+      // try again after another batch, not on every removal while a reader
+      // holds the epoch back
+      next_reclaim_ = retired_.size() + kReclaimBatch;
+    }
+    if (reclaimed.empty()) {
+      return;
+    }
+    // the destructors of keys and values run outside of the lock
+    for (auto victim : reclaimed) {
+      victim->~SkipNode();
+    }
+    std::lock_guard<SpinLock> guard(removed_lock_);
+    for (auto victim : reclaimed) {
+      free_[victim->GetHeight() - 1].push_back(reinterpret_cast<char *>(victim));
+    }
+    num_free_.fetch_add(reclaimed.size(), std::memory_order_relaxed);
+    num_reclaimed_.fetch_add(reclaimed.size(), std::memory_order_relaxed);
+  }
 
- private:
   /**
-   * @brief build a new layer on top of current head with two sentinel nodes
+   * @brief count the trailing zero bits of a positive number
+   * @param n the number, must not be 0
+   * @return the number of trailing zero bits
    */
-  void BuildExtraLayer() {
-    auto new_head = new SkipNode<K, V>(K{}, V{}, true);
-    auto new_tail = new SkipNode<K, V>(K{}, V{}, true);
-    head->SetAbove(new_head);
-    new_head->SetBelow(head);
-    new_head->SetAfter(new_tail);
-    new_tail->SetBefore(new_head);
-
-    // find the old top-level's tail
-    auto curr = head;
-    while (curr->GetAfter() != nullptr) {
-      curr = curr->GetAfter();
+  static int CountTrailingZeros(uint64_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(n);
+#else
+    int count = 0;
+    while ((n & 1) == 0) {
+      n >>= 1;
+      count++;
     }
-    new_tail->SetBelow(curr);
-    curr->SetAbove(new_tail);
+    return count;
+#endif
+  }
 
-    curr_height_++;
-    head = new_head;
+  /**
+   * @brief how many levels are in use now
+   * @return the current height of the SkipList
+   */
+  int GetCurrHeight() const {
+    return curr_height_.load(std::memory_order_relaxed);
   }
 
   /**
-   * @brief in math theory, the expected height of the SkipList is log2(n) + 2
+   * @brief in math theory, the expected height of a SkipList of n keys with
+   *        p = 1/4 is log4(n) + 1, one more level is kept as headroom
    * @return the expected height of SkipList now
    */
   int ExpectedHeight() const {
-      return static_cast<int>(log2(curr_height_)) + 2;
+    std::size_t size = std::max<std::size_t>(GetSize(), 1);
+    return static_cast<int>(log2(static_cast<double>(size)) / 2) + 2;
   }
 
   /**
-   * @brief release the whole row of SkipNodes starting from the given one
-   * @param node the head of a row of SkipNodes
+   * @brief draw the height of a new tower from a geometric distribution
+   *        with p = 1/4, leveldb's branching factor: each level above the
+   *        first has a 1 in 4 chance. Two random bits decide each level, so
+   *        the height is read off the trailing zero bits of a random word
+   * @return the height, between 1 and max_height_
    */
-  void ReleaseLevel(SkipNode<K, V> *node) {
-    while (node) {
-      auto temp = node->GetAfter();
-      delete node;
-      node = temp;
-    }
+  int RandomHeight() const {
+    // the sentinel bit caps the count at 62, i.e. a height of 32
+    int height = CountTrailingZeros(NextRandom() | (1ull << 62)) / 2 + 1;
+    return std::min(height, max_height_.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * @brief the next number of a xorshift64 generator, one per thread so
+   *        writers share no state, unlike rand() and its global lock
+   * @return a random 64-bit word
+   */
+  static uint64_t NextRandom() {
+    static thread_local uint64_t state = NewSeed();
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  /**
+   * @brief a distinct, nonzero seed for each thread, splitmix64 applied to
+   *        a global counter
+   * @return the seed
+   */
+  static uint64_t NewSeed() {
+    static std::atomic<uint64_t> counter{0};
+    const uint64_t kGolden = 0x9e3779b97f4a7c15ull;
+    uint64_t z = counter.fetch_add(kGolden) + kGolden;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return z != 0 ? z : 1;
   }
 
+  /** the ordering of the keys */
+  Comparator compare_;
+
+  /** the Arena all the SkipNodes are carved from, by concurrent writers */
+  ConcurrentArena arena_;
+
   /** the maximum height we allow the SkipList to grow */
-  int max_height_;
+  std::atomic<int> max_height_;
 
   /** the current level of the SkipList */
-  int curr_height_ = 0;
+  std::atomic<int> curr_height_{1};
 
   /** how many key-value pairs are contained in the SkipList */
-  std::size_t curr_size_ = 0;
-
-  /** the mutex for concurrency control */
-  std::mutex mutex_;
+  std::atomic<std::size_t> curr_size_{0};
 
-  /** the top-left sentinel SkipNode in the SkipList */
+  /** the top-left sentinel SkipNode in the SkipList, kMaxHeight tall */
   SkipNode<K, V> *head = nullptr;
+
+  /** how many retired nodes are reclaimed at once */
+  static const std::size_t kReclaimBatch = 64;
+
+  /**
+   * @brief Retired is a node unlinked by SkipRemove, waiting until no pinned
+   *        thread can reach it
+   */
+  struct Retired {
+    /** the node, still constructed */
+    SkipNode<K, V> *node;
+    /** the epoch read right after the node was unlinked */
+    uint64_t epoch;
+  };
+
+  /** protects retired_, next_reclaim_ and free_ */
+  mutable SpinLock removed_lock_;
+
+  /** nodes unlinked by SkipRemove, oldest first */
+  std::deque<Retired> retired_;
+
+  /** how many retired nodes to wait for before trying to reclaim */
+  std::size_t next_reclaim_ = kReclaimBatch;
+
+  /** the memory of reclaimed nodes, by height - 1 */
+  std::vector<char *> free_[kMaxHeight];
+
+  /** how many pieces of memory free_ holds, checked without the lock */
+  std::atomic<std::size_t> num_free_{0};
+
+  /** how many nodes were reclaimed so far */
+  std::atomic<std::size_t> num_reclaimed_{0};
+
+  /** the counters behind GetStats */
+  enum Counter {
+    kSearches,
+    kSearchHops,
+    kLockWaits,
+    kLockWaitNanos,
+    /** the number of linked nodes of height h is at kNodesOfHeight + h - 1 */
+    kNodesOfHeight,
+    kNumCounters = kNodesOfHeight + kMaxHeight
+  };
+
+  /** the counters behind GetStats, bumped from const searches too */
+  mutable StatCounters<kNumCounters> stats_;
 };
 }  // namespace kvstore
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,476 @@
+/**
+ * snapshot.h
+ * This is the on-disk snapshot of a SkipList: its bottom level streamed into
+ * one compact sorted file, so that a restart bulk-builds the list in a single
+ * pass (or reads the file in place) instead of re-inserting every key
+ *
+ *   | record 0 | record 1 | ... | record n-1 | index | footer |
+ *
+ * + record: the key then the value, each encoded by its Coder, so strings
+ *   carry a varint32 length and numbers are fixed-length
+ * + index: the fixed64 offset of every kIndexInterval-th record, a sparse
+ *   index in the spirit of the restart points of leveldb's blocks
+ * + footer: fixed64 index offset | fixed64 record count | fixed64 sequence |
+ *   fixed32 masked crc32c of the records | fixed32 masked crc32c of the
+ *   index | fixed64 magic number
+ *
+ * The Reader maps the file into memory. Opening only checks the footer and
+ * the index, the records are paged in by the OS as they are touched. The
+ * records are sorted by the Comparator of the SkipList that wrote them, which
+ * is not kept in the file: a Reader must be given the same ordering
+ */
+#ifndef KVSTORE_SNAPSHOT_H
+#define KVSTORE_SNAPSHOT_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "coding.h"
+#include "crc32c.h"
+#include "env.h"
+#include "status.h"
+
+namespace kvstore {
+namespace snapshot {
+
+/** one record out of this many is pointed to by the index */
+static const uint64_t kIndexInterval = 16;
+
+/** the size of the footer */
+static const std::size_t kFooterSize = 8 + 8 + 8 + 4 + 4 + 8;
+
+/** the last 8 bytes of every snapshot file */
+static const uint64_t kMagicNumber = 0x6b7673736e617031ull;
+
+/**
+ * @brief Writer streams key-value pairs into a snapshot file
+ * @tparam K key type, must have a Coder
+ * @tparam V value type, must have a Coder
+ */
+template <typename K, typename V>
+class Writer {
+ public:
+  /**
+   * @brief create a Writer appending to an empty file
+   * @param dest the file, must outlive the Writer
+   */
+  explicit Writer(WritableFile *dest) : dest_(dest) {}
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  /**
+   * @brief append a key-value pair, keys must come in strictly increasing
+   *        order of the Comparator the file will be read with
+   * @param key the key
+   * @param value the value
+   * @return OK on success, the error otherwise
+   */
+  Status Add(const K &key, const V &value) {
+    if (count_ % kIndexInterval == 0) {
+      PutFixed64(&index_, offset_);
+    }
+    record_.clear();
+    Coder<K>::Encode(key, &record_);
+    Coder<V>::Encode(value, &record_);
+    data_crc_ = crc32c::Extend(data_crc_, record_.data(), record_.size());
+    offset_ += record_.size();
+    count_++;
+    return dest_->Append(record_);
+  }
+
+  /**
+   * @brief append the index and the footer, no Add is allowed after it
+   *        the file is neither synced nor closed
+   * @param sequence a sequence number to keep in the footer, 0 if unused
+   * @return OK on success, the error otherwise
+   */
+  Status Finish(uint64_t sequence) {
+    Status s = dest_->Append(index_);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string footer;
+    PutFixed64(&footer, offset_);
+    PutFixed64(&footer, count_);
+    PutFixed64(&footer, sequence);
+    PutFixed32(&footer, crc32c::Mask(data_crc_));
+    PutFixed32(&footer, crc32c::Mask(crc32c::Value(index_.data(),
+                                                   index_.size())));
+    PutFixed64(&footer, kMagicNumber);
+    return dest_->Append(footer);
+  }
+
+  /**
+   * @brief how many key-value pairs were added
+   * @return the number of key-value pairs
+   */
+  uint64_t GetCount() const { return count_; }
+
+ private:
+  /** the file being written */
+  WritableFile *dest_;
+  /** the sparse index built so far */
+  std::string index_;
+  /** the encoding buffer of a record */
+  std::string record_;
+  /** the offset of the next record */
+  uint64_t offset_ = 0;
+  /** how many records were added */
+  uint64_t count_ = 0;
+  /** the crc of all the records so far */
+  uint32_t data_crc_ = 0;
+};
+
+/**
+ * @brief Reader serves lookups and ordered walks straight from the mapped
+ *        pages of a snapshot file, it is immutable and thread-safe
+ * @tparam K key type, must have a Coder
+ * @tparam V value type, must have a Coder
+ * @tparam Comparator the less-than ordering the records were written in
+ */
+template <typename K, typename V, typename Comparator = std::less<>>
+class Reader {
+ public:
+  /**
+   * @brief Iterator walks the key-value pairs of a snapshot in key order
+   */
+  class Iterator {
+   public:
+    /**
+     * @brief create an Iterator over a snapshot, initially not Valid
+     * @param reader the snapshot, must outlive the Iterator
+     */
+    explicit Iterator(const Reader *reader) : reader_(reader) {}
+
+    /**
+     * @brief if the Iterator is positioned at a key-value pair
+     * @return true if positioned, false otherwise
+     */
+    bool Valid() const { return valid_; }
+
+    /**
+     * @brief the key at the current position, requires Valid()
+     * @return key
+     */
+    const K &GetKey() const { return key_; }
+
+    /**
+     * @brief the value at the current position, requires Valid()
+     * @return value
+     */
+    const V &GetValue() const { return value_; }
+
+    /**
+     * @brief OK, unless a corrupted record stopped the Iterator
+     * @return the status
+     */
+    Status GetStatus() const { return status_; }
+
+    /**
+     * @brief advance to the next key-value pair, requires Valid()
+     */
+    void Next() { ParseRecord(next_); }
+
+    /**
+     * @brief position at the first key-value pair with key >= target
+     * @param target the key to seek
+     */
+    void Seek(const K &target) {
+      const char *p;
+      status_ = reader_->FindIndexEntry(target, &p);
+      if (!status_.ok()) {
+        valid_ = false;
+        return;
+      }
+      ParseRecord(p);
+      while (valid_ && reader_->compare_(key_, target)) {
+        ParseRecord(next_);
+      }
+    }
+
+    /**
+     * @brief position at the first key-value pair in the snapshot
+     */
+    void SeekToFirst() { ParseRecord(reader_->data_); }
+
+   private:
+    /**
+     * @brief decode the record at p into the current position
+     * @param p the start of the record, the end of the records if none left
+     */
+    void ParseRecord(const char *p) {
+      valid_ = false;
+      if (p == reader_->data_limit_) {
+        return;
+      }
+      next_ = reader_->DecodeRecord(p, &key_, &value_);
+      if (next_ == nullptr) {
+        status_ = reader_->CorruptionError("bad record");
+        return;
+      }
+      valid_ = true;
+    }
+
+    /** the snapshot being iterated */
+    const Reader *reader_;
+    /** the start of the record after the current one */
+    const char *next_ = nullptr;
+    /** if positioned at a key-value pair */
+    bool valid_ = false;
+    /** the current key */
+    K key_{};
+    /** the current value */
+    V value_{};
+    /** why the Iterator stopped early, if it did */
+    Status status_;
+  };
+
+  /**
+   * @brief map a snapshot file and check its footer and index
+   * @param fname the file name
+   * @param verify_checksums if to also check the crc of all the records,
+   *        which reads the whole file
+   * @param result where to store the opened snapshot
+   * @param compare the ordering the records were written in
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const std::string &fname, bool verify_checksums,
+                     std::unique_ptr<Reader> *result,
+                     const Comparator &compare = Comparator()) {
+    result->reset();
+    std::unique_ptr<MmapReadableFile> file;
+    Status s = MmapReadableFile::Open(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    std::unique_ptr<Reader> reader(new Reader(std::move(file), compare));
+    s = reader->ParseFooter(verify_checksums);
+    if (s.ok()) {
+      *result = std::move(reader);
+    }
+    return s;
+  }
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  /**
+   * @brief look up the value of a key
+   *        a binary search over the index, then a walk of at most
+   *        kIndexInterval records
+   * @param key the key
+   * @param value where to store the value
+   * @return OK if found, NotFound if not, Corruption on a bad record
+   */
+  Status Get(const K &key, V *value) const {
+    const char *p;
+    Status s = FindIndexEntry(key, &p);
+    if (!s.ok()) {
+      return s;
+    }
+    K curr_key{};
+    V curr_value{};
+    for (uint64_t i = 0; i < kIndexInterval && p != data_limit_; i++) {
+      p = DecodeRecord(p, &curr_key, &curr_value);
+      if (p == nullptr) {
+        return CorruptionError("bad record");
+      }
+      if (!compare_(curr_key, key)) {
+        if (compare_(key, curr_key)) {
+          break;
+        }
+        *value = std::move(curr_value);
+        return Status::OK();
+      }
+    }
+    return Status::NotFound("key");
+  }
+
+  /**
+   * @brief visit every key-value pair with lo <= key < hi in key order
+   * @param lo the inclusive lower bound
+   * @param hi the exclusive upper bound
+   * @param callback invoked as callback(key, value), returns false to stop
+   * @return how many key-value pairs were visited
+   */
+  template <typename Callback>
+  std::size_t Scan(const K &lo, const K &hi, Callback &&callback) const {
+    std::size_t count = 0;
+    Iterator iter(this);
+    for (iter.Seek(lo); iter.Valid() && compare_(iter.GetKey(), hi);
+         iter.Next()) {
+      count++;
+      if (!callback(iter.GetKey(), iter.GetValue())) {
+        break;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief how many key-value pairs are in the snapshot
+   * @return the number of key-value pairs
+   */
+  uint64_t GetCount() const { return count_; }
+
+  /**
+   * @brief the sequence number given to Writer::Finish
+   * @return the sequence number
+   */
+  uint64_t GetSequence() const { return sequence_; }
+
+  /**
+   * @brief the size of the snapshot file
+   * @return the size in bytes
+   */
+  std::size_t GetFileSize() const { return file_->GetSize(); }
+
+  /**
+   * @brief tell the OS the whole snapshot is about to be read in order
+   */
+  void AdviseSequential() const { file_->AdviseSequential(); }
+
+  /**
+   * @brief tell the OS the snapshot is about to be read at random places
+   */
+  void AdviseRandom() const { file_->AdviseRandom(); }
+
+ private:
+  Reader(std::unique_ptr<MmapReadableFile> &&file, const Comparator &compare)
+      : file_(std::move(file)), compare_(compare) {}
+
+  /**
+   * @brief check the footer and the index, and locate the records
+   * @param verify_checksums if to also check the crc of all the records
+   * @return OK on success, Corruption otherwise
+   */
+  Status ParseFooter(bool verify_checksums) {
+    std::size_t size = file_->GetSize();
+    if (size < kFooterSize) {
+      return CorruptionError("file too short");
+    }
+    const char *footer = file_->GetData() + size - kFooterSize;
+    if (DecodeFixed64(footer + 32) != kMagicNumber) {
+      return CorruptionError("bad magic number");
+    }
+    uint64_t index_offset = DecodeFixed64(footer);
+    count_ = DecodeFixed64(footer + 8);
+    sequence_ = DecodeFixed64(footer + 16);
+    uint32_t data_crc = crc32c::Unmask(DecodeFixed32(footer + 24));
+    uint32_t index_crc = crc32c::Unmask(DecodeFixed32(footer + 28));
+
+    if (index_offset > size - kFooterSize) {
+      return CorruptionError("bad index offset");
+    }
+    uint64_t index_size = size - kFooterSize - index_offset;
+    num_index_entries_ = (count_ + kIndexInterval - 1) / kIndexInterval;
+    if (index_size != num_index_entries_ * 8) {
+      return CorruptionError("bad index size");
+    }
+    data_ = file_->GetData();
+    data_limit_ = data_ + index_offset;
+    index_ = data_limit_;
+    if (crc32c::Value(index_, index_size) != index_crc) {
+      return CorruptionError("index checksum mismatch");
+    }
+    for (uint64_t i = 0; i < num_index_entries_; i++) {
+      if (GetIndexEntry(i) >= index_offset) {
+        return CorruptionError("bad index entry");
+      }
+    }
+    if (verify_checksums &&
+        crc32c::Value(data_, data_limit_ - data_) != data_crc) {
+      return CorruptionError("record checksum mismatch");
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief the offset of the record pointed to by an index entry
+   * @param i the index entry
+   * @return the offset of the (i * kIndexInterval)-th record
+   */
+  uint64_t GetIndexEntry(uint64_t i) const {
+    return DecodeFixed64(index_ + i * 8);
+  }
+
+  /**
+   * @brief find the last indexed record with key <= target, or the first
+   *        record if every key is greater
+   * @param target the key to search
+   * @param result where to store the start of the record
+   * @return OK on success, Corruption on a bad record
+   */
+  Status FindIndexEntry(const K &target, const char **result) const {
+    *result = data_;
+    if (num_index_entries_ == 0) {
+      return Status::OK();
+    }
+    uint64_t left = 0;
+    uint64_t right = num_index_entries_ - 1;
+    K key{};
+    while (left < right) {
+      uint64_t mid = (left + right + 1) / 2;
+      if (Coder<K>::Decode(data_ + GetIndexEntry(mid), data_limit_, &key) ==
+          nullptr) {
+        return CorruptionError("bad indexed key");
+      }
+      if (compare_(target, key)) {
+        right = mid - 1;
+      } else {
+        left = mid;
+      }
+    }
+    *result = data_ + GetIndexEntry(left);
+    return Status::OK();
+  }
+
+  /**
+   * @brief decode a record
+   * @param p the start of the record
+   * @param key where to store the key
+   * @param value where to store the value
+   * @return pointer past the record, nullptr if malformed
+   */
+  const char *DecodeRecord(const char *p, K *key, V *value) const {
+    p = Coder<K>::Decode(p, data_limit_, key);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    return Coder<V>::Decode(p, data_limit_, value);
+  }
+
+  /**
+   * @brief a Corruption status naming the file
+   * @param msg what is wrong
+   * @return the status
+   */
+  Status CorruptionError(const std::string &msg) const {
+    return Status::Corruption(file_->GetName() + ": " + msg);
+  }
+
+  /** the mapped file */
+  std::unique_ptr<MmapReadableFile> file_;
+  /** the ordering of the records */
+  Comparator compare_;
+  /** the first record */
+  const char *data_ = nullptr;
+  /** the end of the records, where the index starts */
+  const char *data_limit_ = nullptr;
+  /** the sparse index */
+  const char *index_ = nullptr;
+  /** how many entries are in the index */
+  uint64_t num_index_entries_ = 0;
+  /** how many records are in the snapshot */
+  uint64_t count_ = 0;
+  /** the sequence number given to Writer::Finish */
+  uint64_t sequence_ = 0;
+};
+}  // namespace snapshot
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * statistics.h
+ * These are event counters cheap enough to leave on in production, in the
+ * spirit of RocksDB's per-core Statistics. A single shared atomic counter
+ * bumped by every thread would bounce its cache line between the cores on
+ * every event. Here each thread is assigned one of a few slots, round
+ * robin, and only ever adds to the counters of its own slot, each slot on
+ * its own cache lines. A read sums the slots, so it is the reader that pays,
+ * and it is a snapshot while writers are running
+ */
+#ifndef KVSTORE_STATISTICS_H
+#define KVSTORE_STATISTICS_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace kvstore {
+
+/**
+ * @brief StatCounters is a fixed set of counters, all thread-safe
+ * @tparam kNumCounters how many counters, indexed from 0
+ */
+template <int kNumCounters>
+class StatCounters {
+ public:
+  /** the number of slots, threads are spread over them round robin */
+  static const int kNumSlots = 16;
+
+  StatCounters() = default;
+
+  StatCounters(const StatCounters &) = delete;
+  StatCounters &operator=(const StatCounters &) = delete;
+
+  /**
+   * @brief add to a counter, in the slot of the calling thread
+   * @param counter the counter index
+   * @param n how much to add, wraps around modulo 2^64 so a negative
+   *        amount cast to uint64_t subtracts
+   */
+  void Add(int counter, uint64_t n) {
+    slots_[SlotIndex()].values[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief read a counter, summing all the slots
+   * @param counter the counter index
+   * @return the value
+   */
+  uint64_t Get(int counter) const {
+    uint64_t sum = 0;
+    for (auto &slot : slots_) {
+      sum += slot.values[counter].load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  /**
+   * @brief Slot is the set of counters of a group of threads, aligned so
+   *        that two slots never share a cache line
+   */
+  struct alignas(64) Slot {
+    /** the counters */
+    std::atomic<uint64_t> values[kNumCounters] = {};
+  };
+
+  /**
+   * @brief the slot of the calling thread, assigned on its first call
+   * @return the slot index
+   */
+  static int SlotIndex() {
+    static std::atomic<int> next_index{0};
+    static thread_local int index =
+        next_index.fetch_add(1, std::memory_order_relaxed) % kNumSlots;
+    return index;
+  }
+
+  /** the slots */
+  Slot slots_[kNumSlots];
+};
+}  // namespace kvstore
+
+#endif
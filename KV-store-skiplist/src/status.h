@@ -0,0 +1,127 @@
+/**
+ * status.h
+ * This is the result of an operation that might fail, modeled after leveldb's
+ * Status. It is either OK, or carries an error code and a message
+ */
+#ifndef KVSTORE_STATUS_H
+#define KVSTORE_STATUS_H
+
+#include <string>
+
+namespace kvstore {
+
+/**
+ * @brief Status reports the success or the failure of an operation
+ */
+class Status {
+ public:
+  /**
+   * @brief create a success Status
+   */
+  Status() = default;
+
+  /**
+   * @brief factory of a success Status
+   * @return OK Status
+   */
+  static Status OK() { return Status(); }
+
+  /**
+   * @brief factory of a not found Status
+   * @param msg what is not found
+   * @return NotFound Status
+   */
+  static Status NotFound(const std::string &msg) {
+    return Status(kNotFound, msg);
+  }
+
+  /**
+   * @brief factory of a data corruption Status
+   * @param msg what is corrupted
+   * @return Corruption Status
+   */
+  static Status Corruption(const std::string &msg) {
+    return Status(kCorruption, msg);
+  }
+
+  /**
+   * @brief factory of an invalid argument Status
+   * @param msg what is invalid
+   * @return InvalidArgument Status
+   */
+  static Status InvalidArgument(const std::string &msg) {
+    return Status(kInvalidArgument, msg);
+  }
+
+  /**
+   * @brief factory of an IO error Status
+   * @param msg what went wrong
+   * @return IOError Status
+   */
+  static Status IOError(const std::string &msg) {
+    return Status(kIOError, msg);
+  }
+
+  /**
+   * @brief if the Status indicates a success
+   * @return true if success, false otherwise
+   */
+  bool ok() const { return code_ == kOk; }
+
+  /**
+   * @brief if the Status indicates a not found error
+   * @return true if not found, false otherwise
+   */
+  bool IsNotFound() const { return code_ == kNotFound; }
+
+  /**
+   * @brief if the Status indicates a corruption error
+   * @return true if corruption, false otherwise
+   */
+  bool IsCorruption() const { return code_ == kCorruption; }
+
+  /**
+   * @brief if the Status indicates an IO error
+   * @return true if IO error, false otherwise
+   */
+  bool IsIOError() const { return code_ == kIOError; }
+
+  /**
+   * @brief human readable description of the Status
+   * @return the description
+   */
+  std::string ToString() const {
+    switch (code_) {
+      case kOk:
+        return "OK";
+      case kNotFound:
+        return "NotFound: " + msg_;
+      case kCorruption:
+        return "Corruption: " + msg_;
+      case kInvalidArgument:
+        return "Invalid argument: " + msg_;
+      case kIOError:
+        return "IO error: " + msg_;
+    }
+    return msg_;
+  }
+
+ private:
+  /** the kind of error */
+  enum Code { kOk, kNotFound, kCorruption, kInvalidArgument, kIOError };
+
+  /**
+   * @brief create an error Status
+   * @param code the kind of error
+   * @param msg the error message
+   */
+  Status(Code code, const std::string &msg) : code_(code), msg_(msg) {}
+
+  /** the kind of error, kOk for success */
+  Code code_ = kOk;
+  /** the error message, empty for success */
+  std::string msg_;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,430 @@
+/**
+ * table.h
+ * This is the reader of a table file (see table_format.h). Opening a table
+ * reads its footer and keeps its index block and its filter block in memory,
+ * data blocks are read from the file on demand. A lookup first probes the
+ * filter, so a key missing from the table usually costs no read at all.
+ * With a block cache, the data blocks read are kept in it under the cache id
+ * of the table and their offset, so a hot block is read from the file once.
+ * A table is immutable, so it is safe to read from many threads at once
+ */
+#ifndef KVSTORE_TABLE_H
+#define KVSTORE_TABLE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "block.h"
+#include "cache.h"
+#include "coding.h"
+#include "env.h"
+#include "filter_policy.h"
+#include "iterator.h"
+#include "options.h"
+#include "status.h"
+#include "table_format.h"
+
+namespace kvstore {
+
+/**
+ * @brief Table serves lookups and ordered walks over a table file
+ * @tparam K key type, must have a Coder
+ * @tparam T value type, must have a Coder
+ */
+template <typename K, typename T>
+class Table {
+ public:
+  /**
+   * @brief open a table file, reading its footer, index block and filter
+   *        block
+   * @param options the filter policy to probe the filter with, the filter is
+   *        ignored without one, and the block cache, if any
+   * @param fname the file name
+   * @param result where to store the opened table
+   * @return OK on success, the error otherwise
+   */
+  static Status Open(const Options &options, const std::string &fname,
+                     std::unique_ptr<Table> *result) {
+    result->reset();
+    uint64_t size;
+    Status s = kvstore::GetFileSize(fname, &size);
+    if (!s.ok()) {
+      return s;
+    }
+    if (size < kTableFooterSize) {
+      return Status::Corruption(fname + ": file too short to be a table");
+    }
+    std::unique_ptr<RandomAccessFile> file;
+    s = RandomAccessFile::Open(fname, &file);
+    if (!s.ok()) {
+      return s;
+    }
+    char footer[kTableFooterSize];
+    s = file->Read(size - kTableFooterSize, kTableFooterSize, footer);
+    if (!s.ok()) {
+      return s;
+    }
+    if (DecodeFixed64(footer + 40) != kTableMagicNumber) {
+      return Status::Corruption(fname + ": bad magic number");
+    }
+    BlockHandle filter_handle;
+    filter_handle.offset = DecodeFixed64(footer);
+    filter_handle.size = DecodeFixed64(footer + 8);
+    BlockHandle index_handle;
+    index_handle.offset = DecodeFixed64(footer + 16);
+    index_handle.size = DecodeFixed64(footer + 24);
+    if (!index_handle.FitsIn(size - kTableFooterSize)) {
+      return Status::Corruption(fname + ": bad index block handle");
+    }
+    std::string contents;
+    s = ReadBlock(file.get(), index_handle, &contents);
+    if (!s.ok()) {
+      return s;
+    }
+    std::unique_ptr<Table> table(new Table(std::move(file)));
+    if (options.block_cache != nullptr) {
+      table->block_cache_ = options.block_cache;
+      table->cache_id_ = options.block_cache->NewId();
+    }
+    table->index_block_.reset(new IndexBlock(std::move(contents)));
+    if (options.filter_policy != nullptr && filter_handle.size > 0) {
+      if (!filter_handle.FitsIn(index_handle.offset)) {
+        return Status::Corruption(fname + ": bad filter block handle");
+      }
+      s = ReadBlock(table->file_.get(), filter_handle, &table->filter_);
+      if (!s.ok()) {
+        return s;
+      }
+      table->filter_policy_ = options.filter_policy;
+    }
+    // the key range of the table: the largest key ends the last data block,
+    // the smallest one starts the first data block
+    typename IndexBlock::Iterator index_iter(table->index_block_.get());
+    for (index_iter.SeekToFirst(); index_iter.Valid(); index_iter.Next()) {
+      table->largest_ = index_iter.GetKey();
+    }
+    if (!index_iter.GetStatus().ok()) {
+      return Status::Corruption(fname + ": bad index block");
+    }
+    index_iter.SeekToFirst();
+    if (index_iter.Valid()) {
+      std::shared_ptr<const DataBlock> block;
+      s = table->ReadDataBlock(index_iter, &block);
+      if (!s.ok()) {
+        return s;
+      }
+      typename DataBlock::Iterator block_iter(block.get());
+      block_iter.SeekToFirst();
+      if (!block_iter.Valid()) {
+        return Status::Corruption(fname + ": bad data block");
+      }
+      table->smallest_ = block_iter.GetKey();
+    }
+    table->sequence_ = DecodeFixed64(footer + 32);
+    table->file_size_ = size;
+    *result = std::move(table);
+    return Status::OK();
+  }
+
+  Table(const Table &) = delete;
+  Table &operator=(const Table &) = delete;
+
+  /**
+   * @brief look up the value of a key
+   *        a probe of the filter, then a search in the index block and a
+   *        search in one data block
+   * @param key the key
+   * @param value where to store the value
+   * @return OK if found, NotFound if not, the error otherwise
+   */
+  Status Get(const K &key, T *value) const {
+    if (!KeyMayMatch(key)) {
+      return Status::NotFound("key");
+    }
+    typename IndexBlock::Iterator index_iter(index_block_.get());
+    index_iter.Seek(key);
+    if (!index_iter.Valid()) {
+      return index_iter.GetStatus().ok() ? Status::NotFound("key")
+                                         : index_iter.GetStatus();
+    }
+    std::shared_ptr<const DataBlock> block;
+    Status s = ReadDataBlock(index_iter, &block);
+    if (!s.ok()) {
+      return s;
+    }
+    typename DataBlock::Iterator block_iter(block.get());
+    block_iter.Seek(key);
+    if (!block_iter.Valid()) {
+      return block_iter.GetStatus().ok() ? Status::NotFound("key")
+                                         : block_iter.GetStatus();
+    }
+    if (key < block_iter.GetKey()) {
+      return Status::NotFound("key");
+    }
+    if (!block_iter.GetValue(value)) {
+      return Status::Corruption(file_->GetName() + ": bad value");
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief probe the filter of the table, without any read
+   * @param key the key
+   * @return false if the key is definitely not in the table, true if it may
+   *         be, or if the table has no filter
+   */
+  bool KeyMayMatch(const K &key) const {
+    if (filter_policy_ == nullptr) {
+      return true;
+    }
+    std::string encoded;
+    Coder<K>::Encode(key, &encoded);
+    return filter_policy_->KeyMayMatch(encoded, filter_);
+  }
+
+  /**
+   * @brief probe the filter of the table for several keys at once, see
+   *        FilterPolicy::KeysMayMatch
+   * @param keys the keys
+   * @param results where to store KeyMayMatch of each key
+   */
+  void KeysMayMatch(const std::vector<K> &keys, bool *results) const {
+    if (filter_policy_ == nullptr) {
+      std::fill(results, results + keys.size(), true);
+      return;
+    }
+    std::vector<std::string> encoded(keys.size());
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      Coder<K>::Encode(keys[i], &encoded[i]);
+    }
+    filter_policy_->KeysMayMatch(encoded.data(), static_cast<int>(keys.size()),
+                                 filter_, results);
+  }
+
+  /**
+   * @brief an Iterator over all the key-value pairs in key order
+   * @return the Iterator, must not outlive the Table
+   */
+  std::unique_ptr<Iterator<K, T>> NewIterator() const {
+    return std::unique_ptr<Iterator<K, T>>(new TableIterator(this));
+  }
+
+  /**
+   * @brief the largest sequence number in the table
+   * @return the sequence number
+   */
+  uint64_t GetSequence() const { return sequence_; }
+
+  /**
+   * @brief the size of the table file
+   * @return the size in bytes
+   */
+  uint64_t GetFileSize() const { return file_size_; }
+
+  /**
+   * @brief the smallest key in the table, requires a non-empty table
+   * @return the key
+   */
+  const K &GetSmallestKey() const { return smallest_; }
+
+  /**
+   * @brief the largest key in the table, requires a non-empty table
+   * @return the key
+   */
+  const K &GetLargestKey() const { return largest_; }
+
+ private:
+  /** the index block maps a key separating a data block from the next one
+   *  (the last key, for the last block) to its location */
+  using IndexBlock = Block<K, BlockHandle>;
+  /** a data block holds the key-value pairs */
+  using DataBlock = Block<K, T>;
+
+  /**
+   * @brief TableIterator walks the index block, and the data block the index
+   *        points to, a two-level iterator in leveldb's terms
+   */
+  class TableIterator : public Iterator<K, T> {
+   public:
+    explicit TableIterator(const Table *table)
+        : table_(table), index_iter_(table->index_block_.get()) {}
+
+    bool Valid() const override {
+      return data_iter_ != nullptr && data_iter_->Valid();
+    }
+
+    void SeekToFirst() override {
+      index_iter_.SeekToFirst();
+      InitDataBlock();
+      if (data_iter_ != nullptr) {
+        data_iter_->SeekToFirst();
+      }
+      SkipEmptyDataBlocks();
+    }
+
+    void Seek(const K &target) override {
+      index_iter_.Seek(target);
+      InitDataBlock();
+      if (data_iter_ != nullptr) {
+        data_iter_->Seek(target);
+      }
+      SkipEmptyDataBlocks();
+    }
+
+    void Next() override {
+      data_iter_->Next();
+      SkipEmptyDataBlocks();
+    }
+
+    K GetKey() const override { return data_iter_->GetKey(); }
+
+    T GetValue() const override {
+      T value{};
+      data_iter_->GetValue(&value);
+      return value;
+    }
+
+    Status GetStatus() const override {
+      if (!index_iter_.GetStatus().ok()) {
+        return index_iter_.GetStatus();
+      }
+      if (data_iter_ != nullptr && !data_iter_->GetStatus().ok()) {
+        return data_iter_->GetStatus();
+      }
+      return status_;
+    }
+
+   private:
+    /**
+     * @brief read the data block the index Iterator points to
+     */
+    void InitDataBlock() {
+      data_iter_.reset();
+      data_block_.reset();
+      if (!index_iter_.Valid()) {
+        return;
+      }
+      Status s = table_->ReadDataBlock(index_iter_, &data_block_);
+      if (!s.ok()) {
+        status_ = s;
+        return;
+      }
+      data_iter_.reset(new typename DataBlock::Iterator(data_block_.get()));
+    }
+
+    /**
+     * @brief move on to the following data blocks while the current one is
+     *        exhausted
+     */
+    void SkipEmptyDataBlocks() {
+      while (data_iter_ != nullptr && !data_iter_->Valid()) {
+        if (!data_iter_->GetStatus().ok()) {
+          return;
+        }
+        index_iter_.Next();
+        InitDataBlock();
+        if (data_iter_ != nullptr) {
+          data_iter_->SeekToFirst();
+        }
+      }
+    }
+
+    /** the Table being iterated */
+    const Table *table_;
+    /** the position in the index block */
+    typename IndexBlock::Iterator index_iter_;
+    /** the data block the index points to, pinned in the cache if any */
+    std::shared_ptr<const DataBlock> data_block_;
+    /** the position in the data block, nullptr if none is read */
+    std::unique_ptr<typename DataBlock::Iterator> data_iter_;
+    /** the error reading a data block, if any */
+    Status status_;
+  };
+
+  explicit Table(std::unique_ptr<RandomAccessFile> &&file)
+      : file_(std::move(file)) {}
+
+  /**
+   * @brief read the data block an index entry points to, from the block
+   *        cache if it is there, adding it to the cache otherwise
+   * @param index_iter the index Iterator, requires Valid()
+   * @param block where to store the data block. A cached block stays pinned
+   *        in the cache until the last copy of the pointer is gone
+   * @return OK on success, the error otherwise
+   */
+  Status ReadDataBlock(const typename IndexBlock::Iterator &index_iter,
+                       std::shared_ptr<const DataBlock> *block) const {
+    BlockHandle handle;
+    if (!index_iter.GetValue(&handle)) {
+      return Status::Corruption(file_->GetName() + ": bad block handle");
+    }
+    std::string key;
+    Cache::Handle *cache_handle = nullptr;
+    if (block_cache_ != nullptr) {
+      PutFixed64(&key, cache_id_);
+      PutFixed64(&key, handle.offset);
+      cache_handle = block_cache_->Lookup(key);
+    }
+    if (cache_handle == nullptr) {
+      std::string contents;
+      Status s = ReadBlock(file_.get(), handle, &contents);
+      if (!s.ok()) {
+        return s;
+      }
+      DataBlock *contents_block = new DataBlock(std::move(contents));
+      if (block_cache_ == nullptr) {
+        block->reset(contents_block);
+        return Status::OK();
+      }
+      cache_handle = block_cache_->Insert(key, contents_block,
+                                          contents_block->GetSize(),
+                                          &DeleteCachedBlock);
+    }
+    // the handle is released along with the last copy of the pointer
+    std::shared_ptr<Cache> cache = block_cache_;
+    const DataBlock *cached =
+        static_cast<const DataBlock *>(cache->Value(cache_handle));
+    block->reset(cached, [cache, cache_handle](const DataBlock *) {
+      cache->Release(cache_handle);
+    });
+    return Status::OK();
+  }
+
+  /**
+   * @brief the deleter of the data blocks in the block cache
+   * @param key the cache key
+   * @param value the data block
+   */
+  static void DeleteCachedBlock(const std::string &key, void *value) {
+    (void)key;
+    delete static_cast<DataBlock *>(value);
+  }
+
+  /** the table file */
+  std::unique_ptr<RandomAccessFile> file_;
+  /** the index block, kept in memory */
+  std::unique_ptr<IndexBlock> index_block_;
+  /** the policy the filter is probed with, nullptr if there is no filter */
+  std::shared_ptr<const FilterPolicy> filter_policy_;
+  /** the filter block, kept in memory */
+  std::string filter_;
+  /** the cache of the data blocks, nullptr if they are not cached */
+  std::shared_ptr<Cache> block_cache_;
+  /** the prefix of the cache keys of the data blocks of this table */
+  uint64_t cache_id_ = 0;
+  /** the largest sequence number in the table */
+  uint64_t sequence_ = 0;
+  /** the size of the table file */
+  uint64_t file_size_ = 0;
+  /** the smallest key in the table */
+  K smallest_{};
+  /** the largest key in the table */
+  K largest_{};
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,238 @@
+/**
+ * table_builder.h
+ * This is the writer of a table file (see table_format.h). Sorted key-value
+ * pairs are packed into data blocks of about Options::block_size bytes, and
+ * the last key of every data block goes into the index block. With a filter
+ * policy, the keys are also kept aside to build the filter block at the end.
+ *
+ * Like leveldb, a data block is only indexed once the first key of the next
+ * one is known, so that string keys can be indexed by the shortest separator
+ * in between instead (see comparator.h). The last block keeps its last key,
+ * which is the largest key of the table
+ */
+#ifndef KVSTORE_TABLE_BUILDER_H
+#define KVSTORE_TABLE_BUILDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "block_builder.h"
+#include "coding.h"
+#include "comparator.h"
+#include "crc32c.h"
+#include "env.h"
+#include "options.h"
+#include "status.h"
+#include "table_format.h"
+
+namespace kvstore {
+
+/**
+ * @brief TableBuilder streams sorted key-value pairs into a table file
+ * @tparam K key type, must have a Coder
+ * @tparam T value type, must have a Coder
+ */
+template <typename K, typename T>
+class TableBuilder {
+ public:
+  /**
+   * @brief create a TableBuilder appending to an empty file
+   * @param options the block size, restart interval and filter policy to use
+   * @param file the file, must outlive the TableBuilder
+   */
+  TableBuilder(const Options &options, WritableFile *file)
+      : options_(options),
+        file_(file),
+        data_block_(options.block_restart_interval),
+        index_block_(1) {}
+
+  TableBuilder(const TableBuilder &) = delete;
+  TableBuilder &operator=(const TableBuilder &) = delete;
+
+  /**
+   * @brief append a key-value pair, keys must come in strictly increasing
+   *        order
+   * @param key the key
+   * @param value the value
+   * @return OK on success, the error otherwise
+   */
+  Status Add(const K &key, const T &value) {
+    if (pending_index_entry_) {
+      ShortenSeparator(&pending_key_, key);
+      AddIndexEntry(pending_key_);
+    }
+    last_key_.clear();
+    Coder<K>::Encode(key, &last_key_);
+    value_.clear();
+    Coder<T>::Encode(value, &value_);
+    data_block_.Add(last_key_, value_);
+    if (options_.filter_policy != nullptr) {
+      filter_keys_.push_back(last_key_);
+    }
+    num_entries_++;
+    if (data_block_.CurrentSizeEstimate() >= options_.block_size) {
+      pending_key_ = key;
+      return FlushDataBlock();
+    }
+    return Status::OK();
+  }
+
+  /**
+   * @brief write the last data block, the filter block, the index block and
+   *        the footer
+   *        no Add is allowed after it, the file is neither synced nor closed
+   * @param sequence the largest sequence number in the table
+   * @return OK on success, the error otherwise
+   */
+  Status Finish(uint64_t sequence) {
+    Status s = FlushDataBlock();
+    if (!s.ok()) {
+      return s;
+    }
+    if (pending_index_entry_) {
+      index_block_.Add(last_key_, handle_encoding_);
+      pending_index_entry_ = false;
+    }
+    BlockHandle filter_handle;
+    if (options_.filter_policy != nullptr) {
+      std::string filter;
+      options_.filter_policy->CreateFilter(
+          filter_keys_.data(), static_cast<int>(filter_keys_.size()), &filter);
+      filter_keys_.clear();
+      s = WriteBlock(filter, &filter_handle);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    BlockHandle index_handle;
+    s = WriteBlock(index_block_.Finish(), &index_handle);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string footer;
+    PutFixed64(&footer, filter_handle.offset);
+    PutFixed64(&footer, filter_handle.size);
+    PutFixed64(&footer, index_handle.offset);
+    PutFixed64(&footer, index_handle.size);
+    PutFixed64(&footer, sequence);
+    PutFixed64(&footer, kTableMagicNumber);
+    s = file_->Append(footer);
+    offset_ += footer.size();
+    return s;
+  }
+
+  /**
+   * @brief how many key-value pairs were added
+   * @return the number of key-value pairs
+   */
+  uint64_t GetNumEntries() const { return num_entries_; }
+
+  /**
+   * @brief the size of the file written so far
+   * @return the size in bytes
+   */
+  uint64_t GetFileSize() const { return offset_; }
+
+ private:
+  /**
+   * @brief write the current data block, its index entry is pending until
+   *        the next key or Finish
+   * @return OK on success, the error otherwise
+   */
+  Status FlushDataBlock() {
+    if (data_block_.Empty()) {
+      return Status::OK();
+    }
+    BlockHandle handle;
+    Status s = WriteBlock(data_block_.Finish(), &handle);
+    data_block_.Reset();
+    if (!s.ok()) {
+      return s;
+    }
+    handle_encoding_.clear();
+    Coder<BlockHandle>::Encode(handle, &handle_encoding_);
+    pending_index_entry_ = true;
+    return Status::OK();
+  }
+
+  /**
+   * @brief index the last data block written by a key
+   * @param key no smaller than the last key of the block, and smaller than
+   *        the first key of the next one
+   */
+  void AddIndexEntry(const K &key) {
+    index_key_.clear();
+    Coder<K>::Encode(key, &index_key_);
+    index_block_.Add(index_key_, handle_encoding_);
+    pending_index_entry_ = false;
+  }
+
+  /**
+   * @brief keep a key as it is, only byte strings know how to get shorter
+   */
+  template <typename Key>
+  static void ShortenSeparator(Key *, const Key &) {}
+
+  /**
+   * @brief shorten a string key as long as it stays in [start, limit)
+   * @param start the key to shorten
+   * @param limit the upper bound
+   */
+  static void ShortenSeparator(std::string *start, const std::string &limit) {
+    BytewiseComparator::FindShortestSeparator(start, limit);
+  }
+
+  /**
+   * @brief write a block followed by its trailer
+   * @param contents the contents of the block
+   * @param handle where to store the location of the block
+   * @return OK on success, the error otherwise
+   */
+  Status WriteBlock(const std::string &contents, BlockHandle *handle) {
+    handle->offset = offset_;
+    handle->size = contents.size();
+    Status s = file_->Append(contents);
+    if (!s.ok()) {
+      return s;
+    }
+    char trailer[kBlockTrailerSize];
+    trailer[0] = kNoCompression;
+    uint32_t crc = crc32c::Value(contents.data(), contents.size());
+    crc = crc32c::Extend(crc, trailer, 1);
+    EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+    s = file_->Append(trailer, kBlockTrailerSize);
+    offset_ += contents.size() + kBlockTrailerSize;
+    return s;
+  }
+
+  /** the block size, restart interval and filter policy */
+  const Options options_;
+  /** the file being written */
+  WritableFile *file_;
+  /** the data block being filled */
+  BlockBuilder data_block_;
+  /** a key between every data block and the next, each is a restart point */
+  BlockBuilder index_block_;
+  /** the encoded keys of the table, for the filter */
+  std::vector<std::string> filter_keys_;
+  /** the encoded key of the last entry */
+  std::string last_key_;
+  /** the encoding buffer of a value */
+  std::string value_;
+  /** the encoding buffer of a BlockHandle */
+  std::string handle_encoding_;
+  /** if the last data block written still waits for its index entry */
+  bool pending_index_entry_ = false;
+  /** the last key of the data block waiting for its index entry */
+  K pending_key_{};
+  /** the encoding buffer of an index key */
+  std::string index_key_;
+  /** the offset of the next block */
+  uint64_t offset_ = 0;
+  /** how many entries were added */
+  uint64_t num_entries_ = 0;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * table_format.h
+ * This is the physical format of a table file, an immutable sorted run of
+ * key-value pairs flushed from a MemTable, following leveldb's SSTable:
+ *
+ *   | data block 0 | ... | data block n-1 | filter block | index block |
+ *   | footer |
+ *
+ * + every block is followed by a 5 byte trailer: a type byte (kNoCompression)
+ *   and the masked crc32c of the block contents and the type byte
+ * + the filter block is the filter of all the keys of the table, built by
+ *   Options::filter_policy (see filter_policy.h). It is absent, with a size
+ *   of 0 in the footer, if the table was built without a filter policy
+ * + the index block maps a key of each data block to the BlockHandle (offset
+ *   and size) of that block: a key no smaller than the last key of the block
+ *   and smaller than the first key of the next one, the last key itself for
+ *   the last block
+ * + the footer is fixed-length: fixed64 offset and fixed64 size of the filter
+ *   block | fixed64 offset and fixed64 size of the index block | fixed64
+ *   largest sequence number | fixed64 magic number
+ *
+ * See block_builder.h for the layout inside a block
+ */
+#ifndef KVSTORE_TABLE_FORMAT_H
+#define KVSTORE_TABLE_FORMAT_H
+
+#include <stdint.h>
+#include <string>
+
+#include "coding.h"
+#include "crc32c.h"
+#include "env.h"
+#include "status.h"
+
+namespace kvstore {
+
+/** the size of the trailer following every block: type (1) and crc (4) */
+static const std::size_t kBlockTrailerSize = 1 + 4;
+
+/** the size of the table footer */
+static const std::size_t kTableFooterSize = 8 + 8 + 8 + 8 + 8 + 8;
+
+/** the last 8 bytes of every table file */
+static const uint64_t kTableMagicNumber = 0x6b767373737462ull;
+
+/**
+ * @brief how the contents of a block are stored
+ */
+enum BlockType : uint8_t { kNoCompression = 0 };
+
+/**
+ * @brief BlockHandle points to a block inside a table file
+ */
+struct BlockHandle {
+  /** where the block starts */
+  uint64_t offset = 0;
+  /** the size of the block, without its trailer */
+  uint64_t size = 0;
+
+  /**
+   * @brief if the block and its trailer end at or before limit, checking
+   *        each part on its own so huge values read from a corrupted file
+   *        cannot wrap around
+   * @param limit the end of the region the block must lie in
+   * @return true if it fits, false otherwise
+   */
+  bool FitsIn(uint64_t limit) const {
+    return limit >= kBlockTrailerSize && size <= limit - kBlockTrailerSize &&
+           offset <= limit - kBlockTrailerSize - size;
+  }
+};
+
+/**
+ * @brief a BlockHandle is stored as two varint64, offset then size
+ */
+template <>
+struct Coder<BlockHandle> {
+  /**
+   * @brief append the encoding of a BlockHandle
+   * @param handle the BlockHandle
+   * @param dst the string to append to
+   */
+  static void Encode(const BlockHandle &handle, std::string *dst) {
+    PutVarint64(dst, handle.offset);
+    PutVarint64(dst, handle.size);
+  }
+
+  /**
+   * @brief parse a BlockHandle from a buffer
+   * @param p the start of the buffer
+   * @param limit the end of the buffer
+   * @param handle where to store the BlockHandle
+   * @return pointer past the BlockHandle, nullptr if malformed or truncated
+   */
+  static const char *Decode(const char *p, const char *limit,
+                            BlockHandle *handle) {
+    p = GetVarint64Ptr(p, limit, &handle->offset);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    return GetVarint64Ptr(p, limit, &handle->size);
+  }
+};
+
+/**
+ * @brief read a block and check its trailer
+ * @param file the table file
+ * @param handle where the block is
+ * @param contents where to store the contents of the block
+ * @return OK on success, Corruption on a checksum mismatch, the error
+ *         otherwise
+ */
+inline Status ReadBlock(const RandomAccessFile *file, const BlockHandle &handle,
+                        std::string *contents) {
+  std::size_t n = static_cast<std::size_t>(handle.size);
+  contents->resize(n + kBlockTrailerSize);
+  char *buf = &(*contents)[0];
+  Status s = file->Read(handle.offset, n + kBlockTrailerSize, buf);
+  if (!s.ok()) {
+    return s;
+  }
+  uint32_t crc = crc32c::Unmask(DecodeFixed32(buf + n + 1));
+  if (crc32c::Value(buf, n + 1) != crc) {
+    return Status::Corruption(file->GetName() + ": block checksum mismatch");
+  }
+  if (buf[n] != kNoCompression) {
+    return Status::Corruption(file->GetName() + ": bad block type");
+  }
+  contents->resize(n);
+  return Status::OK();
+}
+}  // namespace kvstore
+
+#endif
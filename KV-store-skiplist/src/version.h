@@ -0,0 +1,408 @@
+/**
+ * version.h
+ * This is the set of live table files of a DB arranged into levels, in the
+ * spirit of leveldb's Version:
+ * + level 0 holds the tables flushed from the MemTables, newest first. Their
+ *   key ranges may overlap, so a lookup consults all of them
+ * + every other level holds tables with disjoint key ranges, sorted by key,
+ *   so a lookup consults at most one table per level. Each level is allowed
+ *   ten times the bytes of the previous one
+ *
+ * A Version is immutable once published: a compaction or a flush builds a
+ * new one, and readers holding the old one keep using it safely.
+ *
+ * The manifest (dbname/MANIFEST) records the level and number of every live
+ * table as a single log record, see EncodeTo. It is rewritten as a whole on
+ * every change, under a temporary name renamed over the old one
+ */
+#ifndef KVSTORE_VERSION_H
+#define KVSTORE_VERSION_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "coding.h"
+#include "iterator.h"
+#include "status.h"
+#include "table.h"
+
+namespace kvstore {
+
+/** the number of levels */
+static const int kNumLevels = 7;
+
+/**
+ * @brief FileMetaData is a live table file
+ * @tparam K key type
+ * @tparam T value type
+ */
+template <typename K, typename T>
+struct FileMetaData {
+  /** the file number */
+  uint64_t number = 0;
+  /** the opened table */
+  std::shared_ptr<Table<K, T>> table;
+
+  /**
+   * @brief the smallest key in the table
+   * @return the key
+   */
+  const K &GetSmallestKey() const { return table->GetSmallestKey(); }
+
+  /**
+   * @brief the largest key in the table
+   * @return the key
+   */
+  const K &GetLargestKey() const { return table->GetLargestKey(); }
+};
+
+/**
+ * @brief Version is a snapshot of the table files, level by level
+ * @tparam K key type
+ * @tparam T value type
+ */
+template <typename K, typename T>
+class Version {
+ public:
+  /** a shared table file */
+  using FilePtr = std::shared_ptr<const FileMetaData<K, T>>;
+  /** the table files of a level */
+  using FileList = std::vector<FilePtr>;
+
+  /**
+   * @brief look up a key in the tables, the newest first
+   * @param key the key
+   * @param value where to store the value
+   * @return OK if found, NotFound if not, the error otherwise
+   */
+  Status Get(const K &key, T *value) const {
+    for (auto &file : files_[0]) {
+      if (!(key < file->GetSmallestKey()) && !(file->GetLargestKey() < key)) {
+        Status s = file->table->Get(key, value);
+        if (!s.IsNotFound()) {
+          return s;
+        }
+      }
+    }
+    for (int level = 1; level < kNumLevels; level++) {
+      const FileMetaData<K, T> *file = FindFile(level, key);
+      if (file != nullptr) {
+        Status s = file->table->Get(key, value);
+        if (!s.IsNotFound()) {
+          return s;
+        }
+      }
+    }
+    return Status::NotFound("key");
+  }
+
+  /**
+   * @brief the tables that might hold a key, in the order a lookup
+   *        consults them
+   * @param key the key
+   * @param files where to append the tables
+   */
+  void GetFilesForKey(const K &key,
+                      std::vector<const FileMetaData<K, T> *> *files) const {
+    for (auto &file : files_[0]) {
+      if (!(key < file->GetSmallestKey()) && !(file->GetLargestKey() < key)) {
+        files->push_back(file.get());
+      }
+    }
+    for (int level = 1; level < kNumLevels; level++) {
+      const FileMetaData<K, T> *file = FindFile(level, key);
+      if (file != nullptr) {
+        files->push_back(file);
+      }
+    }
+  }
+
+  /**
+   * @brief append Iterators which, merged, yield the content of the tables
+   *        one per table of level 0, one per other non-empty level
+   * @param iters where to append the Iterators, newest first
+   */
+  void AddIterators(std::vector<std::unique_ptr<Iterator<K, T>>> *iters) const {
+    for (auto &file : files_[0]) {
+      iters->push_back(file->table->NewIterator());
+    }
+    for (int level = 1; level < kNumLevels; level++) {
+      if (!files_[level].empty()) {
+        iters->emplace_back(new LevelIterator(files_[level]));
+      }
+    }
+  }
+
+  /**
+   * @brief the tables of a level
+   * @param level the level
+   * @return the tables, newest first in level 0, by key in the others
+   */
+  const FileList &GetFiles(int level) const { return files_[level]; }
+
+  /**
+   * @brief how many tables in all the levels
+   * @return the number of tables
+   */
+  std::size_t NumFiles() const {
+    std::size_t count = 0;
+    for (int level = 0; level < kNumLevels; level++) {
+      count += files_[level].size();
+    }
+    return count;
+  }
+
+  /**
+   * @brief the total size of the tables of a level
+   * @param level the level
+   * @return the size in bytes
+   */
+  uint64_t NumLevelBytes(int level) const {
+    uint64_t bytes = 0;
+    for (auto &file : files_[level]) {
+      bytes += file->table->GetFileSize();
+    }
+    return bytes;
+  }
+
+  /**
+   * @brief the largest sequence number in all the tables
+   * @return the sequence number
+   */
+  uint64_t GetMaxSequence() const {
+    uint64_t sequence = 0;
+    for (int level = 0; level < kNumLevels; level++) {
+      for (auto &file : files_[level]) {
+        sequence = std::max(sequence, file->table->GetSequence());
+      }
+    }
+    return sequence;
+  }
+
+  /**
+   * @brief the tables of a level overlapping a key range
+   * @param level the level
+   * @param lo the smallest key of the range
+   * @param hi the largest key of the range
+   * @param inputs where to append the tables
+   */
+  void GetOverlappingInputs(int level, const K &lo, const K &hi,
+                            FileList *inputs) const {
+    for (auto &file : files_[level]) {
+      if (!(file->GetLargestKey() < lo) && !(hi < file->GetSmallestKey())) {
+        inputs->push_back(file);
+      }
+    }
+  }
+
+  /**
+   * @brief if no level deeper than a given one might hold a key, so that a
+   *        tombstone for it written into that level can be dropped
+   * @param level the level
+   * @param key the key
+   * @return true if the deeper levels don't cover the key
+   */
+  bool IsBaseLevelForKey(int level, const K &key) const {
+    for (int deeper = level + 1; deeper < kNumLevels; deeper++) {
+      if (FindFile(deeper, key) != nullptr) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief add a table, only while building a new Version
+   * @param level the level
+   * @param file the table
+   */
+  void AddFile(int level, const FilePtr &file) {
+    FileList &files = files_[level];
+    if (level == 0) {
+      // the newest first, it has the largest file number
+      auto pos = std::find_if(files.begin(), files.end(),
+                              [&file](const FilePtr &f) {
+                                return f->number < file->number;
+                              });
+      files.insert(pos, file);
+    } else {
+      auto pos = std::find_if(files.begin(), files.end(),
+                              [&file](const FilePtr &f) {
+                                return file->GetLargestKey() <
+                                       f->GetSmallestKey();
+                              });
+      files.insert(pos, file);
+    }
+  }
+
+  /**
+   * @brief remove a table, only while building a new Version
+   * @param level the level
+   * @param number the file number of the table
+   */
+  void RemoveFile(int level, uint64_t number) {
+    FileList &files = files_[level];
+    files.erase(std::remove_if(files.begin(), files.end(),
+                               [number](const FilePtr &f) {
+                                 return f->number == number;
+                               }),
+                files.end());
+  }
+
+  /**
+   * @brief encode the level and number of every table, the manifest record
+   *        varint32 count | (varint32 level | varint64 number) * count
+   * @param dst the string to append to
+   */
+  void EncodeTo(std::string *dst) const {
+    PutVarint32(dst, static_cast<uint32_t>(NumFiles()));
+    for (int level = 0; level < kNumLevels; level++) {
+      for (auto &file : files_[level]) {
+        PutVarint32(dst, static_cast<uint32_t>(level));
+        PutVarint64(dst, file->number);
+      }
+    }
+  }
+
+  /**
+   * @brief parse a manifest record
+   * @param record the record
+   * @param files where to store the (level, number) of every table
+   * @return true on success, false if malformed
+   */
+  static bool DecodeFrom(const std::string &record,
+                         std::vector<std::pair<int, uint64_t>> *files) {
+    const char *p = record.data();
+    const char *limit = p + record.size();
+    uint32_t count;
+    p = GetVarint32Ptr(p, limit, &count);
+    if (p == nullptr) {
+      return false;
+    }
+    files->clear();
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t level;
+      uint64_t number;
+      p = GetVarint32Ptr(p, limit, &level);
+      p = p ? GetVarint64Ptr(p, limit, &number) : nullptr;
+      if (p == nullptr || level >= kNumLevels) {
+        return false;
+      }
+      files->emplace_back(static_cast<int>(level), number);
+    }
+    return p == limit;
+  }
+
+ private:
+  /**
+   * @brief LevelIterator walks the tables of a level other than 0 one after
+   *        another, they are sorted and disjoint
+   */
+  class LevelIterator : public Iterator<K, T> {
+   public:
+    explicit LevelIterator(const FileList &files) : files_(files) {}
+
+    bool Valid() const override { return iter_ != nullptr && iter_->Valid(); }
+
+    void SeekToFirst() override {
+      OpenTable(0);
+      if (iter_ != nullptr) {
+        iter_->SeekToFirst();
+      }
+      SkipEmptyTables();
+    }
+
+    void Seek(const K &target) override {
+      // the first table not entirely before the target
+      auto pos = std::lower_bound(files_.begin(), files_.end(), target,
+                                  [](const FilePtr &f, const K &key) {
+                                    return f->GetLargestKey() < key;
+                                  });
+      OpenTable(pos - files_.begin());
+      if (iter_ != nullptr) {
+        iter_->Seek(target);
+      }
+      SkipEmptyTables();
+    }
+
+    void Next() override {
+      iter_->Next();
+      SkipEmptyTables();
+    }
+
+    K GetKey() const override { return iter_->GetKey(); }
+
+    T GetValue() const override { return iter_->GetValue(); }
+
+    Status GetStatus() const override {
+      if (iter_ != nullptr && !iter_->GetStatus().ok()) {
+        return iter_->GetStatus();
+      }
+      return Status::OK();
+    }
+
+   private:
+    /**
+     * @brief start iterating a table
+     * @param index the position of the table, past the end for none
+     */
+    void OpenTable(std::size_t index) {
+      index_ = index;
+      iter_.reset();
+      if (index_ < files_.size()) {
+        iter_ = files_[index_]->table->NewIterator();
+      }
+    }
+
+    /**
+     * @brief move on to the following tables while the current one is
+     *        exhausted
+     */
+    void SkipEmptyTables() {
+      while (iter_ != nullptr && !iter_->Valid()) {
+        if (!iter_->GetStatus().ok()) {
+          return;
+        }
+        OpenTable(index_ + 1);
+        if (iter_ != nullptr) {
+          iter_->SeekToFirst();
+        }
+      }
+    }
+
+    /** the tables of the level, by key */
+    const FileList files_;
+    /** the position of the current table */
+    std::size_t index_ = 0;
+    /** the Iterator of the current table, nullptr past the last one */
+    std::unique_ptr<Iterator<K, T>> iter_;
+  };
+
+  /**
+   * @brief the table of a level other than 0 whose range holds a key
+   * @param level the level
+   * @param key the key
+   * @return the table, nullptr if none
+   */
+  const FileMetaData<K, T> *FindFile(int level, const K &key) const {
+    const FileList &files = files_[level];
+    auto pos = std::lower_bound(files.begin(), files.end(), key,
+                                [](const FilePtr &f, const K &k) {
+                                  return f->GetLargestKey() < k;
+                                });
+    if (pos == files.end() || key < (*pos)->GetSmallestKey()) {
+      return nullptr;
+    }
+    return pos->get();
+  }
+
+  /** the tables of every level */
+  FileList files_[kNumLevels];
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * write_batch.h
+ * This is a container of put and delete operations to be applied to a
+ * SkipList as one unit, in the spirit of leveldb's WriteBatch. Instead of
+ * serializing into a rep_ string, the operations are kept typed, since the
+ * SkipList holds arbitrary key and value types. They are only serialized when
+ * written to the write-ahead log, in leveldb's format
+ *
+ *   | 8 byte sequence | 4 byte count | count operations |
+ *
+ * where each operation is | type byte | key | for a delete and
+ * | type byte | key | value | for a put, keys and values encoded by Coder
+ */
+#ifndef KVSTORE_WRITE_BATCH_H
+#define KVSTORE_WRITE_BATCH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "coding.h"
+
+namespace kvstore {
+
+/**
+ * @brief the kind of an operation recorded in a WriteBatch
+ */
+enum class OpType { kPut, kDelete };
+
+/**
+ * @brief WriteBatch records operations in the order they are issued
+ *        applying it with SkipList::Write has the same effect as issuing the
+ *        operations one by one, but takes the writer lock only once
+ * @tparam K key type
+ * @tparam V value type
+ */
+template <typename K, typename V>
+class WriteBatch {
+ public:
+  /**
+   * @brief a single recorded operation
+   */
+  struct Op {
+    /** put or delete */
+    OpType type;
+    /** the key operated on */
+    K key;
+    /** the value to put, default constructed for a delete */
+    V value;
+  };
+
+  /**
+   * @brief record a put of a key-value pair
+   * @param key the key
+   * @param value the value
+   */
+  void Put(K key, V value) { ops_.push_back(Op{OpType::kPut, key, value}); }
+
+  /**
+   * @brief record a removal of a key
+   * @param key the key
+   */
+  void Delete(K key) { ops_.push_back(Op{OpType::kDelete, key, V{}}); }
+
+  /**
+   * @brief append all the operations of another batch after this one's
+   * @param other the batch to copy operations from
+   */
+  void Append(const WriteBatch &other) {
+    ops_.insert(ops_.end(), other.ops_.begin(), other.ops_.end());
+  }
+
+  /**
+   * @brief drop all the recorded operations
+   */
+  void Clear() { ops_.clear(); }
+
+  /**
+   * @brief how many operations are recorded
+   * @return the number of operations
+   */
+  std::size_t Count() const { return ops_.size(); }
+
+  /**
+   * @brief give access to the recorded operations in issue order
+   * @return the operations
+   */
+  const std::vector<Op> &GetOps() const { return ops_; }
+
+  /**
+   * @brief serialize the batch for the write-ahead log
+   * @param sequence the sequence number of the first operation
+   * @param dst the string to append the encoding to
+   */
+  void EncodeTo(uint64_t sequence, std::string *dst) const {
+    PutFixed64(dst, sequence);
+    PutFixed32(dst, static_cast<uint32_t>(ops_.size()));
+    for (auto &op : ops_) {
+      dst->push_back(static_cast<char>(op.type));
+      Coder<K>::Encode(op.key, dst);
+      if (op.type == OpType::kPut) {
+        Coder<V>::Encode(op.value, dst);
+      }
+    }
+  }
+
+  /**
+   * @brief replace the content of the batch by a serialized one
+   * @param rep the encoding produced by EncodeTo
+   * @param sequence where to store the sequence number of the first operation
+   * @return true on success, false if the encoding is malformed
+   */
+  bool DecodeFrom(const std::string &rep, uint64_t *sequence) {
+    Clear();
+    if (rep.size() < kHeaderSize) {
+      return false;
+    }
+    const char *p = rep.data();
+    const char *limit = p + rep.size();
+    *sequence = DecodeFixed64(p);
+    uint32_t count = DecodeFixed32(p + 8);
+    p += kHeaderSize;
+    // every operation takes at least one byte, don't trust a corrupted count
+    ops_.reserve(std::min<std::size_t>(count, rep.size()));
+    for (uint32_t i = 0; i < count; i++) {
+      if (p == limit) {
+        return false;
+      }
+      auto type = static_cast<OpType>(*p++);
+      Op op{type, K{}, V{}};
+      p = Coder<K>::Decode(p, limit, &op.key);
+      if (p != nullptr && type == OpType::kPut) {
+        p = Coder<V>::Decode(p, limit, &op.value);
+      } else if (type != OpType::kDelete) {
+        return false;
+      }
+      if (p == nullptr) {
+        return false;
+      }
+      ops_.push_back(std::move(op));
+    }
+    return p == limit;
+  }
+
+ private:
+  /** the size of the encoding header: sequence (8) and count (4) */
+  static const std::size_t kHeaderSize = 12;
+
+  /** the recorded operations in issue order */
+  std::vector<Op> ops_;
+};
+}  // namespace kvstore
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * A benchmark of point lookups in the SkipList and the FatSkipList, counting
+ * the cache misses they take
+ *
+ * Each store is loaded with --keys distinct int keys in a scrambled order,
+ * so neighbouring keys are not neighbours in memory, then --lookups keys
+ * drawn uniformly among them are looked up on one thread. The hardware
+ * counters of the lookup loop are read with perf_event_open: the last level
+ * cache misses and the L1 data cache read misses, per lookup. Where the
+ * kernel exposes no PMU (e.g. in most VMs), they are printed as null and
+ * only the time and the number of nodes a search visits, each a likely miss
+ * on a set much larger than the cache, are left. The results are printed to
+ * stdout as JSON, like ycsb_bench's, a summary goes to stderr.
+ *
+ * Usage:
+ *   ./cache_bench [--keys=N] [--lookups=N] [--stores=skiplist,fat]
+ */
+
+#include "../src/fat_skiplist.h"
+#include "../src/skiplist.h"
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief the command line flags
+ */
+struct Flags {
+  /** how many keys are loaded */
+  long keys = 10000000;
+  /** how many lookups are timed */
+  long lookups = 2000000;
+  /** which stores to run, comma separated */
+  std::string stores = "skiplist,fat";
+};
+
+/**
+ * @brief PerfCounter is one hardware counter of the calling thread, in user
+ *        space only
+ */
+class PerfCounter {
+ public:
+  /**
+   * @brief open the counter, it is not Valid if the kernel refuses
+   * @param type the perf_event type
+   * @param config the perf_event config
+   */
+  PerfCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  ~PerfCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  PerfCounter(const PerfCounter &) = delete;
+  PerfCounter &operator=(const PerfCounter &) = delete;
+
+  /**
+   * @brief if the counter could be opened
+   * @return true if it counts, false otherwise
+   */
+  bool Valid() const { return fd_ >= 0; }
+
+  /**
+   * @brief reset the counter and start counting
+   */
+  void Start() {
+    if (Valid()) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  /**
+   * @brief stop counting
+   * @return the count since Start, 0 if not Valid
+   */
+  uint64_t Stop() {
+    uint64_t count = 0;
+    if (Valid()) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+    return count;
+  }
+
+ private:
+  /** the perf_event file descriptor, -1 if not open */
+  int fd_;
+};
+
+/**
+ * @brief the key of an index: multiplying by an odd constant is a bijection
+ *        of the 32-bit integers, so the keys are distinct and scrambled
+ * @param index the index
+ * @return the key
+ */
+int MakeKey(long index) {
+  return static_cast<int>(static_cast<uint32_t>(index) * 2654435761u);
+}
+
+/**
+ * @brief format a counter per lookup as JSON
+ * @param counter the counter
+ * @param count its count
+ * @param lookups the number of lookups
+ * @return the number, or null if the counter is not Valid
+ */
+std::string PerLookup(const PerfCounter &counter, uint64_t count,
+                      long lookups) {
+  if (!counter.Valid()) {
+    return "null";
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f", static_cast<double>(count) / lookups);
+  return buf;
+}
+
+/**
+ * @brief load a store, look up random keys in it, and print its results
+ * @param name the name of the store
+ * @param flags the flags
+ * @param first if this is the first result printed
+ * @tparam List SkipList or FatSkipList of int keys and values
+ */
+template <typename List>
+void Run(const char *name, const Flags &flags, bool first) {
+  List list;
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < flags.keys; i++) {
+    list.SkipInsert(MakeKey(i), static_cast<int>(i));
+  }
+  std::chrono::duration<double> load =
+      std::chrono::steady_clock::now() - start;
+
+  // draw the keys beforehand, so the loop only does the lookups
+  std::mt19937_64 gen(42);
+  std::uniform_int_distribution<long> dist(0, flags.keys - 1);
+  std::vector<int> keys(flags.lookups);
+  for (auto &key : keys) {
+    key = MakeKey(dist(gen));
+  }
+  std::size_t visited = 0;
+  const long kPathSamples = std::min<long>(flags.lookups, 10000);
+  for (long i = 0; i < kPathSamples; i++) {
+    visited += list.GetSearchPathLength(keys[i]);
+  }
+
+  PerfCounter llc_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  PerfCounter l1d_misses(PERF_TYPE_HW_CACHE,
+                         PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  long found = 0;
+  start = std::chrono::steady_clock::now();
+  llc_misses.Start();
+  l1d_misses.Start();
+  for (int key : keys) {
+    int value;
+    found += list.Get(key, &value);
+  }
+  uint64_t l1d = l1d_misses.Stop();
+  uint64_t llc = llc_misses.Stop();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (found != flags.lookups) {
+    std::cerr << name << ": only " << found << " keys found" << std::endl;
+    exit(1);
+  }
+
+  double ns = elapsed.count() / flags.lookups;
+  double nodes = static_cast<double>(visited) / kPathSamples;
+  fprintf(stderr,
+          "%-8s load %.2f sec, %.1f MB, %.1f ns/lookup, %.1f nodes/lookup\n",
+          name, load.count(), list.ApproximateMemoryUsage() / 1048576.0, ns,
+          nodes);
+  printf("%s\n    {\"store\": \"%s\", \"keys\": %ld, \"lookups\": %ld, "
+         "\"load_sec\": %.3f, \"memory_bytes\": %zu, \"ns_per_lookup\": %.1f, "
+         "\"nodes_per_lookup\": %.2f, \"llc_misses_per_lookup\": %s, "
+         "\"l1d_misses_per_lookup\": %s}",
+         first ? "" : ",", name, flags.keys, flags.lookups, load.count(),
+         list.ApproximateMemoryUsage(), ns, nodes,
+         PerLookup(llc_misses, llc, flags.lookups).c_str(),
+         PerLookup(l1d_misses, l1d, flags.lookups).c_str());
+  fflush(stdout);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  Flags flags;
+  for (int i = 1; i < argc; i++) {
+    long n;
+    char junk;
+    if (sscanf(argv[i], "--keys=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.keys = n;
+    } else if (sscanf(argv[i], "--lookups=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.lookups = n;
+    } else if (strncmp(argv[i], "--stores=", 9) == 0) {
+      flags.stores = argv[i] + 9;
+    } else {
+      std::cerr << "invalid flag " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  // one store at a time, so the largest sets fit in memory
+  printf("{\n  \"benchmark\": \"cache_bench\",\n  \"results\": [");
+  bool first = true;
+  std::string stores = flags.stores + ",";
+  for (std::size_t pos = 0, comma; (comma = stores.find(',', pos)) !=
+                                   std::string::npos;
+       pos = comma + 1) {
+    std::string store = stores.substr(pos, comma - pos);
+    if (store == "skiplist") {
+      Run<kvstore::SkipList<int, int>>("skiplist", flags, first);
+    } else if (store == "fat") {
+      Run<kvstore::FatSkipList<int, int>>("fat", flags, first);
+    } else if (!store.empty()) {
+      std::cerr << "unknown store " << store << std::endl;
+      return 1;
+    } else {
+      continue;
+    }
+    first = false;
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
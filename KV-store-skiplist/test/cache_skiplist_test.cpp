@@ -0,0 +1,227 @@
+#include "../src/cache_skiplist.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+using namespace std::chrono_literals;
+
+/** the cache of the tests */
+using Cache = CacheSkipList<int, std::string>;
+
+/**
+ * @brief a clock the tests advance by hand, so expiry does not depend on how
+ *        fast the host runs them
+ */
+class ManualClock {
+ public:
+  /**
+   * @brief move the time forward
+   * @param duration how much
+   */
+  void Advance(Cache::Clock::duration duration) { now_ += duration; }
+
+  /**
+   * @brief the current time
+   * @return the time
+   */
+  Cache::Clock::time_point Now() const { return now_; }
+
+ private:
+  /** the current time */
+  Cache::Clock::time_point now_ = Cache::Clock::now();
+};
+
+/**
+ * @brief options without a reaper thread, so the tests drive expiry
+ * @param max_bytes the byte budget, 0 for none
+ * @param clock the clock of the deadlines, nullptr for the real one
+ * @return the options
+ */
+static CacheSkipListOptions ManualOptions(std::size_t max_bytes = 0,
+                                          const ManualClock *clock = nullptr) {
+  CacheSkipListOptions options;
+  options.max_bytes = max_bytes;
+  options.reap_interval = 0ms;
+  if (clock != nullptr) {
+    options.clock = [clock]() { return clock->Now(); };
+  }
+  return options;
+}
+
+/**
+ * @brief the charge of one key of the tests, all of the same size
+ * @return the number of bytes
+ */
+static std::size_t ChargeOfOneKey() {
+  Cache list(ManualOptions());
+  list.SkipInsert(0, std::string(10, 'v'));
+  return list.GetUsage();
+}
+
+TEST(CacheSkipListTest, InsertGetRemoveTest) {
+  // test the point operations and the accounting of the charges
+  Cache list(ManualOptions());
+  const std::size_t kCharge = ChargeOfOneKey();
+  EXPECT_GT(kCharge, 10u);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(list.SkipInsert(i, std::string(10, 'v')));
+  }
+  EXPECT_EQ(list.GetUsage(), 100 * kCharge);
+  EXPECT_FALSE(list.SkipInsert(7, std::string(20, 'w')));
+  EXPECT_EQ(list.GetUsage(), 100 * kCharge + 10);
+  std::string value;
+  EXPECT_TRUE(list.Get(7, &value));
+  EXPECT_EQ(value, std::string(20, 'w'));
+  EXPECT_FALSE(list.Get(100, &value));
+  EXPECT_TRUE(list.SkipRemove(7));
+  EXPECT_FALSE(list.SkipRemove(7));
+  EXPECT_EQ(list.GetSize(), 99u);
+  EXPECT_EQ(list.GetUsage(), 99 * kCharge);
+  Cache::Clock::duration ttl;
+  EXPECT_TRUE(list.GetTtl(8, &ttl));
+  EXPECT_EQ(ttl, Cache::Clock::duration::max());
+  EXPECT_FALSE(list.GetTtl(7, &ttl));
+}
+
+TEST(CacheSkipListTest, LazyExpiryTest) {
+  // test if an expired key misses, and is removed by the read
+  ManualClock clock;
+  Cache list(ManualOptions(0, &clock));
+  const std::size_t kCharge = ChargeOfOneKey();
+  list.SkipInsert(1, std::string(10, 'a'), 30ms);
+  list.SkipInsert(2, std::string(10, 'b'));
+  list.SkipInsert(3, std::string(10, 'c'), 1h);
+  std::string value;
+  EXPECT_TRUE(list.Get(1, &value));
+  Cache::Clock::duration ttl;
+  ASSERT_TRUE(list.GetTtl(1, &ttl));
+  EXPECT_EQ(ttl, 30ms);
+  clock.Advance(29ms);
+  EXPECT_TRUE(list.Get(1, &value));
+  clock.Advance(1ms);
+  EXPECT_FALSE(list.GetTtl(1, &ttl));
+  EXPECT_EQ(list.GetSize(), 3u);  // not read since it expired
+  std::vector<int> keys;
+  list.LockedScan(0, 10, [&keys](int key, const std::string &) {
+    keys.push_back(key);
+    return true;
+  });
+  EXPECT_EQ(keys, (std::vector<int>{2, 3}));
+  EXPECT_FALSE(list.Get(1, &value));
+  EXPECT_EQ(list.GetSize(), 2u);
+  EXPECT_EQ(list.GetNumExpired(), 1u);
+  EXPECT_EQ(list.GetUsage(), 2 * kCharge);
+  EXPECT_TRUE(list.Get(3, &value));
+  EXPECT_EQ(value, std::string(10, 'c'));
+}
+
+TEST(CacheSkipListTest, ReapExpiredTest) {
+  // test if the reaper's steps remove the expired keys nobody reads, and
+  // only them, batch by batch
+  ManualClock clock;
+  Cache list(ManualOptions(0, &clock));
+  for (int i = 0; i < 100; i++) {
+    list.SkipInsert(i, "v", i % 2 == 0 ? 20ms : 0ms);
+  }
+  EXPECT_EQ(list.ReapExpired(1000), 0u);
+  clock.Advance(20ms);
+  std::size_t removed = 0;
+  for (int step = 0; step < 10; step++) {
+    removed += list.ReapExpired(10);
+  }
+  EXPECT_EQ(removed, 50u);
+  EXPECT_EQ(list.GetSize(), 50u);
+  std::string value;
+  EXPECT_TRUE(list.Get(1, &value));
+  // nothing has a deadline anymore, so a step is free
+  EXPECT_EQ(list.ReapExpired(1000), 0u);
+}
+
+TEST(CacheSkipListTest, ReaperThreadTest) {
+  // test if the background reaper removes the expired keys on its own
+  CacheSkipListOptions options;
+  options.reap_interval = 5ms;
+  Cache list(options);
+  for (int i = 0; i < 300; i++) {
+    list.SkipInsert(i, "v", 10ms);
+  }
+  list.SkipInsert(1000, "stays");
+  for (int i = 0; i < 200 && list.GetSize() > 1; i++) {
+    std::this_thread::sleep_for(5ms);
+  }
+  EXPECT_EQ(list.GetSize(), 1u);
+  EXPECT_EQ(list.GetNumExpired(), 300u);
+}
+
+TEST(CacheSkipListTest, EvictionTest) {
+  // test if the budget holds, by evicting as many keys as over it
+  const std::size_t kCharge = ChargeOfOneKey();
+  Cache list(ManualOptions(100 * kCharge));
+  for (int i = 0; i < 1000; i++) {
+    list.SkipInsert(i * 7 % 1000, std::string(10, 'v'));
+    ASSERT_LE(list.GetUsage(), 100 * kCharge);
+  }
+  EXPECT_EQ(list.GetSize(), 100u);
+  EXPECT_EQ(list.GetNumEvicted(), 900u);
+}
+
+TEST(CacheSkipListTest, ClockTest) {
+  // test if the keys read keep their place while cold keys come and go
+  const std::size_t kCharge = ChargeOfOneKey();
+  Cache list(ManualOptions(50 * kCharge));
+  std::string value;
+  for (int i = 0; i < 1000; i++) {
+    list.SkipInsert(i, std::string(10, 'v'));
+    for (int hot = 0; hot < 5 && hot <= i; hot++) {
+      EXPECT_TRUE(list.Get(hot, &value)) << hot << " evicted at " << i;
+    }
+  }
+  EXPECT_EQ(list.GetSize(), 50u);
+}
+
+TEST(CacheSkipListTest, ConcurrentTest) {
+  // test if the charges stay exact while writers race on the same keys,
+  // with expiry and eviction running
+  const std::size_t kCharge = ChargeOfOneKey();
+  CacheSkipListOptions options;
+  options.max_bytes = 200 * kCharge;
+  options.reap_interval = 1ms;
+  options.max_sweep = 16;
+  Cache list(options);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&list, t]() {
+      std::string value;
+      for (int i = 0; i < 5000; i++) {
+        int key = (i * 31 + t * 7) % 500;
+        switch (i % 4) {
+          case 0:
+            list.SkipInsert(key, std::string(10, 'v'), 2ms);
+            break;
+          case 1:
+            list.SkipInsert(key, std::string(10, 'w'));
+            break;
+          case 2:
+            list.SkipRemove(key);
+            break;
+          default:
+            list.Get(key, &value);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(list.GetUsage(), list.GetSize() * kCharge);
+  // writers that found the hand busy may leave it over, a write fixes it
+  list.SkipInsert(0, std::string(10, 'v'));
+  EXPECT_LE(list.GetUsage(), 200 * kCharge);
+}
+}  // namespace kvstore
@@ -0,0 +1,211 @@
+#include "../src/cache.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+/** the values deleted by the cache, in order, as (key, value) */
+static std::vector<std::pair<int, int>> deleted;
+
+/**
+ * @brief encode an int key
+ * @param k the key
+ * @return the encoded key
+ */
+static std::string EncodeKey(int k) { return std::to_string(k); }
+
+/**
+ * @brief the deleter of the test values, records what it deletes
+ * @param key the key
+ * @param value the value
+ */
+static void Deleter(const std::string &key, void *value) {
+  deleted.emplace_back(std::stoi(key), *static_cast<int *>(value));
+  delete static_cast<int *>(value);
+}
+
+/**
+ * @brief the deleter of the values shared between threads, records nothing
+ * @param key the key
+ * @param value the value
+ */
+static void DeleteQuietly(const std::string &key, void *value) {
+  (void)key;
+  delete static_cast<int *>(value);
+}
+
+/**
+ * @brief CacheTest runs against a fresh cache
+ */
+class CacheTest : public testing::Test {
+ protected:
+  static const std::size_t kCacheSize = 1000;
+
+  CacheTest() : cache_(NewLRUCache(kCacheSize)) { deleted.clear(); }
+
+  int Lookup(int key) {
+    Cache::Handle *handle = cache_->Lookup(EncodeKey(key));
+    if (handle == nullptr) {
+      return -1;
+    }
+    int value = *static_cast<int *>(cache_->Value(handle));
+    cache_->Release(handle);
+    return value;
+  }
+
+  void Insert(int key, int value, int charge = 1) {
+    cache_->Release(InsertAndReturnHandle(key, value, charge));
+  }
+
+  Cache::Handle *InsertAndReturnHandle(int key, int value, int charge = 1) {
+    return cache_->Insert(EncodeKey(key), new int(value), charge, &Deleter);
+  }
+
+  std::shared_ptr<Cache> cache_;
+};
+
+TEST_F(CacheTest, HitAndMissTest) {
+  // test if lookups find the latest value and count hits and misses
+  EXPECT_EQ(-1, Lookup(100));
+  Insert(100, 101);
+  EXPECT_EQ(101, Lookup(100));
+  EXPECT_EQ(-1, Lookup(200));
+  Insert(200, 201);
+  EXPECT_EQ(101, Lookup(100));
+  EXPECT_EQ(201, Lookup(200));
+
+  Insert(100, 102);
+  EXPECT_EQ(102, Lookup(100));
+  ASSERT_EQ(1u, deleted.size());
+  EXPECT_EQ(100, deleted[0].first);
+  EXPECT_EQ(101, deleted[0].second);
+
+  EXPECT_EQ(4u, cache_->GetHits());
+  EXPECT_EQ(2u, cache_->GetMisses());
+}
+
+TEST_F(CacheTest, EraseTest) {
+  // test if erasing drops an entry once, and a missing key is harmless
+  cache_->Erase(EncodeKey(200));
+  EXPECT_TRUE(deleted.empty());
+
+  Insert(100, 101);
+  Insert(200, 201);
+  cache_->Erase(EncodeKey(100));
+  EXPECT_EQ(-1, Lookup(100));
+  EXPECT_EQ(201, Lookup(200));
+  ASSERT_EQ(1u, deleted.size());
+  EXPECT_EQ(100, deleted[0].first);
+
+  cache_->Erase(EncodeKey(100));
+  EXPECT_EQ(1u, deleted.size());
+}
+
+TEST_F(CacheTest, PinnedEntriesTest) {
+  // test if a value lives as long as a handle to it, even once replaced or
+  // erased
+  Cache::Handle *h1 = cache_->Lookup(EncodeKey(100));
+  EXPECT_EQ(nullptr, h1);
+  Insert(100, 101);
+  h1 = cache_->Lookup(EncodeKey(100));
+  EXPECT_EQ(101, *static_cast<int *>(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle *h2 = cache_->Lookup(EncodeKey(100));
+  EXPECT_EQ(102, *static_cast<int *>(cache_->Value(h2)));
+  EXPECT_TRUE(deleted.empty());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1u, deleted.size());
+  EXPECT_EQ(101, deleted[0].second);
+
+  cache_->Erase(EncodeKey(100));
+  EXPECT_EQ(-1, Lookup(100));
+  EXPECT_EQ(1u, deleted.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2u, deleted.size());
+  EXPECT_EQ(102, deleted[1].second);
+}
+
+TEST_F(CacheTest, EvictionTest) {
+  // test if the least recently used entries are evicted first, and pinned
+  // ones are never evicted
+  Insert(100, 101);
+  Insert(200, 201);
+  Insert(300, 301);
+  Cache::Handle *h = cache_->Lookup(EncodeKey(300));
+
+  // frequently used entry must be kept around, as must things still in use
+  for (int i = 0; i < static_cast<int>(kCacheSize) * 2; i++) {
+    Insert(1000 + i, 2000 + i);
+    EXPECT_EQ(2000 + i, Lookup(1000 + i));
+    EXPECT_EQ(101, Lookup(100));
+  }
+  EXPECT_EQ(101, Lookup(100));
+  EXPECT_EQ(-1, Lookup(200));
+  EXPECT_EQ(301, Lookup(300));
+  cache_->Release(h);
+}
+
+TEST_F(CacheTest, CapacityTest) {
+  // test if the total charge stays within the capacity, give or take the
+  // rounding of the shards, and if pruning empties the cache
+  for (int i = 0; i < 10000; i++) {
+    Insert(i, i, 10);
+  }
+  EXPECT_LE(cache_->TotalCharge(), kCacheSize + 16 * 10);
+  EXPECT_GT(cache_->TotalCharge(), kCacheSize / 2);
+
+  cache_->Prune();
+  EXPECT_EQ(0u, cache_->TotalCharge());
+  EXPECT_EQ(10000u, deleted.size());
+}
+
+TEST_F(CacheTest, ZeroCapacityTest) {
+  // test if a cache of capacity 0 caches nothing but still hands out values
+  cache_ = NewLRUCache(0);
+  Cache::Handle *h = InsertAndReturnHandle(1, 100);
+  EXPECT_EQ(100, *static_cast<int *>(cache_->Value(h)));
+  EXPECT_EQ(-1, Lookup(1));
+  cache_->Release(h);
+  EXPECT_EQ(1u, deleted.size());
+}
+
+TEST_F(CacheTest, NewIdTest) {
+  uint64_t a = cache_->NewId();
+  uint64_t b = cache_->NewId();
+  EXPECT_NE(a, b);
+}
+
+TEST_F(CacheTest, ConcurrentTest) {
+  // test if concurrent inserts and lookups over all the shards keep every
+  // value intact
+  cache_ = NewLRUCache(100000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([this, t]() {
+      for (int i = 0; i < 10000; i++) {
+        int key = (i * 7 + t) % 5000;
+        Cache::Handle *h = cache_->Lookup(EncodeKey(key));
+        if (h == nullptr) {
+          h = cache_->Insert(EncodeKey(key), new int(key * 2), 1,
+                             &DeleteQuietly);
+        }
+        EXPECT_EQ(key * 2, *static_cast<int *>(cache_->Value(h)));
+        cache_->Release(h);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(40000u, cache_->GetHits() + cache_->GetMisses());
+  cache_.reset();
+}
+}  // namespace kvstore
@@ -0,0 +1,122 @@
+#include "../src/codec.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace kvstore {
+
+/**
+ * @brief compress a value and uncompress it back, appending to a prefix
+ * @param codec the codec
+ * @param input the value
+ * @return the size of the compressed value
+ */
+static std::size_t RoundTrip(const Codec &codec, const std::string &input) {
+  std::string compressed = "prefix";
+  codec.Compress(input, &compressed);
+  std::string output = "prefix";
+  EXPECT_TRUE(codec.Uncompress(compressed.substr(6), &output));
+  EXPECT_EQ(output, "prefix" + input);
+  return compressed.size() - 6;
+}
+
+/**
+ * @brief a JSON-like document, repetitive like real ones
+ * @param records how many records it holds
+ * @param gen the random numbers
+ * @return the document
+ */
+static std::string MakeDocument(int records, std::mt19937 *gen) {
+  static const char *kCities[] = {"Paris", "Berlin", "Lisbon", "Oslo"};
+  std::string document = "[";
+  for (int i = 0; i < records; i++) {
+    document += "{\"id\": " + std::to_string((*gen)() % 100000) +
+                ", \"city\": \"" + kCities[(*gen)() % 4] +
+                "\", \"active\": " + ((*gen)() % 2 ? "true" : "false") +
+                ", \"score\": " + std::to_string((*gen)() % 1000) + "},";
+  }
+  document.back() = ']';
+  return document;
+}
+
+TEST(CodecTest, NoCodecTest) {
+  // test if NoCodec keeps the bytes as they are
+  auto codec = NewNoCodec();
+  EXPECT_EQ(codec->Type(), kNoCodec);
+  EXPECT_EQ(RoundTrip(*codec, ""), 0u);
+  EXPECT_EQ(RoundTrip(*codec, "hello"), 5u);
+}
+
+TEST(CodecTest, LzRoundTripTest) {
+  // test the edge cases of the format: empty and tiny values, long literal
+  // runs and matches needing extra length bytes, overlapping matches, and
+  // repeats farther than an offset reaches
+  auto codec = NewLzCodec();
+  EXPECT_EQ(codec->Type(), kLzCodec);
+  std::mt19937 gen(11);
+  std::vector<std::string> inputs = {"", "a", "abc", "abcd", "abcdabcd",
+                                     "aaaaaaaaaaaaaaaaaaaaaaaaa"};
+  std::string random(100000, 0);
+  for (auto &c : random) {
+    c = static_cast<char>(gen());
+  }
+  inputs.push_back(random);
+  inputs.push_back(random.substr(0, 300) + random.substr(0, 300));
+  inputs.push_back(std::string(70000, 'x'));
+  inputs.push_back(random.substr(0, 70000) + random.substr(0, 1000));
+  inputs.push_back(MakeDocument(1000, &gen));
+  for (std::size_t length = 0; length < 300; length++) {
+    inputs.push_back(std::string(length, 'q') + random.substr(0, length) +
+                     std::string(length, 'q'));
+  }
+  for (auto &input : inputs) {
+    RoundTrip(*codec, input);
+  }
+  // a run is one match, random bytes stay about as large
+  EXPECT_LT(RoundTrip(*codec, std::string(70000, 'x')), 300u);
+  EXPECT_LT(RoundTrip(*codec, random), random.size() + random.size() / 100);
+}
+
+TEST(CodecTest, LzRatioTest) {
+  // test if a JSON-like document shrinks by half at least
+  auto codec = NewLzCodec();
+  std::mt19937 gen(5);
+  std::string document = MakeDocument(100, &gen);
+  EXPECT_LT(RoundTrip(*codec, document) * 2, document.size());
+}
+
+TEST(CodecTest, LzCorruptionTest) {
+  // test if every truncation and many bit flips are caught, or at least
+  // uncompress into the declared length without reading out of bounds
+  auto codec = NewLzCodec();
+  std::mt19937 gen(3);
+  std::string document = MakeDocument(20, &gen);
+  std::string compressed;
+  codec->Compress(document, &compressed);
+  std::string output;
+  for (std::size_t length = 0; length < compressed.size(); length++) {
+    output.clear();
+    EXPECT_FALSE(codec->Uncompress(compressed.substr(0, length), &output));
+  }
+  for (int i = 0; i < 2000; i++) {
+    std::string corrupted = compressed;
+    corrupted[gen() % corrupted.size()] ^= static_cast<char>(1 << (gen() % 8));
+    output.clear();
+    if (codec->Uncompress(corrupted, &output)) {
+      EXPECT_EQ(output.size(), document.size());
+    }
+  }
+  // a match reaching before the start of the output
+  std::string bad;
+  PutVarint32(&bad, 8);
+  bad += static_cast<char>(0x10);
+  bad += 'a';
+  bad += static_cast<char>(2);
+  bad += static_cast<char>(0);
+  output.clear();
+  EXPECT_FALSE(codec->Uncompress(bad, &output));
+}
+}  // namespace kvstore
@@ -0,0 +1,68 @@
+#include "../src/comparator.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+namespace kvstore {
+
+/**
+ * @brief shorten a key between two others
+ * @param start the key to shorten
+ * @param limit the upper bound
+ * @return the shortened key
+ */
+static std::string Separator(std::string start, const std::string &limit) {
+  BytewiseComparator::FindShortestSeparator(&start, limit);
+  return start;
+}
+
+/**
+ * @brief shorten a key to a successor
+ * @param key the key to shorten
+ * @return the shortened key
+ */
+static std::string Successor(std::string key) {
+  BytewiseComparator::FindShortestSuccessor(&key);
+  return key;
+}
+
+TEST(ComparatorTest, CompareTest) {
+  // test if keys compare as unsigned bytes, across key types
+  BytewiseComparator less;
+  EXPECT_LT(BytewiseComparator::Compare("abc", "abd"), 0);
+  EXPECT_GT(BytewiseComparator::Compare("abc", "ab"), 0);
+  EXPECT_EQ(BytewiseComparator::Compare(std::string("abc"), "abc"), 0);
+  EXPECT_TRUE(less("\x7f", "\x80"));
+  EXPECT_TRUE(less(std::string("a"), std::string_view("b")));
+  EXPECT_FALSE(less(std::string_view("b"), "a"));
+  EXPECT_FALSE(less("a", "a"));
+}
+
+TEST(ComparatorTest, SeparatorTest) {
+  // test if a separator is short and stays in [start, limit)
+  EXPECT_EQ(Separator("abcdefgh", "abzzz"), "abd");
+  EXPECT_EQ(Separator("key0100kkkk", "key0300"), "key02");
+  EXPECT_EQ(Separator("key0100kkkk", "key0200"), "key0100kkkk");
+  // the next byte up would reach limit, or there is no room
+  EXPECT_EQ(Separator("abc", "abd"), "abc");
+  EXPECT_EQ(Separator("ab\xff", "ac"), "ab\xff");
+  // one is a prefix of the other
+  EXPECT_EQ(Separator("abc", "abcdef"), "abc");
+  for (auto pair : {std::make_pair("foo1", "foo9"), std::make_pair("a", "zz"),
+                    std::make_pair("13kkk", "140")}) {
+    std::string separator = Separator(pair.first, pair.second);
+    EXPECT_LE(BytewiseComparator::Compare(pair.first, separator), 0);
+    EXPECT_LT(BytewiseComparator::Compare(separator, pair.second), 0);
+  }
+}
+
+TEST(ComparatorTest, SuccessorTest) {
+  // test if a successor is short and no smaller than the key
+  EXPECT_EQ(Successor("abc"), "b");
+  EXPECT_EQ(Successor("\xff\xff" "abc"), "\xff\xff" "b");
+  EXPECT_EQ(Successor("\xff\xff"), "\xff\xff");
+  EXPECT_EQ(Successor(""), "");
+}
+}  // namespace kvstore
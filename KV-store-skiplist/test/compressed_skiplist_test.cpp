@@ -0,0 +1,154 @@
+#include "../src/comparator.h"
+#include "../src/compressed_skiplist.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+/**
+ * @brief a JSON-like value, repetitive like real ones
+ * @param n which value
+ * @return the value, about 1KB
+ */
+static std::string MakeValue(int n) {
+  std::string value = "{\"items\": [";
+  for (int i = 0; i < 16; i++) {
+    value += "{\"id\": " + std::to_string(n * 16 + i) +
+             ", \"kind\": \"widget\", \"in_stock\": true},";
+  }
+  value.back() = ']';
+  return value + "}";
+}
+
+TEST(CompressedSkipListTest, InsertGetRemoveTest) {
+  // test the point operations and the accounting of the bytes
+  CompressedSkipList<int> list;
+  std::size_t raw = 0;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(list.SkipInsert(i, MakeValue(i)));
+    raw += MakeValue(i).size();
+  }
+  EXPECT_EQ(list.GetSize(), 100u);
+  EXPECT_EQ(list.GetRawBytes(), raw);
+  EXPECT_GT(list.GetCompressionRatio(), 2.0);
+  std::string value;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(list.Get(i, &value));
+    EXPECT_EQ(value, MakeValue(i));
+  }
+  EXPECT_FALSE(list.Get(100, &value));
+  // incompressible and tiny values are stored as they are
+  EXPECT_FALSE(list.SkipInsert(7, "short"));
+  EXPECT_EQ(list.GetRawBytes(), raw - MakeValue(7).size() + 5);
+  ASSERT_TRUE(list.Get(7, &value));
+  EXPECT_EQ(value, "short");
+  EXPECT_TRUE(list.SkipRemove(8));
+  EXPECT_FALSE(list.SkipRemove(8));
+  EXPECT_FALSE(list.Get(8, &value));
+  for (int i = 0; i < 100; i++) {
+    list.SkipRemove(i);
+  }
+  EXPECT_EQ(list.GetRawBytes(), 0u);
+  EXPECT_EQ(list.GetStoredBytes(), 0u);
+  EXPECT_EQ(list.GetValueCache()->TotalCharge(), 0u);
+}
+
+TEST(CompressedSkipListTest, CacheTest) {
+  // test if hot values are decompressed once, and if a new value of a key
+  // is never shadowed by the cached old one
+  CompressedSkipListOptions options;
+  options.value_cache = NewLRUCache(1 << 20);
+  CompressedSkipList<int> list(options);
+  for (int i = 0; i < 100; i++) {
+    list.SkipInsert(i, MakeValue(i));
+  }
+  std::string value;
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 10; i++) {
+      list.Get(i, &value);
+    }
+  }
+  EXPECT_EQ(options.value_cache->GetMisses(), 10u);
+  EXPECT_EQ(options.value_cache->GetHits(), 90u);
+  list.SkipInsert(3, MakeValue(1000));
+  ASSERT_TRUE(list.Get(3, &value));
+  EXPECT_EQ(value, MakeValue(1000));
+
+  // two lists may share a cache, their values never mix
+  CompressedSkipList<int> other(options);
+  other.SkipInsert(0, MakeValue(2000));
+  ASSERT_TRUE(other.Get(0, &value));
+  EXPECT_EQ(value, MakeValue(2000));
+  ASSERT_TRUE(list.Get(0, &value));
+  EXPECT_EQ(value, MakeValue(0));
+
+  // a scan does not go through the cache
+  uint64_t misses = options.value_cache->GetMisses();
+  std::size_t count = list.Scan(50, 60, [](int key, const std::string &v) {
+    EXPECT_EQ(v, MakeValue(key));
+    return true;
+  });
+  EXPECT_EQ(count, 10u);
+  EXPECT_EQ(options.value_cache->GetMisses(), misses);
+}
+
+TEST(CompressedSkipListTest, NoCodecTest) {
+  // test if the none-codec stores the values as they are, with a string key
+  CompressedSkipListOptions options;
+  options.codec = NewNoCodec();
+  options.value_cache = NewLRUCache(0);
+  CompressedSkipList<std::string, BytewiseComparator> list(options);
+  list.SkipInsert("a", MakeValue(1));
+  EXPECT_EQ(list.GetCompressionRatio(), 1.0);
+  std::string value;
+  ASSERT_TRUE(list.Get(std::string_view("a"), &value));
+  EXPECT_EQ(value, MakeValue(1));
+}
+
+TEST(CompressedSkipListTest, ConcurrentTest) {
+  // test if readers always see whole values while writers replace them, and
+  // if the byte counts and the cache stay exact
+  CompressedSkipListOptions options;
+  options.value_cache = NewLRUCache(16 << 10);  // smaller than the values
+  CompressedSkipList<int> list(options);
+  for (int i = 0; i < 64; i++) {
+    list.SkipInsert(i, MakeValue(i));
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&list, t]() {
+      for (int i = 0; i < 3000; i++) {
+        int key = (i * 7 + t) % 64;
+        list.SkipInsert(key, MakeValue(key + 64 * (i % 3)));
+      }
+    });
+    threads.emplace_back([&list]() {
+      std::string value;
+      for (int i = 0; i < 3000; i++) {
+        int key = i % 64;
+        ASSERT_TRUE(list.Get(key, &value));
+        EXPECT_TRUE(value == MakeValue(key) || value == MakeValue(key + 64) ||
+                    value == MakeValue(key + 128));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::size_t raw = 0;
+  list.Scan(0, 64, [&raw](int, const std::string &value) {
+    raw += value.size();
+    return true;
+  });
+  EXPECT_EQ(list.GetRawBytes(), raw);
+  // no value decompressed while it was replaced is left behind in the cache
+  for (int i = 0; i < 64; i++) {
+    list.SkipRemove(i);
+  }
+  EXPECT_EQ(options.value_cache->TotalCharge(), 0u);
+}
+}  // namespace kvstore
@@ -0,0 +1,446 @@
+#include "../src/db.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+using StringDB = DB<std::string, std::string>;
+using IntStringDB = DB<int, std::string>;
+using IntDB = DB<int, int>;
+
+/**
+ * @brief a scratch DB directory for a test, emptied if left by a previous run
+ * @param name the test name
+ * @return the DB directory
+ */
+static std::string TestDBName(const std::string &name) {
+  std::string dbname = testing::TempDir() + "kvstore_db_test_" + name;
+  DestroyDB(dbname);
+  return dbname;
+}
+
+/**
+ * @brief the files of a kind currently in a DB directory
+ * @param dbname the DB directory
+ * @param type the kind of files
+ * @return the full names of the files
+ */
+static std::vector<std::string> DBFiles(const std::string &dbname,
+                                        FileType type) {
+  std::vector<std::string> filenames;
+  std::vector<std::string> result;
+  GetChildren(dbname, &filenames);
+  for (auto &filename : filenames) {
+    uint64_t number;
+    if (ParseFileName(filename, &number) == type) {
+      result.push_back(dbname + "/" + filename);
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief the write-ahead logs currently in a DB directory
+ * @param dbname the DB directory
+ * @return the full names of the logs
+ */
+static std::vector<std::string> LogFiles(const std::string &dbname) {
+  return DBFiles(dbname, FileType::kLogFile);
+}
+
+TEST(DBTest, PutGetDeleteTest) {
+  // test if the DB behaves like a map before any restart
+  auto dbname = TestDBName("put_get_delete");
+  std::unique_ptr<StringDB> db;
+  ASSERT_TRUE(StringDB::Open(Options(), dbname, &db).ok());
+
+  WriteOptions write_options;
+  ASSERT_TRUE(db->Put(write_options, "foo", "v1").ok());
+  ASSERT_TRUE(db->Put(write_options, "bar", "v2").ok());
+  ASSERT_TRUE(db->Put(write_options, "foo", "v3").ok());
+  ASSERT_TRUE(db->Delete(write_options, "bar").ok());
+  ASSERT_TRUE(db->Delete(write_options, "missing").ok());
+
+  std::string value;
+  ASSERT_TRUE(db->Get("foo", &value).ok());
+  EXPECT_EQ(value, "v3");
+  EXPECT_TRUE(db->Get("bar", &value).IsNotFound());
+  EXPECT_EQ(db->GetSize(), 1);
+  EXPECT_EQ(db->GetLastSequence(), 5);
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, RecoveryTest) {
+  // test if the content survives restarts, and the logs become a table
+  auto dbname = TestDBName("recovery");
+  std::unique_ptr<IntStringDB> db;
+  ASSERT_TRUE(IntStringDB::Open(Options(), dbname, &db).ok());
+  WriteOptions write_options;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(db->Put(write_options, i, std::to_string(i)).ok());
+  }
+  WriteBatch<int, std::string> batch;
+  for (int i = 0; i < 1000; i += 3) {
+    batch.Delete(i);
+  }
+  batch.Put(5000, "batched");
+  ASSERT_TRUE(db->Write(write_options, batch).ok());
+  auto size = db->GetSize();
+  auto sequence = db->GetLastSequence();
+
+  for (int round = 0; round < 3; round++) {
+    db.reset();
+    ASSERT_TRUE(IntStringDB::Open(Options(), dbname, &db).ok());
+    EXPECT_EQ(db->GetSize(), size);
+    EXPECT_EQ(db->GetLastSequence(), sequence);
+    std::string value;
+    for (int i = 0; i < 1000; i++) {
+      if (i % 3 == 0) {
+        EXPECT_TRUE(db->Get(i, &value).IsNotFound());
+      } else {
+        ASSERT_TRUE(db->Get(i, &value).ok());
+        EXPECT_EQ(value, std::to_string(i));
+      }
+    }
+    ASSERT_TRUE(db->Get(5000, &value).ok());
+    EXPECT_EQ(value, "batched");
+    // the recovered content is flushed into a table, next to a fresh log
+    EXPECT_EQ(LogFiles(dbname).size(), 1);
+    EXPECT_EQ(DBFiles(dbname, FileType::kTableFile).size(), 1);
+  }
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, FlushTest) {
+  // test if full MemTables are flushed into tables in the background, and
+  // the newest value or tombstone wins across the MemTables and the tables
+  auto dbname = TestDBName("flush");
+  Options options;
+  options.write_buffer_size = 16 * 1024;
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+  WriteOptions write_options;
+  for (int i = 0; i < 5000; i++) {
+    ASSERT_TRUE(db->Put(write_options, i, i).ok());
+  }
+  for (int i = 0; i < 5000; i += 2) {
+    ASSERT_TRUE(db->Put(write_options, i, -i).ok());
+  }
+  for (int i = 0; i < 5000; i += 5) {
+    ASSERT_TRUE(db->Delete(write_options, i).ok());
+  }
+  ASSERT_TRUE(db->FlushMemTable().ok());
+  EXPECT_GT(db->GetNumTables(), 1);
+  EXPECT_EQ(LogFiles(dbname).size(), 1);
+
+  auto check = [](IntDB *db) {
+    int value;
+    for (int i = 0; i < 5000; i++) {
+      if (i % 5 == 0) {
+        EXPECT_TRUE(db->Get(i, &value).IsNotFound());
+      } else {
+        ASSERT_TRUE(db->Get(i, &value).ok());
+        EXPECT_EQ(value, i % 2 == 0 ? -i : i);
+      }
+    }
+    EXPECT_EQ(db->GetSize(), 4000);
+    int expected = 1;
+    auto count = db->Scan(1, 5000, [&expected](int key, int value) {
+      EXPECT_EQ(key, expected);
+      EXPECT_EQ(value, key % 2 == 0 ? -key : key);
+      expected += (expected % 5 == 4) ? 2 : 1;
+      return true;
+    });
+    EXPECT_EQ(count, 4000);
+  };
+  check(db.get());
+
+  // the tables are all there is to recover, the log is empty
+  auto num_tables = db->GetNumTables();
+  db.reset();
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+  EXPECT_EQ(db->GetNumTables(), num_tables);
+  EXPECT_EQ(db->GetLastSequence(), 5000 + 2500 + 1000);
+  check(db.get());
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, TablesAndLogsRecoveryTest) {
+  // test if a log is replayed on top of the tables and flushed into one more
+  auto dbname = TestDBName("tables_and_logs");
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  WriteOptions write_options;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(db->Put(write_options, i, i).ok());
+  }
+  ASSERT_TRUE(db->FlushMemTable().ok());
+  EXPECT_EQ(db->GetNumTables(), 1);
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(db->Put(write_options, i, -i).ok());
+  }
+  ASSERT_TRUE(db->Delete(write_options, 999).ok());
+
+  db.reset();
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  EXPECT_EQ(db->GetNumTables(), 2);
+  EXPECT_EQ(DBFiles(dbname, FileType::kTableFile).size(), 2);
+  EXPECT_EQ(LogFiles(dbname).size(), 1);
+  EXPECT_EQ(db->GetSize(), 999);
+  EXPECT_EQ(db->GetLastSequence(), 1011);
+  int value;
+  ASSERT_TRUE(db->Get(5, &value).ok());
+  EXPECT_EQ(value, -5);
+  ASSERT_TRUE(db->Get(500, &value).ok());
+  EXPECT_EQ(value, 500);
+  EXPECT_TRUE(db->Get(999, &value).IsNotFound());
+
+  // a restart with nothing new in the log adds no table
+  db.reset();
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  EXPECT_EQ(db->GetNumTables(), 2);
+  EXPECT_EQ(db->GetSize(), 999);
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, MultiGetTest) {
+  // test if MultiGet agrees with Get across the MemTable and filtered tables
+  auto dbname = TestDBName("multi_get");
+  Options options;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+  WriteOptions write_options;
+  for (int round = 0; round < 3; round++) {
+    for (int i = round; i < 3000; i += 3) {
+      ASSERT_TRUE(db->Put(write_options, i, round).ok());
+    }
+    ASSERT_TRUE(db->Delete(write_options, round * 100).ok());
+    ASSERT_TRUE(db->FlushMemTable().ok());
+  }
+  ASSERT_TRUE(db->Put(write_options, 1, 42).ok());
+  EXPECT_EQ(db->GetNumTables(), 3);
+
+  std::vector<int> keys;
+  for (int i = -100; i < 3100; i++) {
+    keys.push_back(i);
+  }
+  std::vector<int> values;
+  auto statuses = db->MultiGet(keys, &values);
+  ASSERT_EQ(statuses.size(), keys.size());
+  ASSERT_EQ(values.size(), keys.size());
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    int value;
+    Status s = db->Get(keys[i], &value);
+    ASSERT_EQ(statuses[i].ok(), s.ok()) << keys[i];
+    ASSERT_EQ(statuses[i].IsNotFound(), s.IsNotFound()) << keys[i];
+    if (s.ok()) {
+      EXPECT_EQ(values[i], value);
+    }
+  }
+  EXPECT_EQ(values[101], 42);
+  EXPECT_TRUE(statuses[200].IsNotFound());
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+/**
+ * @brief the total size of the table files in a DB directory
+ * @param dbname the DB directory
+ * @return the size in bytes
+ */
+static uint64_t TableBytes(const std::string &dbname) {
+  uint64_t total = 0;
+  for (auto &fname : DBFiles(dbname, FileType::kTableFile)) {
+    uint64_t size = 0;
+    GetFileSize(fname, &size);
+    total += size;
+  }
+  return total;
+}
+
+TEST(DBTest, CompactionTest) {
+  // test if compactions push the tables down the levels, keep the newest
+  // values and reclaim the space of the overwritten ones
+  auto dbname = TestDBName("compaction");
+  Options options;
+  options.write_buffer_size = 16 * 1024;
+  options.max_file_size = 8 * 1024;
+  options.level0_compaction_trigger = 2;
+  options.max_bytes_for_level_base = 64 * 1024;
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+  WriteOptions write_options;
+  const int num_keys = 5000;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < num_keys; i++) {
+      ASSERT_TRUE(db->Put(write_options, (i * 7919) % num_keys, round).ok());
+    }
+  }
+  for (int i = 0; i < num_keys; i += 10) {
+    ASSERT_TRUE(db->Delete(write_options, i).ok());
+  }
+  ASSERT_TRUE(db->FlushMemTable().ok());
+  ASSERT_TRUE(db->WaitForCompactions().ok());
+  EXPECT_LT(db->GetNumLevelTables(0),
+            static_cast<std::size_t>(options.level0_compaction_trigger));
+  EXPECT_GT(db->GetNumLevelTables(1) + db->GetNumLevelTables(2), 0);
+
+  auto check = [num_keys](IntDB *db) {
+    int value;
+    for (int i = 0; i < num_keys; i++) {
+      if (i % 10 == 0) {
+        EXPECT_TRUE(db->Get(i, &value).IsNotFound());
+      } else {
+        ASSERT_TRUE(db->Get(i, &value).ok());
+        EXPECT_EQ(value, 3);
+      }
+    }
+    EXPECT_EQ(db->GetSize(), static_cast<std::size_t>(num_keys / 10 * 9));
+  };
+  check(db.get());
+
+  // four rounds of overwrites were written, about one is left
+  uint64_t bytes = TableBytes(dbname);
+  auto num_tables = db->GetNumTables();
+  db.reset();
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+  EXPECT_EQ(db->GetNumTables(), num_tables);
+  check(db.get());
+
+  // rewriting a single copy of the keys doesn't grow the tables much
+  for (int i = 0; i < num_keys; i++) {
+    ASSERT_TRUE(db->Put(write_options, i, 4).ok());
+  }
+  ASSERT_TRUE(db->FlushMemTable().ok());
+  ASSERT_TRUE(db->WaitForCompactions().ok());
+  EXPECT_LT(TableBytes(dbname), bytes * 3);
+  int value;
+  ASSERT_TRUE(db->Get(10, &value).ok());
+  EXPECT_EQ(value, 4);
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, LeftoverTableTest) {
+  // test if a table missing from the manifest, left by a flush or a
+  // compaction cut short, is deleted on open
+  auto dbname = TestDBName("leftover_table");
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  WriteOptions write_options;
+  ASSERT_TRUE(db->Put(write_options, 1, 1).ok());
+  ASSERT_TRUE(db->FlushMemTable().ok());
+  db.reset();
+
+  std::string leftover = TableFileName(dbname, 1000);
+  std::unique_ptr<WritableFile> file;
+  ASSERT_TRUE(WritableFile::Open(leftover, true, &file).ok());
+  ASSERT_TRUE(file->Append("half written").ok());
+  ASSERT_TRUE(file->Close().ok());
+
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  EXPECT_EQ(DBFiles(dbname, FileType::kTableFile).size(), 1);
+  EXPECT_EQ(DBFiles(dbname, FileType::kManifestFile).size(), 1);
+  int value;
+  ASSERT_TRUE(db->Get(1, &value).ok());
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, RateLimiterTest) {
+  // test if the rate limiter holds the callers to its rate, past the burst
+  RateLimiter limiter(1024 * 1024);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 30; i++) {
+    limiter.Request(10 * 1024);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  // 300KB at 1MB/s, the first 100KB are the burst
+  EXPECT_GE(elapsed.count(), 0.15);
+}
+
+TEST(DBTest, TornWriteRecoveryTest) {
+  // test if a torn write at the end of the log loses only that write
+  auto dbname = TestDBName("torn_write");
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  WriteOptions write_options;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(db->Put(write_options, i, i).ok());
+  }
+  db.reset();
+
+  auto logs = LogFiles(dbname);
+  ASSERT_EQ(logs.size(), 1);
+  uint64_t size;
+  ASSERT_TRUE(GetFileSize(logs[0], &size).ok());
+  ASSERT_EQ(truncate(logs[0].c_str(), size - 2), 0);
+
+  ASSERT_TRUE(IntDB::Open(Options(), dbname, &db).ok());
+  EXPECT_EQ(db->GetSize(), 99);
+  int value;
+  EXPECT_TRUE(db->Get(98, &value).ok());
+  EXPECT_TRUE(db->Get(99, &value).IsNotFound());
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+TEST(DBTest, GroupCommitTest) {
+  // test if concurrent writers, some asking for a sync, all get recovered
+  auto dbname = TestDBName("group_commit");
+  Options options;
+  options.sync_bytes = 4096;
+  std::unique_ptr<IntDB> db;
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+
+  int num_thread = 4;
+  int per_thread = 500;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_thread; t++) {
+    threads.emplace_back([&db, t, num_thread, per_thread]() {
+      WriteOptions write_options;
+      for (int i = 0; i < per_thread; i++) {
+        write_options.sync = (i % 100 == 0);
+        ASSERT_TRUE(db->Put(write_options, i * num_thread + t, t).ok());
+      }
+    });
+  }
+  for (auto &thr : threads) {
+    thr.join();
+  }
+  EXPECT_EQ(db->GetSize(), num_thread * per_thread);
+  EXPECT_EQ(db->GetLastSequence(), num_thread * per_thread);
+
+  db.reset();
+  ASSERT_TRUE(IntDB::Open(options, dbname, &db).ok());
+  EXPECT_EQ(db->GetSize(), num_thread * per_thread);
+  int value;
+  for (int key = 0; key < num_thread * per_thread; key++) {
+    ASSERT_TRUE(db->Get(key, &value).ok());
+    EXPECT_EQ(value, key % num_thread);
+  }
+
+  db.reset();
+  DestroyDB(dbname);
+}
+
+}  // namespace kvstore
@@ -0,0 +1,88 @@
+#include "../src/epoch.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+TEST(EpochTest, AdvanceWhenIdle) {
+  // test if the epoch moves forward when no thread is pinned
+  EpochManager *epochs = EpochManager::Default();
+  uint64_t epoch = epochs->GetEpoch();
+  EXPECT_EQ(epochs->TryAdvance(), epoch + 1);
+  EXPECT_EQ(epochs->TryAdvance(), epoch + 2);
+  EXPECT_TRUE(epochs->IsSafe(epoch));
+  EXPECT_FALSE(epochs->IsSafe(epoch + 1));
+}
+
+TEST(EpochTest, PinnedThreadHoldsEpoch) {
+  // test if a pinned thread keeps what was retired meanwhile from being safe
+  EpochManager *epochs = EpochManager::Default();
+  std::atomic<bool> pinned(false);
+  std::atomic<bool> done(false);
+  std::thread reader([&]() {
+    EpochGuard guard;
+    pinned = true;
+    while (!done.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (!pinned.load()) {
+    std::this_thread::yield();
+  }
+  uint64_t retired = epochs->GetEpoch();
+  // the reader has seen this epoch, so it may advance once, but not twice
+  epochs->TryAdvance();
+  epochs->TryAdvance();
+  EXPECT_EQ(epochs->TryAdvance(), retired + 1);
+  EXPECT_FALSE(epochs->IsSafe(retired));
+
+  done = true;
+  reader.join();
+  epochs->TryAdvance();
+  EXPECT_TRUE(epochs->IsSafe(retired));
+}
+
+TEST(EpochTest, NestedGuards) {
+  // test if only the outermost guard unpins
+  EpochManager *epochs = EpochManager::Default();
+  EXPECT_FALSE(epochs->IsPinned());
+  {
+    EpochGuard outer;
+    uint64_t retired = epochs->GetEpoch();
+    {
+      EpochGuard inner;
+      EXPECT_TRUE(epochs->IsPinned());
+    }
+    EXPECT_TRUE(epochs->IsPinned());
+    epochs->TryAdvance();
+    epochs->TryAdvance();
+    EXPECT_FALSE(epochs->IsSafe(retired));
+  }
+  EXPECT_FALSE(epochs->IsPinned());
+}
+
+TEST(EpochTest, ManyThreads) {
+  // test if the records of exited threads are reused and never block
+  EpochManager *epochs = EpochManager::Default();
+  for (int round = 0; round < 10; round++) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+      threads.emplace_back([]() {
+        for (int i = 0; i < 1000; i++) {
+          EpochGuard guard;
+          EpochManager::Default()->TryAdvance();
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  uint64_t epoch = epochs->GetEpoch();
+  EXPECT_EQ(epochs->TryAdvance(), epoch + 1);
+}
+}  // namespace kvstore
@@ -0,0 +1,220 @@
+#include "../src/comparator.h"
+#include "../src/fat_skiplist.h"
+
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+/**
+ * @brief check a FatSkipList against a std::map holding the same pairs,
+ *        through Get and a full Iterator walk
+ * @param list the list
+ * @param expected the pairs it should hold
+ */
+template <typename List, typename Map>
+static void ExpectSame(const List &list, const Map &expected) {
+  EXPECT_EQ(list.GetSize(), expected.size());
+  {
+    typename List::Iterator iter(&list);
+    auto it = expected.begin();
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next(), ++it) {
+      ASSERT_NE(it, expected.end());
+      EXPECT_EQ(iter.GetKey(), it->first);
+      EXPECT_EQ(iter.GetValue(), it->second);
+    }
+    EXPECT_EQ(it, expected.end());
+  }
+  for (auto &pair : expected) {
+    typename Map::mapped_type value;
+    ASSERT_TRUE(list.Get(pair.first, &value));
+    EXPECT_EQ(value, pair.second);
+  }
+}
+
+/**
+ * @brief apply the same random inserts and removes to a FatSkipList and a
+ *        std::map, checking them along the way
+ * @param make_key turns a random number into a key
+ * @tparam Compare the ordering of the list, for the std::map
+ */
+template <typename List, typename Compare = std::less<>, typename MakeKey>
+static void RandomOperations(MakeKey make_key) {
+  using K = decltype(make_key(0));
+  List list;
+  std::map<K, int, Compare> expected;
+  std::mt19937 gen(7);
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 5000; i++) {
+      K key = make_key(gen() % 8000);
+      if (gen() % 3 == 0) {
+        EXPECT_EQ(list.SkipRemove(key), expected.erase(key) == 1);
+      } else {
+        EXPECT_EQ(list.SkipInsert(key, i), expected.count(key) == 0);
+        expected[key] = i;
+      }
+    }
+    ExpectSame(list, expected);
+  }
+  // removing everything shrinks it back to its head nodes
+  for (auto &pair : expected) {
+    EXPECT_TRUE(list.SkipRemove(pair.first));
+  }
+  EXPECT_EQ(list.GetSize(), 0u);
+  EXPECT_EQ(list.GetHeight(), 1);
+  typename List::Iterator iter(&list);
+  iter.SeekToFirst();
+  EXPECT_FALSE(iter.Valid());
+}
+
+TEST(FatSkipListTest, InsertGetRemoveTest) {
+  // test the point operations of SkipList
+  FatSkipList<int, int> list;
+  EXPECT_EQ(list.kFanout, 16);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(list.SkipInsert(i, i * 2));
+  }
+  EXPECT_FALSE(list.SkipInsert(7, 70));
+  EXPECT_EQ(list.GetSize(), 1000u);
+  int value = -1;
+  EXPECT_TRUE(list.Get(7, &value));
+  EXPECT_EQ(value, 70);
+  EXPECT_TRUE(list.Contains(999));
+  EXPECT_FALSE(list.Get(1000, &value));
+  EXPECT_FALSE(list.Get(-1, &value));
+  EXPECT_TRUE(list.SkipRemove(7));
+  EXPECT_FALSE(list.SkipRemove(7));
+  EXPECT_FALSE(list.Contains(7));
+  EXPECT_EQ(list.GetSize(), 999u);
+  EXPECT_GT(list.GetHeight(), 1);
+  EXPECT_GT(list.ApproximateMemoryUsage(), 999 * sizeof(int) * 2);
+}
+
+TEST(FatSkipListTest, ExtremeKeysTest) {
+  // test the keys equal to the sentinel and to the padding of the nodes
+  FatSkipList<int, int> list;
+  EXPECT_FALSE(list.Contains(INT_MIN));
+  EXPECT_FALSE(list.Contains(INT_MAX));
+  for (int i = 0; i < 100; i++) {
+    list.SkipInsert(i, i);
+  }
+  EXPECT_FALSE(list.Contains(INT_MAX));
+  EXPECT_TRUE(list.SkipInsert(INT_MIN, 1));
+  EXPECT_TRUE(list.SkipInsert(INT_MAX, 2));
+  int value;
+  EXPECT_TRUE(list.Get(INT_MIN, &value));
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(list.Get(INT_MAX, &value));
+  EXPECT_EQ(value, 2);
+  FatSkipList<int, int>::Iterator iter(&list);
+  iter.SeekToFirst();
+  EXPECT_EQ(iter.GetKey(), INT_MIN);
+  iter.Seek(INT_MAX);
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), INT_MAX);
+  iter.Next();
+  EXPECT_FALSE(iter.Valid());
+}
+
+TEST(FatSkipListTest, RandomIntTest) {
+  // test the vectorized searches of 32- and 64-bit keys, and two-line nodes
+  RandomOperations<FatSkipList<int, int>>([](int n) { return n; });
+  RandomOperations<FatSkipList<int64_t, int>>(
+      [](int n) { return int64_t(n - 4000) * (int64_t(1) << 40); });
+  RandomOperations<FatSkipList<int, int, std::less<>, 128>>(
+      [](int n) { return n; });
+  RandomOperations<FatSkipList<unsigned, int>>([](int n) { return n * 3u; });
+}
+
+TEST(FatSkipListTest, RandomStringTest) {
+  // test the binary searches of other keys, with their own Comparator
+  RandomOperations<FatSkipList<std::string, int, BytewiseComparator>>(
+      [](int n) { return "key" + std::to_string(n); });
+  RandomOperations<FatSkipList<int, int, std::greater<int>>, std::greater<int>>(
+      [](int n) { return n; });
+}
+
+TEST(FatSkipListTest, ScanTest) {
+  // test if Scan visits [lo, hi) in order, with string_view probes
+  FatSkipList<std::string, int, BytewiseComparator> list;
+  for (int i = 0; i < 1000; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "k%04d", i);
+    list.SkipInsert(key, i);
+  }
+  int value;
+  EXPECT_TRUE(list.Get(std::string_view("k0500"), &value));
+  EXPECT_EQ(value, 500);
+  std::vector<int> values;
+  std::size_t count = list.Scan(std::string_view("k0100"), "k0110",
+                                [&values](const std::string &, int v) {
+                                  values.push_back(v);
+                                  return true;
+                                });
+  EXPECT_EQ(count, 10u);
+  ASSERT_EQ(values.size(), 10u);
+  EXPECT_EQ(values.front(), 100);
+  EXPECT_EQ(values.back(), 109);
+  count = list.Scan("", "\xff", [](const std::string &, int v) {
+    return v < 4;
+  });
+  EXPECT_EQ(count, 5u);
+}
+
+TEST(FatSkipListTest, SearchPathTest) {
+  // test if a search visits far fewer nodes than a SkipList would steps
+  FatSkipList<int, int> list;
+  const int kKeys = 100000;
+  for (int i = 0; i < kKeys; i++) {
+    list.SkipInsert(i * 7919 % kKeys, i);
+  }
+  std::size_t visited = 0;
+  for (int i = 0; i < 1000; i++) {
+    visited += list.GetSearchPathLength(i * 97);
+  }
+  // a SkipList with p = 1/4 takes about 2 * log2(n), 33 steps
+  EXPECT_LT(visited / 1000.0, 20.0);
+}
+
+TEST(FatSkipListTest, ConcurrentTest) {
+  // test if readers always find the keys no writer touches while writers
+  // insert and remove others
+  FatSkipList<int, int> list;
+  for (int i = 0; i < 10000; i += 2) {
+    list.SkipInsert(i, i);
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&list, t]() {
+      for (int round = 0; round < 3; round++) {
+        for (int i = 1 + 2 * t; i < 10000; i += 4) {
+          list.SkipInsert(i, i);
+        }
+        for (int i = 1 + 2 * t; i < 10000; i += 4) {
+          list.SkipRemove(i);
+        }
+      }
+    });
+  }
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&list]() {
+      for (int i = 0; i < 30000; i++) {
+        int value;
+        ASSERT_TRUE(list.Get(i * 2 % 10000, &value));
+        EXPECT_EQ(value, i * 2 % 10000);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(list.GetSize(), 5000u);
+}
+}  // namespace kvstore
@@ -0,0 +1,66 @@
+#include "../src/histogram.h"
+
+#include <gtest/gtest.h>
+
+namespace kvstore {
+
+TEST(HistogramTest, EmptyTest) {
+  // test if an empty histogram reports zeros
+  Histogram histogram;
+  EXPECT_EQ(histogram.Count(), 0);
+  EXPECT_EQ(histogram.Min(), 0);
+  EXPECT_EQ(histogram.Max(), 0);
+  EXPECT_EQ(histogram.Median(), 0);
+  EXPECT_EQ(histogram.Average(), 0);
+}
+
+TEST(HistogramTest, AddTest) {
+  // test the statistics of the samples 1 to 1000
+  Histogram histogram;
+  for (int i = 1; i <= 1000; i++) {
+    histogram.Add(i);
+  }
+  EXPECT_EQ(histogram.Count(), 1000);
+  EXPECT_EQ(histogram.Min(), 1);
+  EXPECT_EQ(histogram.Max(), 1000);
+  EXPECT_DOUBLE_EQ(histogram.Average(), 500.5);
+  // the buckets are at most 20% wide, so are the percentiles off
+  EXPECT_NEAR(histogram.Median(), 500, 100);
+  EXPECT_NEAR(histogram.Percentile(99.0), 990, 200);
+  double last = 0;
+  for (double p : {1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 100.0}) {
+    double value = histogram.Percentile(p);
+    EXPECT_GE(value, last);
+    EXPECT_GE(value, histogram.Min());
+    EXPECT_LE(value, histogram.Max());
+    last = value;
+  }
+}
+
+TEST(HistogramTest, ClampTest) {
+  // test if the percentiles of identical samples are exact
+  Histogram histogram;
+  for (int i = 0; i < 100; i++) {
+    histogram.Add(57);
+  }
+  EXPECT_EQ(histogram.Median(), 57);
+  EXPECT_EQ(histogram.Percentile(99.9), 57);
+  EXPECT_EQ(histogram.StandardDeviation(), 0);
+}
+
+TEST(HistogramTest, MergeTest) {
+  // test if merging equals adding all the samples to one histogram
+  Histogram all, odd, even;
+  for (int i = 1; i <= 10000; i += 7) {
+    all.Add(i);
+    (i % 2 == 0 ? even : odd).Add(i);
+  }
+  odd.Merge(even);
+  EXPECT_EQ(odd.Count(), all.Count());
+  EXPECT_EQ(odd.Min(), all.Min());
+  EXPECT_EQ(odd.Max(), all.Max());
+  EXPECT_DOUBLE_EQ(odd.Average(), all.Average());
+  EXPECT_DOUBLE_EQ(odd.Percentile(99.0), all.Percentile(99.0));
+  EXPECT_EQ(odd.ToString(), all.ToString());
+}
+}  // namespace kvstore
@@ -0,0 +1,320 @@
+/**
+ * A load generator for the key-value server (see server.h)
+ *
+ * Each of --connections threads opens its own connection and sends batches
+ * of --pipeline requests at once, GETs and SETs of uniformly random keys
+ * among --keys, then reads all the replies of the batch. The latency of a
+ * request runs from the send of its batch to the end of its reply, in
+ * nanoseconds. With --load=1 the keys are all SET first. The results are
+ * printed to stdout as JSON, like ycsb_bench's, a summary goes to stderr.
+ *
+ * Usage:
+ *   ./kv_client [--host=127.0.0.1] [--port=6380] [--connections=N]
+ *               [--pipeline=N] [--requests=N] [--keys=N] [--value_size=N]
+ *               [--reads=0.9] [--load=0|1]
+ */
+
+#include "../src/histogram.h"
+#include "../src/resp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief the command line flags
+ */
+struct Flags {
+  /** the address of the server */
+  std::string host = "127.0.0.1";
+  /** the port of the server */
+  int port = 6380;
+  /** how many connections, one thread each */
+  int connections = 4;
+  /** how many requests are sent before reading the replies */
+  int pipeline = 16;
+  /** how many requests in total, over all the connections */
+  long requests = 200000;
+  /** how many distinct keys */
+  long keys = 100000;
+  /** the size of the values */
+  int value_size = 100;
+  /** the share of GETs, the rest are SETs */
+  double reads = 0.9;
+  /** if to SET every key before the run */
+  bool load = false;
+};
+
+/** the kinds of request, each gets its own Histogram */
+enum RequestType { kGet, kSet, kNumRequestTypes };
+
+/** the names of the kinds of request */
+const char *const kRequestNames[kNumRequestTypes] = {"get", "set"};
+
+/**
+ * @brief Client is one blocking connection to the server
+ */
+class Client {
+ public:
+  /**
+   * @brief connect to the server, exits on failure
+   * @param flags the flags
+   */
+  explicit Client(const Flags &flags) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(flags.port));
+    inet_pton(AF_INET, flags.host.c_str(), &addr.sin_addr);
+    if (fd_ < 0 ||
+        connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+      perror("connect");
+      exit(1);
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  /**
+   * @brief close the connection
+   */
+  ~Client() { close(fd_); }
+
+  /**
+   * @brief send a batch of requests, exits on failure
+   * @param requests the requests, already encoded
+   */
+  void Send(const std::string &requests) {
+    std::size_t sent = 0;
+    while (sent < requests.size()) {
+      ssize_t n = send(fd_, requests.data() + sent, requests.size() - sent,
+                       MSG_NOSIGNAL);
+      if (n <= 0) {
+        perror("send");
+        exit(1);
+      }
+      sent += n;
+    }
+  }
+
+  /**
+   * @brief wait for the next reply, exits on failure
+   * @return the reply, valid until the next call
+   */
+  std::string_view NextReply() {
+    while (true) {
+      std::size_t consumed;
+      kvstore::resp::ParseResult result = kvstore::resp::SkipReply(
+          buffer_.data() + start_, buffer_.size() - start_, &consumed);
+      if (result == kvstore::resp::ParseResult::kComplete) {
+        std::string_view reply(buffer_.data() + start_, consumed);
+        start_ += consumed;
+        return reply;
+      }
+      if (result == kvstore::resp::ParseResult::kError) {
+        std::cerr << "malformed reply" << std::endl;
+        exit(1);
+      }
+      buffer_.erase(0, start_);
+      start_ = 0;
+      std::size_t size = buffer_.size();
+      buffer_.resize(size + 64 * 1024);
+      ssize_t n = recv(fd_, &buffer_[size], 64 * 1024, 0);
+      if (n <= 0) {
+        std::cerr << "connection closed by the server" << std::endl;
+        exit(1);
+      }
+      buffer_.resize(size + n);
+    }
+  }
+
+ private:
+  /** the socket */
+  int fd_;
+  /** the bytes received, the next reply starts at start_ */
+  std::string buffer_;
+  /** the start of the next reply in buffer_ */
+  std::size_t start_ = 0;
+};
+
+/**
+ * @brief the key of an index
+ * @param index the index
+ * @return the key
+ */
+std::string MakeKey(long index) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "key:%012ld", index);
+  return buf;
+}
+
+/**
+ * @brief SET every key, the connections sharing the keys out
+ * @param flags the flags
+ */
+void Load(const Flags &flags) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < flags.connections; t++) {
+    threads.emplace_back([&flags, t]() {
+      Client client(flags);
+      std::string value(flags.value_size, 'v');
+      std::string batch;
+      int pending = 0;
+      for (long i = t; i < flags.keys; i += flags.connections) {
+        std::string key = MakeKey(i);
+        kvstore::resp::AppendRequest(&batch, {"SET", key, value});
+        if (++pending == flags.pipeline || i + flags.connections >= flags.keys) {
+          client.Send(batch);
+          for (; pending > 0; pending--) {
+            client.NextReply();
+          }
+          batch.clear();
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  Flags flags;
+  for (int i = 1; i < argc; i++) {
+    long n;
+    double d;
+    char junk;
+    if (sscanf(argv[i], "--port=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.port = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--connections=%ld%c", &n, &junk) == 1 &&
+               n > 0) {
+      flags.connections = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--pipeline=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.pipeline = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--requests=%ld%c", &n, &junk) == 1 &&
+               n > 0) {
+      flags.requests = n;
+    } else if (sscanf(argv[i], "--keys=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.keys = n;
+    } else if (sscanf(argv[i], "--value_size=%ld%c", &n, &junk) == 1 &&
+               n > 0) {
+      flags.value_size = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--reads=%lf%c", &d, &junk) == 1 && d >= 0 &&
+               d <= 1) {
+      flags.reads = d;
+    } else if (sscanf(argv[i], "--load=%ld%c", &n, &junk) == 1) {
+      flags.load = n != 0;
+    } else if (strncmp(argv[i], "--host=", 7) == 0) {
+      flags.host = argv[i] + 7;
+    } else {
+      std::cerr << "invalid flag " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  if (flags.load) {
+    auto start = std::chrono::steady_clock::now();
+    Load(flags);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "loaded %ld keys in %.3f sec\n", flags.keys,
+            elapsed.count());
+  }
+
+  std::vector<kvstore::Histogram> latency(flags.connections *
+                                          kNumRequestTypes);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < flags.connections; t++) {
+    threads.emplace_back([&flags, &latency, t]() {
+      Client client(flags);
+      std::mt19937_64 gen(t * 7919 + 17);
+      std::uniform_int_distribution<long> key_dist(0, flags.keys - 1);
+      std::uniform_real_distribution<double> unit(0.0, 1.0);
+      std::string value(flags.value_size, 'u');
+      std::string batch;
+      std::vector<RequestType> types;
+      long requests = flags.requests / flags.connections +
+                      (t < flags.requests % flags.connections ? 1 : 0);
+      while (requests > 0) {
+        int count = static_cast<int>(std::min<long>(flags.pipeline, requests));
+        requests -= count;
+        batch.clear();
+        types.clear();
+        for (int i = 0; i < count; i++) {
+          std::string key = MakeKey(key_dist(gen));
+          if (unit(gen) < flags.reads) {
+            kvstore::resp::AppendRequest(&batch, {"GET", key});
+            types.push_back(kGet);
+          } else {
+            kvstore::resp::AppendRequest(&batch, {"SET", key, value});
+            types.push_back(kSet);
+          }
+        }
+        auto batch_start = std::chrono::steady_clock::now();
+        client.Send(batch);
+        for (int i = 0; i < count; i++) {
+          client.NextReply();
+          double nanos = std::chrono::duration<double, std::nano>(
+                             std::chrono::steady_clock::now() - batch_start)
+                             .count();
+          latency[t * kNumRequestTypes + types[i]].Add(nanos);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  kvstore::Histogram merged[kNumRequestTypes];
+  for (int t = 0; t < flags.connections; t++) {
+    for (int type = 0; type < kNumRequestTypes; type++) {
+      merged[type].Merge(latency[t * kNumRequestTypes + type]);
+    }
+  }
+  double ops_per_sec = flags.requests / std::max(elapsed.count(), 1e-9);
+  fprintf(stderr, "%ld requests in %.3f sec: %.0f requests/sec\n",
+          flags.requests, elapsed.count(), ops_per_sec);
+  printf("{\n  \"benchmark\": \"kv_client\",\n  \"connections\": %d,\n"
+         "  \"pipeline\": %d,\n  \"requests\": %ld,\n  \"keys\": %ld,\n"
+         "  \"value_size\": %d,\n  \"reads\": %.3f,\n"
+         "  \"elapsed_sec\": %.6f,\n  \"ops_per_sec\": %.1f,\n"
+         "  \"latency_ns\": {",
+         flags.connections, flags.pipeline, flags.requests, flags.keys,
+         flags.value_size, flags.reads, elapsed.count(), ops_per_sec);
+  bool first = true;
+  for (int type = 0; type < kNumRequestTypes; type++) {
+    const kvstore::Histogram &h = merged[type];
+    if (h.Count() == 0) {
+      continue;
+    }
+    printf("%s\n    \"%s\": {\"count\": %.0f, \"avg\": %.1f, \"p50\": %.1f, "
+           "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+           first ? "" : ",", kRequestNames[type], h.Count(), h.Average(),
+           h.Median(), h.Percentile(99.0), h.Percentile(99.9), h.Max());
+    first = false;
+    fprintf(stderr, "%s p50 %.0fns p99 %.0fns p999 %.0fns\n",
+            kRequestNames[type], h.Median(), h.Percentile(99.0),
+            h.Percentile(99.9));
+  }
+  printf("\n  }\n}\n");
+  return 0;
+}
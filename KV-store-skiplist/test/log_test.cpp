@@ -0,0 +1,228 @@
+#include "../src/log_reader.h"
+#include "../src/log_writer.h"
+#include "../src/write_batch.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace kvstore {
+
+/**
+ * @brief a scratch file name for a test, removed if left by a previous run
+ * @param name the test name
+ * @return the file name
+ */
+static std::string TestFileName(const std::string &name) {
+  std::string fname = testing::TempDir() + "kvstore_log_test_" + name;
+  remove(fname.c_str());
+  return fname;
+}
+
+/**
+ * @brief write records into a fresh log file
+ * @param fname the file name
+ * @param records the records
+ */
+static void WriteLog(const std::string &fname,
+                     const std::vector<std::string> &records) {
+  std::unique_ptr<WritableFile> file;
+  ASSERT_TRUE(WritableFile::Open(fname, true, &file).ok());
+  log::Writer writer(file.get());
+  for (auto &record : records) {
+    ASSERT_TRUE(writer.AddRecord(record).ok());
+  }
+  ASSERT_TRUE(file->Close().ok());
+}
+
+/**
+ * @brief read all the records of a log file back
+ * @param fname the file name
+ * @param dropped where to store the number of dropped bytes, may be nullptr
+ * @return the records
+ */
+static std::vector<std::string> ReadLog(const std::string &fname,
+                                        uint64_t *dropped = nullptr) {
+  std::unique_ptr<SequentialFile> file;
+  EXPECT_TRUE(SequentialFile::Open(fname, &file).ok());
+  log::Reader reader(file.get());
+  std::vector<std::string> records;
+  std::string record;
+  while (reader.ReadRecord(&record)) {
+    records.push_back(record);
+  }
+  if (dropped != nullptr) {
+    *dropped = reader.DroppedBytes();
+  }
+  return records;
+}
+
+TEST(CodingTest, VarintAndFixedTest) {
+  // test if numbers survive a round trip through their encodings
+  std::string buf;
+  std::vector<uint64_t> values = {0, 1, 127, 128, 300, 16383, 16384,
+                                  0xffffffffull, 0xffffffffffffffffull};
+  for (auto v : values) {
+    PutVarint64(&buf, v);
+  }
+  const char *p = buf.data();
+  const char *limit = p + buf.size();
+  for (auto v : values) {
+    uint64_t actual;
+    const char *start = p;
+    p = GetVarint64Ptr(p, limit, &actual);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(actual, v);
+    EXPECT_EQ(p - start, VarintLength(v));
+  }
+  EXPECT_EQ(p, limit);
+
+  // a truncated varint is detected
+  std::string two_bytes;
+  PutVarint32(&two_bytes, 300);
+  ASSERT_EQ(two_bytes.size(), 2);
+  uint64_t actual;
+  EXPECT_EQ(GetVarint64Ptr(two_bytes.data(), two_bytes.data() + 1, &actual),
+            nullptr);
+
+  char fixed[8];
+  EncodeFixed32(fixed, 0xdeadbeef);
+  EXPECT_EQ(DecodeFixed32(fixed), 0xdeadbeefu);
+  EncodeFixed64(fixed, 0x0123456789abcdefull);
+  EXPECT_EQ(DecodeFixed64(fixed), 0x0123456789abcdefull);
+}
+
+TEST(CodingTest, CoderTest) {
+  // test if keys and values survive a round trip through their Coder
+  std::string buf;
+  Coder<int>::Encode(-42, &buf);
+  Coder<double>::Encode(3.5, &buf);
+  Coder<std::string>::Encode("hello", &buf);
+  Coder<std::string>::Encode("", &buf);
+
+  const char *p = buf.data();
+  const char *limit = p + buf.size();
+  int i;
+  double d;
+  std::string s1, s2;
+  p = Coder<int>::Decode(p, limit, &i);
+  p = Coder<double>::Decode(p, limit, &d);
+  p = Coder<std::string>::Decode(p, limit, &s1);
+  p = Coder<std::string>::Decode(p, limit, &s2);
+  EXPECT_EQ(p, limit);
+  EXPECT_EQ(i, -42);
+  EXPECT_EQ(d, 3.5);
+  EXPECT_EQ(s1, "hello");
+  EXPECT_EQ(s2, "");
+
+  // a truncated string is detected
+  std::string partial = buf.substr(0, buf.size() - 3);
+  p = partial.data() + 4 + 8;
+  EXPECT_EQ(Coder<std::string>::Decode(p, partial.data() + partial.size(), &s1),
+            nullptr);
+}
+
+TEST(CodingTest, Crc32cTest) {
+  // the standard check value of CRC-32C
+  EXPECT_EQ(crc32c::Value("123456789", 9), 0xe3069283u);
+  // extending is the same as computing over the concatenation
+  EXPECT_EQ(crc32c::Extend(crc32c::Value("1234", 4), "56789", 5),
+            crc32c::Value("123456789", 9));
+  uint32_t crc = crc32c::Value("foo", 3);
+  EXPECT_NE(crc32c::Mask(crc), crc);
+  EXPECT_EQ(crc32c::Unmask(crc32c::Mask(crc)), crc);
+}
+
+TEST(WriteBatchTest, EncodeDecodeTest) {
+  // test if a WriteBatch survives a round trip through its log encoding
+  WriteBatch<std::string, int> batch;
+  batch.Put("a", 1);
+  batch.Delete("b");
+  batch.Put("c", -3);
+  std::string rep;
+  batch.EncodeTo(100, &rep);
+
+  WriteBatch<std::string, int> decoded;
+  uint64_t sequence;
+  ASSERT_TRUE(decoded.DecodeFrom(rep, &sequence));
+  EXPECT_EQ(sequence, 100);
+  ASSERT_EQ(decoded.Count(), 3);
+  EXPECT_EQ(decoded.GetOps()[0].type, OpType::kPut);
+  EXPECT_EQ(decoded.GetOps()[0].key, "a");
+  EXPECT_EQ(decoded.GetOps()[0].value, 1);
+  EXPECT_EQ(decoded.GetOps()[1].type, OpType::kDelete);
+  EXPECT_EQ(decoded.GetOps()[1].key, "b");
+  EXPECT_EQ(decoded.GetOps()[2].value, -3);
+
+  // truncated or trailing garbage is rejected
+  EXPECT_FALSE(decoded.DecodeFrom(rep.substr(0, rep.size() - 1), &sequence));
+  EXPECT_FALSE(decoded.DecodeFrom(rep + "x", &sequence));
+  EXPECT_FALSE(decoded.DecodeFrom("short", &sequence));
+}
+
+TEST(LogTest, ReadWriteTest) {
+  // test if records of all sizes are read back, including ones spanning
+  // several blocks and ones ending right at a block trailer
+  auto fname = TestFileName("read_write");
+  std::vector<std::string> records = {
+      "", "small", std::string(log::kBlockSize - 2 * log::kHeaderSize - 5, 'a'),
+      "after-trailer", std::string(3 * log::kBlockSize + 17, 'b'), "end"};
+  for (int i = 0; i < 1000; i++) {
+    records.push_back(std::to_string(i));
+  }
+  WriteLog(fname, records);
+  uint64_t dropped;
+  EXPECT_EQ(ReadLog(fname, &dropped), records);
+  EXPECT_EQ(dropped, 0);
+  remove(fname.c_str());
+}
+
+TEST(LogTest, TruncatedTailTest) {
+  // test if a torn write at the end of the log is dropped silently
+  auto fname = TestFileName("truncated");
+  std::vector<std::string> records = {"first", "second",
+                                      std::string(50000, 'x')};
+  WriteLog(fname, records);
+  uint64_t size;
+  ASSERT_TRUE(GetFileSize(fname, &size).ok());
+  for (uint64_t cut : {1ull, 7ull, 1000ull, 20000ull}) {
+    ASSERT_EQ(truncate(fname.c_str(), size - cut), 0);
+    size -= cut;
+    uint64_t dropped;
+    auto actual = ReadLog(fname, &dropped);
+    ASSERT_EQ(actual.size(), 2);
+    EXPECT_EQ(actual[0], "first");
+    EXPECT_EQ(actual[1], "second");
+    EXPECT_EQ(dropped, 0);
+  }
+  remove(fname.c_str());
+}
+
+TEST(LogTest, ChecksumMismatchTest) {
+  // test if a corrupted fragment is dropped with the rest of its block, while
+  // the records in later blocks are still read
+  auto fname = TestFileName("checksum");
+  std::vector<std::string> records = {"good", "bad",
+                                      std::string(log::kBlockSize, 'z'),
+                                      "later"};
+  WriteLog(fname, records);
+  {
+    // flip a payload byte of the second record
+    FILE *f = fopen(fname.c_str(), "r+b");
+    ASSERT_NE(f, nullptr);
+    fseek(f, log::kHeaderSize + 4 + log::kHeaderSize, SEEK_SET);
+    fputc('B', f);
+    fclose(f);
+  }
+  uint64_t dropped;
+  auto actual = ReadLog(fname, &dropped);
+  ASSERT_EQ(actual.size(), 2);
+  EXPECT_EQ(actual[0], "good");
+  EXPECT_EQ(actual[1], "later");
+  EXPECT_GT(dropped, 0);
+  remove(fname.c_str());
+}
+
+}  // namespace kvstore
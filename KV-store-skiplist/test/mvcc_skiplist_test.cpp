@@ -0,0 +1,204 @@
+#include "../src/mvcc_skiplist.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+using IntMVCCList = MVCCSkipList<int, int>;
+using StringMVCCList = MVCCSkipList<int, std::string>;
+
+TEST(MVCCSkipListTest, InternalKeyOrderTest) {
+  // test if the versions of a key order newest first, between the other keys
+  InternalKey<int> a(1, 5, ValueType::kValue);
+  InternalKey<int> b(1, 3, ValueType::kDeletion);
+  InternalKey<int> c(2, 9, ValueType::kValue);
+  EXPECT_TRUE(a < b);
+  EXPECT_TRUE(b < c);
+  EXPECT_FALSE(b < a);
+  EXPECT_EQ(a.GetSequence(), 5u);
+  EXPECT_EQ(b.GetType(), ValueType::kDeletion);
+  EXPECT_TRUE(a != b);
+  EXPECT_TRUE(a == InternalKey<int>(1, 5, ValueType::kValue));
+}
+
+TEST(MVCCSkipListTest, SnapshotGetTest) {
+  // test if a Snapshot keeps reading the values as of its creation
+  IntMVCCList list;
+  EXPECT_EQ(list.Put(1, 10), 1u);
+  EXPECT_EQ(list.Put(2, 20), 2u);
+  Snapshot before = list.GetSnapshot();
+  EXPECT_EQ(before.GetSequence(), 2u);
+
+  list.Put(1, 11);
+  list.Delete(2);
+  list.Put(3, 30);
+  Snapshot after = list.GetSnapshot();
+  EXPECT_EQ(after.GetSequence(), 5u);
+  EXPECT_EQ(list.GetNumVersions(), 5u);
+
+  int value;
+  ASSERT_TRUE(list.Get(1, &value, before).ok());
+  EXPECT_EQ(value, 10);
+  ASSERT_TRUE(list.Get(2, &value, before).ok());
+  EXPECT_EQ(value, 20);
+  EXPECT_TRUE(list.Get(3, &value, before).IsNotFound());
+
+  ASSERT_TRUE(list.Get(1, &value, after).ok());
+  EXPECT_EQ(value, 11);
+  EXPECT_TRUE(list.Get(2, &value, after).IsNotFound());
+  ASSERT_TRUE(list.Get(3, &value).ok());
+  EXPECT_EQ(value, 30);
+
+  // a tombstone is a visible version, a missing key has none
+  TaggedValue<int> tagged;
+  ASSERT_TRUE(list.Find(2, after, &tagged));
+  EXPECT_EQ(tagged.type, ValueType::kDeletion);
+  EXPECT_FALSE(list.Find(4, after, &tagged));
+  EXPECT_FALSE(list.Find(3, Snapshot(0), &tagged));
+}
+
+TEST(MVCCSkipListTest, WriteBatchTest) {
+  // test if a batch takes consecutive sequence numbers and the last
+  // operation on a key wins
+  IntMVCCList list;
+  WriteBatch<int, int> batch;
+  batch.Put(1, 1);
+  batch.Put(1, 2);
+  batch.Delete(2);
+  batch.Put(2, 3);
+  EXPECT_EQ(list.Write(batch, 100), 103u);
+  EXPECT_EQ(list.GetLastSequence(), 103u);
+
+  int value;
+  ASSERT_TRUE(list.Get(1, &value).ok());
+  EXPECT_EQ(value, 2);
+  ASSERT_TRUE(list.Get(2, &value).ok());
+  EXPECT_EQ(value, 3);
+  ASSERT_TRUE(list.Get(1, &value, Snapshot(100)).ok());
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(list.Get(2, &value, Snapshot(102)).IsNotFound());
+  EXPECT_TRUE(list.Get(1, &value, Snapshot(99)).IsNotFound());
+
+  // the next write continues after the batch
+  EXPECT_EQ(list.Put(5, 5), 104u);
+  WriteBatch<int, int> empty;
+  EXPECT_EQ(list.Write(empty), 104u);
+}
+
+TEST(MVCCSkipListTest, SnapshotScanTest) {
+  // test if scans and Iterators see one version per key as of their Snapshot
+  IntMVCCList list;
+  for (int i = 0; i < 100; i++) {
+    list.Put(i, i);
+  }
+  Snapshot snapshot = list.GetSnapshot();
+  for (int i = 0; i < 100; i += 2) {
+    list.Put(i, -i);
+  }
+  for (int i = 1; i < 100; i += 3) {
+    list.Delete(i);
+  }
+
+  std::vector<std::pair<int, int>> seen;
+  auto collect = [&seen](int key, int value) {
+    seen.emplace_back(key, value);
+    return true;
+  };
+  EXPECT_EQ(list.Scan(10, 20, snapshot, collect), 10u);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(seen[i], std::make_pair(10 + i, 10 + i));
+  }
+
+  seen.clear();
+  list.Scan(0, 100, list.GetSnapshot(), collect);
+  std::map<int, int> expected;
+  for (int i = 0; i < 100; i++) {
+    if (i % 3 != 1) {
+      expected[i] = i % 2 == 0 ? -i : i;
+    }
+  }
+  ASSERT_EQ(seen.size(), expected.size());
+  auto it = expected.begin();
+  for (auto &entry : seen) {
+    EXPECT_EQ(entry.first, it->first);
+    EXPECT_EQ(entry.second, it->second);
+    ++it;
+  }
+
+  // the Iterator shows the tombstones, once per key
+  IntMVCCList::Iterator iter(&list, list.GetSnapshot());
+  iter.Seek(1);
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), 1);
+  EXPECT_EQ(iter.GetType(), ValueType::kDeletion);
+  iter.Next();
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), 2);
+  EXPECT_EQ(iter.GetValue(), -2);
+  int count = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    count++;
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(MVCCSkipListTest, ConcurrentSnapshotTest) {
+  // test if readers never see a torn value, a half-applied batch, or a
+  // Snapshot changing under them, while a writer keeps overwriting
+  StringMVCCList list;
+  const int kNumKeys = 64;
+  WriteBatch<int, std::string> batch;
+  for (int k = 0; k < kNumKeys; k++) {
+    batch.Put(k, std::string(100, 'a'));
+  }
+  list.Write(batch);
+
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    for (int round = 1; round < 200; round++) {
+      // every batch rewrites all the keys with a single letter
+      WriteBatch<int, std::string> batch;
+      std::string value(100 + round, static_cast<char>('a' + round % 26));
+      for (int k = 0; k < kNumKeys; k++) {
+        batch.Put(k, value);
+      }
+      list.Write(batch);
+    }
+    done = true;
+  });
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 2; t++) {
+    readers.emplace_back([&]() {
+      while (!done.load()) {
+        Snapshot snapshot = list.GetSnapshot();
+        std::string first;
+        list.Scan(0, kNumKeys, snapshot,
+                  [&first](int, const std::string &value) {
+                    EXPECT_EQ(value.find_first_not_of(value[0]),
+                              std::string::npos);
+                    if (first.empty()) {
+                      first = value;
+                    }
+                    EXPECT_EQ(value, first);
+                    return true;
+                  });
+        std::string again;
+        ASSERT_TRUE(list.Get(kNumKeys - 1, &again, snapshot).ok());
+        EXPECT_EQ(again, first);
+      }
+    });
+  }
+  writer.join();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(list.GetNumVersions(), 200u * kNumKeys);
+}
+}  // namespace kvstore
@@ -0,0 +1,332 @@
+#include "../src/server.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+/**
+ * @brief parse a whole buffer holding exactly one request
+ * @param request the buffer
+ * @return the arguments
+ */
+static std::vector<std::string> Parse(const std::string &request) {
+  std::vector<std::string_view> args;
+  std::size_t consumed = 0;
+  EXPECT_EQ(resp::ParseRequest(request.data(), request.size(), &args,
+                               &consumed),
+            resp::ParseResult::kComplete);
+  EXPECT_EQ(consumed, request.size());
+  return std::vector<std::string>(args.begin(), args.end());
+}
+
+/**
+ * @brief a blocking connection to a local Server, for the tests
+ */
+class TestClient {
+ public:
+  /**
+   * @brief connect to the server
+   * @param port the port of the server
+   */
+  explicit TestClient(int port) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)),
+              0);
+  }
+
+  ~TestClient() { close(fd_); }
+
+  /**
+   * @brief send raw bytes
+   * @param data the bytes
+   */
+  void Send(const std::string &data) {
+    ASSERT_EQ(send(fd_, data.data(), data.size(), MSG_NOSIGNAL),
+              static_cast<ssize_t>(data.size()));
+  }
+
+  /**
+   * @brief receive the next reply
+   * @return the reply, raw, empty if the connection was closed
+   */
+  std::string Receive() {
+    while (true) {
+      std::size_t consumed;
+      if (resp::SkipReply(buffer_.data(), buffer_.size(), &consumed) ==
+          resp::ParseResult::kComplete) {
+        std::string reply = buffer_.substr(0, consumed);
+        buffer_.erase(0, consumed);
+        return reply;
+      }
+      char chunk[4096];
+      ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        return "";
+      }
+      buffer_.append(chunk, n);
+    }
+  }
+
+  /**
+   * @brief send one request and wait for its reply
+   * @param args the command name and its arguments
+   * @return the reply, raw
+   */
+  std::string Call(const std::vector<std::string_view> &args) {
+    std::string request;
+    resp::AppendRequest(&request, args);
+    Send(request);
+    return Receive();
+  }
+
+ private:
+  /** the socket */
+  int fd_;
+  /** the bytes received and not returned yet */
+  std::string buffer_;
+};
+
+TEST(ServerTest, ParseRequestTest) {
+  // test the array and inline forms of a request
+  EXPECT_EQ(Parse("*2\r\n$3\r\nGET\r\n$3\r\nfoo\r\n"),
+            (std::vector<std::string>{"GET", "foo"}));
+  EXPECT_EQ(Parse("*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$4\r\na\r\nb\r\n"),
+            (std::vector<std::string>{"SET", "k", std::string("a\r\nb")}));
+  EXPECT_EQ(Parse("*2\r\n$3\r\nSET\r\n$0\r\n\r\n"),
+            (std::vector<std::string>{"SET", ""}));
+  EXPECT_EQ(Parse("SET  foo bar\r\n"),
+            (std::vector<std::string>{"SET", "foo", "bar"}));
+  EXPECT_EQ(Parse("PING\n"), (std::vector<std::string>{"PING"}));
+  EXPECT_TRUE(Parse("\r\n").empty());
+}
+
+TEST(ServerTest, ParsePartialTest) {
+  // test if every prefix of a request is incomplete, and garbage an error
+  std::string request = "*2\r\n$3\r\nGET\r\n$3\r\nfoo\r\n";
+  std::vector<std::string_view> args;
+  std::size_t consumed;
+  for (std::size_t size = 0; size < request.size(); size++) {
+    EXPECT_EQ(resp::ParseRequest(request.data(), size, &args, &consumed),
+              resp::ParseResult::kIncomplete);
+  }
+  for (std::string bad : {"*x\r\n", "*1\r\n+GET\r\n", "*1\r\n$3\r\nGETxx",
+                          "*1\r\n$-1\r\n", "*1\r\n$9999999999999999999\r\n",
+                          "*99999999999999999999\r\n"}) {
+    EXPECT_EQ(resp::ParseRequest(bad.data(), bad.size(), &args, &consumed),
+              resp::ParseResult::kError);
+  }
+}
+
+TEST(ServerTest, SkipReplyTest) {
+  // test if a reply is found whole in a buffer of pipelined replies
+  std::string replies;
+  resp::AppendSimpleString(&replies, "OK");
+  resp::AppendNull(&replies);
+  resp::AppendArrayHeader(&replies, 2);
+  resp::AppendBulkString(&replies, "a\r\nb");
+  resp::AppendInteger(&replies, -3);
+  resp::AppendError(&replies, "ERR no");
+  std::vector<std::size_t> sizes;
+  std::size_t pos = 0;
+  while (pos < replies.size()) {
+    std::size_t consumed;
+    ASSERT_EQ(resp::SkipReply(replies.data() + pos, replies.size() - pos,
+                              &consumed),
+              resp::ParseResult::kComplete);
+    sizes.push_back(consumed);
+    pos += consumed;
+  }
+  EXPECT_EQ(sizes, (std::vector<std::size_t>{5, 5, 19, 9}));
+  std::size_t consumed;
+  EXPECT_EQ(resp::SkipReply(replies.data(), 3, &consumed),
+            resp::ParseResult::kIncomplete);
+}
+
+TEST(ServerTest, ExecuteTest) {
+  // test the commands without going through a socket
+  Server::Store store;
+  Server server(&store, ServerOptions());
+  std::string out;
+  EXPECT_TRUE(server.Execute({"SET", "b", "2"}, &out));
+  EXPECT_TRUE(server.Execute({"set", "a", "1"}, &out));
+  EXPECT_TRUE(server.Execute({"PUT", "c", "3"}, &out));
+  EXPECT_TRUE(server.Execute({"GET", "a"}, &out));
+  EXPECT_TRUE(server.Execute({"GET", "z"}, &out));
+  EXPECT_TRUE(server.Execute({"SCAN", "a", "c"}, &out));
+  EXPECT_TRUE(server.Execute({"SCAN", "a", "\xff", "1"}, &out));
+  EXPECT_TRUE(server.Execute({"DEL", "a", "z", "b"}, &out));
+  EXPECT_TRUE(server.Execute({"DBSIZE"}, &out));
+  EXPECT_TRUE(server.Execute({"GET"}, &out));
+  EXPECT_TRUE(server.Execute({"FLY"}, &out));
+  EXPECT_FALSE(server.Execute({"QUIT"}, &out));
+  EXPECT_EQ(out,
+            "+OK\r\n+OK\r\n+OK\r\n"
+            "$1\r\n1\r\n"
+            "$-1\r\n"
+            "*4\r\n$1\r\na\r\n$1\r\n1\r\n$1\r\nb\r\n$1\r\n2\r\n"
+            "*2\r\n$1\r\na\r\n$1\r\n1\r\n"
+            ":2\r\n"
+            ":1\r\n"
+            "-ERR wrong number of arguments for 'GET' command\r\n"
+            "-ERR unknown command 'FLY'\r\n"
+            "+OK\r\n");
+}
+
+TEST(ServerTest, ExpireTest) {
+  // test SET with EX and PX, and TTL, on a clock advanced by hand
+  Server::Store::Clock::time_point now = Server::Store::Clock::now();
+  CacheSkipListOptions store_options;
+  store_options.reap_interval = std::chrono::milliseconds(0);
+  store_options.clock = [&now]() { return now; };
+  Server::Store store(store_options);
+  Server server(&store, ServerOptions());
+  std::string out;
+  EXPECT_TRUE(server.Execute({"SET", "a", "1", "PX", "50"}, &out));
+  EXPECT_TRUE(server.Execute({"SET", "b", "2", "ex", "10"}, &out));
+  EXPECT_TRUE(server.Execute({"SET", "c", "3"}, &out));
+  EXPECT_TRUE(server.Execute({"TTL", "a"}, &out));
+  EXPECT_TRUE(server.Execute({"TTL", "b"}, &out));
+  EXPECT_TRUE(server.Execute({"TTL", "c"}, &out));
+  EXPECT_TRUE(server.Execute({"TTL", "z"}, &out));
+  EXPECT_TRUE(server.Execute({"SET", "d", "4", "EX", "0"}, &out));
+  EXPECT_TRUE(server.Execute({"SET", "d", "4", "XX", "5"}, &out));
+  EXPECT_TRUE(server.Execute({"SET", "d", "4", "EX"}, &out));
+  EXPECT_EQ(out,
+            "+OK\r\n+OK\r\n+OK\r\n"
+            ":1\r\n:10\r\n:-1\r\n:-2\r\n"
+            "-ERR invalid expire time in 'SET' command\r\n"
+            "-ERR syntax error\r\n"
+            "-ERR wrong number of arguments for 'SET' command\r\n");
+  now += std::chrono::milliseconds(49);
+  out.clear();
+  EXPECT_TRUE(server.Execute({"GET", "a"}, &out));
+  EXPECT_EQ(out, "$1\r\n1\r\n");
+  now += std::chrono::milliseconds(1);
+  out.clear();
+  EXPECT_TRUE(server.Execute({"GET", "a"}, &out));
+  EXPECT_TRUE(server.Execute({"TTL", "a"}, &out));
+  EXPECT_TRUE(server.Execute({"DBSIZE"}, &out));
+  EXPECT_EQ(out, "$-1\r\n:-2\r\n:2\r\n");
+}
+
+TEST(ServerTest, PipelineTest) {
+  // test if pipelined requests, split at every byte, get their replies in
+  // order, from several reactors
+  Server::Store store;
+  ServerOptions options;
+  options.host = "127.0.0.1";
+  options.port = 0;
+  options.num_reactors = 2;
+  Server server(&store, options);
+  ASSERT_TRUE(server.Start().ok());
+  ASSERT_GT(server.GetPort(), 0);
+
+  TestClient client(server.GetPort());
+  EXPECT_EQ(client.Call({"PING"}), "+PONG\r\n");
+  std::string requests;
+  for (int i = 0; i < 100; i++) {
+    std::string key = "key" + std::to_string(i);
+    resp::AppendRequest(&requests, {"SET", key, std::to_string(i)});
+    resp::AppendRequest(&requests, {"GET", key});
+  }
+  requests += "GET key7\r\n";
+  for (std::size_t i = 0; i < requests.size(); i += 7) {
+    client.Send(requests.substr(i, 7));
+  }
+  for (int i = 0; i < 100; i++) {
+    std::string value = std::to_string(i);
+    EXPECT_EQ(client.Receive(), "+OK\r\n");
+    EXPECT_EQ(client.Receive(),
+              "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n");
+  }
+  EXPECT_EQ(client.Receive(), "$1\r\n7\r\n");
+  EXPECT_EQ(client.Call({"DBSIZE"}), ":100\r\n");
+  EXPECT_EQ(client.Call({"QUIT"}), "+OK\r\n");
+  EXPECT_EQ(client.Receive(), "");  // closed by the server
+
+  TestClient bad(server.GetPort());
+  bad.Send("*1\r\n+PING\r\n");
+  EXPECT_EQ(bad.Receive(), "-ERR Protocol error\r\n");
+  EXPECT_EQ(bad.Receive(), "");
+}
+
+TEST(ServerTest, OversizedRequestTest) {
+  // test if a length too long to parse, or a request growing past the
+  // limit, closes the connection instead of buffering forever
+  Server::Store store;
+  ServerOptions options;
+  options.host = "127.0.0.1";
+  options.port = 0;
+  options.num_reactors = 1;
+  options.max_pending_input = 1 << 20;
+  Server server(&store, options);
+  ASSERT_TRUE(server.Start().ok());
+
+  TestClient overflow(server.GetPort());
+  overflow.Send("*1\r\n$9999999999999999999\r\n");
+  EXPECT_EQ(overflow.Receive(), "-ERR Protocol error\r\n");
+  EXPECT_EQ(overflow.Receive(), "");
+
+  TestClient big(server.GetPort());
+  big.Send("*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$100000000\r\n");
+  // the limit is only passed by the last byte, so every send succeeds
+  std::string chunk(64 << 10, 'v');
+  for (int i = 0; i < 16; i++) {
+    big.Send(chunk);
+  }
+  EXPECT_EQ(big.Receive(), "-ERR Protocol error: too big request\r\n");
+  EXPECT_EQ(big.Receive(), "");
+
+  TestClient client(server.GetPort());
+  EXPECT_EQ(client.Call({"PING"}), "+PONG\r\n");
+}
+
+TEST(ServerTest, ConcurrentClientsTest) {
+  // test if clients of both reactors, overwriting the same keys, only ever
+  // read whole values
+  Server::Store store;
+  ServerOptions options;
+  options.host = "127.0.0.1";
+  options.port = 0;
+  options.num_reactors = 2;
+  Server server(&store, options);
+  ASSERT_TRUE(server.Start().ok());
+
+  const int kClients = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kClients; t++) {
+    threads.emplace_back([&server, t]() {
+      TestClient client(server.GetPort());
+      std::string value(100 + t * 100, static_cast<char>('a' + t));
+      for (int i = 0; i < 300; i++) {
+        std::string key = "key" + std::to_string(i % 10);
+        EXPECT_EQ(client.Call({"SET", key, value}), "+OK\r\n");
+        std::string reply = client.Call({"GET", key});
+        // a value written by any client, whole
+        ASSERT_GE(reply.size(), 8u);
+        std::size_t header = reply.find("\r\n");
+        std::size_t size = std::stoul(reply.substr(1, header - 1));
+        std::string got = reply.substr(header + 2, size);
+        EXPECT_EQ(got, std::string(size, got[0]));
+        EXPECT_EQ(size, 100u + (got[0] - 'a') * 100);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(store.GetSize(), 10u);
+  server.Stop();
+}
+}  // namespace kvstore
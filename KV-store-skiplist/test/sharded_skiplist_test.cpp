@@ -0,0 +1,201 @@
+#include "../src/comparator.h"
+#include "../src/sharded_skiplist.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+TEST(ShardedSkipListTest, InsertGetRemoveTest) {
+  // test if point operations reach the shard of their key
+  ShardedSkipList<int, int> list(4);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(list.SkipInsert(i, i * 2));
+  }
+  EXPECT_FALSE(list.SkipInsert(7, 70));
+  EXPECT_EQ(list.GetSize(), 1000u);
+  int value = -1;
+  EXPECT_TRUE(list.Get(7, &value));
+  EXPECT_EQ(value, 70);
+  EXPECT_TRUE(list.Get(999, &value));
+  EXPECT_EQ(value, 1998);
+  EXPECT_FALSE(list.Get(1000, &value));
+  EXPECT_TRUE(list.SkipRemove(7));
+  EXPECT_FALSE(list.SkipRemove(7));
+  EXPECT_FALSE(list.Get(7, &value));
+  EXPECT_EQ(list.GetSize(), 999u);
+}
+
+TEST(ShardedSkipListTest, BalanceTest) {
+  // test if sequential keys are spread evenly over the shards
+  ShardedSkipList<int, int> list(8);
+  for (int i = 0; i < 8000; i++) {
+    list.SkipInsert(i * 8, i);  // multiples of the shard count
+  }
+  ASSERT_EQ(list.GetNumShards(), 8);
+  for (int i = 0; i < list.GetNumShards(); i++) {
+    EXPECT_GT(list.GetShard(i).GetSize(), 800u);
+    EXPECT_LT(list.GetShard(i).GetSize(), 1200u);
+  }
+}
+
+TEST(ShardedSkipListTest, IteratorTest) {
+  // test if the Iterator merges the shards in key order
+  ShardedSkipList<int, int> list(5);
+  std::map<int, int> expected;
+  std::mt19937 gen(3);
+  for (int i = 0; i < 2000; i++) {
+    int key = static_cast<int>(gen() % 100000);
+    list.SkipInsert(key, i);
+    expected[key] = i;
+  }
+  ShardedSkipList<int, int>::Iterator iter(&list);
+  auto it = expected.begin();
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next(), ++it) {
+    ASSERT_NE(it, expected.end());
+    EXPECT_EQ(iter.GetKey(), it->first);
+    EXPECT_EQ(iter.GetValue(), it->second);
+  }
+  EXPECT_EQ(it, expected.end());
+
+  iter.Seek(50000);
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), expected.lower_bound(50000)->first);
+  iter.Seek(100000);
+  EXPECT_FALSE(iter.Valid());
+}
+
+TEST(ShardedSkipListTest, ScanTest) {
+  // test if Scan visits [lo, hi) of every shard in order and stops early
+  ShardedSkipList<int, int> list(3);
+  for (int i = 0; i < 100; i++) {
+    list.SkipInsert(i, i);
+  }
+  std::vector<int> keys;
+  EXPECT_EQ(list.Scan(10, 20,
+                      [&keys](const int &key, int) {
+                        keys.push_back(key);
+                        return true;
+                      }),
+            10u);
+  EXPECT_EQ(keys, (std::vector<int>{10, 11, 12, 13, 14, 15, 16, 17, 18, 19}));
+  keys.clear();
+  EXPECT_EQ(list.Scan(95, 1000,
+                      [&keys](const int &key, int) {
+                        keys.push_back(key);
+                        return keys.size() < 3;
+                      }),
+            3u);
+  EXPECT_EQ(keys, (std::vector<int>{95, 96, 97}));
+}
+
+TEST(ShardedSkipListTest, StringViewTest) {
+  // test if std::string_view probes find std::string keys in their shard
+  ShardedSkipList<std::string, int, BytewiseComparator> list(4);
+  for (int i = 0; i < 200; i++) {
+    list.SkipInsert("key" + std::to_string(i), i);
+  }
+  int value = -1;
+  EXPECT_TRUE(list.Get(std::string_view("key42"), &value));
+  EXPECT_EQ(value, 42);
+  EXPECT_TRUE(list.Get("key199", &value));
+  EXPECT_EQ(value, 199);
+  EXPECT_TRUE(list.SkipRemove(std::string_view("key42")));
+  EXPECT_FALSE(list.Get(std::string_view("key42"), &value));
+  std::size_t count = list.Scan(std::string_view("key1"), std::string_view("key2"),
+                                [](const std::string &, int) { return true; });
+  EXPECT_EQ(count, 111u);  // key1, key10..key19, key100..key199
+}
+
+TEST(ShardedSkipListTest, ComparatorTest) {
+  // test if the merge follows the Comparator of the shards
+  ShardedSkipList<int, int, std::greater<int>> list(4);
+  for (int i = 0; i < 100; i++) {
+    list.SkipInsert(i, i);
+  }
+  std::vector<int> keys;
+  list.Scan(50, 45, [&keys](const int &key, int) {
+    keys.push_back(key);
+    return true;
+  });
+  EXPECT_EQ(keys, (std::vector<int>{50, 49, 48, 47, 46}));
+}
+
+TEST(ShardedSkipListTest, ConcurrentInsertTest) {
+  // test if writers of all the shards at once lose no key
+  ShardedSkipList<int, int> list(4);
+  const int kThreads = 4;
+  const int kPerThread = 5000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&list, t]() {
+      for (int i = 0; i < kPerThread; i++) {
+        list.SkipInsert(i * kThreads + t, t);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(list.GetSize(), static_cast<std::size_t>(kThreads * kPerThread));
+  int expected = 0;
+  ShardedSkipList<int, int>::Iterator iter(&list);
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    ASSERT_EQ(iter.GetKey(), expected);
+    EXPECT_EQ(iter.GetValue(), expected % kThreads);
+    expected++;
+  }
+  EXPECT_EQ(expected, kThreads * kPerThread);
+}
+
+TEST(ShardedSkipListTest, LockedScanTest) {
+  // test if LockedScan and GetValueLocked see whole values while a writer
+  // replaces the values of existing keys
+  ShardedSkipList<int, std::string> list(4);
+  const int kKeys = 200;
+  auto value_of = [](int key, int version) {
+    // long enough to live on the heap, so a torn copy would show
+    return std::string(40, 'a' + version) + std::to_string(key);
+  };
+  for (int i = 0; i < kKeys; i++) {
+    list.SkipInsert(i, value_of(i, 0));
+  }
+  auto known = [&value_of](int key, const std::string &value) {
+    for (int version = 0; version < 4; version++) {
+      if (value == value_of(key, version)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    for (int round = 1; !done.load(); round++) {
+      for (int i = 0; i < kKeys; i++) {
+        list.SkipInsert(i, value_of(i, round % 4));
+      }
+    }
+  });
+  for (int pass = 0; pass < 20; pass++) {
+    EXPECT_EQ(list.LockedScan(0, kKeys,
+                              [&known](int key, const std::string &value) {
+                                EXPECT_TRUE(known(key, value)) << value;
+                                return true;
+                              }),
+              static_cast<std::size_t>(kKeys));
+    ShardedSkipList<int, std::string>::Iterator iter(&list);
+    for (iter.Seek(kKeys / 2); iter.Valid(); iter.Next()) {
+      EXPECT_TRUE(known(iter.GetKey(), iter.GetValueLocked()));
+    }
+  }
+  done = true;
+  writer.join();
+}
+}  // namespace kvstore
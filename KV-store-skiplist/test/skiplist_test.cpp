@@ -1,143 +1,116 @@
+#include "../src/comparator.h"
 #include "../src/skiplist.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 namespace kvstore {
 TEST(SkipNodeTest, SkipNodeLinkage) {
   // test if the SkipNode's linkage is functioning correctly
 
   /*
    create a linkage like:
-        (6, 20)
-           |
-  -oo - (2,4) - +00
+         +------> (6, 20)
+         |           |
+  -oo - (2,4) ----> (6, 20)
    */
-  auto handle_start = new SkipNode<int, int>(0, 0, true);
-  auto handle_end = new SkipNode<int, int>(0, 0, true);
-  auto center = new SkipNode<int, int>(2, 4);
-  handle_start->SetAfter(center);
-  handle_end->SetBefore(center);
-  center->SetBefore(handle_start);
-  center->SetAfter(handle_end);
-  center->SetAbove(new SkipNode<int, int>(6, 20));
-  center->GetAbove()->SetBelow(center);
-
+  Arena arena;
+  auto head = SkipNode<int, int>::NewNode(&arena, 0, 0, 2, true);
+  auto center = SkipNode<int, int>::NewNode(&arena, 2, 4, 1);
+  auto tall = SkipNode<int, int>::NewNode(&arena, 6, 20, 2);
+  head->SetNext(0, center);
+  head->SetNext(1, tall);
+  center->SetNext(0, tall);
+
+  EXPECT_EQ(head->IsSentinel(), true);
+  EXPECT_EQ(center->IsSentinel(), false);
   EXPECT_EQ(center->GetKey(), 2);
   EXPECT_EQ(center->GetValue(), 4);
-  EXPECT_EQ(center->GetAbove()->GetKey(), 6);
-  EXPECT_EQ(center->GetBelow(), nullptr);
-
-  // clean up
-  free(center->GetBefore());
-  free(center->GetAfter());
-  free(center->GetAbove());
-  free(center);
+  EXPECT_EQ(center->GetHeight(), 1);
+  EXPECT_EQ(tall->GetHeight(), 2);
+  EXPECT_EQ(head->GetNext(0)->GetNext(0), tall);
+  EXPECT_EQ(head->GetNext(1), tall);
+  EXPECT_EQ(tall->GetNext(0), nullptr);
+  EXPECT_EQ(tall->GetNext(1), nullptr);
+
+  // rely on Arena to clean up
 }
 
 TEST(SkipNodeTest, SkipNodeSkipSearch) {
   // test if the SkipNode's SkipSearch is working correctly
   // find the biggest node of key that's smaller or equal to given key
 
-  // create such a topology of SkipNode linkages
+  // create such a topology of SkipNode towers
   /*
-    -oo <-> 2 <-------------------------> 9 <-> +oo
-     |      |                             |       |
-    -oo <-> 2 <---------5 <-> 7---------> 9 <-> +oo
-     |      |           |     |           |       |
-    -oo <-> 2 <-> 4 <-> 5 <-> 7---------> 9 <-> +oo
+    -oo --> 2 ---------------------------> 9
+     |      |                              |
+    -oo --> 2 ----------> 5 --> 7 -------> 9
+     |      |             |     |          |
+    -oo --> 2 --> 4 ----> 5 --> 7 -------> 9
   */
-  auto head_1 = new SkipNode<int, int>(0, 0, true);
-  auto head_2 = new SkipNode<int, int>(0, 0, true);
-  auto head_3 = new SkipNode<int, int>(0, 0, true);
-
-  auto tail_1 = new SkipNode<int, int>(0, 0, true);
-  auto tail_2 = new SkipNode<int, int>(0, 0, true);
-  auto tail_3 = new SkipNode<int, int>(0, 0, true);
-
-  auto node_2_1 = new SkipNode<int, int>(2, 0);
-  auto node_2_2 = new SkipNode<int, int>(2, 0);
-  auto node_2_3 = new SkipNode<int, int>(2, 0);
-
-  auto node_9_1 = new SkipNode<int, int>(9, 0);
-  auto node_9_2 = new SkipNode<int, int>(9, 0);
-  auto node_9_3 = new SkipNode<int, int>(9, 0);
-
-  auto node_5_2 = new SkipNode<int, int>(5, 0);
-  auto node_5_3 = new SkipNode<int, int>(5, 0);
-
-  auto node_7_2 = new SkipNode<int, int>(7, 0);
-  auto node_7_3 = new SkipNode<int, int>(7, 0);
-
-  auto node_4_3 = new SkipNode<int, int>(4, 0);
-
-  // we only link "after" and "below" linkage here for convenience
-  // construct first layer
-  head_1->SetAfter(node_2_1);
-  node_2_1->SetAfter(node_9_1);
-  node_9_1->SetAfter(tail_1);
-
-  // construct second layer
-  head_2->SetAfter(node_2_2);
-  node_2_2->SetAfter(node_5_2);
-  node_5_2->SetAfter(node_7_2);
-  node_7_2->SetAfter(node_9_2);
-  node_9_2->SetAfter(tail_2);
-
-  // construct third layer
-  head_3->SetAfter(node_2_3);
-  node_2_3->SetAfter(node_4_3);
-  node_4_3->SetAfter(node_5_3);
-  node_5_3->SetAfter(node_7_3);
-  node_7_3->SetAfter(node_9_3);
-  node_9_3->SetAfter(tail_3);
-
-  // link first and second layer
-  head_1->SetBelow(head_2);
-  node_2_1->SetBelow(node_2_2);
-  node_9_1->SetBelow(node_9_2);
-  tail_1->SetBelow(tail_2);
-
-  // link second and third layer
-  head_2->SetBelow(head_3);
-  node_2_2->SetBelow(node_2_3);
-  node_5_2->SetBelow(node_5_3);
-  node_7_2->SetBelow(node_7_3);
-  node_9_2->SetBelow(node_9_3);
-  tail_2->SetBelow(tail_3);
-
-  auto ans1 = head_1->SkipSearch(6).first;
+  Arena arena;
+  auto head = SkipNode<int, int>::NewNode(&arena, 0, 0, 3, true);
+  auto node_2 = SkipNode<int, int>::NewNode(&arena, 2, 0, 3);
+  auto node_4 = SkipNode<int, int>::NewNode(&arena, 4, 0, 1);
+  auto node_5 = SkipNode<int, int>::NewNode(&arena, 5, 0, 2);
+  auto node_7 = SkipNode<int, int>::NewNode(&arena, 7, 0, 2);
+  auto node_9 = SkipNode<int, int>::NewNode(&arena, 9, 0, 3);
+
+  // construct top level
+  head->SetNext(2, node_2);
+  node_2->SetNext(2, node_9);
+
+  // construct middle level
+  head->SetNext(1, node_2);
+  node_2->SetNext(1, node_5);
+  node_5->SetNext(1, node_7);
+  node_7->SetNext(1, node_9);
+
+  // construct bottom level
+  head->SetNext(0, node_2);
+  node_2->SetNext(0, node_4);
+  node_4->SetNext(0, node_5);
+  node_5->SetNext(0, node_7);
+  node_7->SetNext(0, node_9);
+
+  auto ans1 = head->FindLessOrEqual(6, 2);
   EXPECT_EQ(ans1->GetKey(), 5);
 
-  auto ans2 = head_1->SkipSearch(5).first;
+  auto ans2 = head->FindLessOrEqual(5, 2);
   EXPECT_EQ(ans2->GetKey(), 5);
 
-  auto ans3 = head_1->SkipSearch(10).first;
+  auto ans3 = head->FindLessOrEqual(10, 2);
   EXPECT_EQ(ans3->GetKey(), 9);
 
-  auto ans4 = head_1->SkipSearch(3).first;
+  auto ans4 = head->FindLessOrEqual(3, 2);
   EXPECT_EQ(ans4->GetKey(), 2);
 
-  auto ans5 = head_1->SkipSearch(1).first;
+  auto ans5 = head->FindLessOrEqual(1, 2);
   EXPECT_EQ(ans5->IsSentinel(), true);
 
-  // clean up
-  delete head_1;
-  delete head_2;
-  delete head_3;
-  delete tail_1;
-  delete tail_2;
-  delete tail_3;
-  delete node_2_1;
-  delete node_2_2;
-  delete node_2_3;
-  delete node_9_1;
-  delete node_9_2;
-  delete node_9_3;
-  delete node_5_2;
-  delete node_5_3;
-  delete node_7_2;
-  delete node_7_3;
-  delete node_4_3;
+  // the path holds the rightmost node strictly smaller than the key per level
+  SkipNode<int, int> *path[3];
+  auto ans6 = head->SkipSearch(7, 2, path);
+  EXPECT_EQ(ans6, node_7);
+  EXPECT_EQ(path[2], node_2);
+  EXPECT_EQ(path[1], node_5);
+  EXPECT_EQ(path[0], node_5);
+
+  // the recording search agrees with the path-free one
+  for (int key = 0; key <= 10; key++) {
+    EXPECT_EQ(head->SkipSearch(key, 2, path), head->FindLessOrEqual(key, 2));
+  }
+
+  // rely on Arena to clean up
 }
 
 TEST(SkipListTest, SkipListInsertSearchTest) {
@@ -179,6 +152,377 @@ TEST(SkipListTest, SkipListHeavyInsertTest) {
   // rely on dtor to clean up
 }
 
+TEST(SkipListTest, SkipListBalanceTest) {
+  // test if geometric tower heights keep searches logarithmic, and the max
+  // height adapts to the number of keys rather than to the current height
+  SkipList<int, int> skip(4);
+  const int test_size = 1 << 16;
+  std::mt19937 rng(7);
+  std::vector<int> keys(test_size);
+  for (int i = 0; i < test_size; i++) {
+    keys[i] = i;
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+  for (int key : keys) {
+    skip.SkipInsert(key, key);
+  }
+  // log4(65536) = 8 levels, give or take a few
+  EXPECT_GE(skip.GetHeight(), 6);
+  EXPECT_LE(skip.GetHeight(), 12);
+
+  std::size_t total = 0;
+  for (int i = 0; i < test_size; i++) {
+    total += skip.GetSearchPathLength(i);
+  }
+  // about 2 * log2(n) = 32 steps on average, a uniform height would be
+  // hundreds
+  EXPECT_LT(total / test_size, 64u);
+}
+
+/**
+ * @brief check that a SkipList is sorted and that its size matches
+ * @param skip the SkipList, quiescent
+ * @return the keys in order
+ */
+static std::vector<int> CheckSorted(const SkipList<int, int> &skip) {
+  std::vector<int> keys;
+  SkipList<int, int>::Iterator iter(&skip);
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    if (!keys.empty()) {
+      EXPECT_LT(keys.back(), iter.GetKey());
+    }
+    keys.push_back(iter.GetKey());
+  }
+  EXPECT_EQ(keys.size(), skip.GetSize());
+  return keys;
+}
+
+TEST(SkipListTest, SkipListConcurrentInsertTest) {
+  // test if writers inserting interleaved keys all land, in order
+  SkipList<int, int> skip;
+  const int num_threads = 4;
+  const int per_thread = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&skip, t]() {
+      for (int i = t; i < num_threads * per_thread; i += num_threads) {
+        EXPECT_TRUE(skip.SkipInsert(i, i));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto keys = CheckSorted(skip);
+  ASSERT_EQ(keys.size(), static_cast<std::size_t>(num_threads * per_thread));
+  for (int i = 0; i < num_threads * per_thread; i++) {
+    EXPECT_EQ(keys[i], i);
+    EXPECT_EQ(skip.SkipSearch(i)->GetValue(), i);
+  }
+}
+
+TEST(SkipListTest, SkipListConcurrentInsertRemoveTest) {
+  // test if concurrent inserts, overwrites and removals of the same keys keep
+  // the SkipList consistent, while readers scan it. Scan would read the
+  // values while they are overwritten in place, LockedScan copies them
+  // under the nodes' locks
+  SkipList<int, int> skip;
+  static const int key_range = 512;
+  std::atomic<bool> done(false);
+  std::thread reader([&]() {
+    while (!done.load()) {
+      int prev = -1;
+      skip.LockedScan(0, key_range, [&prev](int key, int value) {
+        EXPECT_LT(prev, key);
+        EXPECT_EQ(key, value % key_range);
+        prev = key;
+        return true;
+      });
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&skip, t]() {
+      std::mt19937 rng(t);
+      for (int i = 0; i < 20000; i++) {
+        int key = static_cast<int>(rng() % key_range);
+        if (rng() % 3 == 0) {
+          skip.SkipRemove(key);
+        } else {
+          skip.SkipInsert(key, key + key_range * static_cast<int>(rng() % 4));
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+  CheckSorted(skip);
+
+  // a removal by each writer of its own keys, then nothing is left
+  writers.clear();
+  for (int t = 0; t < 4; t++) {
+    writers.emplace_back([&skip, t]() {
+      for (int key = t; key < key_range; key += 4) {
+        skip.SkipRemove(key);
+        auto node = skip.SkipSearch(key);
+        EXPECT_TRUE(node->IsSentinel() || node->GetKey() != key);
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  EXPECT_EQ(skip.GetSize(), 0u);
+  EXPECT_TRUE(CheckSorted(skip).empty());
+}
+
+TEST(SkipListTest, SkipListConcurrentWriteBatchTest) {
+  // test if batches applied concurrently on disjoint ranges all land
+  SkipList<int, int> skip;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&skip, t]() {
+      WriteBatch<int, int> batch;
+      for (int i = 0; i < 10000; i++) {
+        batch.Put(t * 10000 + i, i);
+      }
+      for (int i = 0; i < 10000; i += 10) {
+        batch.Delete(t * 10000 + i);
+      }
+      skip.Write(batch);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto keys = CheckSorted(skip);
+  EXPECT_EQ(keys.size(), 36000u);
+  for (int key : keys) {
+    EXPECT_NE(key % 10, 0);
+  }
+}
+
+TEST(SkipListTest, SkipListReclaimTest) {
+  // test if removed nodes are reclaimed and their memory reused, with the
+  // destructors of their keys and values run
+  SkipList<std::string, std::string> skip;
+  for (int i = 0; i < 100; i++) {
+    skip.SkipInsert(std::to_string(i), std::string(100, 'a'));
+  }
+  std::size_t usage = skip.ApproximateMemoryUsage();
+  for (int round = 0; round < 1000; round++) {
+    for (int i = 0; i < 100; i += 2) {
+      EXPECT_TRUE(skip.SkipRemove(std::to_string(i)));
+    }
+    for (int i = 0; i < 100; i += 2) {
+      EXPECT_TRUE(skip.SkipInsert(std::to_string(i), std::to_string(round)));
+    }
+  }
+  EXPECT_EQ(skip.GetSize(), 100u);
+  EXPECT_GT(skip.GetNumReclaimed(), 49000u);
+  // 50k removals without reclamation would have taken far more than this
+  EXPECT_LT(skip.ApproximateMemoryUsage(), usage * 4);
+  for (int i = 0; i < 100; i++) {
+    auto node = skip.SkipSearch(std::to_string(i));
+    EXPECT_EQ(node->GetKey(), std::to_string(i));
+    EXPECT_EQ(node->GetValue(),
+              i % 2 == 0 ? std::string("999") : std::string(100, 'a'));
+  }
+}
+
+TEST(SkipListTest, SkipListPinnedReaderTest) {
+  // test if nothing is reclaimed under an Iterator, even when all its keys
+  // are removed by another thread
+  SkipList<int, std::string> skip;
+  for (int i = 0; i < 1000; i++) {
+    skip.SkipInsert(i, std::to_string(i));
+  }
+  {
+    SkipList<int, std::string>::Iterator iter(&skip);
+    iter.Seek(500);
+    std::thread writer([&skip]() {
+      for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 1000; i++) {
+          skip.SkipRemove(i);
+        }
+        for (int i = 0; i < 1000; i++) {
+          skip.SkipInsert(i, std::string(20, 'x'));
+        }
+      }
+    });
+    writer.join();
+    EXPECT_EQ(skip.GetNumReclaimed(), 0u);
+    EXPECT_EQ(skip.GetNumRetired(), 10000u);
+    // the unlinked node still holds its key and value
+    ASSERT_TRUE(iter.Valid());
+    EXPECT_EQ(iter.GetKey(), 500);
+    EXPECT_EQ(iter.GetValue(), "500");
+  }
+  // once unpinned, the next batch reclaims them all
+  for (int i = 0; i < 1000; i++) {
+    skip.SkipRemove(i);
+  }
+  EXPECT_GE(skip.GetNumReclaimed(), 10000u);
+  EXPECT_EQ(skip.GetSize(), 0u);
+}
+
+/**
+ * @brief Tracked is a value counting its copies
+ */
+struct Tracked {
+  /** how many copies were made, across all Tracked */
+  static int copies;
+  /** the payload */
+  int value = 0;
+
+  Tracked() = default;
+  explicit Tracked(int v) : value(v) {}
+  Tracked(const Tracked &other) : value(other.value) { copies++; }
+  Tracked(Tracked &&other) noexcept : value(other.value) {}
+  Tracked &operator=(const Tracked &other) {
+    value = other.value;
+    copies++;
+    return *this;
+  }
+  Tracked &operator=(Tracked &&other) noexcept {
+    value = other.value;
+    return *this;
+  }
+};
+int Tracked::copies = 0;
+
+TEST(SkipListTest, SkipListStringViewTest) {
+  // test if std::string keys are found by std::string_view and C string
+  // probes through a transparent comparator
+  SkipList<std::string, int, BytewiseComparator> skip;
+  for (int i = 0; i < 100; i++) {
+    skip.SkipInsert("key" + std::to_string(i), i);
+  }
+  std::string_view probe("key42");
+  EXPECT_EQ(skip.SkipSearch(probe)->GetKey(), "key42");
+  EXPECT_EQ(skip.SkipSearch("key7")->GetValue(), 7);
+  // missing, the floor is returned
+  EXPECT_EQ(skip.SkipSearch(std::string_view("key420"))->GetKey(), "key42");
+
+  std::vector<std::string> keys;
+  skip.Scan(std::string_view("key5"), "key6", [&keys](const std::string &key, int) {
+    keys.push_back(key);
+    return true;
+  });
+  std::vector<std::string> expected = {"key5"};
+  for (int i = 50; i < 60; i++) {
+    expected.push_back("key" + std::to_string(i));
+  }
+  EXPECT_EQ(keys, expected);
+
+  SkipList<std::string, int, BytewiseComparator>::Iterator iter(&skip);
+  iter.Seek(std::string_view("key99x"));
+  EXPECT_FALSE(iter.Valid());
+  iter.Seek("key1");
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), "key1");
+
+  EXPECT_TRUE(skip.SkipRemove(std::string_view("key42")));
+  EXPECT_FALSE(skip.SkipRemove("key42"));
+  EXPECT_EQ(skip.GetSize(), 99u);
+}
+
+TEST(SkipListTest, SkipListComparatorTest) {
+  // test if a custom comparator orders the keys
+  SkipList<int, int, std::greater<int>> skip;
+  for (int i = 0; i < 100; i++) {
+    skip.SkipInsert(i, i);
+  }
+  SkipList<int, int, std::greater<int>>::Iterator iter(&skip);
+  int expected = 99;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    EXPECT_EQ(iter.GetKey(), expected--);
+  }
+  EXPECT_EQ(expected, -1);
+  // the floor is the next larger key in this order
+  EXPECT_EQ(skip.SkipSearch(50)->GetKey(), 50);
+  skip.SkipRemove(50);
+  EXPECT_EQ(skip.SkipSearch(50)->GetKey(), 51);
+}
+
+TEST(SkipListTest, SkipListMoveInsertTest) {
+  // test if rvalues are moved into the SkipList, not copied
+  SkipList<int, Tracked> skip;
+  Tracked::copies = 0;
+  for (int i = 0; i < 100; i++) {
+    skip.SkipInsert(int(i), Tracked(i));
+  }
+  // overwriting moves the new value in as well
+  skip.SkipInsert(7, Tracked(70));
+  EXPECT_EQ(Tracked::copies, 0);
+  EXPECT_EQ(skip.SkipSearch(7)->GetValue().value, 70);
+
+  // lvalues are copied, once
+  Tracked::copies = 0;
+  int key = 200;
+  Tracked value(200);
+  skip.SkipInsert(key, value);
+  EXPECT_EQ(Tracked::copies, 1);
+  EXPECT_EQ(value.value, 200);
+}
+
+TEST(SkipListTest, SkipListStatsTest) {
+  // test if the stats follow the inserts, removals and searches
+  SkipList<int, int> skip;
+  const int test_size = 1000;
+  for (int i = 0; i < test_size; i++) {
+    skip.SkipInsert(i, i);
+  }
+  SkipListStats stats = skip.GetStats();
+  EXPECT_EQ(stats.num_keys, test_size);
+  EXPECT_EQ(stats.height, skip.GetHeight());
+  ASSERT_EQ(stats.level_histogram.size(), static_cast<std::size_t>(stats.height));
+  std::size_t nodes = 0;
+  for (auto count : stats.level_histogram) {
+    nodes += count;
+  }
+  EXPECT_EQ(nodes, test_size);
+  // geometric heights, p = 1/4: most nodes are 1 tall
+  EXPECT_GT(stats.level_histogram[0], test_size / 2);
+  EXPECT_GT(stats.node_bytes, test_size * sizeof(int) * 2);
+  EXPECT_GE(stats.memory_usage, stats.node_bytes);
+  EXPECT_GT(stats.BytesPerKey(), 0);
+  EXPECT_EQ(stats.num_searches, test_size);  // one per insert
+  EXPECT_EQ(stats.lock_waits, 0u);  // a single writer never waits
+
+  uint64_t searches = stats.num_searches;
+  uint64_t hops = stats.search_hops;
+  int value;
+  EXPECT_TRUE(skip.Get(500, &value));
+  skip.SkipSearch(700);
+  stats = skip.GetStats();
+  EXPECT_EQ(stats.num_searches, searches + 2);
+  EXPECT_EQ(stats.search_hops - hops,
+            skip.GetSearchPathLength(500) + skip.GetSearchPathLength(700));
+
+  for (int i = 0; i < test_size; i += 2) {
+    skip.SkipRemove(i);
+  }
+  stats = skip.GetStats();
+  EXPECT_EQ(stats.num_keys, test_size / 2);
+  nodes = 0;
+  for (auto count : stats.level_histogram) {
+    nodes += count;
+  }
+  EXPECT_EQ(nodes, test_size / 2);
+  EXPECT_EQ(stats.num_retired + stats.num_reclaimed, test_size / 2);
+  EXPECT_NE(stats.ToString().find("keys: 500\n"), std::string::npos);
+
+  // bulk-built towers are counted as well
+  std::vector<std::pair<int, int>> sorted = {{1, 1}, {2, 2}, {3, 3}, {4, 4}};
+  auto built = SkipList<int, int>::BuildFromSorted(sorted.begin(), sorted.end());
+  EXPECT_EQ(built->GetStats().level_histogram,
+            (std::vector<std::size_t>{2, 1, 1}));
+}
+
 TEST(SkipListTest, SkipListSameKeyInsertTest) {
   // test if the SkipList would replace old value when a key is repeated
   // inserted
@@ -220,4 +564,348 @@ TEST(SkipListTest, SkipListRemovalTest) {
   // rely on dtor to clean up
 }
 
+TEST(SkipListTest, SkipListStringTest) {
+  // test if the SkipList releases keys and values that own heap memory
+  SkipList<std::string, std::string> skip;
+  for (int i = 0; i < 1000; i++) {
+    skip.SkipInsert("key" + std::to_string(i), std::string(100, 'a' + i % 26));
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    EXPECT_EQ(skip.SkipRemove("key" + std::to_string(i)), true);
+  }
+  EXPECT_EQ(skip.GetSize(), 500);
+  auto res = skip.SkipSearch("key7");
+  EXPECT_EQ(res->GetKey(), "key7");
+  EXPECT_EQ(res->GetValue(), std::string(100, 'a' + 7));
+  EXPECT_GT(skip.ApproximateMemoryUsage(), 0);
+
+  // rely on dtor to clean up
+}
+
+TEST(SkipListTest, SkipListIteratorTest) {
+  // test if the Iterator walks the SkipList in order both ways
+  SkipList<int, int> skip;
+  for (int i = 0; i < 100; i += 2) {
+    skip.SkipInsert(i, i * 10);
+  }
+  skip.SkipRemove(50);
+
+  SkipList<int, int>::Iterator iter(&skip);
+  EXPECT_EQ(iter.Valid(), false);
+
+  int expect = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    if (expect == 50) {
+      expect += 2;
+    }
+    EXPECT_EQ(iter.GetKey(), expect);
+    EXPECT_EQ(iter.GetValue(), expect * 10);
+    expect += 2;
+  }
+  EXPECT_EQ(expect, 100);
+
+  expect = 98;
+  for (iter.SeekToLast(); iter.Valid(); iter.Prev()) {
+    if (expect == 50) {
+      expect -= 2;
+    }
+    EXPECT_EQ(iter.GetKey(), expect);
+    expect -= 2;
+  }
+  EXPECT_EQ(expect, -2);
+
+  // Seek lands on the first key >= target
+  iter.Seek(7);
+  ASSERT_EQ(iter.Valid(), true);
+  EXPECT_EQ(iter.GetKey(), 8);
+  iter.Seek(8);
+  EXPECT_EQ(iter.GetKey(), 8);
+  iter.Seek(49);
+  EXPECT_EQ(iter.GetKey(), 52);
+  iter.Seek(-5);
+  EXPECT_EQ(iter.GetKey(), 0);
+  iter.Seek(99);
+  EXPECT_EQ(iter.Valid(), false);
+
+  // an empty SkipList has nothing to iterate
+  SkipList<int, int> empty;
+  SkipList<int, int>::Iterator empty_iter(&empty);
+  empty_iter.SeekToFirst();
+  EXPECT_EQ(empty_iter.Valid(), false);
+  empty_iter.SeekToLast();
+  EXPECT_EQ(empty_iter.Valid(), false);
+}
+
+TEST(SkipListTest, SkipListScanTest) {
+  // test if Scan visits exactly the half-open range [lo, hi)
+  SkipList<int, int> skip;
+  for (int i = 0; i < 1000; i++) {
+    skip.SkipInsert(i, -i);
+  }
+  std::vector<int> keys;
+  auto count = skip.Scan(100, 200, [&](int key, int value) {
+    EXPECT_EQ(value, -key);
+    keys.push_back(key);
+    return true;
+  });
+  EXPECT_EQ(count, 100);
+  ASSERT_EQ(keys.size(), 100);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(keys[i], 100 + i);
+  }
+
+  // the callback could stop the scan early
+  keys.clear();
+  count = skip.Scan(500, 2000, [&](int key, int) {
+    keys.push_back(key);
+    return keys.size() < 10;
+  });
+  EXPECT_EQ(count, 10);
+  EXPECT_EQ(keys.back(), 509);
+
+  EXPECT_EQ(skip.Scan(2000, 3000, [](int, int) { return true; }), 0);
+}
+
+TEST(SkipListTest, SkipListScanConcurrentInsertTest) {
+  // test if a Scan stays ordered and complete while another thread inserts
+  SkipList<int, int> skip;
+  int test_size = 10000;
+  for (int i = 0; i < test_size; i += 2) {
+    skip.SkipInsert(i, i);
+  }
+  std::thread writer([&]() {
+    for (int i = 1; i < test_size; i += 2) {
+      skip.SkipInsert(i, i);
+    }
+  });
+  for (int round = 0; round < 5; round++) {
+    int last = -1;
+    int even_seen = 0;
+    skip.Scan(0, test_size, [&](int key, int value) {
+      EXPECT_GT(key, last);
+      EXPECT_EQ(key, value);
+      last = key;
+      even_seen += (key % 2 == 0);
+      return true;
+    });
+    EXPECT_EQ(even_seen, test_size / 2);
+  }
+  writer.join();
+  EXPECT_EQ(skip.GetSize(), test_size);
+}
+
+TEST(SkipListTest, SkipListWriteBatchTest) {
+  // test if a WriteBatch keeps the issue order semantics on the same key
+  SkipList<int, int> skip;
+  skip.SkipInsert(3, 30);
+  skip.SkipInsert(7, 70);
+
+  WriteBatch<int, int> batch;
+  batch.Put(5, 50);
+  batch.Delete(3);
+  batch.Put(1, 10);
+  batch.Put(5, 55);  // the later put on the same key wins
+  batch.Put(9, 90);
+  batch.Delete(9);   // delete after put leaves nothing
+  batch.Delete(100); // delete of a missing key is a no-op
+  batch.Put(7, 77);  // overwrite of an existing key
+  EXPECT_EQ(batch.Count(), 8);
+  skip.Write(batch);
+
+  EXPECT_EQ(skip.GetSize(), 3);
+  EXPECT_EQ(skip.SkipSearch(1)->GetValue(), 10);
+  EXPECT_EQ(skip.SkipSearch(5)->GetValue(), 55);
+  EXPECT_EQ(skip.SkipSearch(7)->GetValue(), 77);
+  EXPECT_NE(skip.SkipSearch(3)->GetKey(), 3);
+  EXPECT_NE(skip.SkipSearch(9)->GetKey(), 9);
+
+  batch.Clear();
+  EXPECT_EQ(batch.Count(), 0);
+  skip.Write(batch);
+  EXPECT_EQ(skip.GetSize(), 3);
+}
+
+TEST(SkipListTest, SkipListWriteBatchRandomTest) {
+  // test if applying random batches agrees with a std::map reference
+  SkipList<int, int> skip;
+  std::map<int, int> reference;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> key_dist(0, 2000);
+  for (int round = 0; round < 50; round++) {
+    WriteBatch<int, int> batch;
+    for (int i = 0; i < 200; i++) {
+      int key = key_dist(gen);
+      if (gen() % 3 == 0) {
+        batch.Delete(key);
+        reference.erase(key);
+      } else {
+        batch.Put(key, round * 1000 + i);
+        reference[key] = round * 1000 + i;
+      }
+    }
+    skip.Write(batch);
+    ASSERT_EQ(skip.GetSize(), reference.size());
+  }
+  SkipList<int, int>::Iterator iter(&skip);
+  iter.SeekToFirst();
+  for (auto &kv : reference) {
+    ASSERT_EQ(iter.Valid(), true);
+    EXPECT_EQ(iter.GetKey(), kv.first);
+    EXPECT_EQ(iter.GetValue(), kv.second);
+    iter.Next();
+  }
+  EXPECT_EQ(iter.Valid(), false);
+}
+
+TEST(SkipListTest, SkipListBuildFromSortedTest) {
+  // test if the bulk-built SkipList is complete and perfectly balanced
+  std::vector<std::pair<int, int>> sorted;
+  int test_size = 1000;
+  for (int i = 0; i < test_size; i++) {
+    sorted.emplace_back(i * 2, i);
+  }
+  auto skip = SkipList<int, int>::BuildFromSorted(sorted.begin(), sorted.end());
+  EXPECT_EQ(skip->GetSize(), test_size);
+
+  for (int i = 0; i < test_size; i++) {
+    auto node = skip->SkipSearch(i * 2);
+    EXPECT_EQ(node->GetKey(), i * 2);
+    EXPECT_EQ(node->GetValue(), i);
+    // the (i + 1)-th key is 1 + ctz(i + 1) tall
+    int expect_height = 1;
+    for (int n = i + 1; n % 2 == 0; n /= 2) {
+      expect_height++;
+    }
+    EXPECT_EQ(node->GetHeight(), expect_height);
+  }
+
+  // still a regular SkipList afterwards
+  EXPECT_EQ(skip->SkipInsert(3, 33), true);
+  EXPECT_EQ(skip->SkipRemove(4), true);
+  EXPECT_EQ(skip->SkipSearch(3)->GetValue(), 33);
+  EXPECT_EQ(skip->SkipSearch(4)->GetKey(), 3);
+  EXPECT_EQ(skip->GetSize(), test_size);
+
+  // a repeated key keeps the later value, an empty input gives an empty list
+  std::vector<std::pair<int, int>> repeated = {{1, 1}, {1, 2}, {2, 3}};
+  auto small = SkipList<int, int>::BuildFromSorted(repeated.begin(),
+                                                   repeated.end());
+  EXPECT_EQ(small->GetSize(), 2);
+  EXPECT_EQ(small->SkipSearch(1)->GetValue(), 2);
+  auto empty = SkipList<int, int>::BuildFromSorted(repeated.end(),
+                                                   repeated.end());
+  EXPECT_EQ(empty->GetSize(), 0);
+  EXPECT_EQ(empty->SkipSearch(1)->IsSentinel(), true);
+}
+
+TEST(SkipListTest, SkipListCursorAscendingTest) {
+  // test if a Cursor inserts ascending keys in a few steps each, where
+  // SkipInsert starts every search from the head
+  const int test_size = 100000;
+  SkipList<int, int> plain(32);
+  for (int i = 0; i < test_size; i++) {
+    plain.SkipInsert(i, i);
+  }
+  SkipList<int, int> skip(32);
+  SkipList<int, int>::Cursor cursor(&skip);
+  for (int i = 0; i < test_size; i++) {
+    EXPECT_TRUE(cursor.Insert(i, i));
+  }
+  EXPECT_EQ(CheckSorted(skip).size(), static_cast<std::size_t>(test_size));
+  double plain_hops = plain.GetStats().AverageSearchHops();
+  double cursor_hops = skip.GetStats().AverageSearchHops();
+  EXPECT_GT(plain_hops, 15.0);
+  EXPECT_LT(cursor_hops, 4.0);
+
+  // reading and replacing them in order is as cheap
+  SkipListStats before = skip.GetStats();
+  int value;
+  for (int i = 0; i + 1 < test_size; i += 3) {
+    ASSERT_TRUE(cursor.Get(i, &value));
+    EXPECT_EQ(value, i);
+    EXPECT_FALSE(cursor.Insert(i + 1, -i));
+  }
+  SkipListStats after = skip.GetStats();
+  EXPECT_LT(static_cast<double>(after.search_hops - before.search_hops) /
+                (after.num_searches - before.num_searches),
+            6.0);
+  EXPECT_FALSE(cursor.Get(test_size, &value));
+  EXPECT_TRUE(cursor.Get(4, &value));
+  EXPECT_EQ(value, -3);
+}
+
+TEST(SkipListTest, SkipListCursorRandomTest) {
+  // test if a Cursor agrees with a std::map reference while its keys wander
+  // and jump back and forth, and other writers remove the nodes of its
+  // finger, until they are reclaimed
+  SkipList<int, int> skip;
+  SkipList<int, int>::Cursor cursor(&skip);
+  std::map<int, int> reference;
+  std::mt19937 gen(7);
+  int key = 5000;
+  for (int i = 0; i < 100000; i++) {
+    if (gen() % 100 == 0) {
+      key = static_cast<int>(gen() % 10000);
+    } else {
+      key = std::max(0, key + static_cast<int>(gen() % 21) - 8);
+    }
+    int value;
+    switch (gen() % 4) {
+      case 0:
+        EXPECT_EQ(cursor.Remove(key), reference.erase(key) == 1);
+        break;
+      case 1:
+        // the node of the finger goes from under the Cursor
+        EXPECT_EQ(skip.SkipRemove(key - 1), reference.erase(key - 1) == 1);
+        break;
+      case 2:
+        EXPECT_EQ(cursor.Get(key, &value), reference.count(key) == 1);
+        if (reference.count(key) == 1) {
+          EXPECT_EQ(value, reference[key]);
+        }
+        break;
+      default:
+        EXPECT_EQ(cursor.Insert(key, i), reference.count(key) == 0);
+        reference[key] = i;
+    }
+  }
+  EXPECT_GT(skip.GetNumReclaimed(), 0u);
+  auto keys = CheckSorted(skip);
+  ASSERT_EQ(keys.size(), reference.size());
+  auto it = reference.begin();
+  for (int k : keys) {
+    EXPECT_EQ(k, it->first);
+    EXPECT_EQ(skip.SkipSearch(k)->GetValue(), it->second);
+    ++it;
+  }
+}
+
+TEST(SkipListTest, SkipListConcurrentCursorTest) {
+  // test if writers appending interleaved ascending streams through their
+  // own Cursors all land, while others remove behind them
+  SkipList<int, int> skip;
+  const int num_threads = 4;
+  const int per_thread = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&skip, t]() {
+      SkipList<int, int>::Cursor cursor(&skip);
+      for (int i = t; i < num_threads * per_thread; i += num_threads) {
+        EXPECT_TRUE(cursor.Insert(i, i));
+        if (i >= 100 && i % 2 == 0) {
+          skip.SkipRemove(i - 100);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto keys = CheckSorted(skip);
+  for (int key : keys) {
+    EXPECT_TRUE(key % 2 == 1 || key >= num_threads * per_thread - 100);
+  }
+  EXPECT_EQ(keys.size(), static_cast<std::size_t>(num_threads * per_thread / 2 + 50));
+}
+
 }  // namespace kvstore
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "../src/skiplist.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvstore {
+
+using StringList = SkipList<std::string, std::string>;
+using IntList = SkipList<int, int>;
+using StringReader = snapshot::Reader<std::string, std::string>;
+using IntReader = snapshot::Reader<int, int>;
+
+/**
+ * @brief an ordering of ints chosen at runtime, so a list that drops it and
+ *        falls back to a default-constructed one gets the wrong order
+ */
+struct RuntimeOrder {
+  /** if larger keys come first */
+  bool descending = false;
+
+  bool operator()(int a, int b) const { return descending ? b < a : a < b; }
+};
+
+/**
+ * @brief a scratch file name for a test, removed if left by a previous run
+ * @param name the test name
+ * @return the file name
+ */
+static std::string TestFileName(const std::string &name) {
+  std::string fname = testing::TempDir() + "kvstore_snapshot_test_" + name;
+  remove(fname.c_str());
+  return fname;
+}
+
+TEST(SnapshotTest, SaveLoadTest) {
+  // test if a SkipList survives a round trip through a snapshot file
+  auto fname = TestFileName("save_load");
+  StringList list;
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < 1000; i++) {
+    auto key = "key" + std::to_string(i * 7 % 1000);
+    auto value = std::string(i % 50, 'v') + std::to_string(i);
+    list.SkipInsert(key, value);
+    expected[key] = value;
+  }
+  for (int i = 0; i < 1000; i += 5) {
+    list.SkipRemove("key" + std::to_string(i));
+    expected.erase("key" + std::to_string(i));
+  }
+  ASSERT_TRUE(list.SaveSnapshot(fname, 42).ok());
+
+  std::unique_ptr<StringList> loaded;
+  uint64_t sequence;
+  ASSERT_TRUE(
+      StringList::LoadSnapshot(fname, &loaded, 10, &sequence, true).ok());
+  EXPECT_EQ(sequence, 42);
+  EXPECT_EQ(loaded->GetSize(), expected.size());
+  std::map<std::string, std::string> actual;
+  StringList::Iterator iter(loaded.get());
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    actual[iter.GetKey()] = iter.GetValue();
+  }
+  EXPECT_EQ(actual, expected);
+
+  // the loaded SkipList keeps accepting writes
+  EXPECT_TRUE(loaded->SkipInsert("key0", "back"));
+  EXPECT_EQ(loaded->SkipSearch("key0")->GetValue(), "back");
+  remove(fname.c_str());
+}
+
+TEST(SnapshotTest, EmptyTest) {
+  // test if an empty SkipList makes a valid snapshot
+  auto fname = TestFileName("empty");
+  IntList list;
+  ASSERT_TRUE(list.SaveSnapshot(fname).ok());
+
+  std::unique_ptr<IntList> loaded;
+  ASSERT_TRUE(IntList::LoadSnapshot(fname, &loaded).ok());
+  EXPECT_EQ(loaded->GetSize(), 0);
+
+  std::unique_ptr<IntReader> reader;
+  ASSERT_TRUE(IntReader::Open(fname, true, &reader).ok());
+  int value;
+  EXPECT_TRUE(reader->Get(0, &value).IsNotFound());
+  IntReader::Iterator iter(reader.get());
+  iter.SeekToFirst();
+  EXPECT_FALSE(iter.Valid());
+  remove(fname.c_str());
+}
+
+TEST(SnapshotTest, DirectReadTest) {
+  // test if lookups, seeks and scans are served from the mapped file
+  auto fname = TestFileName("direct_read");
+  IntList list;
+  for (int i = 0; i < 1000; i++) {
+    list.SkipInsert(i * 2, i);  // even keys only
+  }
+  ASSERT_TRUE(list.SaveSnapshot(fname).ok());
+
+  std::unique_ptr<IntReader> reader;
+  ASSERT_TRUE(IntReader::Open(fname, false, &reader).ok());
+  EXPECT_EQ(reader->GetCount(), 1000);
+  for (int key = -1; key <= 2001; key++) {
+    int value = -1;
+    auto s = reader->Get(key, &value);
+    if (key >= 0 && key < 2000 && key % 2 == 0) {
+      ASSERT_TRUE(s.ok()) << key;
+      EXPECT_EQ(value, key / 2);
+    } else {
+      ASSERT_TRUE(s.IsNotFound()) << key;
+      EXPECT_EQ(value, -1);
+    }
+  }
+
+  IntReader::Iterator iter(reader.get());
+  iter.Seek(31);
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), 32);
+  iter.Seek(1998);
+  ASSERT_TRUE(iter.Valid());
+  iter.Next();
+  EXPECT_FALSE(iter.Valid());
+  EXPECT_TRUE(iter.GetStatus().ok());
+
+  std::vector<int> keys;
+  auto count = reader->Scan(100, 140, [&keys](int key, int) {
+    keys.push_back(key);
+    return true;
+  });
+  EXPECT_EQ(count, 20);
+  EXPECT_EQ(keys.front(), 100);
+  EXPECT_EQ(keys.back(), 138);
+  remove(fname.c_str());
+}
+
+TEST(SnapshotTest, ComparatorTest) {
+  // test if a list ordered by a stateful Comparator is read back in its own
+  // order, by LoadSnapshot, BuildFromSorted and a Reader
+  using OrderedList = SkipList<int, int, RuntimeOrder>;
+  using OrderedReader = snapshot::Reader<int, int, RuntimeOrder>;
+  auto fname = TestFileName("comparator");
+  const RuntimeOrder descending{true};
+  OrderedList list(10, descending);
+  for (int i = 0; i < 1000; i++) {
+    list.SkipInsert(i * 2, i);  // even keys only
+  }
+  ASSERT_TRUE(list.SaveSnapshot(fname).ok());
+
+  std::unique_ptr<OrderedList> loaded;
+  ASSERT_TRUE(OrderedList::LoadSnapshot(fname, &loaded, 10, nullptr, true,
+                                        descending)
+                  .ok());
+  std::vector<std::pair<int, int>> pairs;
+  OrderedList::Iterator list_iter(loaded.get());
+  for (list_iter.SeekToFirst(); list_iter.Valid(); list_iter.Next()) {
+    pairs.emplace_back(list_iter.GetKey(), list_iter.GetValue());
+  }
+  ASSERT_EQ(pairs.size(), 1000u);
+  EXPECT_EQ(pairs.front().first, 1998);
+  EXPECT_EQ(pairs.back().first, 0);
+  EXPECT_TRUE(loaded->SkipInsert(999, 0));
+  EXPECT_EQ(loaded->SkipSearch(999)->GetKey(), 999);
+  EXPECT_EQ(loaded->SkipSearch(997)->GetKey(), 998);
+
+  auto built = OrderedList::BuildFromSorted(pairs.begin(), pairs.end(), 10,
+                                            descending);
+  EXPECT_TRUE(built->SkipInsert(999, 0));
+  EXPECT_FALSE(built->SkipInsert(1000, 0));
+  EXPECT_EQ(built->GetSize(), 1001u);
+
+  std::unique_ptr<OrderedReader> reader;
+  ASSERT_TRUE(OrderedReader::Open(fname, false, &reader, descending).ok());
+  for (int key = -1; key <= 2001; key++) {
+    int value = -1;
+    auto s = reader->Get(key, &value);
+    if (key >= 0 && key < 2000 && key % 2 == 0) {
+      ASSERT_TRUE(s.ok()) << key;
+      EXPECT_EQ(value, key / 2);
+    } else {
+      ASSERT_TRUE(s.IsNotFound()) << key;
+    }
+  }
+  OrderedReader::Iterator iter(reader.get());
+  iter.Seek(31);
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), 30);
+  std::vector<int> keys;
+  reader->Scan(140, 100, [&keys](int key, int) {
+    keys.push_back(key);
+    return true;
+  });
+  ASSERT_EQ(keys.size(), 20u);
+  EXPECT_EQ(keys.front(), 140);
+  EXPECT_EQ(keys.back(), 102);
+  remove(fname.c_str());
+}
+
+TEST(SnapshotTest, ConcurrentSaveTest) {
+  // test if a snapshot taken while a writer replaces values holds whole
+  // values, each one of those its key ever had
+  auto fname = TestFileName("concurrent_save");
+  const int kKeys = 200;
+  auto value_of = [](int key, int version) {
+    // long enough to live on the heap, so a torn copy would show
+    return std::string(40, 'a' + version) + std::to_string(key);
+  };
+  StringList list;
+  for (int i = 0; i < kKeys; i++) {
+    list.SkipInsert("key" + std::to_string(i), value_of(i, 0));
+  }
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    for (int round = 1; !done.load(); round++) {
+      for (int i = 0; i < kKeys; i++) {
+        list.SkipInsert("key" + std::to_string(i), value_of(i, round % 4));
+      }
+    }
+  });
+  for (int save = 0; save < 5; save++) {
+    ASSERT_TRUE(list.SaveSnapshot(fname).ok());
+    std::unique_ptr<StringList> loaded;
+    ASSERT_TRUE(StringList::LoadSnapshot(fname, &loaded).ok());
+    EXPECT_EQ(loaded->GetSize(), static_cast<std::size_t>(kKeys));
+    for (int i = 0; i < kKeys; i++) {
+      std::string value;
+      ASSERT_TRUE(loaded->Get("key" + std::to_string(i), &value));
+      bool known = false;
+      for (int version = 0; version < 4; version++) {
+        known = known || value == value_of(i, version);
+      }
+      EXPECT_TRUE(known) << value;
+    }
+  }
+  done = true;
+  writer.join();
+  remove(fname.c_str());
+}
+
+TEST(SnapshotTest, CorruptionTest) {
+  // test if damaged files are rejected instead of being trusted
+  auto fname = TestFileName("corruption");
+  StringList list;
+  for (int i = 0; i < 100; i++) {
+    list.SkipInsert("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  ASSERT_TRUE(list.SaveSnapshot(fname).ok());
+  std::unique_ptr<StringReader> reader;
+  ASSERT_TRUE(StringReader::Open(fname, true, &reader).ok());
+  reader.reset();
+
+  {
+    // flip a byte of the first value, only the records checksum notices
+    FILE *f = fopen(fname.c_str(), "r+b");
+    ASSERT_NE(f, nullptr);
+    fseek(f, 6, SEEK_SET);
+    fputc('X', f);
+    fclose(f);
+  }
+  EXPECT_TRUE(StringReader::Open(fname, false, &reader).ok());
+  EXPECT_TRUE(StringReader::Open(fname, true, &reader).IsCorruption());
+
+  // a truncated file loses its footer
+  uint64_t size;
+  ASSERT_TRUE(GetFileSize(fname, &size).ok());
+  ASSERT_EQ(truncate(fname.c_str(), size - 1), 0);
+  EXPECT_TRUE(StringReader::Open(fname, false, &reader).IsCorruption());
+  std::unique_ptr<StringList> loaded;
+  EXPECT_TRUE(StringList::LoadSnapshot(fname, &loaded).IsCorruption());
+  EXPECT_EQ(loaded, nullptr);
+
+  EXPECT_TRUE(StringReader::Open(fname + "_missing", false, &reader)
+                  .IsNotFound());
+  remove(fname.c_str());
+}
+
+}  // namespace kvstore
@@ -4,11 +4,21 @@
  * using std::thread
  */
 
+#include "../src/comparator.h"
+#include "../src/db.h"
+#include "../src/sharded_skiplist.h"
 #include "../src/skiplist.h"
+#include <math.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <random>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <iostream>
 #include <iomanip>
+#include <memory>
 #include <vector>
 #include <assert.h>
 
@@ -30,6 +40,219 @@ void *insertTest(long thread_id, long thread_num, long test_load) {
     return 0;
 }
 
+/**
+ * @brief search test on a thread
+ *        each thread looks up pseudo-random keys from the inserted range
+ * @param thread_id the thread's id
+ * @param test_load the number of lookups this thread performs
+ * @param key_range keys are drawn from [0, key_range)
+ */
+void *searchTest(long thread_id, long test_load, long key_range) {
+    std::mt19937 gen(thread_id);
+    std::uniform_int_distribution<long> dist(0, key_range - 1);
+    long found = 0;
+    for (long i = 0; i < test_load; i++) {
+        auto key = dist(gen);
+        if (test_list.SkipSearch(key)->GetKey() == key) {
+            found++;
+        }
+    }
+    assert(found == test_load && "every key in range should be found");
+    return 0;
+}
+
+/**
+ * @brief run the insertion test on increasing number of writer threads, each
+ *        filling its own disjoint key range of a fresh SkipList
+ * @param max_thread the maximum number of writer threads to launch
+ * @param test_load the total number of inserts, split among the writers
+ */
+void runConcurrentInsertTest(long max_thread, long test_load) {
+    for (long num_writer = 1; num_writer <= max_thread; num_writer *= 2) {
+        kvstore::SkipList<int, int> list;
+        long per_writer = test_load / num_writer;
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector <std::thread> threads;
+        for (long i = 0; i < num_writer; i++) {
+            threads.emplace_back([&list, i, per_writer]() {
+                std::mt19937 gen(i);
+                std::vector<int> keys(per_writer);
+                for (long j = 0; j < per_writer; j++) {
+                    keys[j] = static_cast<int>(i * per_writer + j);
+                }
+                std::shuffle(keys.begin(), keys.end(), gen);
+                for (int key : keys) {
+                    list.SkipInsert(key, key);
+                }
+            });
+        }
+        for (auto &thr: threads) {
+            thr.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        assert(list.GetSize() == static_cast<std::size_t>(num_writer * per_writer));
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << num_writer << " writer(s) take " << std::setw(6) << elapsed.count() << "s, "
+                  << "throughput is " << static_cast<long>(static_cast<double>(num_writer * per_writer) / elapsed.count())
+                  << std::endl;
+    }
+}
+
+/**
+ * @brief fill a fresh ShardedSkipList of 1, 2, 4, ... shards with the same
+ *        number of writers, each owning a disjoint key range inserted in
+ *        random order
+ * @param num_writer the number of writer threads
+ * @param max_shard the maximum number of shards
+ * @param test_load the total number of keys inserted
+ */
+void runShardedInsertTest(long num_writer, long max_shard, long test_load) {
+    long per_writer = test_load / num_writer;
+    for (long num_shard = 1; num_shard <= max_shard; num_shard *= 2) {
+        kvstore::ShardedSkipList<int, int> list(static_cast<int>(num_shard));
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector <std::thread> threads;
+        for (long i = 0; i < num_writer; i++) {
+            threads.emplace_back([&list, i, per_writer]() {
+                std::mt19937 gen(i);
+                std::vector<int> keys(per_writer);
+                for (long j = 0; j < per_writer; j++) {
+                    keys[j] = static_cast<int>(i * per_writer + j);
+                }
+                std::shuffle(keys.begin(), keys.end(), gen);
+                for (int key : keys) {
+                    list.SkipInsert(key, key);
+                }
+            });
+        }
+        for (auto &thr: threads) {
+            thr.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        assert(list.GetSize() == static_cast<std::size_t>(num_writer * per_writer));
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << num_shard << " shard(s) take " << std::setw(6) << elapsed.count() << "s, "
+                  << "throughput is " << static_cast<long>(static_cast<double>(num_writer * per_writer) / elapsed.count())
+                  << std::endl;
+    }
+}
+
+/**
+ * @brief keep inserting fresh keys beyond the searched range until told to stop
+ * @param start the first key to insert
+ * @param stop flag raised when the readers are done
+ */
+void *backgroundInsert(long start, const std::atomic<bool> *stop) {
+    for (long i = start; !stop->load(std::memory_order_relaxed); i++) {
+        test_list.SkipInsert(i, i);
+    }
+    return 0;
+}
+
+/**
+ * @brief run the search test on increasing number of reader threads
+ * @param max_thread the maximum number of reader threads to launch
+ * @param test_load the number of lookups each reader performs
+ * @param with_writer if to run one writer thread concurrently
+ */
+void runSearchTest(long max_thread, long test_load, bool with_writer) {
+    for (long num_reader = 1; num_reader <= max_thread; num_reader *= 2) {
+        std::atomic<bool> stop{false};
+        std::thread writer;
+        if (with_writer) {
+            writer = std::thread(backgroundInsert, test_load, &stop);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector <std::thread> threads;
+        for (long i = 0; i < num_reader; i++) {
+            threads.emplace_back(searchTest, i, test_load, test_load);
+        }
+        for (auto &thr: threads) {
+            thr.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        stop.store(true);
+        if (with_writer) {
+            writer.join();
+        }
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << num_reader << " reader(s) take " << std::setw(6) << elapsed.count() << "s, "
+                  << "throughput is " << static_cast<long>(static_cast<double>(num_reader * test_load) / elapsed.count())
+                  << std::endl;
+    }
+}
+
+
+/**
+ * @brief durable insertion test on a thread, each put is logged before applied
+ * @param db the durable store
+ * @param thread_id the thread's id
+ * @param thread_num how many threads are there in total
+ * @param test_load the total number of test load to be done
+ */
+void *durableInsertTest(kvstore::DB<int, int> *db, long thread_id, long thread_num, long test_load) {
+    kvstore::WriteOptions write_options;
+    for (long i = thread_id; i < test_load; i += thread_num) {
+        kvstore::Status s = db->Put(write_options, i, i);
+        assert(s.ok() && "durable put should succeed");
+    }
+    return 0;
+}
+
+/**
+ * @brief write keys into a DB compacting in the background, while measuring
+ *        the latency of concurrent lookups
+ * @param dbname the DB directory
+ * @param options the options of the DB
+ * @param test_load how many keys to write
+ * @param p50 where to store the median lookup latency, in microseconds
+ * @param p99 where to store the 99th percentile lookup latency
+ * @return how long the writes and the compactions took, in seconds
+ */
+double compactionLatencyTest(const std::string &dbname, const kvstore::Options &options, long test_load,
+                             double *p50, double *p99) {
+    kvstore::DestroyDB(dbname);
+    std::unique_ptr<kvstore::DB<int, int>> db;
+    kvstore::Status s = kvstore::DB<int, int>::Open(options, dbname, &db);
+    assert(s.ok() && "cannot open the compaction test DB");
+    kvstore::WriteOptions write_options;
+    for (long i = 0; i < test_load; i++) {
+        db->Put(write_options, static_cast<int>(i), static_cast<int>(i));
+    }
+    db->FlushMemTable();
+    db->WaitForCompactions();
+
+    std::atomic<bool> done(false);
+    std::vector<double> latencies;
+    std::thread reader([&db, &done, &latencies, test_load]() {
+        std::mt19937 rng(42);
+        int value;
+        while (!done.load()) {
+            int key = static_cast<int>(rng() % test_load);
+            auto start = std::chrono::high_resolution_clock::now();
+            db->Get(key, &value);
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+    });
+    auto start = std::chrono::high_resolution_clock::now();
+    // overwrite everything a few times, keeping the compactions busy
+    std::mt19937 rng(7);
+    for (long i = 0; i < test_load * 3; i++) {
+        db->Put(write_options, static_cast<int>(rng() % test_load), static_cast<int>(i));
+    }
+    db->FlushMemTable();
+    db->WaitForCompactions();
+    auto end = std::chrono::high_resolution_clock::now();
+    done = true;
+    reader.join();
+    std::sort(latencies.begin(), latencies.end());
+    *p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+    *p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+    db.reset();
+    kvstore::DestroyDB(dbname);
+    return std::chrono::duration<double>(end - start).count();
+}
 
 int main(int argc, const char *argv[]) {
     // usage: ./stress_test [number of threads] [number of test load] [max_height of the SkipList]
@@ -61,6 +284,349 @@ int main(int argc, const char *argv[]) {
         std::chrono::duration<double> elapsed = end - start;
         std::cout << "Insertion Test takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
         std::cout << "Throughput is " << static_cast<int>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+        std::cout << "Memory usage is " << test_list.ApproximateMemoryUsage() << " bytes, "
+                  << test_list.ApproximateMemoryUsage() / std::max<long>(test_load, 1) << " bytes per key" << std::endl;
+    }
+
+    {
+        std::cout << "--------Search Path Test--------" << std::endl;
+        std::mt19937 rng(42);
+        std::size_t total = 0;
+        std::size_t longest = 0;
+        for (long i = 0; i < test_load; i++) {
+            std::size_t steps = test_list.GetSearchPathLength(static_cast<int>(rng() % test_load));
+            total += steps;
+            longest = std::max(longest, steps);
+        }
+        std::cout << "Height is " << test_list.GetHeight() << " for " << test_list.GetSize() << " keys" << std::endl;
+        std::cout << "Search path length: average " << static_cast<double>(total) / std::max<long>(test_load, 1)
+                  << ", longest " << longest << ", 2*log2(n) is "
+                  << 2 * log2(static_cast<double>(std::max<long>(test_load, 2))) << std::endl;
+    }
+
+    {
+        std::cout << "--------Concurrent Insertion Test--------" << std::endl;
+        runConcurrentInsertTest(num_thread, test_load);
+    }
+
+    {
+        std::cout << "--------Sharded Insertion Test--------" << std::endl;
+        // as many writers as threads, spread over more and more shards
+        runShardedInsertTest(num_thread, std::max<long>(num_thread * 2, 8), test_load);
+    }
+
+    {
+        std::cout << "--------Search Test--------" << std::endl;
+        runSearchTest(num_thread, test_load, false);
+    }
+
+    {
+        std::cout << "--------Search Test with 1 concurrent writer--------" << std::endl;
+        runSearchTest(num_thread, test_load, true);
+    }
+
+    {
+        std::cout << "--------SkipList Stats--------" << std::endl;
+        // the footprint and the counters gathered by all the tests above
+        std::cout << test_list.GetStats().ToString();
+    }
+
+    {
+        std::cout << "--------Epoch Pinning Test--------" << std::endl;
+        // every SkipSearch pins its thread on its own, unless already pinned
+        // the two modes alternate so that neither gets only the cold caches
+        for (int run = 0; run < 4; run++) {
+            int outer = run % 2;
+            std::mt19937 gen(7);
+            long found = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            {
+                std::unique_ptr<kvstore::EpochGuard> guard(outer ? new kvstore::EpochGuard() : nullptr);
+                for (long i = 0; i < test_load; i++) {
+                    int key = static_cast<int>(gen() % test_load);
+                    found += test_list.SkipSearch(key)->GetKey() == key;
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            assert(found == test_load);
+            std::chrono::duration<double> elapsed = end - start;
+            std::cout << test_load << " lookups " << (outer ? "under one guard" : "pinning each") << " take "
+                      << std::setw(6) << elapsed.count() << "s, throughput is "
+                      << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+        }
+    }
+
+    {
+        std::cout << "--------Reclamation Test--------" << std::endl;
+        // each writer keeps removing and inserting back its own keys
+        kvstore::SkipList<int, int> churn_list;
+        long key_range = std::max<long>(test_load / 10, num_thread);
+        for (long i = 0; i < key_range; i++) {
+            churn_list.SkipInsert(i, i);
+        }
+        std::size_t usage = churn_list.ApproximateMemoryUsage();
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector <std::thread> threads;
+        for (long t = 0; t < num_thread; t++) {
+            threads.emplace_back([&churn_list, t, num_thread, key_range, test_load]() {
+                std::mt19937 gen(t);
+                for (long i = 0; i < test_load / num_thread; i++) {
+                    int key = static_cast<int>((gen() % (key_range / num_thread)) * num_thread + t);
+                    churn_list.SkipRemove(key);
+                    churn_list.SkipInsert(key, key);
+                }
+            });
+        }
+        for (auto &thr: threads) {
+            thr.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << test_load << " removals and inserts take " << std::setw(6) << elapsed.count() << "s, "
+                  << "throughput is " << static_cast<long>(static_cast<double>(2 * test_load) / elapsed.count())
+                  << std::endl;
+        std::cout << churn_list.GetNumReclaimed() << " nodes reclaimed, " << churn_list.GetNumRetired()
+                  << " pending, memory usage went from " << usage << " to "
+                  << churn_list.ApproximateMemoryUsage() << " bytes" << std::endl;
+    }
+
+    {
+        std::cout << "--------String Key Test--------" << std::endl;
+        // the probes point into one buffer, a std::string probe copies its
+        // key out of it, a std::string_view probe does not
+        kvstore::SkipList<std::string, int, kvstore::BytewiseComparator> string_list;
+        std::vector<char> buffer(test_load * 24);
+        for (long i = 0; i < test_load; i++) {
+            snprintf(&buffer[i * 24], 24, "user%019ld", i);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for (long i = 0; i < test_load; i++) {
+            string_list.SkipInsert(std::string(&buffer[i * 24], 23), static_cast<int>(i));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << test_load << " string keys inserted in " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        for (int run = 0; run < 4; run++) {
+            bool view = run % 2 == 1;
+            std::mt19937 gen(11);
+            long found = 0;
+            start = std::chrono::high_resolution_clock::now();
+            for (long i = 0; i < test_load; i++) {
+                const char *key = &buffer[(gen() % test_load) * 24];
+                if (view) {
+                    found += string_list.SkipSearch(std::string_view(key, 23))->GetKey().size() == 23;
+                } else {
+                    found += string_list.SkipSearch(std::string(key, 23))->GetKey().size() == 23;
+                }
+            }
+            end = std::chrono::high_resolution_clock::now();
+            assert(found == test_load);
+            elapsed = end - start;
+            std::cout << test_load << " lookups by " << (view ? "std::string_view" : "std::string") << " take "
+                      << std::setw(6) << elapsed.count() << "s, throughput is "
+                      << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+        }
+    }
+
+    {
+        std::cout << "--------Batch Write Test--------" << std::endl;
+        kvstore::SkipList<int, int> batch_list(max_height);
+        kvstore::WriteBatch<int, int> batch;
+        for (long i = 0; i < test_load; i++) {
+            batch.Put(i, i);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        batch_list.Write(batch);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << "Batch of " << batch.Count() << " sorted puts takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Throughput is " << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+    }
+
+    {
+        std::cout << "--------Bulk Build Test--------" << std::endl;
+        std::vector<std::pair<int, int>> sorted;
+        sorted.reserve(test_load);
+        for (long i = 0; i < test_load; i++) {
+            sorted.emplace_back(i, i);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        auto built_list = kvstore::SkipList<int, int>::BuildFromSorted(sorted.begin(), sorted.end(), max_height);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << "Bulk build of " << built_list->GetSize() << " sorted keys takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Build rate is " << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+    }
+
+    {
+        std::cout << "--------Durable Write & Recovery Test--------" << std::endl;
+        std::string dbname = "stress_test_db";
+        kvstore::DestroyDB(dbname);
+        std::unique_ptr<kvstore::DB<int, int>> db;
+        kvstore::Options options;
+        options.max_height = max_height;
+        options.filter_policy = kvstore::NewBloomFilterPolicy(10);
+        kvstore::Status s = kvstore::DB<int, int>::Open(options, dbname, &db);
+        assert(s.ok() && "cannot open the stress test DB");
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector <std::thread> threads;
+        for (long i = 0; i < num_thread; i++) {
+            threads.emplace_back(durableInsertTest, db.get(), i, num_thread, test_load);
+        }
+        for (auto &thr: threads) {
+            thr.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << "Durable insertion takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Throughput is " << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+        db.reset();
+
+        uint64_t log_bytes = 0;
+        std::vector<std::string> filenames;
+        kvstore::GetChildren(dbname, &filenames);
+        for (auto &filename : filenames) {
+            uint64_t size = 0;
+            kvstore::GetFileSize(dbname + "/" + filename, &size);
+            log_bytes += size;
+        }
+        start = std::chrono::high_resolution_clock::now();
+        s = kvstore::DB<int, int>::Open(options, dbname, &db);
+        end = std::chrono::high_resolution_clock::now();
+        assert(s.ok() && db->GetSize() == static_cast<std::size_t>(test_load) && "recovery should restore every key");
+        elapsed = end - start;
+        std::cout << "Recovery of " << log_bytes << " log bytes takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Replay rate is " << static_cast<long>(static_cast<double>(log_bytes) / elapsed.count() / 1048576)
+                  << " MB/s" << std::endl;
+        db.reset();
+
+        // the recovery above flushed the logs into a table
+        start = std::chrono::high_resolution_clock::now();
+        s = kvstore::DB<int, int>::Open(options, dbname, &db);
+        end = std::chrono::high_resolution_clock::now();
+        assert(s.ok() && db->GetSize() == static_cast<std::size_t>(test_load) && "restart should restore every key");
+        elapsed = end - start;
+        std::cout << "Restart from the tables takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+
+        // every key is in a table now, the missing ones are answered by the filters
+        int value;
+        long found = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (long i = 0; i < test_load; i++) {
+            found += db->Get(static_cast<int>(test_load + i), &value).ok();
+        }
+        end = std::chrono::high_resolution_clock::now();
+        elapsed = end - start;
+        assert(found == 0 && "missing keys should not be found");
+        std::cout << test_load << " lookups of missing keys take " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Throughput is " << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+        db.reset();
+
+        // lookups of present keys, reading every block from the file, then from a warm block cache
+        for (std::size_t capacity : {std::size_t(0), std::size_t(64) << 20}) {
+            options.block_cache = kvstore::NewLRUCache(capacity);
+            s = kvstore::DB<int, int>::Open(options, dbname, &db);
+            assert(s.ok() && "cannot reopen the stress test DB");
+            std::mt19937 rng(42);
+            if (capacity > 0) {
+                for (long i = 0; i < test_load; i++) {
+                    db->Get(static_cast<int>(i), &value);
+                }
+            }
+            uint64_t hits = options.block_cache->GetHits();
+            uint64_t misses = options.block_cache->GetMisses();
+            start = std::chrono::high_resolution_clock::now();
+            for (long i = 0; i < test_load; i++) {
+                found += db->Get(static_cast<int>(rng() % test_load), &value).ok();
+            }
+            end = std::chrono::high_resolution_clock::now();
+            elapsed = end - start;
+            hits = options.block_cache->GetHits() - hits;
+            misses = options.block_cache->GetMisses() - misses;
+            std::cout << test_load << " random lookups with " << (capacity == 0 ? "no" : "a warm") << " block cache take "
+                      << std::setw(6) << elapsed.count() << "s, hit rate "
+                      << (hits + misses == 0 ? 0 : 100 * hits / (hits + misses)) << "%" << std::endl;
+            std::cout << "Throughput is " << static_cast<long>(static_cast<double>(test_load) / elapsed.count()) << std::endl;
+            db.reset();
+        }
+        assert(found == 2 * test_load && "present keys should be found");
+        kvstore::DestroyDB(dbname);
+    }
+
+    {
+        std::cout << "--------Compaction Test--------" << std::endl;
+        kvstore::Options options;
+        options.max_height = max_height;
+        options.write_buffer_size = 256 * 1024;
+        options.max_file_size = 256 * 1024;
+        options.max_bytes_for_level_base = 1024 * 1024;
+        for (uint64_t rate : {0ull, 8ull * 1024 * 1024}) {
+            options.compaction_bytes_per_second = rate;
+            double p50, p99;
+            double elapsed = compactionLatencyTest("stress_test_compaction_db", options, test_load, &p50, &p99);
+            std::cout << "Compaction limit " << (rate == 0 ? std::string("none") : std::to_string(rate >> 20) + "MB/s")
+                      << ": overwrites and compactions take " << std::setw(6) << elapsed << "s" << std::endl;
+            std::cout << "Lookups meanwhile: p50 " << p50 << "us, p99 " << p99 << "us" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "--------Scan Test--------" << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        long sum = 0;
+        auto count = test_list.Scan(0, test_load, [&sum](int, int value) {
+            sum += value;
+            return true;
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        std::cout << "Scan of " << count << " keys takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Throughput is " << static_cast<long>(static_cast<double>(count) / elapsed.count()) << std::endl;
+    }
+
+    {
+        std::cout << "--------Snapshot Test--------" << std::endl;
+        std::string fname = "stress_test.snap";
+        auto start = std::chrono::high_resolution_clock::now();
+        kvstore::Status s = test_list.SaveSnapshot(fname);
+        auto end = std::chrono::high_resolution_clock::now();
+        assert(s.ok() && "cannot save the snapshot");
+        std::chrono::duration<double> elapsed = end - start;
+        uint64_t file_size = 0;
+        kvstore::GetFileSize(fname, &file_size);
+        std::cout << "Saving " << test_list.GetSize() << " keys into " << file_size << " bytes takes "
+                  << std::setw(6) << elapsed.count() << "s" << std::endl;
+
+        std::unique_ptr<kvstore::SkipList<int, int>> loaded;
+        start = std::chrono::high_resolution_clock::now();
+        s = kvstore::SkipList<int, int>::LoadSnapshot(fname, &loaded, max_height);
+        end = std::chrono::high_resolution_clock::now();
+        assert(s.ok() && loaded->GetSize() == test_list.GetSize() && "cannot load the snapshot");
+        elapsed = end - start;
+        std::cout << "Loading it back takes " << std::setw(6) << elapsed.count() << "s" << std::endl;
+        std::cout << "Load rate is " << static_cast<long>(static_cast<double>(loaded->GetSize()) / elapsed.count())
+                  << std::endl;
+
+        std::unique_ptr<kvstore::snapshot::Reader<int, int>> reader;
+        start = std::chrono::high_resolution_clock::now();
+        s = kvstore::snapshot::Reader<int, int>::Open(fname, false, &reader);
+        assert(s.ok() && "cannot open the snapshot");
+        reader->AdviseRandom();
+        std::mt19937 gen(1);
+        std::uniform_int_distribution<int> dist(0, test_load - 1);
+        long found = 0;
+        for (long i = 0; i < test_load; i++) {
+            int value;
+            found += reader->Get(dist(gen), &value).ok();
+        }
+        end = std::chrono::high_resolution_clock::now();
+        elapsed = end - start;
+        std::cout << test_load << " direct reads from the mapped file take " << std::setw(6) << elapsed.count()
+                  << "s, " << found << " found" << std::endl;
+        std::cout << "Throughput is " << static_cast<long>(static_cast<double>(test_load) / elapsed.count())
+                  << std::endl;
+        kvstore::RemoveFile(fname);
     }
 
     return 0;
@@ -0,0 +1,507 @@
+#include "../src/filter_policy.h"
+#include "../src/memtable.h"
+#include "../src/merger.h"
+#include "../src/table.h"
+#include "../src/table_builder.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace kvstore {
+
+using StringBlock = Block<std::string, std::string>;
+using StringTable = Table<std::string, std::string>;
+using StringTableBuilder = TableBuilder<std::string, std::string>;
+using IntTable = Table<int, int>;
+using IntTableBuilder = TableBuilder<int, int>;
+using IntIterator = Iterator<int, int>;
+using IntMemTable = MemTable<int, int>;
+
+/**
+ * @brief a scratch file name for a test, removed if left by a previous run
+ * @param name the test name
+ * @return the file name
+ */
+static std::string TestFileName(const std::string &name) {
+  std::string fname = testing::TempDir() + "kvstore_table_test_" + name;
+  remove(fname.c_str());
+  return fname;
+}
+
+/**
+ * @brief write a table file holding some key-value pairs
+ * @param fname the file name
+ * @param options the block size and restart interval to use
+ * @param entries the key-value pairs
+ * @param sequence the sequence number of the table
+ */
+template <typename K, typename T>
+static void BuildTable(const std::string &fname, const Options &options,
+                       const std::map<K, T> &entries, uint64_t sequence) {
+  std::unique_ptr<WritableFile> file;
+  ASSERT_TRUE(WritableFile::Open(fname, true, &file).ok());
+  TableBuilder<K, T> builder(options, file.get());
+  for (auto &entry : entries) {
+    ASSERT_TRUE(builder.Add(entry.first, entry.second).ok());
+  }
+  ASSERT_TRUE(builder.Finish(sequence).ok());
+  EXPECT_EQ(builder.GetNumEntries(), entries.size());
+  ASSERT_TRUE(file->Close().ok());
+}
+
+TEST(TableTest, BlockTest) {
+  // test if a block finds its keys through the restart points
+  BlockBuilder builder(4);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%04d", i * 2);
+    keys.push_back(buf);
+  }
+  std::string key, value;
+  for (auto &k : keys) {
+    key.clear();
+    value.clear();
+    Coder<std::string>::Encode(k, &key);
+    Coder<std::string>::Encode("v" + k, &value);
+    builder.Add(key, value);
+  }
+  StringBlock block(std::string(builder.Finish()));
+
+  StringBlock::Iterator iter(&block);
+  std::size_t i = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next(), i++) {
+    ASSERT_LT(i, keys.size());
+    EXPECT_EQ(iter.GetKey(), keys[i]);
+    std::string v;
+    ASSERT_TRUE(iter.GetValue(&v));
+    EXPECT_EQ(v, "v" + keys[i]);
+  }
+  EXPECT_EQ(i, keys.size());
+  EXPECT_TRUE(iter.GetStatus().ok());
+
+  iter.Seek("key0100");
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), "key0100");
+  iter.Seek("key0101");
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), "key0102");
+  iter.Seek("a");
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), "key0000");
+  iter.Seek("key9999");
+  EXPECT_FALSE(iter.Valid());
+
+  // malformed contents are reported, not read
+  StringBlock bad(std::string("\xff\xff\xff\xff", 4));
+  StringBlock::Iterator bad_iter(&bad);
+  bad_iter.SeekToFirst();
+  EXPECT_FALSE(bad_iter.Valid());
+  EXPECT_TRUE(bad_iter.GetStatus().IsCorruption());
+}
+
+TEST(TableTest, GetAndIterateTest) {
+  // test if a table of many blocks serves lookups and a full walk
+  auto fname = TestFileName("get_and_iterate");
+  Options options;
+  options.block_size = 256;
+  std::map<std::string, std::string> entries;
+  for (int i = 0; i < 2000; i++) {
+    entries["key" + std::to_string(i * 3)] = std::string(i % 30, 'v');
+  }
+  BuildTable(fname, options, entries, 77);
+
+  std::unique_ptr<StringTable> table;
+  ASSERT_TRUE(StringTable::Open(Options(), fname, &table).ok());
+  EXPECT_EQ(table->GetSequence(), 77);
+  std::string value;
+  for (auto &entry : entries) {
+    ASSERT_TRUE(table->Get(entry.first, &value).ok());
+    EXPECT_EQ(value, entry.second);
+  }
+  EXPECT_TRUE(table->Get("key1", &value).IsNotFound());
+  EXPECT_TRUE(table->Get("a", &value).IsNotFound());
+  EXPECT_TRUE(table->Get("zzz", &value).IsNotFound());
+
+  std::map<std::string, std::string> actual;
+  auto iter = table->NewIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    actual[iter->GetKey()] = iter->GetValue();
+  }
+  EXPECT_TRUE(iter->GetStatus().ok());
+  EXPECT_EQ(actual, entries);
+
+  iter->Seek("key5");
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->GetKey(), entries.lower_bound("key5")->first);
+
+  remove(fname.c_str());
+}
+
+TEST(TableTest, ShortIndexKeyTest) {
+  // test if blocks indexed by short separators still find every key, and
+  // none of the keys between them
+  auto fname = TestFileName("short_index_key");
+  Options options;
+  options.block_size = 128;
+  std::map<std::string, std::string> entries;
+  for (int i = 0; i < 500; i++) {
+    entries[std::to_string(i * 7) + std::string(40, 'k')] = std::to_string(i);
+  }
+  BuildTable(fname, options, entries, 1);
+
+  std::unique_ptr<StringTable> table;
+  ASSERT_TRUE(StringTable::Open(Options(), fname, &table).ok());
+  EXPECT_EQ(table->GetLargestKey(), entries.rbegin()->first);
+  std::string value;
+  for (auto &entry : entries) {
+    ASSERT_TRUE(table->Get(entry.first, &value).ok());
+    EXPECT_EQ(value, entry.second);
+    // a separator like "13" or "2" is not a key
+    EXPECT_TRUE(table->Get(entry.first.substr(0, 2), &value).IsNotFound());
+    EXPECT_TRUE(table->Get(entry.first + "\x01", &value).IsNotFound());
+  }
+  auto iter = table->NewIterator();
+  for (auto &entry : entries) {
+    iter->Seek(entry.first.substr(0, entry.first.size() - 1));
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ(iter->GetKey(), entry.first);
+  }
+  std::size_t count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  EXPECT_EQ(count, entries.size());
+
+  remove(fname.c_str());
+}
+
+TEST(TableTest, EmptyTest) {
+  // test if a table without any entry is still a valid table
+  auto fname = TestFileName("empty");
+  BuildTable(fname, Options(), std::map<int, int>(), 0);
+  std::unique_ptr<IntTable> table;
+  ASSERT_TRUE(IntTable::Open(Options(), fname, &table).ok());
+  int value;
+  EXPECT_TRUE(table->Get(1, &value).IsNotFound());
+  auto iter = table->NewIterator();
+  iter->SeekToFirst();
+  EXPECT_FALSE(iter->Valid());
+  remove(fname.c_str());
+}
+
+TEST(TableTest, CorruptionTest) {
+  // test if a flipped byte is caught by the block checksum
+  auto fname = TestFileName("corruption");
+  Options options;
+  options.block_size = 256;
+  std::map<int, int> entries;
+  for (int i = 0; i < 1000; i++) {
+    entries[i] = i;
+  }
+  BuildTable(fname, options, entries, 1);
+  auto flip = [&fname](long offset) {
+    FILE *f = fopen(fname.c_str(), "r+b");
+    ASSERT_NE(f, nullptr);
+    fseek(f, offset, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ 0x55, f);
+    fclose(f);
+  };
+
+  // a data block in the middle, only the reads going through it fail
+  uint64_t size;
+  ASSERT_TRUE(GetFileSize(fname, &size).ok());
+  flip(static_cast<long>(size / 2));
+  std::unique_ptr<IntTable> table;
+  ASSERT_TRUE(IntTable::Open(Options(), fname, &table).ok());
+  int value;
+  EXPECT_TRUE(table->Get(0, &value).ok());
+  auto iter = table->NewIterator();
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  EXPECT_LT(count, 1000);
+  EXPECT_TRUE(iter->GetStatus().IsCorruption());
+  EXPECT_TRUE(table->Get(count, &value).IsCorruption());
+
+  // the first data block is read on open, to learn the smallest key
+  flip(10);
+  EXPECT_TRUE(IntTable::Open(Options(), fname, &table).IsCorruption());
+
+  // a truncated file loses its footer
+  ASSERT_EQ(truncate(fname.c_str(), size - 1), 0);
+  EXPECT_TRUE(IntTable::Open(Options(), fname, &table).IsCorruption());
+  remove(fname.c_str());
+}
+
+TEST(TableTest, FooterOverflowTest) {
+  // test if block handles whose sizes wrap around 64 bits, in a footer that
+  // has no checksum, are rejected as corruption instead of being allocated
+  auto fname = TestFileName("footer_overflow");
+  Options options;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  std::map<int, int> entries;
+  for (int i = 0; i < 100; i++) {
+    entries[i] = i;
+  }
+  BuildTable(fname, options, entries, 1);
+  uint64_t size;
+  ASSERT_TRUE(GetFileSize(fname, &size).ok());
+  // overwrite a fixed64 field of the footer, returning the old value
+  auto patch = [&fname, size](std::size_t field, uint64_t value) {
+    char buf[8];
+    FILE *f = fopen(fname.c_str(), "r+b");
+    EXPECT_NE(f, nullptr);
+    fseek(f, static_cast<long>(size - kTableFooterSize + field), SEEK_SET);
+    EXPECT_EQ(fread(buf, 1, 8, f), 8u);
+    uint64_t old = DecodeFixed64(buf);
+    EncodeFixed64(buf, value);
+    fseek(f, static_cast<long>(size - kTableFooterSize + field), SEEK_SET);
+    fwrite(buf, 1, 8, f);
+    fclose(f);
+    return old;
+  };
+  std::unique_ptr<IntTable> table;
+  ASSERT_TRUE(IntTable::Open(options, fname, &table).ok());
+
+  // the index block, then the filter block
+  for (std::size_t field : {24, 8}) {
+    uint64_t old = patch(field, UINT64_MAX - 2);
+    EXPECT_TRUE(IntTable::Open(options, fname, &table).IsCorruption());
+    patch(field, UINT64_MAX);
+    EXPECT_TRUE(IntTable::Open(options, fname, &table).IsCorruption());
+    patch(field, old);
+  }
+  // an offset wrapping with the size
+  uint64_t old = patch(16, UINT64_MAX - 8);
+  EXPECT_TRUE(IntTable::Open(options, fname, &table).IsCorruption());
+  patch(16, old);
+  ASSERT_TRUE(IntTable::Open(options, fname, &table).ok());
+  remove(fname.c_str());
+}
+
+TEST(TableTest, BloomFilterTest) {
+  // test if a Bloom filter has no false negative and few false positives
+  BloomFilterPolicy policy(10);
+  std::string empty;
+  policy.CreateFilter(nullptr, 0, &empty);
+  EXPECT_FALSE(policy.KeyMayMatch("hello", empty));
+  EXPECT_FALSE(policy.KeyMayMatch("", std::string()));
+
+  for (int n : {1, 10, 100, 1000, 10000}) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < n; i++) {
+      keys.push_back("key" + std::to_string(i));
+    }
+    std::string filter;
+    policy.CreateFilter(keys.data(), n, &filter);
+    // about bits_per_key bits per key, plus the probe count
+    EXPECT_LE(filter.size(), static_cast<std::size_t>(n * 10 / 8 + 40));
+    for (auto &key : keys) {
+      ASSERT_TRUE(policy.KeyMayMatch(key, filter));
+    }
+
+    std::vector<std::string> others;
+    for (int i = 0; i < 10000; i++) {
+      others.push_back("other" + std::to_string(i));
+    }
+    std::unique_ptr<bool[]> results(new bool[others.size()]);
+    policy.KeysMayMatch(others.data(), static_cast<int>(others.size()), filter,
+                        results.get());
+    int false_positives = 0;
+    for (std::size_t i = 0; i < others.size(); i++) {
+      // the batched probe agrees with the single one
+      ASSERT_EQ(results[i], policy.KeyMayMatch(others[i], filter));
+      false_positives += results[i];
+    }
+    EXPECT_LE(false_positives, 200) << n << " keys";
+  }
+}
+
+TEST(TableTest, TableFilterTest) {
+  // test if a table answers most absent keys from its filter
+  auto fname = TestFileName("table_filter");
+  Options options;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  std::map<int, int> entries;
+  for (int i = 0; i < 10000; i += 2) {
+    entries[i] = i;
+  }
+  BuildTable(fname, options, entries, 1);
+
+  std::unique_ptr<IntTable> table;
+  ASSERT_TRUE(IntTable::Open(options, fname, &table).ok());
+  int value;
+  for (auto &entry : entries) {
+    ASSERT_TRUE(table->KeyMayMatch(entry.first));
+    ASSERT_TRUE(table->Get(entry.first, &value).ok());
+    EXPECT_EQ(value, entry.second);
+  }
+  std::vector<int> absent;
+  for (int i = 1; i < 10000; i += 2) {
+    absent.push_back(i);
+  }
+  std::unique_ptr<bool[]> results(new bool[absent.size()]);
+  table->KeysMayMatch(absent, results.get());
+  int false_positives = 0;
+  for (std::size_t i = 0; i < absent.size(); i++) {
+    EXPECT_EQ(results[i], table->KeyMayMatch(absent[i]));
+    EXPECT_TRUE(table->Get(absent[i], &value).IsNotFound());
+    false_positives += results[i];
+  }
+  EXPECT_LE(false_positives, 100);
+
+  // without a filter policy, the filter block is just skipped
+  ASSERT_TRUE(IntTable::Open(Options(), fname, &table).ok());
+  EXPECT_TRUE(table->KeyMayMatch(1));
+  EXPECT_TRUE(table->Get(1, &value).IsNotFound());
+  ASSERT_TRUE(table->Get(2, &value).ok());
+  remove(fname.c_str());
+}
+
+TEST(TableTest, BlockCacheTest) {
+  // test if the data blocks read are served from the block cache afterwards,
+  // and if iterators keep their block pinned
+  auto fname = TestFileName("block_cache");
+  Options options;
+  options.block_size = 256;
+  std::map<int, int> entries;
+  for (int i = 0; i < 5000; i++) {
+    entries[i] = i * 3;
+  }
+  BuildTable(fname, options, entries, 1);
+
+  options.block_cache = NewLRUCache(1 << 20);
+  std::unique_ptr<IntTable> table;
+  ASSERT_TRUE(IntTable::Open(options, fname, &table).ok());
+  int value;
+  for (auto &entry : entries) {
+    ASSERT_TRUE(table->Get(entry.first, &value).ok());
+    EXPECT_EQ(value, entry.second);
+  }
+  uint64_t misses = options.block_cache->GetMisses();
+  EXPECT_GT(misses, 1u);
+  EXPECT_GT(options.block_cache->TotalCharge(), 0u);
+  for (auto &entry : entries) {
+    ASSERT_TRUE(table->Get(entry.first, &value).ok());
+    EXPECT_EQ(value, entry.second);
+  }
+  EXPECT_EQ(options.block_cache->GetMisses(), misses);
+  EXPECT_GE(options.block_cache->GetHits(), entries.size());
+
+  // a cache too small for a single block evicts every block once unpinned,
+  // the iterator still reads them all
+  options.block_cache = NewLRUCache(0);
+  ASSERT_TRUE(IntTable::Open(options, fname, &table).ok());
+  auto iter = table->NewIterator();
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    EXPECT_EQ(iter->GetValue(), iter->GetKey() * 3);
+    count++;
+  }
+  EXPECT_EQ(count, 5000);
+  EXPECT_EQ(options.block_cache->TotalCharge(), 0u);
+  remove(fname.c_str());
+}
+
+TEST(TableTest, MergingIteratorTest) {
+  // test if the newest child wins among duplicate keys
+  auto fname = TestFileName("merging");
+  std::map<int, int> older;
+  for (int i = 0; i < 100; i++) {
+    older[i] = 0;
+  }
+  BuildTable(fname, Options(), older, 100);
+  std::unique_ptr<IntTable> table;
+  ASSERT_TRUE(IntTable::Open(Options(), fname, &table).ok());
+
+  MemTable<int, int> mem;
+  WriteBatch<int, int> batch;
+  for (int i = 50; i < 150; i += 2) {
+    batch.Put(i, 1);
+  }
+  mem.Write(batch);
+
+  std::vector<std::unique_ptr<Iterator<int, TaggedValue<int>>>> children;
+  children.push_back(mem.NewIterator());
+  // adapt the table of plain ints to tagged values
+  class Adapter : public Iterator<int, TaggedValue<int>> {
+   public:
+    explicit Adapter(std::unique_ptr<IntIterator> &&iter)
+        : iter_(std::move(iter)) {}
+    bool Valid() const override { return iter_->Valid(); }
+    void SeekToFirst() override { iter_->SeekToFirst(); }
+    void Seek(const int &target) override { iter_->Seek(target); }
+    void Next() override { iter_->Next(); }
+    int GetKey() const override { return iter_->GetKey(); }
+    TaggedValue<int> GetValue() const override {
+      TaggedValue<int> tagged;
+      tagged.value = iter_->GetValue();
+      return tagged;
+    }
+    Status GetStatus() const override { return iter_->GetStatus(); }
+
+   private:
+    std::unique_ptr<IntIterator> iter_;
+  };
+  children.emplace_back(new Adapter(table->NewIterator()));
+  MergingIterator<int, TaggedValue<int>> iter(std::move(children));
+
+  int expected = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    EXPECT_EQ(iter.GetKey(), expected);
+    bool newer = expected >= 50 && expected % 2 == 0;
+    EXPECT_EQ(iter.GetValue().value, newer ? 1 : 0);
+    expected += expected >= 100 ? 2 : 1;
+  }
+  EXPECT_EQ(expected, 150);
+  iter.Seek(99);
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), 99);
+  iter.Next();
+  ASSERT_TRUE(iter.Valid());
+  EXPECT_EQ(iter.GetKey(), 100);
+  EXPECT_EQ(iter.GetValue().value, 1);
+  remove(fname.c_str());
+}
+
+TEST(TableTest, MemTableTombstoneTest) {
+  // test if a deletion stays in the MemTable as a tombstone
+  IntMemTable mem;
+  WriteBatch<int, int> batch;
+  batch.Put(1, 10);
+  batch.Put(2, 20);
+  batch.Delete(2);
+  batch.Delete(3);
+  mem.Write(batch);
+  EXPECT_EQ(mem.GetSize(), 4);  // the put of 2 stays as an older version
+  EXPECT_GT(mem.ApproximateMemoryUsage(), 0);
+
+  int value;
+  Status s;
+  ASSERT_TRUE(mem.Get(1, &value, &s));
+  EXPECT_TRUE(s.ok());
+  EXPECT_EQ(value, 10);
+  ASSERT_TRUE(mem.Get(2, &value, &s));
+  EXPECT_TRUE(s.IsNotFound());
+  ASSERT_TRUE(mem.Get(3, &value, &s));
+  EXPECT_TRUE(s.IsNotFound());
+  EXPECT_FALSE(mem.Get(4, &value, &s));
+
+  auto iter = mem.NewIterator();
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->GetValue().type, ValueType::kValue);
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->GetValue().type, ValueType::kDeletion);
+}
+
+}  // namespace kvstore
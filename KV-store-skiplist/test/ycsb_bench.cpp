@@ -0,0 +1,814 @@
+/**
+ * A YCSB-like benchmark of the SkipList and the DB
+ *
+ * The store is loaded with --records keys, then each workload runs
+ * --operations operations over --threads threads, with the keys drawn
+ * uniformly or from a zipfian distribution, with int or string keys:
+ *   a  update-heavy   50% reads, 50% updates
+ *   b  read-heavy     95% reads, 5% updates
+ *   c  read-only      100% reads
+ *   e  scan-heavy     95% scans of 1 to 100 keys, 5% inserts
+ * The latency of every operation is recorded into a Histogram (see
+ * histogram.h), in nanoseconds. The results are printed to stdout as one
+ * JSON document, a summary of each run goes to stderr.
+ *
+ * Usage:
+ *   ./ycsb_bench [--records=N] [--operations=N] [--threads=N]
+ *                [--value_size=N] [--values=fill|json]
+ *                [--workloads=a,b,c,e] [--distributions=uniform,zipfian]
+ *                [--keys=int,string] [--stores=skiplist,compressed,db]
+ *                [--db=DIR] [--histogram=0|1]
+ *
+ * The values are one byte repeated, or JSON-like records with --values=json,
+ * which compress about as well as real documents. The compressed store is a
+ * CompressedSkipList with the LZ codec, its runs also report the compression
+ * ratio of the values it holds.
+ */
+
+#include "../src/compressed_skiplist.h"
+#include "../src/db.h"
+#include "../src/histogram.h"
+#include "../src/skiplist.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief the command line flags
+ */
+struct Flags {
+  /** how many keys are loaded before the workloads run */
+  long records = 100000;
+  /** how many operations each workload runs, over all the threads */
+  long operations = 100000;
+  /** how many threads run the operations */
+  int threads = 1;
+  /** the size of the values */
+  int value_size = 100;
+  /** the kind of values, "fill" or "json" */
+  std::string values = "fill";
+  /** the workloads to run, comma separated */
+  std::string workloads = "a,b,c,e";
+  /** the key distributions, comma separated */
+  std::string distributions = "uniform,zipfian";
+  /** the key types, comma separated */
+  std::string keys = "int,string";
+  /** the stores, comma separated */
+  std::string stores = "skiplist,db";
+  /** the directory of the DB, destroyed before and after */
+  std::string db = "ycsb_bench_db";
+  /** if to print the latency histograms to stderr */
+  bool histogram = false;
+};
+
+/**
+ * @brief Workload is a mix of operations, the shares sum to 1
+ */
+struct Workload {
+  /** the YCSB name of the workload */
+  const char *name;
+  /** what it stresses */
+  const char *description;
+  /** the share of point reads */
+  double read;
+  /** the share of updates of existing keys */
+  double update;
+  /** the share of inserts of new keys */
+  double insert;
+  /** the share of range scans */
+  double scan;
+  /** the longest scan, scans are uniform between 1 and it */
+  int max_scan_length;
+};
+
+/** the workloads, from YCSB's core set */
+const Workload kWorkloads[] = {
+    {"a", "update-heavy", 0.5, 0.5, 0, 0, 0},
+    {"b", "read-heavy", 0.95, 0.05, 0, 0, 0},
+    {"c", "read-only", 1.0, 0, 0, 0, 0},
+    {"e", "scan-heavy", 0, 0, 0.05, 0.95, 100},
+};
+
+/** the kinds of operation, each gets its own Histogram */
+enum OpType { kRead, kUpdate, kInsert, kScan, kNumOpTypes };
+
+/** the names of the kinds of operation */
+const char *const kOpNames[kNumOpTypes] = {"read", "update", "insert", "scan"};
+
+/**
+ * @brief ZipfianGenerator draws ranks in [0, n) with P(i) proportional to
+ *        1 / (i + 1)^theta, Gray et al.'s method as used by YCSB. Rank 0 is
+ *        the hottest, the keys of the ranks are scattered by MakeKey
+ */
+class ZipfianGenerator {
+ public:
+  /**
+   * @brief precompute the constants of the distribution, O(n)
+   * @param n the number of items
+   * @param theta the skew, YCSB's default is 0.99
+   */
+  explicit ZipfianGenerator(uint64_t n, double theta = 0.99)
+      : n_(n), theta_(theta) {
+    for (uint64_t i = 1; i <= n; i++) {
+      zetan_ += 1.0 / pow(static_cast<double>(i), theta);
+    }
+    double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - pow(2.0 / static_cast<double>(n), 1.0 - theta)) /
+           (1.0 - zeta2 / zetan_);
+  }
+
+  /**
+   * @brief draw a rank
+   * @param u a uniform number in [0, 1)
+   * @return the rank, in [0, n)
+   */
+  uint64_t Next(double u) const {
+    double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + pow(0.5, theta_)) {
+      return 1;
+    }
+    auto rank = static_cast<uint64_t>(static_cast<double>(n_) *
+                                      pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(rank, n_ - 1);
+  }
+
+ private:
+  /** the number of items */
+  uint64_t n_;
+  /** the skew */
+  double theta_;
+  /** the sum of 1 / i^theta for i in [1, n] */
+  double zetan_ = 0;
+  /** 1 / (1 - theta) */
+  double alpha_;
+  /** the correction term of the method */
+  double eta_;
+};
+
+/**
+ * @brief the key of a record, scattered over the key space so that the
+ *        load order and the hot ranks are not the key order
+ * @param index the index of the record
+ * @return the key, a bijection of the index
+ */
+template <typename K>
+K MakeKey(uint64_t index);
+
+template <>
+int MakeKey<int>(uint64_t index) {
+  // an odd multiplier is a bijection modulo 2^32
+  return static_cast<int>(static_cast<uint32_t>(index) * 2654435761u);
+}
+
+template <>
+std::string MakeKey<std::string>(uint64_t index) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "user%020llu",
+           static_cast<unsigned long long>(index * 0x9e3779b97f4a7c15ull));
+  return buf;
+}
+
+/**
+ * @brief the value of a record
+ * @param index the index of the record
+ * @param flags the flags, for the size and kind of the values
+ * @param fill the byte repeated in a "fill" value
+ * @return the value, value_size bytes long
+ */
+std::string MakeValue(uint64_t index, const Flags &flags, char fill) {
+  if (flags.values != "json") {
+    return std::string(flags.value_size, fill);
+  }
+  static const char *kNames[] = {"alice", "bob", "carol", "dave", "erin"};
+  static const char *kStatus[] = {"active", "pending", "suspended"};
+  std::mt19937_64 gen(index * 31 + fill);
+  std::string value = "[";
+  while (value.size() < static_cast<std::size_t>(flags.value_size)) {
+    value += "{\"id\": " + std::to_string(gen() % 1000000) +
+             ", \"name\": \"" + kNames[gen() % 5] + "\", \"status\": \"" +
+             kStatus[gen() % 3] + "\", \"score\": " +
+             std::to_string(gen() % 10000) + "},";
+  }
+  value.resize(flags.value_size);
+  return value;
+}
+
+/**
+ * @brief a key larger than any MakeKey, the exclusive end of the scans
+ * @return the key
+ */
+template <typename K>
+K MaxKey();
+
+template <>
+int MaxKey<int>() {
+  return std::numeric_limits<int>::max();
+}
+
+template <>
+std::string MaxKey<std::string>() {
+  return "\xff";
+}
+
+/**
+ * @brief SkipListStore runs the operations on a SkipList
+ * @tparam K key type
+ */
+template <typename K>
+class SkipListStore {
+ public:
+  /**
+   * @brief the name of the store in the results
+   * @return the name
+   */
+  static const char *Name() { return "skiplist"; }
+
+  /**
+   * @brief look up a key and copy its value out
+   * @param key the key
+   * @return true if found, false otherwise
+   */
+  bool Read(const K &key) {
+    kvstore::EpochGuard guard;
+    auto node = list_.SkipSearch(key);
+    if (node->IsSentinel() || node->GetKey() != key) {
+      return false;
+    }
+    std::string value = node->GetValue();
+    return !value.empty();
+  }
+
+  /**
+   * @brief write a key, new or not
+   * @param key the key
+   * @param value the value
+   */
+  void Write(const K &key, const std::string &value) {
+    list_.SkipInsert(key, value);
+  }
+
+  /**
+   * @brief visit the keys from a key on
+   * @param key the first key
+   * @param length how many keys to visit at most
+   * @return how many keys were visited
+   */
+  std::size_t Scan(const K &key, int length) {
+    int count = 0;
+    return list_.Scan(key, MaxKey<K>(),
+                      [&count, length](const K &, const std::string &) {
+                        return ++count < length;
+                      });
+  }
+
+  /**
+   * @brief how many times smaller the values are stored than written
+   * @return 0, the values are not compressed
+   */
+  double CompressionRatio() const { return 0; }
+
+ private:
+  /** the SkipList */
+  kvstore::SkipList<K, std::string> list_;
+};
+
+/**
+ * @brief CompressedStore runs the operations on a CompressedSkipList with
+ *        the LZ codec and the default cache of decompressed values
+ * @tparam K key type
+ */
+template <typename K>
+class CompressedStore {
+ public:
+  /**
+   * @brief the name of the store in the results
+   * @return the name
+   */
+  static const char *Name() { return "compressed"; }
+
+  /**
+   * @brief look up a key and decompress its value
+   * @param key the key
+   * @return true if found, false otherwise
+   */
+  bool Read(const K &key) {
+    std::string value;
+    return list_.Get(key, &value);
+  }
+
+  /**
+   * @brief write a key, new or not
+   * @param key the key
+   * @param value the value
+   */
+  void Write(const K &key, const std::string &value) {
+    list_.SkipInsert(key, value);
+  }
+
+  /**
+   * @brief visit the keys from a key on
+   * @param key the first key
+   * @param length how many keys to visit at most
+   * @return how many keys were visited
+   */
+  std::size_t Scan(const K &key, int length) {
+    int count = 0;
+    return list_.Scan(key, MaxKey<K>(),
+                      [&count, length](const K &, const std::string &) {
+                        return ++count < length;
+                      });
+  }
+
+  /**
+   * @brief how many times smaller the values are stored than written
+   * @return the ratio
+   */
+  double CompressionRatio() const { return list_.GetCompressionRatio(); }
+
+ private:
+  /** the CompressedSkipList */
+  kvstore::CompressedSkipList<K> list_;
+};
+
+/**
+ * @brief DBStore runs the operations on a DB with the default options
+ * @tparam K key type
+ */
+template <typename K>
+class DBStore {
+ public:
+  /**
+   * @brief open a fresh DB
+   * @param dbname the DB directory, destroyed first
+   */
+  explicit DBStore(const std::string &dbname) : dbname_(dbname) {
+    kvstore::DestroyDB(dbname_);
+    kvstore::Options options;
+    options.create_if_missing = true;
+    kvstore::Status s = kvstore::DB<K, std::string>::Open(options, dbname_, &db_);
+    if (!s.ok()) {
+      std::cerr << "cannot open " << dbname_ << ": " << s.ToString() << std::endl;
+      exit(1);
+    }
+  }
+
+  /**
+   * @brief close and destroy the DB
+   */
+  ~DBStore() {
+    db_.reset();
+    kvstore::DestroyDB(dbname_);
+  }
+
+  /**
+   * @brief the name of the store in the results
+   * @return the name
+   */
+  static const char *Name() { return "db"; }
+
+  /**
+   * @brief look up a key and copy its value out
+   * @param key the key
+   * @return true if found, false otherwise
+   */
+  bool Read(const K &key) {
+    std::string value;
+    return db_->Get(key, &value).ok();
+  }
+
+  /**
+   * @brief write a key, new or not
+   * @param key the key
+   * @param value the value
+   */
+  void Write(const K &key, const std::string &value) {
+    db_->Put(kvstore::WriteOptions(), key, value);
+  }
+
+  /**
+   * @brief visit the keys from a key on
+   * @param key the first key
+   * @param length how many keys to visit at most
+   * @return how many keys were visited
+   */
+  std::size_t Scan(const K &key, int length) {
+    int count = 0;
+    return db_->Scan(key, MaxKey<K>(),
+                     [&count, length](const K &, const std::string &) {
+                       return ++count < length;
+                     });
+  }
+
+  /**
+   * @brief how many times smaller the values are stored than written
+   * @return 0, not measured for the tables
+   */
+  double CompressionRatio() const { return 0; }
+
+ private:
+  /** the DB directory */
+  std::string dbname_;
+  /** the DB */
+  std::unique_ptr<kvstore::DB<K, std::string>> db_;
+};
+
+/**
+ * @brief Result is the outcome of a run
+ */
+struct Result {
+  /** the store */
+  std::string store;
+  /** the key type */
+  std::string key;
+  /** the workload, or "load" */
+  std::string workload;
+  /** the key distribution */
+  std::string distribution;
+  /** the wall time of the run */
+  double elapsed_sec = 0;
+  /** how many operations ran */
+  long operations = 0;
+  /** the latency of each kind of operation, in nanoseconds */
+  kvstore::Histogram latency[kNumOpTypes];
+  /** the compression ratio of the values after the run, 0 if none */
+  double compression_ratio = 0;
+};
+
+/**
+ * @brief split a comma separated list
+ * @param list the list
+ * @return the items
+ */
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+/**
+ * @brief if a comma separated list holds an item
+ * @param list the list
+ * @param item the item
+ * @return true if present, false otherwise
+ */
+bool Contains(const std::string &list, const std::string &item) {
+  for (auto &entry : Split(list)) {
+    if (entry == item) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief the nanoseconds elapsed since a point in time
+ * @param start the point in time
+ * @return the nanoseconds
+ */
+double NanosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/**
+ * @brief insert the records, in the order of their index, on one thread
+ * @param store the store, empty
+ * @param flags the flags
+ * @param result where to store the latencies of the inserts
+ */
+template <typename K, typename Store>
+void Load(Store *store, const Flags &flags, Result *result) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < flags.records; i++) {
+    K key = MakeKey<K>(i);
+    std::string value = MakeValue(i, flags, 'v');
+    auto op_start = std::chrono::steady_clock::now();
+    store->Write(key, value);
+    result->latency[kInsert].Add(NanosSince(op_start));
+  }
+  result->elapsed_sec = NanosSince(start) / 1e9;
+  result->operations = flags.records;
+}
+
+/**
+ * @brief run a workload over the loaded records
+ * @param store the store, loaded
+ * @param workload the mix of operations
+ * @param zipfian the zipfian generator, nullptr for uniform keys
+ * @param flags the flags
+ * @param next_insert the index of the next record to insert, shared by the
+ *        workloads
+ * @param result where to store the latencies
+ */
+template <typename K, typename Store>
+void Run(Store *store, const Workload &workload,
+         const ZipfianGenerator *zipfian, const Flags &flags,
+         std::atomic<uint64_t> *next_insert, Result *result) {
+  std::vector<Result> per_thread(flags.threads);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < flags.threads; t++) {
+    threads.emplace_back([&, t]() {
+      std::mt19937_64 gen(t * 7919 + 17);
+      std::uniform_real_distribution<double> unit(0.0, 1.0);
+      std::uniform_int_distribution<uint64_t> uniform(0, flags.records - 1);
+      std::uniform_int_distribution<int> scan_length(
+          1, std::max(workload.max_scan_length, 1));
+      std::string value;
+      Result &local = per_thread[t];
+      long operations = flags.operations / flags.threads +
+                        (t < flags.operations % flags.threads ? 1 : 0);
+      for (long i = 0; i < operations; i++) {
+        double dice = unit(gen);
+        uint64_t index =
+            zipfian != nullptr ? zipfian->Next(unit(gen)) : uniform(gen);
+        OpType op;
+        if ((dice -= workload.read) < 0) {
+          op = kRead;
+        } else if ((dice -= workload.update) < 0) {
+          op = kUpdate;
+        } else if ((dice -= workload.insert) < 0) {
+          op = kInsert;
+          index = next_insert->fetch_add(1, std::memory_order_relaxed);
+        } else {
+          op = kScan;
+        }
+        K key = MakeKey<K>(index);
+        if (op == kUpdate || op == kInsert) {
+          value = MakeValue(index + i, flags, 'u');
+        }
+        auto op_start = std::chrono::steady_clock::now();
+        switch (op) {
+          case kRead:
+            store->Read(key);
+            break;
+          case kUpdate:
+          case kInsert:
+            store->Write(key, value);
+            break;
+          default:
+            store->Scan(key, scan_length(gen));
+            break;
+        }
+        local.latency[op].Add(NanosSince(op_start));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  result->elapsed_sec = NanosSince(start) / 1e9;
+  result->operations = flags.operations;
+  for (auto &local : per_thread) {
+    for (int op = 0; op < kNumOpTypes; op++) {
+      result->latency[op].Merge(local.latency[op]);
+    }
+  }
+}
+
+/**
+ * @brief print a one line summary of a run to stderr, and its histograms
+ *        if asked to
+ * @param result the run
+ * @param flags the flags
+ */
+void Report(const Result &result, const Flags &flags) {
+  fprintf(stderr, "%-10s %-6s %-4s %-7s : %10.0f ops/sec", result.store.c_str(),
+          result.key.c_str(), result.workload.c_str(),
+          result.distribution.c_str(),
+          result.operations / std::max(result.elapsed_sec, 1e-9));
+  for (int op = 0; op < kNumOpTypes; op++) {
+    const kvstore::Histogram &latency = result.latency[op];
+    if (latency.Count() > 0) {
+      fprintf(stderr, ", %s p50 %.0fns p99 %.0fns", kOpNames[op],
+              latency.Median(), latency.Percentile(99.0));
+    }
+  }
+  if (result.compression_ratio > 0) {
+    fprintf(stderr, ", ratio %.2f", result.compression_ratio);
+  }
+  fprintf(stderr, "\n");
+  if (flags.histogram) {
+    for (int op = 0; op < kNumOpTypes; op++) {
+      if (result.latency[op].Count() > 0) {
+        fprintf(stderr, "%s latency (ns):\n%s\n", kOpNames[op],
+                result.latency[op].ToString().c_str());
+      }
+    }
+  }
+}
+
+/**
+ * @brief append a run to the JSON array of results
+ * @param result the run
+ * @param json the JSON text
+ */
+void AppendJson(const Result &result, std::string *json) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "    {\"store\": \"%s\", \"key\": \"%s\", \"workload\": \"%s\", "
+           "\"distribution\": \"%s\", \"operations\": %ld, "
+           "\"elapsed_sec\": %.6f, \"ops_per_sec\": %.1f, \"latency_ns\": {",
+           result.store.c_str(), result.key.c_str(), result.workload.c_str(),
+           result.distribution.c_str(), result.operations, result.elapsed_sec,
+           result.operations / std::max(result.elapsed_sec, 1e-9));
+  json->append(buf);
+  bool first = true;
+  for (int op = 0; op < kNumOpTypes; op++) {
+    const kvstore::Histogram &latency = result.latency[op];
+    if (latency.Count() == 0) {
+      continue;
+    }
+    snprintf(buf, sizeof(buf),
+             "%s\"%s\": {\"count\": %.0f, \"avg\": %.1f, \"p50\": %.1f, "
+             "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+             first ? "" : ", ", kOpNames[op], latency.Count(),
+             latency.Average(), latency.Median(), latency.Percentile(99.0),
+             latency.Percentile(99.9), latency.Max());
+    json->append(buf);
+    first = false;
+  }
+  json->append("}");
+  if (result.compression_ratio > 0) {
+    snprintf(buf, sizeof(buf), ", \"compression_ratio\": %.3f",
+             result.compression_ratio);
+    json->append(buf);
+  }
+  json->append("}");
+}
+
+/**
+ * @brief load a fresh store, then run every workload under every
+ *        distribution on it
+ * @param key_name the name of the key type
+ * @param flags the flags
+ * @param results where to append the runs
+ * @param make_store creates the fresh store
+ */
+template <typename K, typename Store, typename MakeStore>
+void RunAll(const std::string &key_name, const Flags &flags,
+            std::vector<Result> *results, MakeStore make_store) {
+  std::unique_ptr<Store> store = make_store();
+  Result load;
+  load.store = Store::Name();
+  load.key = key_name;
+  load.workload = "load";
+  load.distribution = "none";
+  Load<K>(store.get(), flags, &load);
+  load.compression_ratio = store->CompressionRatio();
+  Report(load, flags);
+  results->push_back(std::move(load));
+
+  std::unique_ptr<ZipfianGenerator> zipfian;
+  std::atomic<uint64_t> next_insert{static_cast<uint64_t>(flags.records)};
+  for (auto &distribution : Split(flags.distributions)) {
+    if (distribution == "zipfian" && zipfian == nullptr) {
+      zipfian.reset(new ZipfianGenerator(flags.records));
+    } else if (distribution != "zipfian" && distribution != "uniform") {
+      std::cerr << "unknown distribution " << distribution << std::endl;
+      exit(1);
+    }
+    for (auto &workload : kWorkloads) {
+      if (!Contains(flags.workloads, workload.name)) {
+        continue;
+      }
+      Result result;
+      result.store = Store::Name();
+      result.key = key_name;
+      result.workload = workload.name;
+      result.distribution = distribution;
+      Run<K>(store.get(), workload,
+             distribution == "zipfian" ? zipfian.get() : nullptr, flags,
+             &next_insert, &result);
+      result.compression_ratio = store->CompressionRatio();
+      Report(result, flags);
+      results->push_back(std::move(result));
+    }
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  Flags flags;
+  for (int i = 1; i < argc; i++) {
+    long n;
+    char junk;
+    if (sscanf(argv[i], "--records=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.records = n;
+    } else if (sscanf(argv[i], "--operations=%ld%c", &n, &junk) == 1 &&
+               n >= 0) {
+      flags.operations = n;
+    } else if (sscanf(argv[i], "--threads=%ld%c", &n, &junk) == 1 && n > 0) {
+      flags.threads = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--value_size=%ld%c", &n, &junk) == 1 &&
+               n > 0) {
+      flags.value_size = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--histogram=%ld%c", &n, &junk) == 1) {
+      flags.histogram = n != 0;
+    } else if (strcmp(argv[i], "--values=fill") == 0 ||
+               strcmp(argv[i], "--values=json") == 0) {
+      flags.values = argv[i] + 9;
+    } else if (strncmp(argv[i], "--workloads=", 12) == 0) {
+      flags.workloads = argv[i] + 12;
+    } else if (strncmp(argv[i], "--distributions=", 16) == 0) {
+      flags.distributions = argv[i] + 16;
+    } else if (strncmp(argv[i], "--keys=", 7) == 0) {
+      flags.keys = argv[i] + 7;
+    } else if (strncmp(argv[i], "--stores=", 9) == 0) {
+      flags.stores = argv[i] + 9;
+    } else if (strncmp(argv[i], "--db=", 5) == 0) {
+      flags.db = argv[i] + 5;
+    } else {
+      std::cerr << "invalid flag " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Result> results;
+  if (Contains(flags.stores, "skiplist")) {
+    if (Contains(flags.keys, "int")) {
+      RunAll<int, SkipListStore<int>>("int", flags, &results, []() {
+        return std::unique_ptr<SkipListStore<int>>(new SkipListStore<int>());
+      });
+    }
+    if (Contains(flags.keys, "string")) {
+      RunAll<std::string, SkipListStore<std::string>>(
+          "string", flags, &results, []() {
+            return std::unique_ptr<SkipListStore<std::string>>(
+                new SkipListStore<std::string>());
+          });
+    }
+  }
+  if (Contains(flags.stores, "compressed")) {
+    if (Contains(flags.keys, "int")) {
+      RunAll<int, CompressedStore<int>>("int", flags, &results, []() {
+        return std::unique_ptr<CompressedStore<int>>(
+            new CompressedStore<int>());
+      });
+    }
+    if (Contains(flags.keys, "string")) {
+      RunAll<std::string, CompressedStore<std::string>>(
+          "string", flags, &results, []() {
+            return std::unique_ptr<CompressedStore<std::string>>(
+                new CompressedStore<std::string>());
+          });
+    }
+  }
+  if (Contains(flags.stores, "db")) {
+    if (Contains(flags.keys, "int")) {
+      RunAll<int, DBStore<int>>("int", flags, &results, [&flags]() {
+        return std::unique_ptr<DBStore<int>>(new DBStore<int>(flags.db));
+      });
+    }
+    if (Contains(flags.keys, "string")) {
+      RunAll<std::string, DBStore<std::string>>(
+          "string", flags, &results, [&flags]() {
+            return std::unique_ptr<DBStore<std::string>>(
+                new DBStore<std::string>(flags.db));
+          });
+    }
+  }
+
+  std::string json;
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\n  \"benchmark\": \"ycsb\",\n  \"records\": %ld,\n"
+           "  \"operations\": %ld,\n  \"threads\": %d,\n"
+           "  \"value_size\": %d,\n  \"values\": \"%s\",\n"
+           "  \"results\": [\n",
+           flags.records, flags.operations, flags.threads, flags.value_size,
+           flags.values.c_str());
+  json.append(buf);
+  for (std::size_t i = 0; i < results.size(); i++) {
+    AppendJson(results[i], &json);
+    json.append(i + 1 < results.size() ? ",\n" : "\n");
+  }
+  json.append("  ]\n}\n");
+  std::cout << json;
+  return 0;
+}